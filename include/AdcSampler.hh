@@ -0,0 +1,78 @@
+#ifndef __ADCSAMPLER_H__
+#define __ADCSAMPLER_H__
+
+#include <Arduino.h>
+
+#include <atomic>
+#include <functional>
+
+#include "LatencyHistogram.hh"
+#include "SpscRing.hh"
+
+#ifdef ESP32
+#include <esp_timer.h>
+#else
+#include <HostClock.h>
+#endif
+
+// Takes ADC samples at a fixed rate, off a timer rather than whenever the
+// consumer gets around to it, and queues them with their timestamps. The
+// consumer takes them in batches. On the ESP32 the timer is an esp_timer,
+// whose callbacks run in a high priority task (analogRead isn't safe from an
+// ISR); on the host it's a thread (HostThread, so it follows a simulation's
+// virtual clock), and read() can be any synthetic source.
+class AdcSampler {
+ public:
+  typedef std::function<uint16_t()> Source;
+  // About 2.5s of samples at 100Hz.
+  static const size_t QueueBytes = 2048;
+
+  // Consumer side counters.
+  struct Stats {
+    unsigned long samples = 0;  // Handed to the consumer.
+    unsigned long dropped = 0;  // Queue was full.
+    unsigned long missed = 0;   // Timer ticks that never produced a sample.
+    unsigned long batches = 0;
+    size_t maxBatch = 0;
+    uint32_t maxJitter = 0;  // us, worst interval error against the period.
+  };
+
+  AdcSampler(Source read, uint32_t rate);
+  ~AdcSampler() { end(); }
+
+  bool begin();
+  void end();
+
+  uint32_t getRate() const { return rate; }
+  uint32_t getPeriod() const { return period; }
+
+  // Consumer side: moves up to max of the oldest samples to out and returns
+  // how many.
+  size_t takeBatch(uint16_t* out, size_t max);
+  Stats getStats() const;
+  // Distribution of interval errors, in us.
+  const LatencyHistogram& getJitter() const { return jitter; }
+
+  // Timer side; public so tests can drive it.
+  void sample();
+
+ private:
+  Source read;
+  const uint32_t rate;
+  const uint32_t period;  // us
+  SpscRing<QueueBytes> queue;
+  std::atomic<bool> running{false};
+#ifdef ESP32
+  esp_timer_handle_t timer = nullptr;
+#else
+  HostThread thread;
+#endif
+
+  // Consumer side.
+  Stats stats;
+  LatencyHistogram jitter;
+  bool started = false;
+  uint32_t lastTime = 0;
+};
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef __BLECAPTURE_H__
+#define __BLECAPTURE_H__
+
+#include <Arduino.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <functional>
+
+// Flight recorder for raw kettle notifications: every notification goes into
+// a ring, in PSRAM when the board has it, overwriting the oldest once full,
+// so the last stretch of traffic can be dumped and replayed on the host (see
+// the replay tool). Records are a varint of ms since the one before, a
+// varint of length << 2 | channel, then the bytes: a 20-byte notification
+// takes 22 or 23 bytes.
+//
+// A dump starts with Magic, Version, three reserved bytes and the 32-bit
+// little-endian time the first record's delta counts from, followed by the
+// records, oldest first.
+//
+// record() is for one task, e.g. the BLE task's notify callbacks. It never
+// waits: while a dump is being taken, notifications are counted as dropped
+// instead. A printout to the console goes on for many loop() passes, so
+// recording carries on during it and only drops what would overwrite records
+// not printed yet.
+class BleCapture {
+ public:
+  static const uint8_t Magic[4];
+  static const uint8_t Version = 1;
+  static const size_t HeaderBytes = 12;
+  static const int Channels = 4;  // e.g. kettle slots.
+  static const size_t MaxRecord = 512;
+
+  struct Stats {
+    uint32_t recorded = 0;
+    uint32_t overwritten = 0;  // Oldest records given up for new ones.
+    uint32_t dropped = 0;      // During a dump, or too long.
+  };
+
+  struct Record {
+    unsigned long time;  // ms
+    uint8_t channel;
+    const uint8_t* data;
+    size_t length;
+  };
+
+  ~BleCapture();
+
+  // Allocates the ring; false if there's no room for it.
+  bool begin(size_t bytes);
+  bool active() const { return buffer != nullptr; }
+
+  // Producer side.
+  void record(uint8_t channel, const uint8_t* data, size_t length,
+              unsigned long timeNow);
+
+  // Consumer side: hands the whole dump to sink in a few pieces, with
+  // recording paused meanwhile. Returns the bytes dumped.
+  size_t dump(std::function<void(const uint8_t*, size_t)> sink);
+  // The dump as hex lines between markers, for a serial log, a slice at a
+  // time: startPrint() takes the records held now and prints the first
+  // marker, then each printSome() prints as many lines as out takes without
+  // waiting, up to maxLines. False once it printed the end marker.
+  void startPrint(HardwareSerial& out);
+  bool printSome(HardwareSerial& out, int maxLines = 8);
+  bool printing() const { return printActive.load(std::memory_order_relaxed); }
+
+  // Bytes of records held.
+  size_t size() const { return used.load(std::memory_order_relaxed); }
+  Stats getStats() const;
+
+  // Reads a dump, calling onRecord(const Record&) for each record. False if
+  // it isn't one, or is cut short.
+  template <typename Sink>
+  static bool parse(const uint8_t* data, size_t length, Sink&& onRecord);
+
+ private:
+  uint8_t* buffer = nullptr;
+  size_t capacity = 0;
+  size_t head = 0;  // Where the next record goes.
+  size_t tail = 0;  // The oldest record.
+  std::atomic<size_t> used{0};
+  unsigned long base = 0;      // What the oldest record's delta counts from.
+  unsigned long timeLast = 0;  // Of the newest record.
+  std::atomic<bool> enabled{true};
+  std::atomic<bool> writing{false};
+  std::atomic<uint32_t> recorded{0};
+  std::atomic<uint32_t> overwritten{0};
+  std::atomic<uint32_t> dropped{0};
+
+  // The printout in progress. The printer's cursor runs over the dump, header
+  // first; record() may free only the printed bytes of the records held at
+  // its start.
+  std::atomic<bool> printActive{false};
+  std::atomic<size_t> printed{0};  // Record bytes out so far.
+  uint8_t printHeader[HeaderBytes];
+  size_t printStart = 0;           // tail at the start.
+  size_t printBytes = 0;           // Of the dump, header included.
+  size_t printPos = 0;
+  size_t printFreed = 0;           // record() only: bytes dropped since.
+
+  uint8_t at(size_t offset) const { return buffer[offset % capacity]; }
+  void header(uint8_t* out) const;
+  // Bytes of the oldest record, header included.
+  size_t oldestSize() const;
+  size_t readVarint(size_t offset, uint32_t& value) const;
+  // Reads a varint at data[i], advancing i; false if it runs past the end.
+  static bool readVarint(const uint8_t* data, size_t length, size_t& i,
+                         uint32_t& value);
+  void dropOldest();
+};
+
+template <typename Sink>
+bool BleCapture::parse(const uint8_t* data, size_t length, Sink&& onRecord) {
+  if (length < HeaderBytes || memcmp(data, Magic, sizeof(Magic)) != 0 ||
+      data[4] != Version)
+    return false;
+  unsigned long time = data[8] | data[9] << 8 | data[10] << 16 |
+                       (unsigned long)data[11] << 24;
+  size_t i = HeaderBytes;
+  while (i < length) {
+    uint32_t delta, tag;
+    if (!readVarint(data, length, i, delta) ||
+        !readVarint(data, length, i, tag) || length - i < (tag >> 2))
+      return false;
+    time += delta;
+    Record r = {time, (uint8_t)(tag & 3), data + i, tag >> 2};
+    onRecord(r);
+    i += r.length;
+  }
+  return true;
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef __BOUNDEDQUEUE_H__
+#define __BOUNDEDQUEUE_H__
+
+#include <stddef.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <utility>
+
+// Fixed-size FIFO for handing messages between tasks. push() never blocks:
+// when the queue is full the item is refused and counted, so a stuck consumer
+// can't stall the producer. pop() doesn't block either; popWait() does, for
+// consumers that have nothing else to do.
+template <typename T, size_t Capacity>
+class BoundedQueue {
+ public:
+  bool push(T item) {
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      if (count == Capacity) {
+        dropped++;
+        return false;
+      }
+      items[(head + count) % Capacity] = std::move(item);
+      count++;
+      if (count > highWater) highWater = count;
+    }
+    ready.notify_one();
+    return true;
+  }
+
+  bool pop(T& item) {
+    std::lock_guard<std::mutex> lock(mtx);
+    return take(item);
+  }
+
+  bool popWait(T& item, unsigned long timeoutMs) {
+    std::unique_lock<std::mutex> lock(mtx);
+    ready.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                   [this] { return count > 0; });
+    return take(item);
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return count;
+  }
+  bool full() { return size() == Capacity; }
+
+  unsigned long getDropped() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return dropped;
+  }
+  size_t getHighWater() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return highWater;
+  }
+
+ private:
+  std::mutex mtx;
+  std::condition_variable ready;
+  T items[Capacity];
+  size_t head = 0;
+  size_t count = 0;
+  size_t highWater = 0;
+  unsigned long dropped = 0;
+
+  bool take(T& item) {
+    if (count == 0) return false;
+    item = std::move(items[head]);
+    head = (head + 1) % Capacity;
+    count--;
+    return true;
+  }
+};
+
+#endif
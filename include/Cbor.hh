@@ -0,0 +1,66 @@
+#ifndef __CBOR_H__
+#define __CBOR_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The subset of CBOR (RFC 8949) the bridge needs for status and command
+// messages: maps, text strings, integers, booleans and null. Both sides work
+// on caller-provided buffers and never allocate.
+class CborWriter {
+ public:
+  // With a null buffer, only counts how many bytes would be written.
+  CborWriter(uint8_t* buffer, size_t capacity)
+      : buffer(buffer), capacity(capacity) {}
+
+  void map(size_t pairs);
+  void text(const char* s);
+  void text(const char* s, size_t length);
+  void integer(long value);
+  void boolean(bool value);
+  void null();
+
+  // Bytes written so far, or 0 once anything didn't fit.
+  size_t size() const { return overflow ? 0 : length; }
+  bool ok() const { return !overflow; }
+
+ private:
+  uint8_t* buffer;
+  size_t capacity;
+  size_t length = 0;
+  bool overflow = false;
+
+  void head(uint8_t major, uint64_t value);
+  void put(const uint8_t* data, size_t n);
+};
+
+class CborReader {
+ public:
+  struct Item {
+    enum Type { Int, Text, Bool, Null, Map, Array, Other };
+    Type type;
+    long value;        // Int, Bool, or the entry count of a Map/Array.
+    const char* text;  // Text, not terminated.
+    size_t length;
+  };
+
+  CborReader(const uint8_t* data, size_t length)
+      : data(data), length(length) {}
+
+  // Reads the next item. For maps and arrays only the header is consumed;
+  // their entries follow as separate items (use skip() to step over them).
+  bool next(Item& item);
+  // Skips the entries of a Map/Array item just returned by next().
+  bool skip(const Item& item);
+  bool atEnd() const { return pos >= length; }
+
+ private:
+  const uint8_t* data;
+  size_t length;
+  size_t pos = 0;
+
+  bool argument(uint8_t info, uint64_t& value);
+  bool skipDepth(const Item& item, int depth);
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef __CLOUDCOMMAND_H__
+#define __CLOUDCOMMAND_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+// A command written by a client to /<kettle name>/command, e.g.
+// {"on": true}, {"off": true}, {"calibrate": true} or
+// {"temp": true, "value": 205}. {"calibrate": true, "value": 16} adds a
+// calibration point at 16oz.
+struct CloudCommand {
+  enum Type { None, On, Off, Calibrate, Temp, CalibratePoint };
+  Type type = None;
+  int value = 0;
+  // micros() when it was taken off the database, for Trace; 0 if not
+  // stamped.
+  uint32_t timeClaimed = 0;
+
+  // Parses a command node. Keys are checked in the same order the bridge has
+  // always used (off, on, calibrate, temp), and only their presence matters.
+  static CloudCommand parse(const std::string& json);
+  // The same for a command node encoded as a CBOR map.
+  static CloudCommand parse(const uint8_t* cbor, size_t length);
+  // Writes the command as a CBOR map; returns its size, or 0 if it didn't fit.
+  size_t encode(uint8_t* buffer, size_t capacity) const;
+};
+
+// Local copy of the command node, kept up to date from Realtime Database
+// stream events, so commands written in several steps (e.g. "temp" and then
+// "value") are only acted on once complete.
+class CommandMirror {
+ public:
+  // Applies a put or patch event at path (relative to the command node).
+  void put(const std::string& path, const std::string& data);
+  void patch(const std::string& path, const std::string& data);
+  // If the node holds a complete command, returns true and clears the mirror
+  // (the caller is expected to delete the node remotely too).
+  bool take(CloudCommand& cmd);
+  bool empty() const { return node == "{}"; }
+
+ private:
+  std::string node = "{}";
+  void set(const std::string& key, const std::string& value);
+};
+
+#endif
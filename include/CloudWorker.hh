@@ -0,0 +1,100 @@
+#ifndef __CLOUDWORKER_H__
+#define __CLOUDWORKER_H__
+
+#include <Arduino.h>
+
+#include <mutex>
+#include <string>
+
+#include "BoundedQueue.hh"
+#include "CloudCommand.hh"
+#include "PinnedTask.hh"
+#include "RtdbClient.hh"
+#include "RtdbStream.hh"
+#include "TelemetryRelay.hh"
+
+// Does all cloud I/O on its own task, so a slow or unreachable Firebase
+// never stalls the main loop. The main loop hands it status uploads and
+// takes received commands back, both through bounded queues and without
+// blocking:
+//
+//   main loop                        worker
+//   sendStatus(path, body)  ----->   PATCH (or CBOR through the relay)
+//   takeResult(ok)          <-----   outcome of each upload
+//   takeCommand(cmd)        <-----   commands from the stream / polling
+//
+// The worker also keeps the command stream open for the kettle named with
+// setKettle(), and falls back to polling while it's down.
+class CloudWorker {
+ public:
+  static const size_t QueueDepth = 4;
+  static const unsigned long PollInterval = 3000;
+  // While the command stream is down we poll, and try to reopen it this
+  // often.
+  static const unsigned long StreamRetryInterval = 30000;
+
+  struct Stats {
+    unsigned long uploads = 0;
+    unsigned long failures = 0;
+    unsigned long commands = 0;
+    unsigned long claimFailures = 0;
+    unsigned long maxRequestTime = 0;  // ms, slowest single upload or claim.
+  };
+
+  // relay may be null; then status goes to Firebase as JSON.
+  CloudWorker(const PinnedTask::Config& config, RtdbClient& rest,
+              RtdbStream& stream, TelemetryRelay* relay = nullptr);
+  ~CloudWorker() { end(); }
+
+  void begin();
+  void end();
+
+  // Main loop side, all non-blocking.
+  // Kettle whose command node to follow; empty while offline.
+  void setKettle(const std::string& name);
+  // Queues a status upload; false if the queue is full.
+  bool sendStatus(const std::string& path, const std::string& body,
+                  bool cbor = false);
+  // Outcome of the oldest finished upload, if any.
+  bool takeResult(bool& ok) { return results.pop(ok); }
+  bool takeCommand(CloudCommand& cmd) { return commands.pop(cmd); }
+
+  Stats getStats();
+  size_t getQueueHighWater() { return requests.getHighWater(); }
+  PinnedTask::Stats takeTaskStats() { return task.takeStats(); }
+
+ private:
+  struct Request {
+    std::string path;
+    std::string body;
+    bool cbor = false;
+  };
+
+  RtdbClient& rest;
+  RtdbStream& stream;
+  TelemetryRelay* relay;
+  PinnedTask task;
+
+  BoundedQueue<Request, QueueDepth> requests;
+  BoundedQueue<bool, QueueDepth> results;
+  BoundedQueue<CloudCommand, QueueDepth> commands;
+
+  std::mutex mtx;  // Guards kettleName and stats.
+  std::string kettleName;
+  Stats stats;
+
+  // Worker thread state.
+  std::string streamPath;
+  CommandMirror mirror;
+  bool claimPending = false;
+  unsigned long lastStreamAttempt = 0;
+  unsigned long lastPoll = 0;
+
+  void step();
+  void upload(const Request& request);
+  void serviceCommands(const std::string& name, unsigned long timeNow);
+  bool claim(const std::string& path);
+  void timed(unsigned long timeStart);
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef __COMMANDQUEUE_H__
+#define __COMMANDQUEUE_H__
+
+#include <Arduino.h>
+#include <mutex>
+
+// Bounded queue of kettle commands waiting for a debounce slot. Safe to use
+// from any task. Rather than replaying every request, it keeps only what
+// still matters:
+//  - a new Set replaces the value of a pending Set,
+//  - Off jumps to the front and cancels a pending On,
+//  - repeated On or Off requests collapse into one.
+// So at most one of each command is ever queued, and an Off is always the
+// next thing sent.
+class CommandQueue {
+ public:
+  enum Command { On, Off, Set };
+  static const int Capacity = 3;
+
+  struct Entry {
+    Command cmd;
+    byte value;                // Temperature for Set.
+    unsigned long timeQueued;  // millis() of the first request it covers.
+  };
+
+  struct Stats {
+    unsigned long queued = 0;      // Requests accepted.
+    unsigned long coalesced = 0;   // Requests merged into a pending one.
+    unsigned long cancelled = 0;   // On requests dropped by an Off.
+    unsigned long dispatched = 0;  // Commands handed out by pop().
+    int depth = 0;
+    int maxDepth = 0;
+    // Time from request to dispatch, in ms.
+    unsigned long lastDispatchTime = 0;
+    unsigned long maxDispatchTime = 0;
+    unsigned long totalDispatchTime = 0;
+  };
+
+  void push(Command cmd, byte value = 0);
+  bool pop(Entry& entry);
+  void clear();
+  bool empty();
+  Stats getStats();
+
+ private:
+  std::mutex mtx;
+  Entry entries[Capacity];
+  int count = 0;
+  Stats stats;
+
+  int find(Command cmd) const;
+  void remove(int i);
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef __COMMANDTRACKER_H__
+#define __COMMANDTRACKER_H__
+
+#include <Arduino.h>
+
+#include "CommandQueue.hh"
+
+// Tracks commands written to the kettle until a state frame shows they took
+// effect: power for On/Off, target temperature for Set. The kettle doesn't
+// echo sequence numbers, so the expected effect is what gets matched; the
+// sequence of the last write is kept for logs. Unconfirmed commands are
+// resent after RetryTimeout, up to MaxRetries times.
+//
+// There's one slot per effect, so a newer power command supersedes an
+// unconfirmed one, and likewise for Set. Not thread safe: StaggKettle only
+// uses it from loop().
+class CommandTracker {
+ public:
+  static const unsigned long RetryTimeout = 500;  // ms
+  static const int MaxRetries = 3;
+
+  struct Stats {
+    unsigned long confirmed = 0;
+    unsigned long retries = 0;
+    unsigned long failed = 0;      // Gave up after MaxRetries.
+    unsigned long superseded = 0;  // Replaced by a newer command.
+    // Latencies of the last confirmed command, in ms: request to first
+    // write, first write to confirming state frame, and end to end.
+    unsigned long lastQueueTime = 0;
+    unsigned long lastConfirmTime = 0;
+    unsigned long lastTotalTime = 0;
+    unsigned long maxTotalTime = 0;
+    unsigned long totalTime = 0;  // Sum over all confirmed commands.
+  };
+
+  // Record a write of cmd with the given sequence number; retry is set when
+  // resending a command returned by due().
+  void sent(const CommandQueue::Entry& cmd, byte sequence,
+            unsigned long timeNow, bool retry = false);
+  // Feed decoded kettle state.
+  void onPower(bool power, unsigned long timeNow);
+  void onTargetTemp(byte temp, unsigned long timeNow);
+  // If a command is due to be resent, returns true and fills cmd.
+  bool due(unsigned long timeNow, CommandQueue::Entry& cmd);
+  void clear();
+  const Stats& getStats() const { return stats; }
+
+ private:
+  struct InFlight {
+    bool active = false;
+    CommandQueue::Entry cmd;
+    byte sequence;
+    int retries;
+    unsigned long timeFirstWrite;
+    unsigned long timeLastWrite;
+  };
+  enum Slot { Power, Temp, Slots };
+
+  InFlight inFlight[Slots];
+  Stats stats;
+
+  static Slot slotFor(CommandQueue::Command cmd) {
+    return cmd == CommandQueue::Command::Set ? Temp : Power;
+  }
+  void confirm(InFlight& f, unsigned long timeNow);
+};
+
+#endif
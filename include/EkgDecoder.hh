@@ -0,0 +1,171 @@
+#ifndef __EKGDECODER_H__
+#define __EKGDECODER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace Ekg {
+// All Fellow Stagg EKG+ comms (both rx & tx) start with 0xefdd.
+static const uint8_t Magic0 = 0xef;
+static const uint8_t Magic1 = 0xdd;
+
+static const uint8_t States = 9;
+static const uint8_t StateBytes[States] = {
+    3, // 0 = Power
+    3, // 1 = Hold
+    4, // 2 = Target temperature
+    4, // 3 = Current temperature
+    4, // 4 = Countdown when lifted?
+    4, // 5 = Unknown, usually 0x05, 0xFF, 0xFF, 0xFF
+    3, // 6 = Boiled/Holding?, usually 0x06, 0x00, 0x00
+    3, // 7 = Unknown, usually 0x07, 0x00, 0x00
+    3  // 8 = Kettle lifted
+    };
+
+// Frames of unknown type longer than this are considered garbage.
+static const size_t MaxFrame = 64;
+}  // namespace Ekg
+
+// Splits the kettle's notification stream into state frames of the form
+// 0xefdd followed by some bytes, where Ekg::StateBytes holds the number of
+// bytes for each state we expect. Separators are found with memchr, and frames
+// that arrive whole are handed to the sink straight out of the notification
+// buffer. Only a frame split across two notifications is copied.
+//
+// Resynchronization matches the original byte-at-a-time parser exactly, quirks
+// included: a separator inside a frame cuts it short and the truncated frame
+// (minus one byte) is still reported, unknown frames run until the next
+// separator in the same notification, and anything reaching 64 bytes is
+// dropped.
+class EkgDecoder {
+ public:
+  void reset() {
+    state = SeekMagic0;
+    pos = 0;
+  }
+
+  // Calls onFrame(const uint8_t* frame, size_t length) for each frame found.
+  template <typename Sink>
+  void feed(const uint8_t* data, size_t length, Sink&& onFrame);
+
+ private:
+  enum State { SeekMagic0, SeekMagic1, Payload };
+
+  template <typename Sink>
+  size_t frameInPlace(const uint8_t* data, size_t length, size_t i,
+                      Sink& onFrame);
+  template <typename Sink>
+  void bufferByte(const uint8_t* data, size_t length, size_t i, Sink& onFrame);
+
+  State state = SeekMagic0;
+  size_t pos = 0;
+  uint8_t buffer[Ekg::MaxFrame];
+};
+
+template <typename Sink>
+void EkgDecoder::feed(const uint8_t* data, size_t length, Sink&& onFrame) {
+  size_t i = 0;
+  while (i < length) {
+    if (state != Payload) {
+      // Note a stray byte between 0xef and 0xdd doesn't reset the search, and
+      // after a frame we only wait for the 0xdd.
+      uint8_t magic = state == SeekMagic0 ? Ekg::Magic0 : Ekg::Magic1;
+      const uint8_t* p =
+          (const uint8_t*)memchr(data + i, magic, length - i);
+      if (p == nullptr) return;
+      i = p - data + 1;
+      state = state == SeekMagic0 ? SeekMagic1 : Payload;
+      pos = 0;
+      continue;
+    }
+    if (pos == 0) {
+      size_t n = frameInPlace(data, length, i, onFrame);
+      if (n > 0) {
+        i += n;
+        continue;
+      }
+    }
+    // The frame continues past the end of this notification (or started in
+    // the previous one), so buffer it.
+    bufferByte(data, length, i, onFrame);
+    i++;
+  }
+}
+
+// Decodes the frame starting at data[i] if it ends within this notification.
+// Returns the number of bytes consumed, or 0 if it has to be buffered.
+template <typename Sink>
+size_t EkgDecoder::frameInPlace(const uint8_t* data, size_t length, size_t i,
+                                Sink& onFrame) {
+  const uint8_t* frame = data + i;
+  size_t avail = length - i;
+
+  if (frame[0] < Ekg::States) {
+    size_t frameBytes = Ekg::StateBytes[frame[0]];
+    if (avail < frameBytes) return 0;
+    for (size_t p = 1; p + 1 < frameBytes; p++) {
+      if (frame[p] == Ekg::Magic0 && frame[p + 1] == Ekg::Magic1) {
+        if (p > 1) onFrame(frame, p - 1);
+        state = SeekMagic1;
+        return p + 1;
+      }
+    }
+    onFrame(frame, frameBytes);
+    state = SeekMagic1;
+    return frameBytes;
+  }
+
+  // Unknown type: runs until the next separator in this notification.
+  size_t limit = avail < Ekg::MaxFrame ? avail : Ekg::MaxFrame;
+  size_t p = 0;
+  while (p < limit) {
+    const uint8_t* sep =
+        (const uint8_t*)memchr(frame + p, Ekg::Magic0, limit - p);
+    size_t next = sep == nullptr ? limit : sep - frame;
+    if (next >= Ekg::MaxFrame - 1 && limit == Ekg::MaxFrame) {
+      state = SeekMagic0;
+      return Ekg::MaxFrame;
+    }
+    if (next == limit) break;
+    if (next + 1 < avail && frame[next + 1] == Ekg::Magic1) {
+      if (next > 1) onFrame(frame, next - 1);
+      state = SeekMagic1;
+      return next + 1;
+    }
+    p = next + 1;
+  }
+  return 0;
+}
+
+// The original parser's per-byte step, used for frames split across
+// notifications.
+template <typename Sink>
+void EkgDecoder::bufferByte(const uint8_t* data, size_t length, size_t i,
+                            Sink& onFrame) {
+  buffer[pos] = data[i];
+  // If we have at least one byte, we know the type of state frame that we
+  // got, so check if it's in range of the states we know about, and if so,
+  // if we have that number of bytes, we have a complete frame.
+  if (pos > 0 && buffer[0] < Ekg::States &&
+      pos + 1 >= Ekg::StateBytes[buffer[0]]) {
+    onFrame((const uint8_t*)buffer, pos + 1);
+    pos = 0;
+    state = SeekMagic1;
+  // Some weirdly long frame, probably something wrong, skip it.
+  } else if (pos >= Ekg::MaxFrame - 1) {
+    pos = 0;
+    state = SeekMagic0;
+  // If we see 0xef, peek forward and see if we have a frame separator. If
+  // we do, then report what we got and move on to the next frame.
+  } else if (i + 1 < length && data[i] == Ekg::Magic0 &&
+             data[i + 1] == Ekg::Magic1) {
+    if (pos > 1) onFrame((const uint8_t*)buffer, pos - 1);
+    pos = 0;
+    state = SeekMagic1;
+  } else {
+    pos++;
+  }
+}
+
+#endif
@@ -4,33 +4,72 @@
 #include <Preferences.h>
 #include <math.h>
 
+#include "AdcSampler.hh"
+#include "FillCurve.hh"
+#include "FillFilter.hh"
+#include "ScaleCalibration.hh"
+#include "Snapshot.hh"
+
 namespace Calibration {
+// The points nextCalibration() steps through; more can be added one at a
+// time with addCalibrationPoint().
 static const int Count = 4;
-static double Ounces[Count] = {0.0, 12.0, 24.0, 30.0};
-static const int CurveOrder = 2;
+static const double Ounces[Count] = {0.0, 12.0, 24.0, 30.0};
 static const int16_t BufferSize = 32;
+// Preferences key of the saved ScaleCalibration.
+static const char PrefsKey[] = "ScaleCal";
 }  // namespace Calibration
 
 class FSRScale {
  public:
-  FSRScale(byte pin);
+  // What other tasks see of the scale, published on every change.
+  struct Status {
+    enum Field { FillField, CalModeField, SamplingField, Fields };
+    int fill = 0;
+    byte calMode = 0;
+    AdcSampler::Stats sampling;  // Refreshed about once a second.
+  };
+  typedef Snapshot<Status, Status::Fields> StatusSnapshot;
+  static const uint32_t DefaultSampleRate = 100;  // Hz
+
+  FSRScale(byte pin, uint32_t sampleRate = DefaultSampleRate);
+  // Starts sampling.
+  void begin();
   void loadFromPrefs();
   byte getCalibrationMode() { return calMode; }
   int getFill() { return (int)round(fill); }
   void nextCalibration();
+  // Adds (or replaces) a calibration point at the current reading, keeping
+  // the others, and saves the result.
+  void addCalibrationPoint(float ounces);
+  // The kettle was lifted or set down; the fill reading starts over.
+  void setLifted(bool lifted);
+  // Filters whatever was sampled since the last call.
   void loop();
+  // Safe to read from any task.
+  const StatusSnapshot& getStatus() const { return status; }
   ~FSRScale();
 
  private:
   Preferences prefs;
   byte pin = 35;  // ADC_PIN0
   byte calMode = 0;
-  uint16_t fsrBuffer[Calibration::BufferSize];
-  byte fsrBufferPos = 0;
-  double prevAvg;
-  double fill;
-  double coeffs[Calibration::CurveOrder + 1];
+  AdcSampler sampler;
+  uint16_t batch[Calibration::BufferSize];
+  FillFilter filter;
+  bool lifted = false;
+  double prevAvg = -1;
+  float fill = 0;
+  ScaleCalibration calibration;
+  ScaleCalibration guided;  // Points of a guided run in progress.
+  FillCurve curve;
   double calReadings[Calibration::Count];
+  StatusSnapshot status;
+  Status published;
+  unsigned long lastSamplingPublish = 0;
+
+  void publishStatus();
+  void applyCalibration();
 };
 
 #endif
\ No newline at end of file
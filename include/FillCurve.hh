@@ -0,0 +1,49 @@
+#ifndef __FILLCURVE_H__
+#define __FILLCURVE_H__
+
+#include <stdint.h>
+
+#include "ScaleCalibration.hh"
+
+// Turns an averaged FSR reading into oz of water on the calibration model.
+// The ESP32's FPU only does single precision, so rather than working the
+// model out in double on every reading, setModel() tabulates the fill every
+// Step codes over the 12-bit range and ounces() interpolates in fixed point.
+// Cells where that would be off by more than Tolerance (where the fill
+// clamps, breaks between calibration points, or where the quadratic runs
+// out of solutions) fall back to the model in float.
+class FillCurve {
+ public:
+  static const int Step = 16;  // ADC codes per table cell.
+  static const int Cells = 4096 / Step;
+  static constexpr double Tolerance = 0.01;  // oz
+  typedef ScaleCalibration::Model Model;
+
+  FillCurve() {}
+  // Rebuilds the table.
+  void setModel(const Model& model);
+  const Model& getModel() const { return model; }
+
+  // From the table.
+  float ounces(float reading) const;
+  // The same from the model, in float.
+  float solve(float reading) const { return model.ouncesFloat(reading); }
+
+ private:
+  Model model;
+  bool built = false;
+  // Fill at each cell boundary in 1/256 oz.
+  uint16_t table[Cells + 1] = {};
+  // Cells to solve in float instead of interpolating, one bit each.
+  uint32_t solved[Cells / 32] = {};
+
+  bool isSolved(int cell) const {
+    return solved[cell / 32] & (1UL << (cell % 32));
+  }
+  float interpolate(uint32_t cell, uint32_t frac) const {
+    return ((table[cell] * (256 - frac) + table[cell + 1] * frac) >> 8) /
+           256.0f;
+  }
+};
+
+#endif
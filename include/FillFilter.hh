@@ -0,0 +1,47 @@
+#ifndef __FILLFILTER_H__
+#define __FILLFILTER_H__
+
+#include <stdint.h>
+
+// Smooths raw FSR readings for the fill level. A running sum over the last
+// Window samples keeps the cost per sample constant. When the last Recent
+// samples all land more than stepThreshold away from the average, on the same
+// side, the level has changed (kettle set down, water poured in); a single
+// spike doesn't count. The window then restarts from those samples instead of
+// taking a whole turnover to catch up. reset() starts over on request, e.g.
+// when the kettle reports being lifted or set down.
+class FillFilter {
+ public:
+  static const int Window = 32;
+  static const int Recent = 4;
+  // Raw ADC counts; about 3oz with the usual calibration, and several times
+  // the noise of a single reading.
+  static const uint16_t DefaultStepThreshold = 40;
+
+  FillFilter(uint16_t stepThreshold = DefaultStepThreshold)
+      : stepThreshold(stepThreshold) {}
+
+  void add(uint16_t sample);
+  void reset();
+
+  bool ready() const { return count > 0; }
+  // Mean of the samples in the window, in raw ADC counts.
+  double average() const { return count ? (double)sum / count : 0.0; }
+  // Times the window restarted on a step.
+  unsigned long getSteps() const { return steps; }
+
+ private:
+  const uint16_t stepThreshold;
+  uint16_t window[Window] = {};
+  uint8_t pos = 0;
+  uint8_t count = 0;
+  uint32_t sum = 0;
+  uint16_t recent[Recent] = {};
+  uint8_t recentPos = 0;
+  uint8_t recentCount = 0;
+  uint32_t recentSum = 0;
+  int8_t outside = 0;  // Samples in a row past the threshold, signed by side.
+  unsigned long steps = 0;
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef __JSONSCAN_H__
+#define __JSONSCAN_H__
+
+#include <string>
+
+// Just enough JSON reading for Realtime Database events and commands, without
+// building a document: values are returned as raw text spans.
+namespace JsonScan {
+
+// Finds member key of the top-level object in json and stores its raw value
+// text (e.g. "true", "\"/\"", "{...}"). Returns false if json isn't an object
+// or has no such member.
+bool member(const std::string& json, const char* key, std::string& value);
+
+// Calls onMember(key, rawValue) for each member of the top-level object.
+// Returns false if json isn't a well-formed object.
+template <typename F>
+bool members(const std::string& json, F&& onMember);
+
+// Converts raw value text from member().
+bool toString(const std::string& raw, std::string& value);
+bool toLong(const std::string& raw, long& value);
+bool isNull(const std::string& raw);
+
+// Implementation detail of members(): length of the value starting at
+// json[pos] (after whitespace), or 0 if malformed.
+size_t valueLength(const std::string& json, size_t pos);
+size_t skipSpace(const std::string& json, size_t pos);
+
+template <typename F>
+bool members(const std::string& json, F&& onMember) {
+  size_t pos = skipSpace(json, 0);
+  if (pos >= json.size() || json[pos] != '{') return false;
+  pos = skipSpace(json, pos + 1);
+  if (pos < json.size() && json[pos] == '}') return true;
+  while (pos < json.size()) {
+    size_t keyLength = valueLength(json, pos);
+    std::string key;
+    if (keyLength == 0 || !toString(json.substr(pos, keyLength), key))
+      return false;
+    pos = skipSpace(json, pos + keyLength);
+    if (pos >= json.size() || json[pos] != ':') return false;
+    pos = skipSpace(json, pos + 1);
+    size_t length = valueLength(json, pos);
+    if (length == 0) return false;
+    onMember(key, json.substr(pos, length));
+    pos = skipSpace(json, pos + length);
+    if (pos >= json.size()) return false;
+    if (json[pos] == '}') return true;
+    if (json[pos] != ',') return false;
+    pos = skipSpace(json, pos + 1);
+  }
+  return false;
+}
+
+}  // namespace JsonScan
+
+#endif
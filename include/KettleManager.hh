@@ -0,0 +1,57 @@
+#ifndef __KETTLEMANAGER_H__
+#define __KETTLEMANAGER_H__
+
+#include <Arduino.h>
+#include <BLEDevice.h>
+
+#include "BoundedQueue.hh"
+#include "StaggKettle.hh"
+
+// Drives several kettles from one task. Each kettle connects to its own
+// link directly as before; kettles with nothing to try share one scan,
+// which runs in the background so connected kettles keep being served, and
+// every kettle found that isn't already someone's goes to one that needs
+// it. Connection attempts still happen one at a time, in loop().
+class KettleManager : public BLEAdvertisedDeviceCallbacks {
+ public:
+  // Connections the ESP32 BLE controller allows by default.
+  static const int MaxKettles = 3;
+  static_assert(MaxKettles <= StaggKettle::MaxKettles,
+                "every kettle needs a notifier slot");
+
+  struct Stats {
+    unsigned long scans = 0;
+    unsigned long found = 0;     // Kettles heard, each once per scan.
+    unsigned long assigned = 0;  // Handed to a kettle that needed one.
+  };
+
+  KettleManager();
+  ~KettleManager();
+
+  StaggKettle& get(int slot) { return kettles[slot]; }
+  const StaggKettle& get(int slot) const { return kettles[slot]; }
+  // Runs every kettle's loop(), hands out what the scan found, and starts
+  // the next scan while any kettle needs one.
+  void loop();
+  const Stats& getStats() const { return stats; }
+
+  // BLE scan callback.
+  void onResult(BLEAdvertisedDevice advertisedDevice);
+
+ private:
+  StaggKettle kettles[MaxKettles];
+  // Found by the scan on the BLE task, taken by loop().
+  BoundedQueue<StaggKettle::Link, 4> found;
+  BLEScan* pBLEScan = nullptr;
+  bool scanning = false;
+  unsigned long timeScan = 0;  // Start of the current scan, or end of last.
+  unsigned long scanDelay = 0;
+  unsigned long assignedBefore = 0;  // stats.assigned when the scan began.
+  Stats stats;
+
+  void assign(const StaggKettle::Link& link);
+  void scan(unsigned long timeNow);
+  void scanDone(unsigned long timeNow);
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef __LATENCYHISTOGRAM_H__
+#define __LATENCYHISTOGRAM_H__
+
+#include <stdint.h>
+#include <string.h>
+
+// Histogram of durations in microseconds, e.g. main loop iterations. Buckets
+// are log-linear (four per power of two, so within 19%), recording is a few
+// instructions, and the whole thing is a fixed 1KB.
+class LatencyHistogram {
+ public:
+  static const int SubBuckets = 4;
+  static const int Buckets = 32 * SubBuckets;
+
+  void record(uint32_t micros) {
+    counts[bucket(micros)]++;
+    count++;
+    if (micros > max) max = micros;
+  }
+
+  // Upper bound of the bucket holding the p-th fraction of samples.
+  uint32_t percentile(double p) const {
+    if (count == 0) return 0;
+    uint64_t target = (uint64_t)(p * count);
+    if (target >= count) target = count - 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < Buckets; i++) {
+      seen += counts[i];
+      if (seen > target) {
+        uint32_t bound = upper(i);
+        return bound < max ? bound : max;
+      }
+    }
+    return max;
+  }
+
+  // Samples at or above micros.
+  uint32_t countAbove(uint32_t micros) const {
+    uint32_t n = 0;
+    for (int i = bucket(micros); i < Buckets; i++) n += counts[i];
+    return n;
+  }
+
+  // Adds n samples to bucket i, largest of them largest: for histograms kept
+  // elsewhere (see Trace.hh) and read back through this one.
+  void add(int i, uint32_t n, uint32_t largest) {
+    counts[i] += n;
+    count += n;
+    if (n > 0 && largest > max) max = largest;
+  }
+
+  uint32_t getCount() const { return count; }
+  uint32_t getMax() const { return max; }
+
+  void reset() {
+    memset(counts, 0, sizeof(counts));
+    count = 0;
+    max = 0;
+  }
+
+  // Values below 4 get their own bucket; above, bucket by the top three bits.
+  static int bucket(uint32_t v) {
+    if (v < SubBuckets) return v;
+    int log = 31 - __builtin_clz(v);
+    return (log - 1) * SubBuckets + (v >> (log - 2)) - SubBuckets;
+  }
+  static uint32_t upper(int i) {
+    if (i < SubBuckets) return i;
+    int log = i / SubBuckets + 1;
+    uint64_t sub = i % SubBuckets + SubBuckets + 1;
+    uint64_t bound = (sub << (log - 2)) - 1;
+    return bound > 0xffffffffu ? 0xffffffffu : (uint32_t)bound;
+  }
+
+ private:
+  uint32_t counts[Buckets] = {};
+  uint32_t count = 0;
+  uint32_t max = 0;
+};
+
+#endif
@@ -0,0 +1,198 @@
+#ifndef __LOG_H__
+#define __LOG_H__
+
+#include <Arduino.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <type_traits>
+
+#include "PinnedTask.hh"
+
+// Levels, most severe first. LOG_LEVEL, a build flag, is the most verbose
+// level compiled in: calls above it vanish, arguments and all.
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+#define LOG_LEVEL_VERBOSE 5
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// Logging that's cheap enough for the BLE callback and the kettle's decoder:
+// a call copies its call site's address, millis() and its arguments as raw
+// bytes into a lock-free ring (MpscRing), and a low priority task drains the
+// ring to Serial. Nothing is formatted, allocated or waited for on the
+// caller's side; when the ring is full the record is dropped and counted.
+//
+// Formats are printf's, checked by the compiler like printf's, with these
+// arguments: integers up to 32 bits (bool and enums too; %d, %u, %x, %c,
+// with l if the type wants it), floats and doubles (sent as float; %f, %g),
+// and strings (%s, up to MaxText bytes). A const uint8_t* for "%.*s" is
+// that many bytes printed as hex.
+//
+// On the wire each record is a binary frame the host decodes (the "log"
+// tool), sent between the lines others still print directly: 0x00, a type,
+// the payload length, the payload and an 8-bit sum of all but the 0x00.
+// Types: 'F' is a format the first time its site logs (id, level, text);
+// 'R' a record (id, millis(), arguments); 'D' records dropped since the
+// last 'D'. Build with LOG_TEXT for the drain task to print text itself.
+namespace Log {
+
+enum Level : uint8_t {
+  Error = LOG_LEVEL_ERROR,
+  Warn = LOG_LEVEL_WARN,
+  Info = LOG_LEVEL_INFO,
+  Debug = LOG_LEVEL_DEBUG,
+  Verbose = LOG_LEVEL_VERBOSE
+};
+
+// One per call site, constant.
+struct Site {
+  Level level;
+  const char* format;
+};
+
+static const size_t RingBytes = 4096;
+static const size_t MaxRecord = 96;
+// Longest string argument kept; the top bit of its length byte marks bytes
+// for hex.
+static const size_t MaxText = 127;
+static const uint8_t Hex = 0x80;
+
+struct Stats {
+  uint32_t written;
+  uint32_t dropped;
+  size_t highWater;  // Most bytes queued at once.
+  int sites;         // Call sites seen by the drain task.
+};
+
+// A record on the caller's stack: the site, millis() and the arguments,
+// cut short if they don't fit.
+class Record {
+ public:
+  explicit Record(const Site* site) {
+    uint32_t time = millis();
+    put(&site, sizeof(site));
+    put(&time, sizeof(time));
+  }
+
+  void put(const void* data, size_t n) {
+    if (n > MaxRecord - length) n = MaxRecord - length;
+    memcpy(bytes + length, data, n);
+    length += n;
+  }
+  void text(const void* data, size_t n, uint8_t flags) {
+    if (n > MaxText) n = MaxText;
+    if (length < MaxRecord && n > MaxRecord - length - 1)
+      n = MaxRecord - length - 1;
+    uint8_t header = n | flags;
+    put(&header, 1);
+    put(data, n);
+  }
+
+  uint8_t bytes[MaxRecord];
+  size_t length = 0;
+  uint32_t lastInt = 0;  // A "%.*s" precision, for the bytes after it.
+};
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value ||
+                               std::is_enum<T>::value>::type
+encode(Record& r, T v) {
+  r.lastInt = (uint32_t)v;
+  r.put(&r.lastInt, 4);
+}
+inline void encode(Record& r, double v) {
+  float f = v;
+  r.put(&f, 4);
+}
+inline void encode(Record& r, const char* s) {
+  size_t n = 0;
+  while (s && n < MaxText && s[n]) n++;
+  r.text(s, n, 0);
+}
+inline void encode(Record& r, const uint8_t* data) {
+  r.text(data, r.lastInt, Hex);
+}
+
+inline void encodeAll(Record& r) {}
+template <typename T, typename... Rest>
+inline void encodeAll(Record& r, const T& first, const Rest&... rest) {
+  encode(r, first);
+  encodeAll(r, rest...);
+}
+
+void push(const Record& r);
+
+template <typename... Args>
+inline void write(const Site* site, const Args&... args) {
+  Record r(site);
+  encodeAll(r, args...);
+  push(r);
+}
+
+// Never called; lets the compiler check formats against their arguments.
+inline void check(const char* format, ...)
+    __attribute__((format(printf, 1, 2)));
+inline void check(const char* format, ...) {}
+
+// Starts the drain task.
+void begin();
+// Drains what's queued now, on the caller's task.
+void drain();
+// Has the drain task send every format it has sent so far again, for a
+// decoder that started listening late.
+void resend();
+Stats getStats();
+PinnedTask::Stats takeTaskStats();
+
+// Formats a record's arguments with its site's format; returns the length
+// of out, which is always terminated. Missing arguments print as "?".
+size_t format(char* out, size_t size, const char* format, const uint8_t* args,
+              size_t length);
+// "[    12.345] I " followed by the message.
+size_t formatLine(char* out, size_t size, uint8_t level, uint32_t time,
+                  const char* format, const uint8_t* args, size_t length);
+char levelLetter(uint8_t level);
+
+}  // namespace Log
+
+#define LOG_AT(level, format, ...)                             \
+  do {                                                         \
+    static const Log::Site logSite = {level, format};          \
+    if (false) Log::check(format, ##__VA_ARGS__);              \
+    Log::write(&logSite, ##__VA_ARGS__);                       \
+  } while (0)
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(format, ...) LOG_AT(Log::Error, format, ##__VA_ARGS__)
+#else
+#define LOG_ERROR(format, ...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(format, ...) LOG_AT(Log::Warn, format, ##__VA_ARGS__)
+#else
+#define LOG_WARN(format, ...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(format, ...) LOG_AT(Log::Info, format, ##__VA_ARGS__)
+#else
+#define LOG_INFO(format, ...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(format, ...) LOG_AT(Log::Debug, format, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(format, ...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_VERBOSE
+#define LOG_VERBOSE(format, ...) LOG_AT(Log::Verbose, format, ##__VA_ARGS__)
+#else
+#define LOG_VERBOSE(format, ...) do {} while (0)
+#endif
+
+#endif
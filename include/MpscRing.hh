@@ -0,0 +1,123 @@
+#ifndef __MPSCRING_H__
+#define __MPSCRING_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+
+// Lock-free multi-producer/single-consumer ring of variable-length byte
+// records, e.g. log records from every task to the one that prints them. As
+// SpscRing, records never wrap and a full ring drops and counts the record,
+// but here any number of producers reserve their space with a
+// compare-and-swap and publish it with the record's header. A producer
+// that's preempted between the two holds up the consumer, not the other
+// producers.
+template <size_t Size>
+class MpscRing {
+  static_assert((Size & (Size - 1)) == 0, "Size must be a power of two");
+
+ public:
+  static const size_t MaxRecord = Size / 2 - 4;
+
+  // Producer side, from any task. Returns false (and counts an overflow) if
+  // there's no room.
+  bool push(const uint8_t* data, size_t length);
+
+  // Consumer side: the oldest record, or nullptr if the ring is empty or the
+  // oldest is still being written. Stays valid until pop().
+  const uint8_t* front(size_t& length);
+  void pop();
+
+  uint32_t getPushed() const { return pushed.load(std::memory_order_relaxed); }
+  uint32_t getOverflows() const {
+    return overflows.load(std::memory_order_relaxed);
+  }
+  size_t getHighWater() const {
+    return highWater.load(std::memory_order_relaxed);
+  }
+
+ private:
+  // Records are a 4-byte header followed by the data, padded to 4 bytes. The
+  // header is 0 until the record is published, so the consumer zeroes what
+  // it frees for the next lap.
+  static const size_t Header = 4;
+  static const uint32_t Ready = 0x80000000u;
+  static const uint32_t Wrap = 0xffffffffu;
+
+  static size_t recordSize(size_t length) {
+    return (Header + length + 3) & ~(size_t)3;
+  }
+  std::atomic<uint32_t>& header(size_t offset) {
+    return *reinterpret_cast<std::atomic<uint32_t>*>(buffer + offset);
+  }
+
+  std::atomic<size_t> head{0};  // Reserved by producers.
+  std::atomic<size_t> tail{0};  // Written by the consumer only.
+  std::atomic<uint32_t> pushed{0};
+  std::atomic<uint32_t> overflows{0};
+  std::atomic<size_t> highWater{0};
+  alignas(4) uint8_t buffer[Size] = {};
+};
+
+template <size_t Size>
+bool MpscRing<Size>::push(const uint8_t* data, size_t length) {
+  static_assert(sizeof(std::atomic<uint32_t>) == Header, "Header is a word");
+  size_t need = recordSize(length);
+  size_t h = head.load(std::memory_order_relaxed);
+  size_t offset, skip;
+  do {
+    offset = h & (Size - 1);
+    // Skip the rest of the buffer if the record doesn't fit before its end.
+    skip = Size - offset < need ? Size - offset : 0;
+    if (length > MaxRecord ||
+        h + skip + need - tail.load(std::memory_order_acquire) > Size) {
+      overflows.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+  } while (!head.compare_exchange_weak(h, h + skip + need,
+                                       std::memory_order_relaxed));
+
+  if (skip > 0) {
+    header(offset).store(Wrap, std::memory_order_release);
+    offset = 0;
+  }
+  memcpy(buffer + offset + Header, data, length);
+  header(offset).store(Ready | length, std::memory_order_release);
+
+  pushed.fetch_add(1, std::memory_order_relaxed);
+  size_t queued = h + skip + need - tail.load(std::memory_order_relaxed);
+  if (queued > highWater.load(std::memory_order_relaxed))
+    highWater.store(queued, std::memory_order_relaxed);
+  return true;
+}
+
+template <size_t Size>
+const uint8_t* MpscRing<Size>::front(size_t& length) {
+  size_t t = tail.load(std::memory_order_relaxed);
+  for (;;) {
+    size_t offset = t & (Size - 1);
+    uint32_t h = header(offset).load(std::memory_order_acquire);
+    if (h == 0) return nullptr;
+    if (h != Wrap) {
+      length = h & ~Ready;
+      return buffer + offset + Header;
+    }
+    memset(buffer + offset, 0, Size - offset);
+    t += Size - offset;
+    tail.store(t, std::memory_order_release);
+  }
+}
+
+template <size_t Size>
+void MpscRing<Size>::pop() {
+  size_t t = tail.load(std::memory_order_relaxed);
+  size_t offset = t & (Size - 1);
+  size_t size =
+      recordSize(header(offset).load(std::memory_order_relaxed) & ~Ready);
+  memset(buffer + offset, 0, size);
+  tail.store(t + size, std::memory_order_release);
+}
+
+#endif
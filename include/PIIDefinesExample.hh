@@ -12,4 +12,9 @@
 #define FIREBASE_PROJECT "<my firebase project>.firebaseio.com"
 #define FIREBASE_SECRET "<my firebase secret code>"
 
+// Send status as CBOR through native/tools/cbor_relay.py on the local network
+// instead of JSON straight to Firebase.
+// #define TELEMETRY_RELAY_HOST "192.168.0.10"
+// #define TELEMETRY_RELAY_PORT 9001
+
 #endif
\ No newline at end of file
@@ -0,0 +1,73 @@
+#ifndef __PINNEDTASK_H__
+#define __PINNEDTASK_H__
+
+#include <Arduino.h>
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#ifndef ESP32
+#include <HostClock.h>
+#endif
+
+// Runs step() every period ms on its own thread, pinned to a core at a given
+// priority. On the ESP32 the thread is a FreeRTOS task (std::thread is built
+// on pthreads, which esp_pthread configures); on the host it's a plain
+// std::thread, pinned where the machine has the core and with priority
+// mapped to niceness, so the same task layout runs in host tools; or a
+// coroutine, on the host's virtual clock (HostClock.h).
+class PinnedTask {
+ public:
+  struct Config {
+    const char* name;
+    int core;
+    int priority;  // FreeRTOS priority; higher runs first.
+    uint32_t stackSize;
+    unsigned long period;  // ms between step() starts.
+  };
+
+  // Counters since the last takeStats().
+  struct Stats {
+    unsigned long runs = 0;
+    unsigned long overruns = 0;  // step() took longer than a period.
+    unsigned long busyTime = 0;  // us spent in step(), waits included.
+    unsigned long elapsed = 0;   // us since the last takeStats().
+    unsigned long maxRunTime = 0;
+    uint32_t stackFree = 0;  // Least free stack seen, in bytes; 0 on the host.
+
+    unsigned long busyPercent() const {
+      return elapsed ? (unsigned long)(100ULL * busyTime / elapsed) : 0;
+    }
+  };
+
+  PinnedTask(const Config& config) : config(config) {}
+  ~PinnedTask() { end(); }
+
+  void begin(std::function<void()> step);
+  void end();
+
+  const Config& getConfig() const { return config; }
+  Stats takeStats();
+
+ private:
+  const Config config;
+  std::function<void()> step;
+#ifdef ESP32
+  std::thread thread;
+#else
+  HostThread thread;
+#endif
+  std::atomic<bool> running{false};
+  // FreeRTOS task handle, once the task has started.
+  std::atomic<void*> handle{nullptr};
+
+  std::mutex mtx;  // Guards stats.
+  Stats stats;
+  unsigned long statsStart = 0;
+
+  void run();
+};
+
+#endif
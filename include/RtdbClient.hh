@@ -0,0 +1,70 @@
+#ifndef __RTDBCLIENT_H__
+#define __RTDBCLIENT_H__
+
+#include <Arduino.h>
+#include <Client.h>
+
+#include <string>
+
+// Plain Realtime Database REST requests over one keep-alive connection, with
+// the ETag headers FirebaseESP32 doesn't expose. Runs over any Arduino
+// Client, like RtdbStream.
+class RtdbClient {
+ public:
+  static const unsigned long Timeout = 5000;
+  // Responses longer than this are drained and dropped.
+  static const size_t MaxBody = 4096;
+
+  struct Response {
+    int code = 0;       // HTTP status, or 0 if the server couldn't be reached.
+    std::string etag;   // Only when requested.
+    std::string body;   // Raw JSON.
+  };
+
+  RtdbClient(Client& client, const char* host, uint16_t port = 443,
+             const char* auth = nullptr);
+
+  // One request on <path>.json. ifMatch makes PUT/DELETE conditional: 412,
+  // with the current value and its ETag, if the node changed.
+  Response request(const char* method, const std::string& path,
+                   const std::string& body = "", bool wantEtag = false,
+                   const char* ifMatch = nullptr);
+
+  enum Claim { Claimed, Empty, Failed };
+
+  // Takes the value at path and deletes it, such that a value written in
+  // between is never deleted unseen: the delete only succeeds if the node
+  // still has the ETag we read, otherwise the newer value is taken instead.
+  // A poll of a node that's still empty is one delete conditioned on the
+  // empty node's ETag; a command costs one more. The REST API has no single
+  // request that reads and deletes, and documents no If-None-Match, so this
+  // is as close as it gets. On Claimed, value holds the raw JSON taken.
+  Claim claim(const std::string& path, std::string& value);
+
+  unsigned long getRequests() const { return requests; }
+  unsigned long getConnects() const { return connects; }
+  // Claims that found the node still empty in one request.
+  unsigned long getIdlePolls() const { return idlePolls; }
+  unsigned long getConflicts() const { return conflicts; }
+
+ private:
+  Client& client;
+  std::string host;
+  uint16_t port;
+  std::string auth;
+
+  // ETag of the empty command node, once claim() has seen it.
+  std::string claimPath;
+  std::string claimEtag;
+
+  unsigned long requests = 0;
+  unsigned long connects = 0;
+  unsigned long idlePolls = 0;
+  unsigned long conflicts = 0;
+
+  bool readLine(std::string& out);
+  bool readBody(size_t length, std::string* out);
+  bool readChunked(std::string& out);
+};
+
+#endif
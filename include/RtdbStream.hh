@@ -0,0 +1,75 @@
+#ifndef __RTDBSTREAM_H__
+#define __RTDBSTREAM_H__
+
+#include <Arduino.h>
+#include <Client.h>
+
+#include <functional>
+#include <string>
+
+// Listens to a Realtime Database location over the REST streaming API
+// (server-sent events), so changes arrive as they happen instead of being
+// polled for. Runs over any Arduino Client: WiFiClientSecure on the board, a
+// plain socket against a local stand-in on the host.
+//
+// begin() blocks while connecting and reading the response headers; after
+// that poll() only reads what has already arrived.
+class RtdbStream {
+ public:
+  // Firebase sends a keep-alive every 30s; give up on the stream after this
+  // long without hearing anything.
+  static const unsigned long IdleTimeout = 65000;
+  static const unsigned long ConnectTimeout = 5000;
+
+  struct Event {
+    enum Type { Put, Patch, KeepAlive, Cancel, AuthRevoked, Other };
+    Type type;
+    std::string path;  // Relative to the streamed location.
+    std::string data;  // Raw JSON.
+  };
+  typedef std::function<void(const Event&)> Callback;
+
+  RtdbStream(Client& client, const char* host, uint16_t port = 443,
+             const char* auth = nullptr);
+
+  bool begin(const std::string& path);
+  void stop();
+  bool connected();
+  void poll(Callback onEvent);
+
+  unsigned long getConnects() const { return connects; }
+  unsigned long getEvents() const { return events; }
+  unsigned long getBytes() const { return bytes; }
+
+ private:
+  Client& client;
+  std::string host;
+  uint16_t port;
+  std::string auth;
+  bool active = false;
+  unsigned long timeLastData = 0;
+
+  // Transfer-Encoding: chunked framing.
+  bool chunked = false;
+  enum ChunkState { ChunkSize, ChunkData, ChunkEnd } chunkState = ChunkSize;
+  size_t chunkRemaining = 0;
+  std::string chunkLine;
+
+  // Server-sent event being assembled.
+  std::string line;
+  std::string eventName;
+  std::string eventData;
+
+  unsigned long connects = 0;
+  unsigned long events = 0;
+  unsigned long bytes = 0;
+
+  bool open(const std::string& host, uint16_t port, const std::string& uri,
+            std::string& location);
+  bool readLine(std::string& out);
+  void consume(const char* data, size_t length, Callback& onEvent);
+  void consumeEventByte(char c, Callback& onEvent);
+  void dispatch(Callback& onEvent);
+};
+
+#endif
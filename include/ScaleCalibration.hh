@@ -0,0 +1,95 @@
+#ifndef __SCALECALIBRATION_H__
+#define __SCALECALIBRATION_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Calibration points (oz of water against the averaged FSR reading) and the
+// model of fill against reading that fits them best. Points can be added one
+// at a time, e.g. to refine the full end, without redoing the others; the
+// model is refitted on every change. The candidates are polynomials of fill
+// in the reading, of every order the points allow, and straight lines
+// between the points; the one with the lowest leave-one-out residual wins.
+//
+// save() writes the points and the model as a single versioned blob with a
+// CRC, so it goes to flash in one write.
+class ScaleCalibration {
+ public:
+  static const int MaxPoints = 12;
+  static const int MaxOrder = 3;
+  static const uint8_t Version = 1;
+  // Largest blob save() writes.
+  static const size_t MaxBlob = 8 + MaxPoints * 8 + (MaxOrder + 1) * 8 + 8;
+
+  struct Point {
+    float ounces;
+    float reading;
+  };
+
+  struct Model {
+    enum Type : uint8_t {
+      // reading = a*oz^2 + b*oz + c, solved for oz; coeffs are a, b, c. What
+      // the scale used before, and still does until calibrated.
+      Quadratic,
+      // oz = sum of coeffs[i] * x^i, with x the reading scaled to -1..1.
+      Polynomial,
+      // Straight lines between points (by reading), extended at both ends.
+      Piecewise
+    };
+    // Past the top of the quadratic, and the most any model reports (0.9L).
+    static constexpr float MaxFill = 30.43f;
+
+    Type type = Quadratic;
+    uint8_t order = 0;  // Polynomial.
+    uint8_t count = 0;  // Piecewise.
+    double coeffs[MaxOrder + 1] = {};
+    Point points[MaxPoints] = {};
+
+    static Model quadratic(double a, double b, double c);
+    // Fill for a reading, in double and in float.
+    double ounces(double reading) const;
+    float ouncesFloat(float reading) const;
+    // Readings where the fill isn't smooth, other than where it clamps.
+    int breaks(float* out, int max) const;
+  };
+
+  ScaleCalibration() {}
+  explicit ScaleCalibration(const Model& initial) : model(initial) {}
+
+  // Adds a point, replacing any at the same ounces, and refits. Returns false
+  // if there's no room.
+  bool addPoint(float ounces, float reading);
+  void clear();
+  int getCount() const { return count; }
+  const Point& getPoint(int i) const { return points[i]; }
+  // Until there are 2 points, the model it was constructed with.
+  const Model& getModel() const { return model; }
+  // RMS of the chosen model's leave-one-out residuals, in oz; 0 until there
+  // are enough points to tell.
+  float getResidual() const { return residual; }
+
+  // Returns the blob's length, or 0 if it doesn't fit in out.
+  size_t save(uint8_t* out, size_t capacity) const;
+  // Takes the points and model from a blob, if it's intact and of this
+  // version.
+  bool load(const uint8_t* data, size_t length);
+
+ private:
+  Point points[MaxPoints];  // By reading.
+  int count = 0;
+  // Power sums of the scaled readings, and of ounces times them, for least
+  // squares fits; kept up to date as points come and go.
+  double powers[2 * MaxOrder + 1] = {};
+  double moments[MaxOrder + 1] = {};
+  Model model;
+  float residual = 0;
+
+  static void accumulate(const Point& p, double sign, double* powers,
+                         double* moments);
+  static bool fitPolynomial(int order, const double* powers,
+                            const double* moments, double* coeffs);
+  double leaveOneOut(const Model& candidate) const;
+  void refit();
+};
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <type_traits>
+
+// Latest copy of a state struct, published by one task and read by any
+// number of others without locks. There are two buffers: the writer fills the
+// one readers aren't looking at, then bumps the version, so a reader only has
+// to retry if a whole publish lands while it's copying. The writer says which
+// of the Fields changed with each publish; every Reader gets the fields that
+// changed since its own last read, however many versions it skipped.
+template <typename T, int Fields>
+class Snapshot {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "snapshots are copied word by word");
+  static_assert(Fields <= 32, "one bit per field");
+
+ public:
+  typedef uint32_t Mask;
+  static const Mask All = Fields == 32 ? 0xffffffffu : (1u << Fields) - 1;
+
+  // Writer side. changed has a bit set for every field of value that differs
+  // from the last publish.
+  void publish(const T& value, Mask changed) {
+    uint32_t next = version.load(std::memory_order_relaxed) + 1;
+    latest.value = value;
+    for (int i = 0; i < Fields; i++)
+      if (changed & (1u << i)) latest.changedAt[i] = next;
+    // Readers that see any of these stores must also see the previous version
+    // bump, so they know to retry.
+    std::atomic_thread_fence(std::memory_order_release);
+    store(slots[next & 1], latest);
+    version.store(next, std::memory_order_release);
+  }
+
+  // Number of publishes so far.
+  uint32_t getVersion() const {
+    return version.load(std::memory_order_acquire);
+  }
+
+  // Follows a Snapshot for one consumer.
+  class Reader {
+   public:
+    Reader(const Snapshot& snapshot) : snapshot(snapshot) {}
+
+    // If anything was published since the last call, copies the latest value
+    // to out and returns the fields that changed in between; everything on the
+    // first call. Returns 0 and leaves out alone otherwise.
+    Mask poll(T& out) {
+      if (snapshot.getVersion() == seen) return 0;
+      Slot slot;
+      uint32_t version = snapshot.read(slot);
+      Mask changed = 0;
+      for (int i = 0; i < Fields; i++)
+        if (first || (int32_t)(slot.changedAt[i] - seen) > 0)
+          changed |= 1u << i;
+      out = slot.value;
+      seen = version;
+      first = false;
+      return changed;
+    }
+
+   private:
+    const Snapshot& snapshot;
+    uint32_t seen = 0;
+    bool first = true;
+  };
+
+  // Reads that had to start over because a publish overtook them.
+  unsigned long getRetries() const { return retries; }
+
+ private:
+  struct Slot {
+    T value;
+    uint32_t changedAt[Fields];
+  };
+  static const size_t Words = (sizeof(Slot) + 3) / 4;
+
+  // Relaxed atomic words, so concurrent copies are well defined; they compile
+  // to plain loads and stores.
+  std::atomic<uint32_t> slots[2][Words] = {};
+  std::atomic<uint32_t> version{0};
+  mutable std::atomic<unsigned long> retries{0};
+  Slot latest = {};  // Writer's copy.
+
+  static void store(std::atomic<uint32_t>* words, const Slot& slot) {
+    uint32_t buf[Words] = {};
+    memcpy(buf, &slot, sizeof(Slot));
+    for (size_t i = 0; i < Words; i++)
+      words[i].store(buf[i], std::memory_order_relaxed);
+  }
+
+  uint32_t read(Slot& slot) const {
+    uint32_t buf[Words];
+    for (;;) {
+      uint32_t before = version.load(std::memory_order_acquire);
+      const std::atomic<uint32_t>* words = slots[before & 1];
+      for (size_t i = 0; i < Words; i++)
+        buf[i] = words[i].load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (version.load(std::memory_order_relaxed) == before) {
+        memcpy(&slot, buf, sizeof(Slot));
+        return before;
+      }
+      retries.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef __SPSCRING_H__
+#define __SPSCRING_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+
+// Lock-free single-producer/single-consumer ring of variable-length byte
+// records, e.g. BLE notifications handed from the BLE task to the main loop.
+// Records never wrap around the end of the buffer, so the consumer reads each
+// one in place. The producer never blocks: when the ring is full the record is
+// dropped and counted.
+template <size_t Size>
+class SpscRing {
+  static_assert((Size & (Size - 1)) == 0, "Size must be a power of two");
+
+ public:
+  // Largest record that can ever fit.
+  static const size_t MaxRecord = Size / 2 - 2;
+
+  // Producer side. Returns false (and counts an overflow) if there's no room.
+  bool push(const uint8_t* data, size_t length);
+
+  // Consumer side: the oldest record, or nullptr if the ring is empty. Stays
+  // valid until pop().
+  const uint8_t* front(size_t& length);
+  void pop();
+
+  // Consumer side: drop everything queued so far.
+  void clear() {
+    size_t length;
+    while (front(length) != nullptr) pop();
+  }
+
+  uint32_t getPushed() const { return pushed.load(std::memory_order_relaxed); }
+  uint32_t getOverflows() const {
+    return overflows.load(std::memory_order_relaxed);
+  }
+  // Most bytes ever queued at once, including record headers.
+  size_t getHighWater() const {
+    return highWater.load(std::memory_order_relaxed);
+  }
+
+ private:
+  // Records are a 2-byte length followed by the data, padded to 2 bytes so a
+  // header always fits before the end of the buffer.
+  static const size_t Header = 2;
+  static const uint16_t Wrap = 0xffff;
+
+  static size_t recordSize(size_t length) {
+    return (Header + length + 1) & ~(size_t)1;
+  }
+
+  std::atomic<size_t> head{0};  // Written by the producer only.
+  std::atomic<size_t> tail{0};  // Written by the consumer only.
+  std::atomic<uint32_t> pushed{0};
+  std::atomic<uint32_t> overflows{0};
+  std::atomic<size_t> highWater{0};
+  uint8_t buffer[Size];
+};
+
+template <size_t Size>
+bool SpscRing<Size>::push(const uint8_t* data, size_t length) {
+  size_t h = head.load(std::memory_order_relaxed);
+  size_t t = tail.load(std::memory_order_acquire);
+  size_t offset = h & (Size - 1);
+  size_t need = recordSize(length);
+  // Skip the rest of the buffer if the record doesn't fit before its end.
+  size_t skip = Size - offset < need ? Size - offset : 0;
+
+  if (length > MaxRecord || h + skip + need - t > Size) {
+    overflows.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  if (skip > 0) {
+    memcpy(buffer + offset, &Wrap, Header);
+    offset = 0;
+  }
+  uint16_t header = length;
+  memcpy(buffer + offset, &header, Header);
+  memcpy(buffer + offset + Header, data, length);
+
+  h += skip + need;
+  head.store(h, std::memory_order_release);
+  pushed.fetch_add(1, std::memory_order_relaxed);
+  if (h - t > highWater.load(std::memory_order_relaxed))
+    highWater.store(h - t, std::memory_order_relaxed);
+  return true;
+}
+
+template <size_t Size>
+const uint8_t* SpscRing<Size>::front(size_t& length) {
+  size_t t = tail.load(std::memory_order_relaxed);
+  size_t h = head.load(std::memory_order_acquire);
+  while (t != h) {
+    size_t offset = t & (Size - 1);
+    uint16_t header;
+    memcpy(&header, buffer + offset, Header);
+    if (header != Wrap) {
+      length = header;
+      return buffer + offset + Header;
+    }
+    t += Size - offset;
+    tail.store(t, std::memory_order_release);
+  }
+  return nullptr;
+}
+
+template <size_t Size>
+void SpscRing<Size>::pop() {
+  size_t t = tail.load(std::memory_order_relaxed);
+  uint16_t header;
+  memcpy(&header, buffer + (t & (Size - 1)), Header);
+  tail.store(t + recordSize(header), std::memory_order_release);
+}
+
+#endif
@@ -3,21 +3,101 @@
 
 #include <Arduino.h>
 #include <BLEDevice.h>
-#include <mutex>
-#include <queue>
+#include <atomic>
 #include <string>
 #include <unordered_map>
 
+#include "BleCapture.hh"
+#include "CommandQueue.hh"
+#include "CommandTracker.hh"
+#include "EkgDecoder.hh"
+#include "Snapshot.hh"
+#include "SpscRing.hh"
+#include "Trace.hh"
+
 class StaggKettle : public BLEClientCallbacks,
                     public BLEAdvertisedDeviceCallbacks {
  public:
   // Some constants...
   enum State { Inactive, Scanning, Found, Connecting, Connected };
   static const char* StateStrings[5];
-  const int RetryDelay = 5000; // 5s
-  enum Command { On, Off, Set };
+  // Failed attempts back off from MinRetryDelay, doubling up to
+  // MaxRetryDelay; losing a working link retries at once.
+  static const unsigned long MinRetryDelay = 250;
+  static const unsigned long MaxRetryDelay = 30000;
+  static const uint32_t ScanSeconds = 5;
+  // At most this many kettles can take notifications at once.
+  static const int MaxKettles = 4;
+  static const size_t RxQueueBytes = 2048;
+  typedef CommandQueue::Command Command;
   enum TempUnits { Fahrenheit, Celsius };
 
+  // Where the kettle was last found, kept across reboots (see setLink()) so
+  // reconnecting doesn't need a scan.
+  struct Link {
+    char name[32] = {};
+    char address[18] = {};  // "aa:bb:cc:dd:ee:ff"
+    uint8_t addressType = 0;
+    uint16_t handle = 0;  // Of the serial characteristic.
+
+    bool valid() const { return address[0] != 0; }
+    bool operator==(const Link& other) const {
+      return strcmp(name, other.name) == 0 &&
+             strcmp(address, other.address) == 0 &&
+             addressType == other.addressType && handle == other.handle;
+    }
+    bool operator!=(const Link& other) const { return !(*this == other); }
+  };
+
+  // Time to connected is from boot, or from losing the link, to the serial
+  // characteristic being ready.
+  struct ConnectStats {
+    unsigned long connects = 0;
+    unsigned long direct = 0;  // Of those, by address rather than own scan.
+    unsigned long scans = 0;
+    unsigned long failures = 0;  // Attempts and scans that found nothing.
+    unsigned long bootTime = 0;  // ms
+    unsigned long lastTime = 0;  // ms
+    unsigned long maxTime = 0;   // ms, after a drop.
+  };
+
+  // Everything other tasks may want to know about the kettle, published by
+  // loop() as a Snapshot whenever some of it changes.
+  struct Status {
+    enum Field {
+      StateField,
+      NameField,
+      PowerField,
+      LiftedField,
+      HoldField,
+      UnitsField,
+      CurrentTempField,
+      TargetTempField,
+      CountdownField,
+      AcksField,
+      DiagnosticsField,  // commands, rxHighWater, rxOverflows.
+      LinkField,
+      ConnectField,
+      Fields
+    };
+    State state = Inactive;
+    char name[32] = {};
+    bool power = false;
+    bool lifted = false;
+    bool hold = false;
+    TempUnits units = Fahrenheit;
+    byte currentTemp = 0;
+    byte targetTemp = 0;
+    unsigned int countdown = 0;
+    CommandTracker::Stats acks;
+    CommandQueue::Stats commands;
+    size_t rxHighWater = 0;
+    unsigned long rxOverflows = 0;
+    Link link;
+    ConnectStats connect;
+  };
+  typedef Snapshot<Status, Status::Fields> StatusSnapshot;
+
   StaggKettle();
   ~StaggKettle();
   
@@ -31,12 +111,53 @@ class StaggKettle : public BLEClientCallbacks,
   byte getCurrentTemp() const { return currentTemp; }
   byte getTargetTemp() const { return targetTemp; }
 
+  // Notification queue stats: most bytes ever queued, and notifications
+  // dropped because loop() fell behind.
+  size_t getRxHighWater() const { return rxNotifications.getHighWater(); }
+  unsigned long getRxOverflows() const {
+    return rxNotifications.getOverflows();
+  }
+
+  // The kettle to try first, e.g. as saved from an earlier Status::link.
+  // Call before the first loop().
+  void setLink(const Link& link);
+  // Whether the kettle scans for itself when it has no link to try. A
+  // KettleManager scans for all of its kettles instead, and hands them what
+  // it finds with assign().
+  void setScanning(bool scans) { this->scans = scans; }
+  // Inactive with no link worth trying: only a scan can help.
+  bool needsDevice() const {
+    return state == Inactive && (!link.valid() || !tryDirect);
+  }
+  const Link& getLink() const { return link; }
+  // Connects to link on the next loop(). Call from the task running loop().
+  void assign(const Link& link);
+  // Whether an advertiser is a kettle, and where to find it.
+  static bool isKettle(BLEAdvertisedDevice& device);
+  static Link linkTo(BLEAdvertisedDevice& device);
   void scan();
+  // Connects to the device found by scan(), or else to the cached link.
   bool connectToServer();
   void setTemp(byte temp);
-  void on() { qCommands.push(Command::On); }
-  void off() { qCommands.push(Command::Off); }
+  void on() { commands.push(Command::On); }
+  void off() { commands.push(Command::Off); }
+  CommandQueue::Stats getCommandStats() { return commands.getStats(); }
+  // Confirmation of sent commands by the kettle's state frames. Only safe to
+  // read from the task calling loop().
+  const CommandTracker::Stats& getCommandAcks() const {
+    return acks.getStats();
+  }
   void loop();
+  // Safe to read from any task.
+  const StatusSnapshot& getStatus() const { return status; }
+  // Records every raw notification into capture, on the given channel; null
+  // stops. Set it before connecting.
+  void setCapture(BleCapture* capture, uint8_t channel = 0) {
+    this->capture = capture;
+    captureChannel = channel;
+  }
+  // Decodes notifications queued by onNotify, called at the top of loop().
+  void processNotifications();
 
   // BLE callbacks
   void onResult(BLEAdvertisedDevice advertisedDevice);
@@ -51,34 +172,50 @@ class StaggKettle : public BLEClientCallbacks,
   byte sequence = 0;
   byte currentTemp = 0;
   byte targetTemp = 0;
-  byte userTemp = 0;
   bool lifted = false;
   bool power = false;
   bool hold = false;
   TempUnits units = TempUnits::Fahrenheit;
-  unsigned int countdown;
+  unsigned int countdown = 0;
 
   // kettle data states
-  uint8_t buffer[64];
-  int bufferPos = 0;
-  int bufferState = 0;
+  SpscRing<RxQueueBytes> rxNotifications;
+  Trace::Mark rxWait;  // Oldest queued notification, for Trace.
+  EkgDecoder decoder;
   std::unordered_map<uint8_t, uint8_t*> unknownStates;
+  BleCapture* capture = nullptr;
+  uint8_t captureChannel = 0;
 
   // BLE state
-  BLEScan* pBLEScan;
-  BLEAdvertisedDevice* pDevice;
-  BLERemoteService* pRemoteService;
-  BLERemoteCharacteristic* prcKettleSerial;
-  BLEClient* pClient;
+  BLEScan* pBLEScan = nullptr;
+  BLEAdvertisedDevice* pDevice = nullptr;
+  BLERemoteService* pRemoteService = nullptr;
+  BLERemoteCharacteristic* prcKettleSerial = nullptr;
+  BLEClient* pClient = nullptr;
   std::string name;
+  Link link;
+  // Whether the next attempt goes straight to link; cleared when that
+  // fails, so the kettle is looked for again.
+  bool tryDirect = true;
+  bool scans = true;
+  int notifier = -1;  // Slot in the notifier table.
+  bool linked = false;  // Up to the serial characteristic.
+  unsigned long retryDelay = 0;
+  unsigned long timeLinkLost = 0;
+  ConnectStats connectStats;
 
   // Device state
   unsigned long timeLastCommand;
-  unsigned long timeStateChange;
-  std::queue<Command> qCommands;
-  std::mutex mtxState;
+  unsigned long timeStateChange = 0;
+  CommandQueue commands;
+  CommandTracker acks;
+  StatusSnapshot status;
+  Status published;
 
-  void parseEvent(const uint8_t* data, size_t length, bool debug);
-  void sendCommand(Command cmd);
+  void parseEvent(const uint8_t* data, size_t length);
+  bool sendCommand(Command cmd, byte value);
+  void retryLater(unsigned long timeNow);
+  void onLinked(unsigned long timeNow, bool direct);
+  void publishStatus();
 };
 #endif
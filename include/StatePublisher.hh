@@ -0,0 +1,102 @@
+#ifndef __STATEPUBLISHER_H__
+#define __STATEPUBLISHER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+class CborWriter;
+
+// Decides when to upload kettle status and what to send. Tracks which fields
+// changed since the last acknowledged upload and builds a JSON object with
+// only those, for a PATCH (Firebase.updateNode) instead of a full setJSON.
+//
+// Uploads are coalesced: at most one per minInterval, and only once some
+// changed field has waited its own maxLatency. So a power change goes out at
+// the next slot, while currentTemp ticking up during a boil is batched.
+class StatePublisher {
+ public:
+  static const int MaxFields = 16;
+
+  struct Stats {
+    unsigned long changes = 0;     // Field value changes seen.
+    unsigned long uploads = 0;     // Acknowledged uploads.
+    unsigned long failures = 0;    // Uploads that failed and will be retried.
+    unsigned long fieldsSent = 0;
+    unsigned long bytesSent = 0;   // Payload bytes, JSON or CBOR.
+    unsigned long fullBytes = 0;   // What full snapshots would have cost.
+    // Field changes that didn't need an upload of their own.
+    unsigned long requestsSaved() const {
+      return changes > uploads ? changes - uploads : 0;
+    }
+  };
+
+  StatePublisher(unsigned long minInterval) : minInterval(minInterval) {}
+
+  // Registers a field; returns its id, or -1 if there's no room.
+  int addBool(const char* name, unsigned long maxLatency);
+  int addInt(const char* name, unsigned long maxLatency);
+
+  void set(int field, long value, unsigned long timeNow);
+
+  // Whether an upload should happen now.
+  bool due(unsigned long timeNow) const;
+  // JSON object with the changed fields (or all of them after resync()),
+  // plus "lastUpdated". Call acknowledge() with the outcome.
+  std::string delta(unsigned long timeNow);
+  // The same as a CBOR map written into buffer, without allocating. Returns
+  // its size, or 0 if it didn't fit (then nothing counts as sent).
+  size_t delta(uint8_t* buffer, size_t capacity, unsigned long timeNow);
+  void acknowledge(bool ok, unsigned long timeNow);
+  // Send everything on the next upload, e.g. after the path changed.
+  void resync();
+
+  // Several publishers can share one upload, a multi-location update (a
+  // PATCH of the database root, keyed by full paths). Whether this one has
+  // anything to add:
+  bool pending() const;
+  // Picks the fields to send; returns how many entries append() will add,
+  // lastUpdated included, e.g. for the CBOR map header.
+  int prepare() { return select() + 1; }
+  // Adds them with each key prefixed by path, e.g. "EKG-1/status/", to a
+  // JSON object being written (after its "{" and any other entries), or to
+  // a CBOR map. Returns false if a key didn't fit MaxKey. Then
+  // acknowledge() as usual.
+  static const size_t MaxKey = 64;
+  void append(std::string& json, const char* path, unsigned long timeNow);
+  bool append(CborWriter& out, const char* path, unsigned long timeNow);
+
+  const Stats& getStats() const { return stats; }
+
+ private:
+  struct Field {
+    const char* name;
+    bool isBool;
+    unsigned long maxLatency;
+    long value;
+    long acked;
+    bool known;       // acked holds what the server has.
+    bool sending;     // Included in the upload awaiting acknowledge().
+    long sentValue;
+    bool dirty;
+    unsigned long timeDirty;
+  };
+
+  Field fields[MaxFields];
+  int count = 0;
+  unsigned long minInterval;
+  unsigned long timeLastUpload = 0;
+  bool uploaded = false;
+  Stats stats;
+
+  int add(const char* name, bool isBool, unsigned long maxLatency);
+  // Marks the dirty fields as going out with this upload; returns how many.
+  int select();
+  static void append(std::string& json, const Field& f, long value,
+                     const char* path = "");
+  static void write(CborWriter& out, const Field& f,
+                    const char* key = nullptr);
+};
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef __STATUSSCREEN_H__
+#define __STATUSSCREEN_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "StaggKettle.hh"
+
+#include <Wire.h>
+
+// The kettle and scale status on the 128x64 SSD1306, laid out in fixed
+// lines. Text is blitted a glyph at a time from a font stored in the
+// panel's own column format, into a framebuffer of 8 pages of 128 columns.
+// flush() compares it with what the panel was last sent and only sends the
+// columns that changed, one window per page, so a new temperature costs a
+// few dozen bytes on the I2C bus instead of the whole 1KB frame.
+class StatusScreen {
+ public:
+  static const int Width = 128;
+  static const int Pages = 8;  // 8 rows of pixels each.
+  static const int GlyphWidth = 6;  // 5 columns and a space.
+  static const int Columns = Width / GlyphWidth;
+  // Bytes per I2C write after the control byte, as the Adafruit library
+  // sends them.
+  static const size_t Chunk = 31;
+
+  // Where the bytes go. write() is one I2C transaction: the control byte
+  // (0x00 for commands, 0x40 for data) followed by up to Chunk bytes.
+  class Bus {
+   public:
+    virtual ~Bus() {}
+    virtual bool write(uint8_t control, const uint8_t* bytes, size_t n) = 0;
+  };
+
+  struct Stats {
+    unsigned long flushes = 0;  // That sent anything.
+    unsigned long pages = 0;
+    unsigned long bytes = 0;  // On the bus, address and control included.
+    unsigned long transactions = 0;
+  };
+
+  StatusScreen(Bus& bus) : bus(bus) {}
+
+  void showKettle(const StaggKettle::Status& kettle);
+  // calOunces is the point being calibrated, or negative when not.
+  void showScale(int fill, float calOunces);
+  // Draws text on a line, clearing the rest of it from column on.
+  void text(int page, int column, const char* s);
+
+  // Sends whatever changed; returns false if the bus failed, leaving it to
+  // be sent next time.
+  bool flush();
+  // The panel's contents are unknown (e.g. after the splash screen); the
+  // next flush sends everything.
+  void invalidate() { valid = false; }
+
+  const uint8_t* getFrame() const { return &frame[0][0]; }
+  const Stats& getStats() const { return stats; }
+
+ private:
+  Bus& bus;
+  uint8_t frame[Pages][Width] = {};
+  uint8_t shown[Pages][Width] = {};  // What the panel has.
+  bool valid = false;
+  Stats stats;
+
+  bool send(uint8_t control, const uint8_t* bytes, size_t n);
+};
+
+// The SSD1306 on Wire, already set up by Adafruit_SSD1306::begin().
+class WireDisplayBus : public StatusScreen::Bus {
+ public:
+  WireDisplayBus(TwoWire& wire, uint8_t address)
+      : wire(wire), address(address) {}
+  bool write(uint8_t control, const uint8_t* bytes, size_t n) override;
+
+ private:
+  TwoWire& wire;
+  uint8_t address;
+};
+
+#endif
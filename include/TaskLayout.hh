@@ -0,0 +1,23 @@
+#ifndef __TASKLAYOUT_H__
+#define __TASKLAYOUT_H__
+
+#include "PinnedTask.hh"
+
+// Where the bridge's work runs. Core 0 also carries the WiFi and BLE stacks
+// at high priority, so only the cloud link and the log's drain go there, at
+// low priority: they mostly wait on the network and the UART. Core 1 runs
+// the kettle state machine ahead of scale sampling, and the display last,
+// next to the Arduino loop() task (priority 1) that passes messages between
+// them all.
+namespace TaskLayout {
+// name, core, priority, stack bytes, period ms
+static const PinnedTask::Config Kettle = {"kettle", 1, 3, 4096, 10};
+static const PinnedTask::Config Scale = {"scale", 1, 2, 3072, 20};
+static const PinnedTask::Config Ui = {"ui", 1, 1, 4096, 50};
+// TLS needs a lot more stack than anything else.
+static const PinnedTask::Config Cloud = {"cloud", 0, 1, 12 * 1024, 20};
+// Priority 0 would be the idle task's.
+static const PinnedTask::Config Log = {"log", 0, 1, 3072, 20};
+}  // namespace TaskLayout
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef __TCPCONNECT_H__
+#define __TCPCONNECT_H__
+
+#include <stdint.h>
+
+// Plain socket calls under both TlsClient builds, mbedTLS on the board and
+// OpenSSL on the host, so the host tools run the same connect.
+
+// A TCP connection to host:port, tried address by address until timeout ms
+// have passed (the name lookup aside). Returns a non-blocking socket with
+// Nagle off, or -1.
+int tcpConnect(const char* host, uint16_t port, unsigned long timeout);
+
+// Waits up to timeout ms for the socket to become readable, or writable;
+// false when it didn't.
+bool tcpWait(int fd, bool write, unsigned long timeout);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef __TELEMETRYRELAY_H__
+#define __TELEMETRYRELAY_H__
+
+#include <Arduino.h>
+#include <Client.h>
+
+// Sends CBOR messages to native/tools/cbor_relay.py, which translates them to
+// Realtime Database REST calls. Keeps one keep-alive HTTP connection and
+// builds requests in fixed buffers, so a status upload doesn't touch the heap.
+class TelemetryRelay {
+ public:
+  static const unsigned long Timeout = 3000;
+
+  TelemetryRelay(Client& client, const char* host, uint16_t port)
+      : client(client), host(host), port(port) {}
+
+  // PATCH/PUT of a CBOR body to <path>.cbor. Returns the HTTP status, or 0
+  // if the relay couldn't be reached.
+  int send(const char* method, const char* path, const uint8_t* body,
+           size_t length);
+  // GET <path>.cbor into response; length is set to the body size, or 0 if
+  // it didn't fit.
+  int get(const char* path, uint8_t* response, size_t capacity,
+          size_t& length);
+
+  unsigned long getRequests() const { return requests; }
+  unsigned long getConnects() const { return connects; }
+  unsigned long getBytes() const { return bytes; }
+
+ private:
+  Client& client;
+  const char* host;
+  uint16_t port;
+  unsigned long requests = 0;
+  unsigned long connects = 0;
+  unsigned long bytes = 0;
+
+  int request(const char* method, const char* path, const uint8_t* body,
+              size_t length, uint8_t* response, size_t capacity,
+              size_t& responseLength);
+  bool readLine(char* line, size_t capacity);
+  bool readBytes(uint8_t* data, size_t length);
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef __TLSCLIENT_H__
+#define __TLSCLIENT_H__
+
+#include <Arduino.h>
+#include <Client.h>
+
+// TLS client that keeps its session when the connection closes, so the next
+// connect() to the same host resumes it (session ticket or session ID)
+// instead of paying for a full handshake. Counts full and resumed handshakes
+// and how long they took.
+//
+// mbedTLS on the board (src/TlsClient.cc), OpenSSL on the host
+// (native/src/TlsClient.cc).
+class TlsClient : public Client {
+ public:
+  struct Stats {
+    unsigned long full = 0;
+    unsigned long resumed = 0;
+    unsigned long failed = 0;
+    unsigned long lastHandshakeTime = 0;  // ms
+    unsigned long maxHandshakeTime = 0;
+    unsigned long totalFullTime = 0;
+    unsigned long totalResumedTime = 0;
+  };
+
+  TlsClient();
+  ~TlsClient();
+
+  // Skip certificate verification, as WiFiClientSecure::setInsecure().
+  void setInsecure() { insecure = true; }
+  void setCACert(const char* pem) { caCert = pem; }
+  // Bounds connect(), TCP connect and handshake together; 10 s by default.
+  void setConnectTimeout(unsigned long ms) { connectTimeout = ms; }
+  // Drop the saved session; the next connect() does a full handshake.
+  void forgetSession();
+
+  // Has mbedTLS allocate its record buffers (the big allocations) in PSRAM,
+  // for every TLS connection including the ones made by libraries. Call once
+  // at startup, before any TLS context exists. Returns false where that isn't
+  // possible (no PSRAM, or on the host).
+  static bool usePsram();
+
+  int connect(const char* host, uint16_t port) override;
+  size_t write(const uint8_t* buf, size_t size) override;
+  int available() override;
+  int read(uint8_t* buf, size_t size) override;
+  void stop() override;
+  uint8_t connected() override;
+#ifdef ESP32
+  // The rest of the Arduino Client interface.
+  int connect(IPAddress ip, uint16_t port) override;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  int read() override;
+  int peek() override;
+  void flush() override {}
+  operator bool() override { return connected(); }
+#endif
+
+  const Stats& getStats() const { return stats; }
+
+ private:
+  struct Impl;
+  Impl* impl;
+  Stats stats;
+  bool insecure = false;
+  const char* caCert = nullptr;
+  unsigned long connectTimeout = 10000;
+
+  void handshakeDone(bool resumed, unsigned long timeStart);
+};
+
+#endif
@@ -0,0 +1,185 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+#include "LatencyHistogram.hh"
+
+#ifndef ESP32
+#include <time.h>
+#endif
+
+class CborWriter;
+
+// Latency probes on the bridge's hot paths, for seeing where a command's
+// time goes: each probe feeds a log-scale histogram in microseconds
+// (LatencyHistogram's buckets), and a few counters count what passes. All
+// of it is lock-free, a relaxed atomic add or two per probe, so probes can
+// sit in the BLE callback and the sampler timer.
+//
+// The TRACE_* macros are what the bridge calls, and compile to nothing
+// unless BRIDGE_TRACE is defined. The totals are kept from boot; the main
+// loop prints them with its stats and, every tracePublishInterval, sends
+// them to /bridge/trace along with a status upload.
+namespace Trace {
+
+enum Probe {
+  NotifyWait,      // BLE notification arrival until the kettle task decodes
+                   // it; the oldest in each batch.
+  Decode,          // Decoding one notification's frames.
+  CommandHandoff,  // Cloud command claimed until the kettle task has it.
+  CommandQueued,   // In the kettle's CommandQueue until sent, to the ms.
+  Write,           // writeValue() of a kettle command.
+  CloudRequest,    // One RtdbClient request, connecting included.
+  LoopPass,        // A main loop() pass, without its sleep; as loopTimes,
+                   // but from boot.
+  AdcSample,       // One FSR sample in the sampler's timer callback.
+  Probes
+};
+
+enum Counter { Notifications, NotifyBytes, Frames, Counters };
+
+const char* name(Probe probe);
+const char* name(Counter counter);
+
+// A cheap timestamp for spans within one task: CPU cycles on the ESP32
+// (per core, but tasks are pinned), steady nanoseconds on the host. Wraps
+// after about 17s on the ESP32; longer spans use micros().
+inline uint32_t ticks() {
+#ifdef ESP32
+  return ESP.getCycleCount();
+#else
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint32_t)((uint64_t)t.tv_sec * 1000000000ull + t.tv_nsec);
+#endif
+}
+
+inline uint32_t ticksPerMicro() {
+#ifdef ESP32
+  return CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ;
+#else
+  return 1000;
+#endif
+}
+
+class Histogram {
+ public:
+  // The max is exact with one writer per probe, as the bridge has; racing
+  // writers can lose a max but never a count.
+  void record(uint32_t micros) {
+    counts[LatencyHistogram::bucket(micros)].fetch_add(
+        1, std::memory_order_relaxed);
+    if (micros > max.load(std::memory_order_relaxed))
+      max.store(micros, std::memory_order_relaxed);
+  }
+  // Adds what's been recorded to out.
+  void read(LatencyHistogram& out) const;
+  void reset();
+
+ private:
+  std::atomic<uint32_t> counts[LatencyHistogram::Buckets] = {};
+  std::atomic<uint32_t> max{0};
+};
+
+extern Histogram histograms[Probes];
+extern std::atomic<uint32_t> counters[Counters];
+
+inline void record(Probe probe, uint32_t micros) {
+  histograms[probe].record(micros);
+}
+
+inline void count(Counter counter, uint32_t n = 1) {
+  counters[counter].fetch_add(n, std::memory_order_relaxed);
+}
+
+// Microseconds since a stamp of micros() | 1, which is never 0 so that 0 can
+// mean unstamped, but can be a microsecond ahead.
+inline uint32_t since(uint32_t stamp) {
+  return (uint32_t)micros() - (stamp & ~1u);
+}
+
+// Records the time from construction to the end of the scope.
+class Span {
+ public:
+  explicit Span(Probe probe) : probe(probe), start(ticks()) {}
+  ~Span() { record(probe, (ticks() - start) / ticksPerMicro()); }
+
+ private:
+  const Probe probe;
+  const uint32_t start;
+};
+
+// The same in micros(), for spans that block.
+class LongSpan {
+ public:
+  explicit LongSpan(Probe probe) : probe(probe), start(micros()) {}
+  ~LongSpan() { record(probe, micros() - start); }
+
+ private:
+  const Probe probe;
+  const uint32_t start;
+};
+
+// When the oldest of a batch handed from one task to another arrived: set
+// by the producer unless already set, taken by the consumer.
+class Mark {
+ public:
+  void set() {
+    uint32_t unset = 0;
+    stamp.compare_exchange_strong(unset, (uint32_t)micros() | 1,
+                                  std::memory_order_relaxed);
+  }
+  // Records the wait under probe, if anything arrived.
+  void take(Probe probe) {
+    uint32_t t = stamp.exchange(0, std::memory_order_relaxed);
+    if (t != 0) record(probe, since(t));
+  }
+
+ private:
+  std::atomic<uint32_t> stamp{0};  // 0 when unset
+};
+
+// Every probe and counter, e.g. "Trace decode us p50/p99/max: 3/7/40 over
+// 1200" for each probe that saw anything.
+void print(HardwareSerial& out);
+// Appends "key":{"decode":{"p50":3,"p99":7,"max":40,"n":1200},...,
+// "notifications":5} to a JSON object being built, after a comma if it
+// isn't the first member.
+void appendJson(std::string& body, const char* key);
+// The same as one CBOR map entry.
+void appendCbor(CborWriter& out, const char* key);
+// Back to nothing recorded.
+void reset();
+
+}  // namespace Trace
+
+#ifdef BRIDGE_TRACE
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SPAN(probe) \
+  Trace::Span TRACE_CONCAT(traceSpan, __LINE__)(Trace::probe)
+#define TRACE_LONG_SPAN(probe) \
+  Trace::LongSpan TRACE_CONCAT(traceSpan, __LINE__)(Trace::probe)
+#define TRACE_RECORD(probe, micros) Trace::record(Trace::probe, micros)
+#define TRACE_COUNT(counter, n) Trace::count(Trace::counter, n)
+#define TRACE_MARK(mark) (mark).set()
+#define TRACE_TAKE(probe, mark) (mark).take(Trace::probe)
+// Stamps a field to take a wait from later with Trace::since(); 0 is
+// unstamped.
+#define TRACE_STAMP(field) ((field) = (uint32_t)micros() | 1)
+#else
+#define TRACE_SPAN(probe)
+#define TRACE_LONG_SPAN(probe)
+#define TRACE_RECORD(probe, micros) do {} while (0)
+#define TRACE_COUNT(counter, n) do {} while (0)
+#define TRACE_MARK(mark) do {} while (0)
+#define TRACE_TAKE(probe, mark) do {} while (0)
+#define TRACE_STAMP(field) do {} while (0)
+#endif
+
+#endif
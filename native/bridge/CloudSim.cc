@@ -0,0 +1,208 @@
+#include "CloudSim.hh"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+
+#include <iterator>
+
+#include "JsonScan.hh"
+
+std::string CloudSim::normalize(const std::string& path) {
+  std::string p = path.substr(0, path.find('?'));
+  if (p.size() >= 5 && p.compare(p.size() - 5, 5, ".json") == 0)
+    p.resize(p.size() - 5);
+  size_t start = p.find_first_not_of('/');
+  if (start == std::string::npos) return "";
+  size_t end = p.find_last_not_of('/');
+  return p.substr(start, end - start + 1);
+}
+
+// FNV-1a of the value; Firebase's are opaque too.
+std::string CloudSim::etag(const std::string& value) {
+  uint64_t h = 14695981039346656037ull;
+  for (char c : value) {
+    h ^= (uint8_t)c;
+    h *= 1099511628211ull;
+  }
+  char buf[17];
+  snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)h);
+  return buf;
+}
+
+// Whether path is node or below it; everything is under the root, "".
+bool CloudSim::under(const std::string& path, const std::string& node) {
+  if (node.empty()) return true;
+  return path.compare(0, node.size(), node) == 0 &&
+         (path.size() == node.size() || path[node.size()] == '/');
+}
+
+void CloudSim::put(const std::string& path, const std::string& json) {
+  write(normalize(path), json);
+}
+
+std::string CloudSim::get(const std::string& path) const {
+  auto it = nodes.find(normalize(path));
+  return it == nodes.end() ? "null" : it->second;
+}
+
+void CloudSim::loop() {
+  unsigned long timeNow = millis();
+  for (Stream& s : streams)
+    if (timeNow - s.timeLastEvent >= KeepAliveInterval)
+      event(s, "keep-alive", "null");
+}
+
+void CloudSim::onConnect(HostNetwork::Connection& c) { stats.connects++; }
+
+void CloudSim::onReceive(HostNetwork::Connection& c) {
+  stats.bytesIn += c.received.size();
+  Request request;
+  while (parse(c.received, request)) handle(c, request);
+}
+
+void CloudSim::onClose(HostNetwork::Connection& c) {
+  for (size_t i = 0; i < streams.size();) {
+    if (streams[i].connection == &c) {
+      streams.erase(streams.begin() + i);
+    } else {
+      i++;
+    }
+  }
+}
+
+// Takes one whole request off the front of input, if it's all there.
+bool CloudSim::parse(std::string& input, Request& request) {
+  size_t headersEnd = input.find("\r\n\r\n");
+  if (headersEnd == std::string::npos) return false;
+  request = Request();
+  size_t contentLength = 0;
+  size_t pos = 0;
+  bool first = true;
+  while (pos < headersEnd) {
+    size_t eol = input.find("\r\n", pos);
+    std::string line = input.substr(pos, eol - pos);
+    pos = eol + 2;
+    if (first) {
+      first = false;
+      size_t space = line.find(' ');
+      request.method = line.substr(0, space);
+      size_t uriEnd = line.find(' ', space + 1);
+      request.path = normalize(line.substr(space + 1, uriEnd - space - 1));
+      continue;
+    }
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) continue;
+    std::string value = line.substr(colon + 1);
+    value.erase(0, value.find_first_not_of(' '));
+    line.resize(colon);
+    if (strcasecmp(line.c_str(), "Content-Length") == 0)
+      contentLength = strtoul(value.c_str(), nullptr, 10);
+    else if (strcasecmp(line.c_str(), "Accept") == 0)
+      request.stream = value == "text/event-stream";
+    else if (strcasecmp(line.c_str(), "X-Firebase-ETag") == 0)
+      request.wantEtag = true;
+    else if (strcasecmp(line.c_str(), "if-match") == 0)
+      request.ifMatch = value;
+  }
+  size_t bodyStart = headersEnd + 4;
+  if (input.size() < bodyStart + contentLength) return false;
+  request.body = input.substr(bodyStart, contentLength);
+  input.erase(0, bodyStart + contentLength);
+  return true;
+}
+
+void CloudSim::handle(HostNetwork::Connection& c, const Request& request) {
+  stats.requests++;
+  const std::string& path = request.path;
+  std::string current = get(path);
+  std::string tag = etag(current);
+
+  if (request.method == "GET" && request.stream) {
+    stats.streams++;
+    std::string headers =
+        "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n"
+        "Cache-Control: no-cache\r\n\r\n";
+    stats.bytesOut += headers.size();
+    c.send(headers, HostNetwork::roundTrip);
+    streams.push_back({&c, path, millis()});
+    event(streams.back(), "put", "{\"path\":\"/\",\"data\":" + current + "}");
+    return;
+  }
+  if (request.method == "GET") {
+    stats.gets++;
+    reply(c, 200, current, request.wantEtag ? tag : "");
+    return;
+  }
+  if (!request.ifMatch.empty() && request.ifMatch != tag) {
+    stats.conflicts++;
+    reply(c, 412, current, tag);
+    return;
+  }
+  if (request.method == "PUT") {
+    stats.puts++;
+    write(path, request.body);
+    reply(c, 200, request.body, request.wantEtag ? etag(request.body) : "");
+  } else if (request.method == "DELETE") {
+    stats.deletes++;
+    write(path, "null");
+    reply(c, 200, "null", request.wantEtag ? etag("null") : "");
+  } else if (request.method == "PATCH") {
+    stats.patches++;
+    bool ok = JsonScan::members(
+        request.body, [&](const std::string& key, const std::string& value) {
+          write(normalize(path + "/" + key), value);
+        });
+    if (ok)
+      reply(c, 200, request.body);
+    else
+      reply(c, 400, "{\"error\":\"Invalid data; couldn't parse JSON object.\"}");
+  } else {
+    reply(c, 405, "{\"error\":\"Method not allowed\"}");
+  }
+}
+
+void CloudSim::reply(HostNetwork::Connection& c, int code,
+                     const std::string& body, const std::string& etag) {
+  const char* reason = code == 200   ? "OK"
+                       : code == 412 ? "Precondition Failed"
+                                     : "Error";
+  std::string response = "HTTP/1.1 " + std::to_string(code) + " " + reason +
+                         "\r\nContent-Type: application/json\r\n"
+                         "Content-Length: " +
+                         std::to_string(body.size()) + "\r\n";
+  if (!etag.empty()) response += "ETag: " + etag + "\r\n";
+  response += "\r\n" + body;
+  stats.bytesOut += response.size();
+  c.send(response, HostNetwork::roundTrip);
+}
+
+// Replaces the node at path and everything below it, then tells the streams
+// that can see it.
+void CloudSim::write(const std::string& path, const std::string& value) {
+  // Keys starting with path sort together, but "a-b" comes between "a" and
+  // "a/b".
+  auto it = nodes.lower_bound(path);
+  while (it != nodes.end() && it->first.compare(0, path.size(), path) == 0)
+    it = under(it->first, path) ? nodes.erase(it) : std::next(it);
+  if (!JsonScan::isNull(value)) nodes[path] = value;
+
+  for (Stream& s : streams) {
+    if (under(path, s.path)) {
+      std::string relative = "/" + path.substr(s.path.size());
+      if (relative.size() > 1 && relative[1] == '/') relative.erase(0, 1);
+      event(s, "put", "{\"path\":\"" + relative + "\",\"data\":" + value + "}");
+    } else if (under(s.path, path)) {
+      event(s, "put", "{\"path\":\"/\",\"data\":" + get(s.path) + "}");
+    }
+  }
+}
+
+void CloudSim::event(Stream& s, const std::string& name,
+                     const std::string& data) {
+  std::string text = "event: " + name + "\ndata: " + data + "\n\n";
+  stats.events++;
+  stats.bytesOut += text.size();
+  s.timeLastEvent = millis();
+  s.connection->send(text, HostNetwork::roundTrip / 2);
+}
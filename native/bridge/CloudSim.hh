@@ -0,0 +1,87 @@
+#ifndef __CLOUDSIM_H__
+#define __CLOUDSIM_H__
+
+// An in-process Realtime Database for the bridge simulation, on a
+// HostNetwork: the REST and streaming parts of native/tools/rtdb_standin.py
+// that the bridge uses. GET, PUT, PATCH and DELETE on <path>.json, with
+// ETags and if-match (412 with the current value), and
+// event streams for GETs that accept text/event-stream, with a put event
+// for every write under the streamed node and keep-alives.
+//
+// Nodes hold whatever was written at exactly their path, raw, and a PATCH
+// writes each of its members at its own path below the target: enough for
+// the bridge's status fields and command node, without assembling trees.
+// Replies arrive a round trip after the request, events half of one after
+// the write.
+
+#include <HostNetwork.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+class CloudSim : public HostNetwork::Server {
+ public:
+  static const unsigned long KeepAliveInterval = 30000;
+
+  struct Stats {
+    unsigned long connects = 0;
+    unsigned long requests = 0;
+    unsigned long gets = 0;
+    unsigned long patches = 0;
+    unsigned long puts = 0;
+    unsigned long deletes = 0;
+    unsigned long conflicts = 0;
+    unsigned long streams = 0;
+    unsigned long events = 0;
+    unsigned long bytesIn = 0;
+    unsigned long bytesOut = 0;
+  };
+
+  // Another client's PUT, e.g. the app's command.
+  void put(const std::string& path, const std::string& json);
+  // The raw value at path, or "null".
+  std::string get(const std::string& path) const;
+  // Sends keep-alives that are due.
+  void loop();
+
+  const Stats& getStats() const { return stats; }
+
+  // HostNetwork::Server
+  void onConnect(HostNetwork::Connection& c) override;
+  void onReceive(HostNetwork::Connection& c) override;
+  void onClose(HostNetwork::Connection& c) override;
+
+ private:
+  struct Request {
+    std::string method;
+    std::string path;
+    std::string body;
+    bool stream = false;
+    bool wantEtag = false;
+    std::string ifMatch;
+  };
+
+  struct Stream {
+    HostNetwork::Connection* connection;
+    std::string path;
+    unsigned long timeLastEvent;
+  };
+
+  std::map<std::string, std::string> nodes;
+  std::vector<Stream> streams;
+  Stats stats;
+
+  static std::string normalize(const std::string& path);
+  static std::string etag(const std::string& value);
+  static bool under(const std::string& path, const std::string& node);
+
+  bool parse(std::string& input, Request& request);
+  void handle(HostNetwork::Connection& c, const Request& request);
+  void reply(HostNetwork::Connection& c, int code, const std::string& body,
+             const std::string& etag = "");
+  void write(const std::string& path, const std::string& value);
+  void event(Stream& s, const std::string& name, const std::string& data);
+};
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef __NATIVE_ADAFRUIT_SSD1306_H__
+#define __NATIVE_ADAFRUIT_SSD1306_H__
+
+// Host stand-in for the parts of the Adafruit SSD1306 driver the bridge uses
+// to set the panel up; drawing goes through StatusScreen.
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#define SSD1306_EXTERNALVCC 0x01
+#define SSD1306_SWITCHCAPVCC 0x02
+
+class Adafruit_SSD1306 {
+ public:
+  Adafruit_SSD1306(uint8_t w, uint8_t h, TwoWire* twi = &Wire,
+                   int8_t rst_pin = -1) {}
+  bool begin(uint8_t switchvcc = SSD1306_SWITCHCAPVCC, uint8_t i2caddr = 0,
+             bool reset = true, bool periphBegin = true) {
+    return true;
+  }
+  void display() {}
+};
+
+#endif
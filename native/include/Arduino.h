@@ -0,0 +1,122 @@
+#ifndef __NATIVE_ARDUINO_H__
+#define __NATIVE_ARDUINO_H__
+
+// Thin host-side stand-in for the parts of the Arduino core the bridge uses,
+// so the kettle/scale logic can be built and profiled on a Linux box.
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <functional>
+#include <string>
+
+typedef uint8_t byte;
+
+#define DEC 10
+#define HEX 16
+
+using std::max;
+using std::min;
+
+// See HostClock.h for simulated time.
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+uint16_t analogRead(uint8_t pin);
+// Host only: what analogRead() returns, e.g. a simulated sensor; 0 until set.
+void setAnalogSource(std::function<uint16_t(uint8_t pin)> source);
+
+class String {
+ public:
+  String(const char* s = "") : s(s ? s : "") {}
+  String(const std::string& s) : s(s) {}
+  String(char c) : s(1, c) {}
+  String(unsigned char v, unsigned char base = DEC);
+  String(int v, unsigned char base = DEC);
+  String(unsigned int v, unsigned char base = DEC);
+  String(long v, unsigned char base = DEC);
+  String(unsigned long v, unsigned char base = DEC);
+  String(double v, unsigned char decimals = 2);
+
+  const char* c_str() const { return s.c_str(); }
+  unsigned int length() const { return s.size(); }
+
+  String& operator+=(const String& rhs) {
+    s += rhs.s;
+    return *this;
+  }
+  friend String operator+(const String& lhs, const String& rhs) {
+    return String(lhs.s + rhs.s);
+  }
+  friend String operator+(const char* lhs, const String& rhs) {
+    return String(std::string(lhs) + rhs.s);
+  }
+  friend String operator+(const String& lhs, const char* rhs) {
+    return String(lhs.s + rhs);
+  }
+  bool operator==(const String& rhs) const { return s == rhs.s; }
+
+ private:
+  std::string s;
+};
+
+// Serial output is dropped until begin() is called, so benchmarks measure the
+// cost of formatting log messages without flooding the terminal.
+class HardwareSerial {
+ public:
+  void begin(unsigned long baud) { enabled = true; }
+  void end() { enabled = false; }
+  // Nothing is ever typed on the host.
+  int available() { return 0; }
+  int read() { return -1; }
+  // Nor does the host's console ever make a writer wait.
+  int availableForWrite() { return 4096; }
+
+  size_t write(uint8_t c) { return print((char)c); }
+  size_t write(const uint8_t* buf, size_t size);
+  size_t print(const char* s);
+  size_t print(const String& s) { return print(s.c_str()); }
+  size_t print(char c);
+  size_t print(int v, int base = DEC) { return print(String((long)v, base)); }
+  size_t print(unsigned int v, int base = DEC) {
+    return print(String((unsigned long)v, base));
+  }
+  size_t print(long v, int base = DEC) { return print(String(v, base)); }
+  size_t print(unsigned long v, int base = DEC) {
+    return print(String(v, base));
+  }
+  size_t print(unsigned char v, int base = DEC) {
+    return print(String((unsigned long)v, base));
+  }
+  size_t print(double v, int decimals = 2) { return print(String(v, decimals)); }
+
+  size_t println() { return print("\n"); }
+  template <typename T>
+  size_t println(const T& v) {
+    return print(v) + println();
+  }
+  template <typename T>
+  size_t println(const T& v, int fmt) {
+    return print(v, fmt) + println();
+  }
+
+ private:
+  bool enabled = false;
+};
+
+extern HardwareSerial Serial;
+
+class EspClass {
+ public:
+  // The host has no fixed heap to run out of.
+  uint32_t getFreeHeap() { return 0; }
+};
+
+extern EspClass ESP;
+
+#endif
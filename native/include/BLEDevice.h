@@ -0,0 +1,255 @@
+#ifndef __NATIVE_BLEDEVICE_H__
+#define __NATIVE_BLEDEVICE_H__
+
+// Host-side stand-in for the ESP32 BLE client API. Nothing here talks to a
+// radio: characteristics just remember their notify callback and hand writes
+// to an optional hook, which is enough to drive StaggKettle from a harness.
+
+#include <Arduino.h>
+#include <HostClock.h>
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class BLEClient;
+class BLERemoteCharacteristic;
+
+enum esp_ble_addr_type_t {
+  BLE_ADDR_TYPE_PUBLIC = 0,
+  BLE_ADDR_TYPE_RANDOM = 1,
+  BLE_ADDR_TYPE_RPA_PUBLIC = 2,
+  BLE_ADDR_TYPE_RPA_RANDOM = 3
+};
+
+// Controller memory is the board's concern.
+enum esp_bt_mode_t { ESP_BT_MODE_BLE = 1, ESP_BT_MODE_CLASSIC_BT = 2 };
+inline int esp_bt_controller_mem_release(esp_bt_mode_t mode) { return 0; }
+
+class BLEUUID {
+ public:
+  BLEUUID() {}
+  BLEUUID(const char* uuid) : uuid(uuid) {}
+  std::string toString() const { return uuid; }
+  bool equals(const BLEUUID& other) const { return uuid == other.uuid; }
+
+ private:
+  std::string uuid;
+};
+
+class BLEAddress {
+ public:
+  BLEAddress(const std::string& address = "") : address(address) {}
+  std::string toString() const { return address; }
+  bool equals(const BLEAddress& other) const {
+    return address == other.address;
+  }
+
+ private:
+  std::string address;
+};
+
+class BLEAdvertisedDevice {
+ public:
+  BLEAdvertisedDevice() {}
+  BLEAdvertisedDevice(const std::string& name, const BLEAddress& address,
+                      const BLEUUID& serviceUUID,
+                      esp_ble_addr_type_t addressType = BLE_ADDR_TYPE_PUBLIC)
+      : name(name),
+        address(address),
+        serviceUUID(serviceUUID),
+        addressType(addressType) {}
+
+  std::string getName() const { return name; }
+  BLEAddress getAddress() const { return address; }
+  esp_ble_addr_type_t getAddressType() const { return addressType; }
+  bool haveServiceUUID() const { return !serviceUUID.toString().empty(); }
+  bool isAdvertisingService(const BLEUUID& uuid) const {
+    return serviceUUID.equals(uuid);
+  }
+
+ private:
+  std::string name;
+  BLEAddress address;
+  BLEUUID serviceUUID;
+  esp_ble_addr_type_t addressType = BLE_ADDR_TYPE_PUBLIC;
+};
+
+class BLEAdvertisedDeviceCallbacks {
+ public:
+  virtual ~BLEAdvertisedDeviceCallbacks() {}
+  virtual void onResult(BLEAdvertisedDevice advertisedDevice) = 0;
+};
+
+class BLEClientCallbacks {
+ public:
+  virtual ~BLEClientCallbacks() {}
+  virtual void onConnect(BLEClient* pclient) = 0;
+  virtual void onDisconnect(BLEClient* pclient) = 0;
+};
+
+typedef std::function<void(BLERemoteCharacteristic*, uint8_t*, size_t, bool)>
+    notify_callback;
+
+class BLERemoteCharacteristic {
+ public:
+  BLERemoteCharacteristic(const BLEUUID& uuid) : uuid(uuid) {}
+
+  BLEUUID getUUID() const { return uuid; }
+  uint16_t getHandle() const { return 0x002a; }
+  bool canNotify() const { return true; }
+  void registerForNotify(notify_callback callback) { notify = callback; }
+  void writeValue(uint8_t* data, size_t length, bool response = false);
+
+  // Host-only: deliver a notification as the BLE stack would.
+  void deliver(uint8_t* data, size_t length);
+  // Host-only: receives every writeValue() from the client side.
+  std::function<void(const uint8_t*, size_t)> onWrite;
+
+ private:
+  BLEUUID uuid;
+  notify_callback notify;
+};
+
+class BLERemoteService {
+ public:
+  BLERemoteService(const BLEUUID& uuid, BLEClient* client = nullptr)
+      : uuid(uuid), client(client) {}
+  ~BLERemoteService();
+
+  BLEUUID getUUID() const { return uuid; }
+  BLERemoteCharacteristic* getCharacteristic(const BLEUUID& uuid);
+  // Host-only: the characteristic, once the client asked for it.
+  BLERemoteCharacteristic* peek() const { return characteristic; }
+
+ private:
+  BLEUUID uuid;
+  BLEClient* client;
+  BLERemoteCharacteristic* characteristic = nullptr;
+};
+
+class BLEClient {
+ public:
+  ~BLEClient();
+  void setClientCallbacks(BLEClientCallbacks* callbacks) {
+    this->callbacks = callbacks;
+  }
+  bool connect(BLEAdvertisedDevice* device);
+  bool connect(BLEAddress address,
+               esp_ble_addr_type_t type = BLE_ADDR_TYPE_PUBLIC);
+  void disconnect();
+  bool isConnected() const { return connected; }
+  BLERemoteService* getService(const BLEUUID& uuid);
+
+  // Host-only: the last service handed out, until it's deleted.
+  BLERemoteService* service = nullptr;
+
+ private:
+  BLEClientCallbacks* callbacks = nullptr;
+  bool connected = false;
+};
+
+class BLEScanResults {};
+
+class BLEScan {
+ public:
+  void setAdvertisedDeviceCallbacks(BLEAdvertisedDeviceCallbacks* callbacks) {
+    this->callbacks = callbacks;
+  }
+  void setInterval(uint16_t interval) {}
+  void setWindow(uint16_t window) {}
+  void setActiveScan(bool active) {}
+  ~BLEScan() { stop(); }
+  // Blocks like the ESP32 one: until the duration is up or stop() is called
+  // from the callbacks.
+  BLEScanResults start(uint32_t duration, bool is_continue = false);
+  // Returns at once, scanning on another thread; scanCompleteCB may be null.
+  bool start(uint32_t duration, void (*scanCompleteCB)(BLEScanResults),
+             bool is_continue = false);
+  // Host-only: also waits for a scan started without blocking to finish,
+  // unless called from its own callbacks.
+  void stop();
+  void clearResults() {}
+
+ private:
+  BLEAdvertisedDeviceCallbacks* callbacks = nullptr;
+  std::atomic<bool> stopped{false};
+  HostThread worker;
+
+  void run(uint32_t duration);
+};
+
+// Host-only: the far end of a simulated peer, e.g. a simulated kettle. Its
+// callbacks run with the radio locked, so they mustn't wait for anything that
+// calls into the radio.
+class BLEHostPeripheral {
+ public:
+  virtual ~BLEHostPeripheral() {}
+  virtual void onConnect() {}
+  virtual void onDisconnect() {}
+  // A connected client wrote to the peer's characteristic.
+  virtual void onWrite(const uint8_t* data, size_t length) = 0;
+};
+
+// Host-only: the peripherals in range. Unless simulate() was called, scans
+// find nothing at once and connecting to any device succeeds, as before.
+// Otherwise a scan hears a present peer scanDelay ms after it started (or
+// after the peer appeared), connecting takes connectDelay ms, and
+// connecting to an address nobody answers at fails after connectTimeout.
+// A peer with a peripheral gets its clients' writes and can notify them.
+class BLEHostRadio {
+ public:
+  unsigned long scanDelay = 0;
+  unsigned long connectDelay = 0;
+  unsigned long connectTimeout = 0;
+
+  void simulate() { simulated = true; }
+  bool isSimulated() const { return simulated; }
+  void addPeer(const BLEAdvertisedDevice& device,
+               BLEHostPeripheral* peripheral = nullptr);
+  // Switches a peer on or off; switching it off drops its connections.
+  void setPresent(const BLEAddress& address, bool present);
+  // Drops every connection, as a link loss would.
+  void dropAll();
+  // Notifies the client connected to address, as the peer would; false if
+  // there's none or it hasn't got the characteristic yet.
+  bool notify(const BLEAddress& address, uint8_t* data, size_t length);
+  // The characteristic a client connected to address holds, or null.
+  BLERemoteCharacteristic* characteristic(const BLEAddress& address);
+
+  // Used by the shim.
+  bool hear(unsigned long scanStart, BLEAdvertisedDevice& device,
+            std::vector<std::string>& heard);
+  bool reachable(const BLEAddress& address);
+  void attach(BLEClient* client, const BLEAddress& address);
+  void detach(BLEClient* client);
+  BLEHostPeripheral* peripheral(BLEClient* client);
+  std::recursive_mutex& lock() { return mtx; }
+
+ private:
+  struct Peer {
+    BLEAdvertisedDevice device;
+    BLEHostPeripheral* peripheral;
+    bool present;
+    unsigned long since;  // When it last appeared.
+  };
+  std::recursive_mutex mtx;
+  bool simulated = false;
+  std::vector<Peer> peers;
+  std::vector<std::pair<BLEClient*, std::string>> links;
+
+  std::vector<BLEClient*> linked(const std::string& address);
+  BLEHostPeripheral* peripheral(const std::string& address);
+};
+
+class BLEDevice {
+ public:
+  static void init(std::string deviceName) {}
+  static BLEScan* getScan();
+  static BLEClient* createClient() { return new BLEClient(); }
+  static BLEHostRadio& radio();
+};
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef __NATIVE_CLIENT_H__
+#define __NATIVE_CLIENT_H__
+
+// The subset of the Arduino Client interface the cloud code uses, so it can
+// run over WiFiClientSecure on the board and plain sockets on the host.
+
+#include <Arduino.h>
+
+class Client {
+ public:
+  virtual ~Client() {}
+  virtual int connect(const char* host, uint16_t port) = 0;
+  virtual size_t write(const uint8_t* buf, size_t size) = 0;
+  virtual int available() = 0;
+  virtual int read(uint8_t* buf, size_t size) = 0;
+  virtual void stop() = 0;
+  virtual uint8_t connected() = 0;
+};
+
+#endif
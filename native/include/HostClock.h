@@ -0,0 +1,60 @@
+#ifndef __NATIVE_HOSTCLOCK_H__
+#define __NATIVE_HOSTCLOCK_H__
+
+// Time on the host. millis(), micros() and delay() normally follow the steady
+// clock. Between simulate() and realtime() they follow a virtual clock
+// instead, which only moves when everything is waiting in delay(): the
+// thread that called simulate() and every HostThread started since run as
+// coroutines on it, one at a time, and whoever wakes earliest goes next (on
+// a tie, whoever went to sleep first). A run is the same every time, and
+// hours of it take seconds.
+//
+// On the virtual clock, nothing may hold a lock across delay(): the others
+// run on the same thread and would find it taken. Threads other than these
+// read the virtual time, but their delay() sleeps in real time.
+
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <thread>
+
+class HostClock {
+ public:
+  // Starts the virtual clock at start ms, on the calling thread.
+  static void simulate(unsigned long start = 0);
+  // Back to the steady clock, carrying on from the virtual time. Threads
+  // still on the virtual clock are abandoned where they wait.
+  static void realtime();
+  static bool simulated();
+
+  // Coroutine switches since simulate().
+  static uint64_t getSwitches();
+  // Real time the calling coroutine has spent running, in us: what its work
+  // costs the host, without the others'.
+  static uint64_t getRunTime();
+};
+
+// A std::thread, or a coroutine if started on the virtual clock.
+class HostThread {
+ public:
+  struct Fiber;
+
+  HostThread() {}
+  explicit HostThread(std::function<void()> run);
+  HostThread(HostThread&& other) = default;
+  HostThread& operator=(HostThread&& other);
+  ~HostThread();
+
+  bool joinable() const;
+  // Whether the caller is this thread.
+  bool isCurrent() const;
+  // Waits for it to finish; returns at once if it was abandoned.
+  void join();
+
+ private:
+  std::thread thread;
+  std::shared_ptr<Fiber> fiber;
+};
+
+#endif
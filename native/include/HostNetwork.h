@@ -0,0 +1,78 @@
+#ifndef __NATIVE_HOSTNETWORK_H__
+#define __NATIVE_HOSTNETWORK_H__
+
+// An in-process network for simulations on the virtual clock (HostClock.h).
+// PosixClient and TlsClient connecting to a host and port that a Server
+// listens on get a Connection to it instead of a socket. Connecting takes a
+// round trip (TLS adds its handshake), requests reach the server at once and
+// what it sends arrives when it says. The whole network can go down, as
+// when the WiFi drops: every connection on it closes, and new ones fail.
+//
+// Everything on it runs on the virtual clock, one coroutine at a time, so it
+// takes no locks.
+
+#include <Arduino.h>
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+class HostNetwork {
+ public:
+  class Server;
+
+  class Connection {
+   public:
+    Connection(Server* server) : server(server) {}
+
+    // Server side. What the client sent that the server hasn't consumed.
+    std::string received;
+    // Queues data to arrive after ms.
+    void send(const std::string& data, unsigned long ms);
+    void close() { open = false; }
+
+    // Client side, as an Arduino Client.
+    size_t write(const uint8_t* buf, size_t size);
+    int available();
+    int read(uint8_t* buf, size_t size);
+    void stop();
+    bool connected();
+
+   private:
+    struct Segment {
+      unsigned long due;
+      std::string bytes;
+    };
+
+    Server* server;
+    bool open = true;
+    std::deque<Segment> pending;
+    size_t offset = 0;  // Into the first segment.
+
+    friend class HostNetwork;
+  };
+
+  class Server {
+   public:
+    virtual ~Server() {}
+    virtual void onConnect(Connection& c) {}
+    // New bytes are in c.received.
+    virtual void onReceive(Connection& c) = 0;
+    // Closed by the client or the network.
+    virtual void onClose(Connection& c) {}
+  };
+
+  // ms, for connecting; servers use it for their replies.
+  static unsigned long roundTrip;
+
+  static void listen(const char* host, uint16_t port, Server* server);
+  static bool serves(const char* host, uint16_t port);
+  // Null if the network is down.
+  static std::shared_ptr<Connection> connect(const char* host, uint16_t port);
+
+  static void setUp(bool up);
+  static bool isUp();
+};
+
+#endif
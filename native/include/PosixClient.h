@@ -0,0 +1,27 @@
+#ifndef __NATIVE_POSIXCLIENT_H__
+#define __NATIVE_POSIXCLIENT_H__
+
+#include <Client.h>
+#include <HostNetwork.h>
+
+#include <memory>
+
+// Plain TCP Client for talking to local stand-in servers from the host, or to
+// in-process ones on a HostNetwork.
+class PosixClient : public Client {
+ public:
+  ~PosixClient() { stop(); }
+  int connect(const char* host, uint16_t port) override;
+  size_t write(const uint8_t* buf, size_t size) override;
+  int available() override;
+  int read(uint8_t* buf, size_t size) override;
+  void stop() override;
+  uint8_t connected() override;
+
+ private:
+  int fd = -1;
+  bool eof = false;
+  std::shared_ptr<HostNetwork::Connection> sim;
+};
+
+#endif
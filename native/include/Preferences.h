@@ -0,0 +1,27 @@
+#ifndef __NATIVE_PREFERENCES_H__
+#define __NATIVE_PREFERENCES_H__
+
+// Host stand-in for the ESP32's NVS key-value store. Every Preferences shares
+// one in-memory store, which outlives them as flash outlives a reboot.
+
+#include <Arduino.h>
+
+#include <string>
+
+class Preferences {
+ public:
+  bool begin(const char* name, bool readOnly = false);
+  void end() { space.clear(); }
+
+  size_t getBytesLength(const char* key);
+  size_t getBytes(const char* key, void* buf, size_t maxLen);
+  size_t putBytes(const char* key, const void* value, size_t len);
+  double getDouble(const char* key, double defaultValue = NAN);
+  size_t putDouble(const char* key, double value);
+
+ private:
+  std::string space;
+  bool readOnly = false;
+};
+
+#endif
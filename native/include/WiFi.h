@@ -0,0 +1,61 @@
+#ifndef __NATIVE_WIFI_H__
+#define __NATIVE_WIFI_H__
+
+// Host stand-in for the ESP32 WiFi station. It connects as soon as it's
+// started, unless a simulation has taken the access point away with
+// setLink(false), which also takes the HostNetwork down; events go to the
+// onEvent() handlers as on the board.
+
+#include <Arduino.h>
+#include <PosixClient.h>
+
+#include <vector>
+
+class IPAddress {
+ public:
+  IPAddress() {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes{a, b, c, d} {}
+  String toString() const;
+
+ private:
+  uint8_t bytes[4] = {};
+};
+
+typedef PosixClient WiFiClient;
+
+enum wifi_mode_t { WIFI_MODE_NULL, WIFI_MODE_STA, WIFI_MODE_AP, WIFI_MODE_APSTA };
+
+enum WiFiEvent_t {
+  SYSTEM_EVENT_STA_DISCONNECTED = 5,
+  SYSTEM_EVENT_STA_GOT_IP = 7,
+};
+
+class WiFiClass {
+ public:
+  typedef void (*EventHandler)(WiFiEvent_t event);
+
+  void mode(wifi_mode_t mode) {}
+  void onEvent(EventHandler handler) { handlers.push_back(handler); }
+  bool config(IPAddress local, IPAddress gateway, IPAddress subnet,
+              IPAddress dns) {
+    return true;
+  }
+  void begin(const char* ssid, const char* pass);
+  void setAutoReconnect(bool autoReconnect) {}
+  bool isConnected() const { return connected; }
+
+  // Host only: the access point comes and goes.
+  void setLink(bool up);
+
+ private:
+  std::vector<EventHandler> handlers;
+  bool started = false;
+  bool link = true;
+  bool connected = false;
+
+  void update();
+};
+
+extern WiFiClass WiFi;
+
+#endif
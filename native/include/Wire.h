@@ -0,0 +1,32 @@
+#ifndef __NATIVE_WIRE_H__
+#define __NATIVE_WIRE_H__
+
+// Host stand-in for the I2C bus: transmissions always succeed, and only their
+// bytes are counted.
+
+#include <Arduino.h>
+
+class TwoWire {
+ public:
+  bool begin() { return true; }
+  void beginTransmission(uint8_t address) { bytes++; }
+  size_t write(uint8_t data) {
+    bytes++;
+    return 1;
+  }
+  size_t write(const uint8_t* data, size_t length) {
+    bytes += length;
+    return length;
+  }
+  uint8_t endTransmission() { return 0; }
+
+  // Host only: bytes on the bus, addresses included.
+  unsigned long getBytes() const { return bytes; }
+
+ private:
+  unsigned long bytes = 0;
+};
+
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,65 @@
+#include <Arduino.h>
+
+#include <stdio.h>
+
+HardwareSerial Serial;
+EspClass ESP;
+
+// Until a simulation sets one.
+static std::function<uint16_t(uint8_t)> analogSource;
+
+uint16_t analogRead(uint8_t pin) { return analogSource ? analogSource(pin) : 0; }
+
+void setAnalogSource(std::function<uint16_t(uint8_t pin)> source) {
+  analogSource = source;
+}
+
+static std::string formatInteger(unsigned long v, unsigned char base,
+                                 bool negative) {
+  if (base < 2 || base > 16) base = DEC;
+  char buf[8 * sizeof(long) + 2];
+  char* p = buf + sizeof(buf) - 1;
+  *p = '\0';
+  do {
+    *--p = "0123456789abcdef"[v % base];
+    v /= base;
+  } while (v != 0);
+  if (negative) *--p = '-';
+  return std::string(p);
+}
+
+String::String(unsigned char v, unsigned char base)
+    : s(formatInteger(v, base, false)) {}
+
+String::String(int v, unsigned char base) : String((long)v, base) {}
+
+String::String(unsigned int v, unsigned char base)
+    : s(formatInteger(v, base, false)) {}
+
+String::String(long v, unsigned char base)
+    : s(base == DEC && v < 0 ? formatInteger(-(unsigned long)v, base, true)
+                             : formatInteger((unsigned long)v, base, false)) {}
+
+String::String(unsigned long v, unsigned char base)
+    : s(formatInteger(v, base, false)) {}
+
+String::String(double v, unsigned char decimals) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+  s = buf;
+}
+
+size_t HardwareSerial::print(const char* s) {
+  if (!enabled) return 0;
+  return fputs(s, stdout) < 0 ? 0 : strlen(s);
+}
+
+size_t HardwareSerial::write(const uint8_t* buf, size_t size) {
+  if (!enabled) return 0;
+  return fwrite(buf, 1, size, stdout);
+}
+
+size_t HardwareSerial::print(char c) {
+  if (!enabled) return 0;
+  return fputc(c, stdout) < 0 ? 0 : 1;
+}
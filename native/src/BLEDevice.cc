@@ -0,0 +1,227 @@
+#include <BLEDevice.h>
+
+void BLERemoteCharacteristic::writeValue(uint8_t* data, size_t length,
+                                         bool response) {
+  if (onWrite) onWrite(data, length);
+}
+
+void BLERemoteCharacteristic::deliver(uint8_t* data, size_t length) {
+  if (notify) notify(this, data, length, true);
+}
+
+BLERemoteService::~BLERemoteService() {
+  std::lock_guard<std::recursive_mutex> lock(BLEDevice::radio().lock());
+  if (client != nullptr && client->service == this) client->service = nullptr;
+  delete characteristic;
+}
+
+BLERemoteCharacteristic* BLERemoteService::getCharacteristic(
+    const BLEUUID& uuid) {
+  if (characteristic == nullptr) {
+    characteristic = new BLERemoteCharacteristic(uuid);
+    BLEHostPeripheral* peripheral =
+        client != nullptr ? BLEDevice::radio().peripheral(client) : nullptr;
+    if (peripheral != nullptr)
+      characteristic->onWrite = [peripheral](const uint8_t* data,
+                                             size_t length) {
+        peripheral->onWrite(data, length);
+      };
+  }
+  return characteristic->getUUID().equals(uuid) ? characteristic : nullptr;
+}
+
+BLEClient::~BLEClient() { BLEDevice::radio().detach(this); }
+
+bool BLEClient::connect(BLEAdvertisedDevice* device) {
+  if (device != nullptr && BLEDevice::radio().isSimulated())
+    return connect(device->getAddress(), device->getAddressType());
+  connected = device != nullptr;
+  if (connected && callbacks != nullptr) callbacks->onConnect(this);
+  return connected;
+}
+
+bool BLEClient::connect(BLEAddress address, esp_ble_addr_type_t type) {
+  BLEHostRadio& radio = BLEDevice::radio();
+  if (radio.isSimulated()) {
+    if (!radio.reachable(address)) {
+      delay(radio.connectTimeout);
+      return false;
+    }
+    delay(radio.connectDelay);
+    // It may have gone while we were connecting.
+    if (!radio.reachable(address)) return false;
+    radio.attach(this, address);
+  }
+  connected = true;
+  if (callbacks != nullptr) callbacks->onConnect(this);
+  return true;
+}
+
+void BLEClient::disconnect() {
+  BLEDevice::radio().detach(this);
+  if (!connected) return;
+  connected = false;
+  if (callbacks != nullptr) callbacks->onDisconnect(this);
+}
+
+BLERemoteService* BLEClient::getService(const BLEUUID& uuid) {
+  if (!connected) return nullptr;
+  std::lock_guard<std::recursive_mutex> lock(BLEDevice::radio().lock());
+  service = new BLERemoteService(uuid, this);
+  return service;
+}
+
+BLEScanResults BLEScan::start(uint32_t duration, bool is_continue) {
+  if (worker.joinable()) worker.join();
+  stopped = false;
+  run(duration);
+  return BLEScanResults();
+}
+
+bool BLEScan::start(uint32_t duration, void (*scanCompleteCB)(BLEScanResults),
+                    bool is_continue) {
+  if (worker.joinable()) worker.join();
+  stopped = false;
+  worker = HostThread([this, duration, scanCompleteCB]() {
+    run(duration);
+    if (scanCompleteCB != nullptr) scanCompleteCB(BLEScanResults());
+  });
+  return true;
+}
+
+void BLEScan::run(uint32_t duration) {
+  BLEHostRadio& radio = BLEDevice::radio();
+  if (!radio.isSimulated()) return;
+  unsigned long timeStart = millis();
+  std::vector<std::string> heard;
+  while (!stopped && millis() - timeStart < duration * 1000) {
+    BLEAdvertisedDevice device;
+    if (radio.hear(timeStart, device, heard)) {
+      if (callbacks != nullptr) callbacks->onResult(device);
+      continue;
+    }
+    delay(10);
+  }
+}
+
+void BLEScan::stop() {
+  stopped = true;
+  if (worker.joinable() && !worker.isCurrent())
+    worker.join();
+}
+
+void BLEHostRadio::addPeer(const BLEAdvertisedDevice& device,
+                           BLEHostPeripheral* peripheral) {
+  std::lock_guard<std::recursive_mutex> lock(mtx);
+  peers.push_back({device, peripheral, true, millis()});
+}
+
+void BLEHostRadio::setPresent(const BLEAddress& address, bool present) {
+  std::lock_guard<std::recursive_mutex> lock(mtx);
+  for (Peer& peer : peers) {
+    if (!peer.device.getAddress().equals(address) || peer.present == present)
+      continue;
+    peer.present = present;
+    peer.since = millis();
+  }
+  if (!present)
+    for (BLEClient* client : linked(address.toString())) client->disconnect();
+}
+
+void BLEHostRadio::dropAll() {
+  std::lock_guard<std::recursive_mutex> lock(mtx);
+  for (BLEClient* client : linked("")) client->disconnect();
+}
+
+bool BLEHostRadio::notify(const BLEAddress& address, uint8_t* data,
+                          size_t length) {
+  std::lock_guard<std::recursive_mutex> lock(mtx);
+  BLERemoteCharacteristic* c = characteristic(address);
+  if (c == nullptr) return false;
+  c->deliver(data, length);
+  return true;
+}
+
+BLERemoteCharacteristic* BLEHostRadio::characteristic(
+    const BLEAddress& address) {
+  std::lock_guard<std::recursive_mutex> lock(mtx);
+  for (BLEClient* client : linked(address.toString()))
+    if (client->service != nullptr && client->service->peek() != nullptr)
+      return client->service->peek();
+  return nullptr;
+}
+
+bool BLEHostRadio::hear(unsigned long scanStart, BLEAdvertisedDevice& device,
+                        std::vector<std::string>& heard) {
+  std::lock_guard<std::recursive_mutex> lock(mtx);
+  unsigned long timeNow = millis();
+  for (const Peer& peer : peers) {
+    std::string address = peer.device.getAddress().toString();
+    unsigned long since = peer.since > scanStart ? peer.since : scanStart;
+    if (!peer.present || timeNow - since < scanDelay) continue;
+    bool known = false;
+    for (const std::string& h : heard) known = known || h == address;
+    if (known) continue;
+    heard.push_back(address);
+    device = peer.device;
+    return true;
+  }
+  return false;
+}
+
+bool BLEHostRadio::reachable(const BLEAddress& address) {
+  std::lock_guard<std::recursive_mutex> lock(mtx);
+  for (const Peer& peer : peers)
+    if (peer.present && peer.device.getAddress().equals(address)) return true;
+  return false;
+}
+
+void BLEHostRadio::attach(BLEClient* client, const BLEAddress& address) {
+  std::lock_guard<std::recursive_mutex> lock(mtx);
+  links.push_back({client, address.toString()});
+  BLEHostPeripheral* p = peripheral(address.toString());
+  if (p != nullptr) p->onConnect();
+}
+
+void BLEHostRadio::detach(BLEClient* client) {
+  std::lock_guard<std::recursive_mutex> lock(mtx);
+  for (size_t i = 0; i < links.size(); i++) {
+    if (links[i].first != client) continue;
+    BLEHostPeripheral* p = peripheral(links[i].second);
+    links.erase(links.begin() + i);
+    if (p != nullptr) p->onDisconnect();
+    return;
+  }
+}
+
+BLEHostPeripheral* BLEHostRadio::peripheral(BLEClient* client) {
+  std::lock_guard<std::recursive_mutex> lock(mtx);
+  for (const auto& link : links)
+    if (link.first == client) return peripheral(link.second);
+  return nullptr;
+}
+
+// Clients connected to an address, or to anything for "".
+std::vector<BLEClient*> BLEHostRadio::linked(const std::string& address) {
+  std::vector<BLEClient*> clients;
+  for (const auto& link : links)
+    if (address.empty() || link.second == address)
+      clients.push_back(link.first);
+  return clients;
+}
+
+BLEHostPeripheral* BLEHostRadio::peripheral(const std::string& address) {
+  for (const Peer& peer : peers)
+    if (peer.device.getAddress().toString() == address) return peer.peripheral;
+  return nullptr;
+}
+
+BLEScan* BLEDevice::getScan() {
+  static BLEScan scan;
+  return &scan;
+}
+
+BLEHostRadio& BLEDevice::radio() {
+  static BLEHostRadio radio;
+  return radio;
+}
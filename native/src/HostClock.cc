@@ -0,0 +1,242 @@
+#include <Arduino.h>
+#include <HostClock.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ucontext.h>
+
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <vector>
+
+// Each coroutine's stack; only the pages it touches are ever mapped.
+static const size_t StackBytes = 512 * 1024;
+
+struct HostThread::Fiber {
+  std::function<void()> run;
+  ucontext_t context;
+  void* stack = nullptr;  // None for the thread that called simulate().
+  uint64_t wake = 0;      // us
+  uint64_t order = 0;     // Goes first among those waking together.
+  bool done = false;
+  bool abandoned = false;
+  Fiber* joiner = nullptr;
+  // Real time spent running, in us, and when the current turn started.
+  uint64_t runTime = 0;
+  uint64_t turnStart = 0;
+
+  ~Fiber() { free(stack); }
+};
+typedef HostThread::Fiber Fiber;
+
+namespace {
+
+struct Earlier {
+  bool operator()(const Fiber* a, const Fiber* b) const {
+    return a->wake != b->wake ? a->wake < b->wake : a->order < b->order;
+  }
+};
+
+// Added to the steady clock, so time carries on after a simulation.
+std::atomic<int64_t> offset{0};
+std::atomic<bool> simulating{false};
+std::atomic<uint64_t> now{0};  // us, while simulating.
+std::thread::id owner;
+
+// Only touched by the coroutines, which run one at a time.
+std::shared_ptr<Fiber> home;
+Fiber* current = nullptr;
+std::set<Fiber*, Earlier> waiting;
+std::vector<std::shared_ptr<Fiber>> fibers;
+uint64_t sleeps = 0;
+uint64_t switches = 0;
+
+uint64_t realMicros() {
+  // Here rather than a global: statics elsewhere read the clock as they're
+  // built, maybe before this file's are.
+  static const std::chrono::steady_clock::time_point timeStart =
+      std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - timeStart)
+      .count();
+}
+
+uint64_t steadyMicros() { return realMicros() + offset.load(); }
+
+bool onClock() {
+  return simulating.load() && std::this_thread::get_id() == owner;
+}
+
+// Frees the stacks of coroutines that have finished, other than our own.
+void reap() {
+  for (size_t i = 0; i < fibers.size();) {
+    Fiber* f = fibers[i].get();
+    if (f->done && f != current) {
+      free(f->stack);
+      f->stack = nullptr;
+      fibers[i] = fibers.back();
+      fibers.pop_back();
+    } else {
+      i++;
+    }
+  }
+}
+
+// Runs whoever wakes first, moving the clock to then. The caller is either
+// waiting or done; it carries on from here when its turn comes.
+void next() {
+  Fiber* self = current;
+  if (waiting.empty()) {
+    fprintf(stderr, "<HostClock> Everything is waiting on something else\n");
+    abort();
+  }
+  Fiber* to = *waiting.begin();
+  waiting.erase(waiting.begin());
+  if (to->wake > now) now = to->wake;
+  if (to == self) return;
+  switches++;
+  current = to;
+  uint64_t timeNow = realMicros();
+  self->runTime += timeNow - self->turnStart;
+  to->turnStart = timeNow;
+  swapcontext(&self->context, &to->context);
+  reap();
+}
+
+void sleepFor(uint64_t us) {
+  current->wake = now + us;
+  current->order = sleeps++;
+  waiting.insert(current);
+  next();
+}
+
+void launch() {
+  Fiber* self = current;
+  reap();
+  self->run();
+  self->run = nullptr;
+  self->done = true;
+  if (self->joiner != nullptr) {
+    self->joiner->wake = now;
+    self->joiner->order = sleeps++;
+    waiting.insert(self->joiner);
+  }
+  next();
+  // Never resumed.
+  abort();
+}
+
+}  // namespace
+
+unsigned long millis() { return micros() / 1000; }
+
+unsigned long micros() {
+  return simulating.load() ? now.load() : steadyMicros();
+}
+
+void delay(unsigned long ms) {
+  if (onClock())
+    sleepFor((uint64_t)ms * 1000);
+  else
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(unsigned int us) {
+  if (onClock())
+    sleepFor(us);
+  else
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void HostClock::simulate(unsigned long start) {
+  if (simulating) return;
+  owner = std::this_thread::get_id();
+  home = std::make_shared<Fiber>();
+  current = home.get();
+  current->turnStart = realMicros();
+  sleeps = switches = 0;
+  now = (uint64_t)start * 1000;
+  simulating = true;
+}
+
+void HostClock::realtime() {
+  if (!onClock()) return;
+  offset = (int64_t)now.load() - (int64_t)steadyMicros() + offset.load();
+  simulating = false;
+  for (std::shared_ptr<Fiber>& f : fibers) {
+    f->abandoned = true;
+    // Not the stack we may be standing on.
+    if (f.get() != current) {
+      free(f->stack);
+      f->stack = nullptr;
+    }
+  }
+  fibers.clear();
+  waiting.clear();
+  current = nullptr;
+  home = nullptr;
+}
+
+bool HostClock::simulated() { return simulating.load(); }
+
+uint64_t HostClock::getSwitches() { return switches; }
+
+uint64_t HostClock::getRunTime() {
+  if (!onClock()) return 0;
+  return current->runTime + realMicros() - current->turnStart;
+}
+
+HostThread::HostThread(std::function<void()> run) {
+  if (!onClock()) {
+    thread = std::thread(run);
+    return;
+  }
+  fiber = std::make_shared<Fiber>();
+  Fiber* f = fiber.get();
+  f->run = run;
+  f->stack = malloc(StackBytes);
+  getcontext(&f->context);
+  f->context.uc_stack.ss_sp = f->stack;
+  f->context.uc_stack.ss_size = StackBytes;
+  f->context.uc_link = nullptr;
+  makecontext(&f->context, launch, 0);
+  // Starts at the creator's next delay().
+  f->wake = now;
+  f->order = sleeps++;
+  waiting.insert(f);
+  fibers.push_back(fiber);
+}
+
+HostThread& HostThread::operator=(HostThread&& other) {
+  if (joinable()) std::terminate();
+  thread = std::move(other.thread);
+  fiber = std::move(other.fiber);
+  return *this;
+}
+
+// Like std::thread, a coroutine must be joined, unless the clock let it go.
+HostThread::~HostThread() {
+  if (fiber && !fiber->done && !fiber->abandoned) std::terminate();
+}
+
+bool HostThread::joinable() const {
+  return fiber != nullptr || thread.joinable();
+}
+
+bool HostThread::isCurrent() const {
+  if (fiber) return onClock() && current == fiber.get();
+  return thread.get_id() == std::this_thread::get_id();
+}
+
+void HostThread::join() {
+  if (!fiber) {
+    thread.join();
+    return;
+  }
+  if (!fiber->done && !fiber->abandoned && onClock()) {
+    fiber->joiner = current;
+    next();
+  }
+  fiber = nullptr;
+}
@@ -0,0 +1,126 @@
+#include <HostNetwork.h>
+
+namespace {
+
+struct Listener {
+  std::string host;
+  uint16_t port;
+  HostNetwork::Server* server;
+};
+
+std::vector<Listener> listeners;
+std::vector<std::weak_ptr<HostNetwork::Connection>> connections;
+bool up = true;
+
+HostNetwork::Server* find(const char* host, uint16_t port) {
+  for (const Listener& l : listeners)
+    if (l.host == host && l.port == port) return l.server;
+  return nullptr;
+}
+
+}  // namespace
+
+unsigned long HostNetwork::roundTrip = 50;
+
+void HostNetwork::Connection::send(const std::string& data, unsigned long ms) {
+  if (!open || data.empty()) return;
+  unsigned long due = millis() + ms;
+  // Bytes on one connection stay in order.
+  if (!pending.empty() && (long)(pending.back().due - due) > 0)
+    due = pending.back().due;
+  pending.push_back({due, data});
+}
+
+size_t HostNetwork::Connection::write(const uint8_t* buf, size_t size) {
+  if (!open) return 0;
+  received.append((const char*)buf, size);
+  server->onReceive(*this);
+  return size;
+}
+
+int HostNetwork::Connection::available() {
+  unsigned long timeNow = millis();
+  size_t n = 0;
+  for (const Segment& s : pending) {
+    if ((long)(timeNow - s.due) < 0) break;
+    n += s.bytes.size();
+  }
+  return n - offset;
+}
+
+int HostNetwork::Connection::read(uint8_t* buf, size_t size) {
+  unsigned long timeNow = millis();
+  size_t n = 0;
+  while (n < size && !pending.empty() &&
+         (long)(timeNow - pending.front().due) >= 0) {
+    const std::string& bytes = pending.front().bytes;
+    size_t take = bytes.size() - offset;
+    if (take > size - n) take = size - n;
+    memcpy(buf + n, bytes.data() + offset, take);
+    n += take;
+    offset += take;
+    if (offset == bytes.size()) {
+      pending.pop_front();
+      offset = 0;
+    }
+  }
+  return n > 0 ? (int)n : -1;
+}
+
+void HostNetwork::Connection::stop() {
+  if (!open) return;
+  open = false;
+  pending.clear();
+  server->onClose(*this);
+}
+
+// Like a socket, what arrived before the close can still be read.
+bool HostNetwork::Connection::connected() {
+  return open || available() > 0;
+}
+
+void HostNetwork::listen(const char* host, uint16_t port, Server* server) {
+  listeners.push_back({host, port, server});
+}
+
+bool HostNetwork::serves(const char* host, uint16_t port) {
+  return find(host, port) != nullptr;
+}
+
+std::shared_ptr<HostNetwork::Connection> HostNetwork::connect(const char* host,
+                                                              uint16_t port) {
+  Server* server = find(host, port);
+  if (server == nullptr || !up) return nullptr;
+  delay(roundTrip);
+  // It may have gone down meanwhile.
+  if (!up) return nullptr;
+  std::shared_ptr<Connection> c = std::make_shared<Connection>(server);
+  for (size_t i = 0; i < connections.size();) {
+    if (connections[i].expired()) {
+      connections[i] = connections.back();
+      connections.pop_back();
+    } else {
+      i++;
+    }
+  }
+  connections.push_back(c);
+  server->onConnect(*c);
+  return c;
+}
+
+void HostNetwork::setUp(bool up) {
+  ::up = up;
+  if (up) return;
+  for (std::weak_ptr<Connection>& weak : connections) {
+    std::shared_ptr<Connection> c = weak.lock();
+    if (!c || !c->open) continue;
+    // Nothing more gets through, in either direction.
+    c->pending.clear();
+    c->offset = 0;
+    c->open = false;
+    c->server->onClose(*c);
+  }
+  connections.clear();
+}
+
+bool HostNetwork::isUp() { return up; }
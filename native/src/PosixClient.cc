@@ -0,0 +1,76 @@
+#include <PosixClient.h>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+int PosixClient::connect(const char* host, uint16_t port) {
+  stop();
+  if (HostNetwork::serves(host, port)) {
+    sim = HostNetwork::connect(host, port);
+    return sim != nullptr;
+  }
+  struct addrinfo hints = {}, *res;
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host, String((unsigned int)port).c_str(), &hints, &res) != 0)
+    return 0;
+  for (struct addrinfo* ai = res; ai != nullptr; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) continue;
+    if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  if (fd < 0) return 0;
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  eof = false;
+  return 1;
+}
+
+size_t PosixClient::write(const uint8_t* buf, size_t size) {
+  if (sim) return sim->write(buf, size);
+  if (fd < 0) return 0;
+  ssize_t n = send(fd, buf, size, MSG_NOSIGNAL);
+  return n < 0 ? 0 : n;
+}
+
+int PosixClient::available() {
+  if (sim) return sim->available();
+  if (fd < 0) return 0;
+  int n = 0;
+  if (ioctl(fd, FIONREAD, &n) < 0) return 0;
+  if (n == 0) {
+    // Readable with nothing to read means the peer closed the connection.
+    char c;
+    if (recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 0) eof = true;
+  }
+  return n;
+}
+
+int PosixClient::read(uint8_t* buf, size_t size) {
+  if (sim) return sim->read(buf, size);
+  if (fd < 0) return -1;
+  ssize_t n = recv(fd, buf, size, MSG_DONTWAIT);
+  if (n == 0) eof = true;
+  return n <= 0 ? -1 : n;
+}
+
+void PosixClient::stop() {
+  if (sim) sim->stop();
+  sim = nullptr;
+  if (fd >= 0) close(fd);
+  fd = -1;
+}
+
+uint8_t PosixClient::connected() {
+  if (sim) return sim->connected();
+  if (fd < 0) return 0;
+  available();
+  return !eof;
+}
@@ -0,0 +1,43 @@
+#include <Preferences.h>
+
+#include <map>
+#include <vector>
+
+// By namespace, then key.
+static std::map<std::string, std::map<std::string, std::vector<uint8_t>>>
+    store;
+
+bool Preferences::begin(const char* name, bool readOnly) {
+  space = name;
+  this->readOnly = readOnly;
+  return true;
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+  if (space.empty() || !store[space].count(key)) return 0;
+  return store[space][key].size();
+}
+
+size_t Preferences::getBytes(const char* key, void* buf, size_t maxLen) {
+  size_t length = getBytesLength(key);
+  if (length == 0 || length > maxLen) return 0;
+  memcpy(buf, store[space][key].data(), length);
+  return length;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t len) {
+  if (space.empty() || readOnly) return 0;
+  const uint8_t* bytes = (const uint8_t*)value;
+  store[space][key].assign(bytes, bytes + len);
+  return len;
+}
+
+double Preferences::getDouble(const char* key, double defaultValue) {
+  double value;
+  return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value
+                                                               : defaultValue;
+}
+
+size_t Preferences::putDouble(const char* key, double value) {
+  return putBytes(key, &value, sizeof(value));
+}
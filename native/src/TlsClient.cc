@@ -0,0 +1,219 @@
+// Host build of TlsClient on OpenSSL, for testing session resumption against
+// a local TLS server. On a HostNetwork server there's no TLS, only the
+// time its handshake takes: two round trips in full, one resumed.
+
+#include "TlsClient.hh"
+
+#include <HostNetwork.h>
+
+#include <poll.h>
+#include <unistd.h>
+
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+
+#include <string>
+
+#include "TcpConnect.hh"
+
+static const unsigned long Timeout = 10000;
+
+struct TlsClient::Impl {
+  SSL_CTX* ctx = nullptr;
+  SSL* ssl = nullptr;
+  SSL_SESSION* session = nullptr;
+  std::string sessionHost;
+  int fd = -1;
+  bool eof = false;
+  std::shared_ptr<HostNetwork::Connection> sim;
+  std::string simSession;  // Host of the session a HostNetwork server gave.
+
+  ~Impl() {
+    if (session) SSL_SESSION_free(session);
+    if (ctx) SSL_CTX_free(ctx);
+  }
+
+  // Keeps the newest resumable session; TLS 1.3 tickets arrive after the
+  // handshake.
+  void saveSession() {
+    SSL_SESSION* s = SSL_get1_session(ssl);
+    if (!s) return;
+    if (!SSL_SESSION_is_resumable(s)) {
+      SSL_SESSION_free(s);
+      return;
+    }
+    if (session) SSL_SESSION_free(session);
+    session = s;
+  }
+};
+
+TlsClient::TlsClient() : impl(new Impl) {}
+
+TlsClient::~TlsClient() {
+  stop();
+  delete impl;
+}
+
+bool TlsClient::usePsram() { return false; }
+
+void TlsClient::forgetSession() {
+  impl->simSession.clear();
+  if (impl->session) SSL_SESSION_free(impl->session);
+  impl->session = nullptr;
+}
+
+void TlsClient::handshakeDone(bool resumed, unsigned long timeStart) {
+  unsigned long time = millis() - timeStart;
+  stats.lastHandshakeTime = time;
+  if (time > stats.maxHandshakeTime) stats.maxHandshakeTime = time;
+  if (resumed) {
+    stats.resumed++;
+    stats.totalResumedTime += time;
+  } else {
+    stats.full++;
+    stats.totalFullTime += time;
+  }
+}
+
+int TlsClient::connect(const char* host, uint16_t port) {
+  stop();
+  Impl& s = *impl;
+  if (HostNetwork::serves(host, port)) {
+    unsigned long timeStart = millis();
+    s.sim = HostNetwork::connect(host, port);
+    bool resumed = s.simSession == host;
+    if (s.sim) delay(HostNetwork::roundTrip * (resumed ? 1 : 2));
+    if (!s.sim || !s.sim->connected()) {
+      s.sim = nullptr;
+      stats.failed++;
+      return 0;
+    }
+    handshakeDone(resumed, timeStart);
+    s.simSession = host;
+    return 1;
+  }
+  if (!s.ctx) {
+    s.ctx = SSL_CTX_new(TLS_client_method());
+    if (!s.ctx) return 0;
+    if (caCert && !insecure) {
+      BIO* bio = BIO_new_mem_buf(caCert, -1);
+      X509* cert = PEM_read_bio_X509(bio, nullptr, nullptr, nullptr);
+      if (cert) X509_STORE_add_cert(SSL_CTX_get_cert_store(s.ctx), cert);
+      X509_free(cert);
+      BIO_free(bio);
+      SSL_CTX_set_verify(s.ctx, SSL_VERIFY_PEER, nullptr);
+    }
+  }
+
+  unsigned long timeStart = millis();
+  s.fd = tcpConnect(host, port, connectTimeout);
+  if (s.fd < 0) {
+    stats.failed++;
+    return 0;
+  }
+  s.ssl = SSL_new(s.ctx);
+  SSL_set_fd(s.ssl, s.fd);
+  SSL_set_tlsext_host_name(s.ssl, host);
+  if (s.session && s.sessionHost == host) SSL_set_session(s.ssl, s.session);
+  // Non-blocking as on the board: the handshake waits on the socket for
+  // whatever is left of the timeout.
+  int ret;
+  while ((ret = SSL_connect(s.ssl)) != 1) {
+    int err = SSL_get_error(s.ssl, ret);
+    unsigned long elapsed = millis() - timeStart;
+    if ((err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) &&
+        elapsed < connectTimeout) {
+      tcpWait(s.fd, err == SSL_ERROR_WANT_WRITE, connectTimeout - elapsed);
+      continue;
+    }
+    Serial.println("<TlsClient::connect> Handshake failed");
+    ERR_clear_error();
+    SSL_free(s.ssl);
+    s.ssl = nullptr;
+    close(s.fd);
+    s.fd = -1;
+    stats.failed++;
+    return 0;
+  }
+  handshakeDone(SSL_session_reused(s.ssl), timeStart);
+  s.saveSession();
+  s.sessionHost = host;
+  s.eof = false;
+  return 1;
+}
+
+size_t TlsClient::write(const uint8_t* buf, size_t size) {
+  if (impl->sim) return impl->sim->write(buf, size);
+  if (!impl->ssl) return 0;
+  size_t written = 0;
+  unsigned long timeStart = millis();
+  while (written < size && millis() - timeStart < Timeout) {
+    int n = SSL_write(impl->ssl, buf + written, size - written);
+    if (n > 0) {
+      written += n;
+      continue;
+    }
+    int err = SSL_get_error(impl->ssl, n);
+    if (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE) {
+      impl->eof = true;
+      break;
+    }
+    struct pollfd p = {impl->fd, (short)(err == SSL_ERROR_WANT_READ ? POLLIN
+                                                                     : POLLOUT),
+                       0};
+    poll(&p, 1, 10);
+  }
+  return written;
+}
+
+int TlsClient::available() {
+  if (impl->sim) return impl->sim->available();
+  if (!impl->ssl) return 0;
+  if (SSL_pending(impl->ssl) > 0) return SSL_pending(impl->ssl);
+  // Pull in whatever records arrived (tickets included) without blocking.
+  uint8_t c;
+  int n = SSL_peek(impl->ssl, &c, 1);
+  if (n > 0) return SSL_pending(impl->ssl);
+  int err = SSL_get_error(impl->ssl, n);
+  if (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE) {
+    ERR_clear_error();
+    impl->eof = true;
+  }
+  return 0;
+}
+
+int TlsClient::read(uint8_t* buf, size_t size) {
+  if (impl->sim) return impl->sim->read(buf, size);
+  if (!impl->ssl) return -1;
+  int n = SSL_read(impl->ssl, buf, size);
+  if (n > 0) return n;
+  int err = SSL_get_error(impl->ssl, n);
+  if (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE) {
+    ERR_clear_error();
+    impl->eof = true;
+  }
+  return -1;
+}
+
+void TlsClient::stop() {
+  if (impl->sim) {
+    impl->sim->stop();
+    impl->sim = nullptr;
+    return;
+  }
+  if (!impl->ssl) return;
+  impl->saveSession();
+  SSL_shutdown(impl->ssl);
+  SSL_free(impl->ssl);
+  impl->ssl = nullptr;
+  close(impl->fd);
+  impl->fd = -1;
+}
+
+uint8_t TlsClient::connected() {
+  if (impl->sim) return impl->sim->connected();
+  if (!impl->ssl) return 0;
+  available();
+  return !impl->eof || SSL_pending(impl->ssl) > 0;
+}
@@ -0,0 +1,32 @@
+#include <HostNetwork.h>
+#include <WiFi.h>
+
+#include <stdio.h>
+
+WiFiClass WiFi;
+
+String IPAddress::toString() const {
+  char s[16];
+  snprintf(s, sizeof(s), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2],
+           bytes[3]);
+  return String(s);
+}
+
+void WiFiClass::begin(const char* ssid, const char* pass) {
+  started = true;
+  update();
+}
+
+void WiFiClass::setLink(bool up) {
+  link = up;
+  HostNetwork::setUp(up);
+  update();
+}
+
+void WiFiClass::update() {
+  bool now = started && link;
+  if (now == connected) return;
+  connected = now;
+  for (EventHandler handler : handlers)
+    handler(connected ? SYSTEM_EVENT_STA_GOT_IP : SYSTEM_EVENT_STA_DISCONNECTED);
+}
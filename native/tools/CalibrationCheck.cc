@@ -0,0 +1,172 @@
+// Scale calibration on simulated sensors: the old fit (a quadratic of reading
+// against oz through the 4 guided points, solved for oz) against
+// ScaleCalibration on the same points, and after refining it with extra
+// points at the full end. Then checks the saved blob: it round-trips, and
+// damaged, truncated or foreign blobs are refused.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <random>
+
+#include "ScaleCalibration.hh"
+#include "Tools.hh"
+
+namespace {
+
+typedef ScaleCalibration::Model Model;
+
+struct Sensor {
+  const char* name;
+  double span;   // Counts from empty to far past full.
+  double knee;   // oz; smaller flattens out sooner.
+};
+
+const Sensor sensors[] = {
+    {"near linear", 3000, 120},
+    {"curved", 700, 20},
+    {"flattening", 500, 10},
+};
+
+const double Guided[] = {0.0, 12.0, 24.0, 30.0};
+const double Extra[] = {18.0, 27.0};
+
+double reading(const Sensor& s, double ounces) {
+  return 3020 + s.span * (1 - exp(-ounces / s.knee));
+}
+
+// Least squares quadratic of reading against oz, as fitCurve() did.
+Model oldFit(const double* ounces, const double* readings, int n) {
+  double m[3][4] = {};
+  for (int i = 0; i < n; i++) {
+    double x[3] = {ounces[i] * ounces[i], ounces[i], 1};
+    for (int r = 0; r < 3; r++) {
+      for (int c = 0; c < 3; c++) m[r][c] += x[r] * x[c];
+      m[r][3] += x[r] * readings[i];
+    }
+  }
+  for (int c = 0; c < 3; c++) {
+    for (int r = c + 1; r < 3; r++) {
+      double f = m[r][c] / m[c][c];
+      for (int k = c; k < 4; k++) m[r][k] -= f * m[c][k];
+    }
+  }
+  double k[3];
+  for (int r = 2; r >= 0; r--) {
+    k[r] = m[r][3];
+    for (int c = r + 1; c < 3; c++) k[r] -= m[r][c] * k[c];
+    k[r] /= m[r][r];
+  }
+  return Model::quadratic(k[0], k[1], k[2]);
+}
+
+struct Error {
+  double worst = 0;
+  double full = 0;  // Over 24oz and up.
+};
+
+Error error(const Sensor& s, const Model& m) {
+  Error e;
+  for (double oz = 0; oz <= 30.0001; oz += 0.25) {
+    double d = fabs(m.ounces(reading(s, oz)) - oz);
+    if (d > e.worst) e.worst = d;
+    if (oz >= 24 && d > e.full) e.full = d;
+  }
+  return e;
+}
+
+const char* name(const Model& m) {
+  static const char* names[] = {"quadratic", "polynomial", "piecewise"};
+  return names[m.type];
+}
+
+int checkBlob(const ScaleCalibration& cal) {
+  int errors = 0;
+  uint8_t blob[ScaleCalibration::MaxBlob];
+  size_t length = cal.save(blob, sizeof(blob));
+  ScaleCalibration back;
+  if (!length || !back.load(blob, length) ||
+      back.getCount() != cal.getCount() ||
+      back.getModel().type != cal.getModel().type ||
+      back.getResidual() != cal.getResidual())
+    errors++;
+  for (double r = 2900; r < 4096; r += 0.5) {
+    if (back.getModel().ounces(r) != cal.getModel().ounces(r)) {
+      errors++;
+      break;
+    }
+  }
+  // Every flipped bit and every truncation is caught.
+  for (size_t i = 0; i < length * 8; i++) {
+    blob[i / 8] ^= 1 << (i % 8);
+    if (back.load(blob, length)) errors++;
+    blob[i / 8] ^= 1 << (i % 8);
+  }
+  for (size_t n = 0; n < length; n++)
+    if (back.load(blob, n)) errors++;
+  // A later version isn't guessed at.
+  blob[4]++;
+  if (back.load(blob, length)) errors++;
+  blob[4]--;
+  if (!back.load(blob, length)) errors++;
+  if (cal.save(blob, length - 1) != 0) errors++;
+  printf("blob: %zu bytes in one write (was 3 writes of 8 bytes), %d errors\n",
+         length, errors);
+  return errors;
+}
+
+}  // namespace
+
+int calibrationCheck(int argc, char** argv) {
+  int rounds = argc > 1 ? atoi(argv[1]) : 2000;
+
+  std::mt19937 rng(17);
+  std::normal_distribution<double> noise(0, 2);  // Of a 32-sample average.
+  int errors = 0;
+  bool better = true;
+  ScaleCalibration last;
+  for (const Sensor& s : sensors) {
+    double readings[4];
+    ScaleCalibration cal;
+    for (int i = 0; i < 4; i++) {
+      readings[i] = reading(s, Guided[i]) + noise(rng);
+      cal.addPoint(Guided[i], readings[i]);
+    }
+    Error old = error(s, oldFit(Guided, readings, 4));
+    Error guided = error(s, cal.getModel());
+    printf("%-12s old quadratic: max %.2f oz, full end %.2f\n", s.name,
+           old.worst, old.full);
+    printf("%-12s %d points, %s: max %.2f oz, full end %.2f (residual %.2f)\n",
+           "", cal.getCount(), name(cal.getModel()), guided.worst, guided.full,
+           cal.getResidual());
+    for (double oz : Extra) cal.addPoint(oz, reading(s, oz) + noise(rng));
+    Error refined = error(s, cal.getModel());
+    printf("%-12s %d points, %s: max %.2f oz, full end %.2f (residual %.2f)\n",
+           "", cal.getCount(), name(cal.getModel()), refined.worst,
+           refined.full, cal.getResidual());
+    better = better && refined.full <= old.full + 0.05;
+    last = cal;
+  }
+  errors += checkBlob(last);
+
+  // What adding a point costs, refit and model choice included.
+  ScaleCalibration cal;
+  auto timeStart = std::chrono::steady_clock::now();
+  for (int k = 0; k < rounds; k++) {
+    cal.clear();
+    for (int i = 0; i < ScaleCalibration::MaxPoints; i++)
+      cal.addPoint(i * 2.5f, reading(sensors[1], i * 2.5));
+  }
+  std::chrono::duration<double, std::micro> t =
+      std::chrono::steady_clock::now() - timeStart;
+  printf("addPoint: %.2f us on average up to %d points\n",
+         t.count() / ((double)rounds * ScaleCalibration::MaxPoints),
+         ScaleCalibration::MaxPoints);
+
+  bool ok = errors == 0 && better;
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
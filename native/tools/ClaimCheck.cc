@@ -0,0 +1,140 @@
+// Races a command writer against the bridge's command poller on the RTDB
+// stand-in, once with the old pathExist + getJSON + deleteNode sequence and
+// once with RtdbClient::claim(). The writer sometimes replaces a command right
+// after writing it, like a second client would; the newest command of every
+// burst must reach the bridge.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <PosixClient.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "CloudCommand.hh"
+#include "RtdbClient.hh"
+#include "Tools.hh"
+
+struct ClaimRun {
+  unsigned long delivered = 0;
+  unsigned long duplicates = 0;
+  unsigned long lost = 0;        // Newest command of a burst never delivered.
+  unsigned long superseded = 0;  // Replaced before the bridge got to it.
+  unsigned long polls = 0;
+  unsigned long idlePolls = 0;
+  unsigned long requests = 0;
+  unsigned long idleRequests = 0;
+  unsigned long oneRequest = 0;  // Idle polls of a single request.
+};
+
+static void pause(std::mt19937& rng, int maxMicros) {
+  std::this_thread::sleep_for(std::chrono::microseconds(rng() % maxMicros));
+}
+
+static ClaimRun race(const char* host, uint16_t port, int bursts, bool legacy) {
+  const std::string path = "/claimtest/command";
+  ClaimRun run;
+  std::mutex lock;
+  std::set<long> delivered;
+  std::atomic<bool> done{false};
+
+  PosixClient writerSocket;
+  RtdbClient writer(writerSocket, host, port, "secret");
+  writer.request("DELETE", path);
+
+  std::thread poller([&]() {
+    PosixClient socket;
+    RtdbClient rtdb(socket, host, port, "secret");
+    std::mt19937 rng(2);
+    while (!done) {
+      unsigned long before = rtdb.getRequests();
+      std::string value;
+      bool got = false;
+      if (legacy) {
+        // What FirebaseESP32 did: three requests, unconditional delete.
+        RtdbClient::Response r = rtdb.request("GET", path);
+        if (r.code == 200 && r.body != "null") {
+          pause(rng, 2000);  // Round trip to the server.
+          r = rtdb.request("GET", path);
+          pause(rng, 2000);
+          rtdb.request("DELETE", path);
+          got = r.code == 200 && r.body != "null";
+          value = r.body;
+        }
+      } else {
+        got = rtdb.claim(path, value) == RtdbClient::Claimed;
+      }
+      unsigned long used = rtdb.getRequests() - before;
+      std::lock_guard<std::mutex> guard(lock);
+      run.polls++;
+      run.requests += used;
+      if (!got) {
+        run.idlePolls++;
+        run.idleRequests += used;
+        continue;
+      }
+      CloudCommand cmd = CloudCommand::parse(value);
+      if (!delivered.insert(cmd.value).second) run.duplicates++;
+      run.delivered++;
+    }
+    run.oneRequest = rtdb.getIdlePolls();
+  });
+
+  std::mt19937 rng(1);
+  long next = 1;
+  std::vector<long> newest;
+  for (int b = 0; b < bursts; b++) {
+    int writes = 1 + rng() % 3;
+    for (int w = 0; w < writes; w++) {
+      if (w > 0) pause(rng, 3000);
+      std::string json =
+          "{\"temp\":true,\"value\":" + std::to_string(next++) + "}";
+      writer.request("PUT", path, json);
+    }
+    newest.push_back(next - 1);
+    // Wait until the bridge took it before the next burst.
+    for (int i = 0; i < 500 && writer.request("GET", path).body != "null"; i++)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    pause(rng, 5000);
+  }
+  done = true;
+  poller.join();
+
+  for (long v : newest)
+    if (!delivered.count(v)) run.lost++;
+  run.superseded = (next - 1) - run.delivered - run.lost;
+  return run;
+}
+
+static void report(const char* name, const ClaimRun& r, int bursts) {
+  printf("%s:\n", name);
+  printf("  %d bursts, %lu delivered, %lu lost, %lu superseded, %lu duplicates\n",
+         bursts, r.delivered, r.lost, r.superseded, r.duplicates);
+  unsigned long busy = r.polls - r.idlePolls;
+  printf("  requests per command %.2f, per idle poll %.2f (%lu in one "
+         "conditional delete)\n",
+         busy ? (double)(r.requests - r.idleRequests) / busy : 0.0,
+         r.idlePolls ? (double)r.idleRequests / r.idlePolls : 0.0,
+         r.oneRequest);
+}
+
+int claimCheck(int argc, char** argv) {
+  const char* host = argc > 1 ? argv[1] : "127.0.0.1";
+  uint16_t port = argc > 2 ? atoi(argv[2]) : 9000;
+  int bursts = argc > 3 ? atoi(argv[3]) : 200;
+
+  ClaimRun legacy = race(host, port, bursts, true);
+  report("pathExist + getJSON + deleteNode", legacy, bursts);
+  ClaimRun claim = race(host, port, bursts, false);
+  report("RtdbClient::claim", claim, bursts);
+
+  bool ok = claim.delivered > 0 && claim.lost == 0 && claim.duplicates == 0;
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+#include "Corpus.hh"
+
+#include <random>
+
+namespace Corpus {
+
+const char* SplitNames[SplitCount] = {"per-frame", "mtu20", "random",
+                                      "coalesced", "bytewise"};
+
+static void frame(Traffic& t, std::initializer_list<uint8_t> payload) {
+  t.bytes.push_back(0xef);
+  t.bytes.push_back(0xdd);
+  t.bytes.insert(t.bytes.end(), payload);
+  t.frames++;
+}
+
+static void status(Traffic& t) {
+  frame(t, {0x05, 0xff, 0xff, 0xff});
+  frame(t, {0x06, 0x00, 0x00});
+  frame(t, {0x07, 0x00, 0x00});
+}
+
+Traffic session() {
+  Traffic t;
+  uint8_t current = 72, target = 205;
+
+  // State dump right after the init handshake.
+  frame(t, {0x00, 0x00, 0x00});
+  frame(t, {0x01, 0x00, 0x00});
+  frame(t, {0x02, target, 0x01, 0x00});
+  frame(t, {0x03, current, 0x01, 0x00});
+  frame(t, {0x08, 0x01, 0x00});
+  status(t);
+
+  // Power on, heat up to target.
+  frame(t, {0x00, 0x01, 0x00});
+  for (; current < target; current++) {
+    for (int i = 0; i < 3; i++) frame(t, {0x03, current, 0x01, 0x00});
+    if (current % 8 == 0) status(t);
+  }
+  frame(t, {0x06, 0x01, 0x00});
+
+  // Hold at temperature for a while.
+  frame(t, {0x01, 0x01, 0x00});
+  for (int i = 0; i < 60; i++) {
+    frame(t, {0x03, (uint8_t)(target - (i % 3)), 0x01, 0x00});
+    if (i % 10 == 0) status(t);
+  }
+
+  // Lifted off the base: the kettle counts down before switching off.
+  frame(t, {0x08, 0x00, 0x00});
+  for (uint8_t countdown = 30; countdown > 0; countdown--)
+    frame(t, {0x04, countdown, 0x00, 0x00});
+  frame(t, {0x08, 0x01, 0x00});
+
+  // Off, cooling.
+  frame(t, {0x01, 0x00, 0x00});
+  frame(t, {0x00, 0x00, 0x00});
+  for (; current > 150; current--) {
+    frame(t, {0x03, current, 0x01, 0x00});
+    if (current % 8 == 0) status(t);
+  }
+  return t;
+}
+
+static void randomFrame(Traffic& t, std::mt19937& rng) {
+  uint8_t v = rng() % 2;
+  switch (rng() % 9) {
+    case 0: frame(t, {0x00, v, 0x00}); break;
+    case 1: frame(t, {0x01, v, 0x00}); break;
+    case 2: frame(t, {0x02, (uint8_t)(160 + rng() % 53), 0x01, 0x00}); break;
+    case 3: frame(t, {0x03, (uint8_t)(60 + rng() % 153), 0x01, 0x00}); break;
+    case 4: frame(t, {0x04, (uint8_t)(rng() % 31), 0x00, 0x00}); break;
+    case 5: frame(t, {0x05, 0xff, 0xff, 0xff}); break;
+    case 6: frame(t, {0x06, v, 0x00}); break;
+    case 7: frame(t, {0x07, 0x00, 0x00}); break;
+    case 8: frame(t, {0x08, v, 0x00}); break;
+  }
+}
+
+Traffic synthetic(size_t frames, uint32_t seed) {
+  std::mt19937 rng(seed);
+  Traffic t;
+  t.bytes.reserve(frames * 6);
+  while (t.frames < frames) randomFrame(t, rng);
+  return t;
+}
+
+Traffic noisy(size_t frames, uint32_t seed) {
+  std::mt19937 rng(seed);
+  Traffic t;
+  t.bytes.reserve(frames * 8);
+  while (t.frames < frames) {
+    switch (rng() % 16) {
+      case 0:  // Line noise, which may contain stray separator bytes.
+        for (int i = rng() % 12; i >= 0; i--) t.bytes.push_back(rng() % 256);
+        break;
+      case 1:  // A frame cut short by the next separator.
+        t.bytes.insert(t.bytes.end(), {0xef, 0xdd, 0x02, 0xc8});
+        break;
+      case 2:  // An unknown frame type.
+        frame(t, {(uint8_t)(9 + rng() % 8), 0x01, 0x02, 0x03, 0x04});
+        break;
+      default:
+        randomFrame(t, rng);
+        break;
+    }
+  }
+  return t;
+}
+
+std::vector<Chunk> split(const std::vector<uint8_t>& bytes, Split how,
+                         uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::vector<Chunk> chunks;
+  uint32_t size = bytes.size();
+  uint32_t pos = 0;
+  while (pos < size) {
+    uint32_t length;
+    switch (how) {
+      case PerFrame:
+        length = 1;
+        while (pos + length < size &&
+               !(bytes[pos + length] == 0xef &&
+                 pos + length + 1 < size && bytes[pos + length + 1] == 0xdd))
+          length++;
+        break;
+      case Mtu20: length = 20; break;
+      case Random: length = 1 + rng() % 32; break;
+      case Coalesced: length = 244; break;
+      case Bytewise:
+      default: length = 1; break;
+    }
+    if (length > size - pos) length = size - pos;
+    chunks.push_back({pos, length});
+    pos += length;
+  }
+  return chunks;
+}
+
+}  // namespace Corpus
@@ -0,0 +1,47 @@
+#ifndef __CORPUS_H__
+#define __CORPUS_H__
+
+// Kettle notification traffic for host-side benchmarks and parser checks.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace Corpus {
+
+// One BLE notification: a slice of a traffic stream.
+struct Chunk {
+  uint32_t offset;
+  uint32_t length;
+};
+
+enum Split { PerFrame, Mtu20, Random, Coalesced, Bytewise, SplitCount };
+extern const char* SplitNames[SplitCount];
+
+struct Traffic {
+  std::vector<uint8_t> bytes;
+  size_t frames = 0;
+};
+
+// A full boil cycle as the kettle reports it over 0xefdd frames: the state
+// dump after connecting, power on, heating with periodic temperature and
+// status frames, hold, a lift with countdown, and power off while cooling.
+// Built from the frame layouts documented in the README.
+Traffic session();
+
+// Random well-formed frames of every known type (0x00-0x08).
+Traffic synthetic(size_t frames, uint32_t seed);
+
+// Like synthetic(), but with runs of line noise, truncated frames and
+// unknown frame types mixed in, to exercise resynchronization.
+Traffic noisy(size_t frames, uint32_t seed);
+
+// Cut a traffic stream into notifications the way the BLE stack might
+// deliver them: one frame each, 20-byte MTU payloads, random sizes, large
+// coalesced payloads or single bytes.
+std::vector<Chunk> split(const std::vector<uint8_t>& bytes, Split how,
+                         uint32_t seed);
+
+}  // namespace Corpus
+
+#endif
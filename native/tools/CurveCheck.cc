@@ -0,0 +1,129 @@
+// The calibration model three ways: in double as FSRScale used to, in
+// float, and from FillCurve's table. Checks that the float and table results
+// stay within a bound of the double ones over the whole 12-bit range for a
+// few calibrations of each kind, then times each. The host's FPU does double in
+// hardware, so the timings only show what the table saves in arithmetic; on
+// the ESP32 double is done in software and the gap is much wider.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "FillCurve.hh"
+#include "Tools.hh"
+
+namespace {
+
+// Oz; well under the 1oz FSRScale reports in.
+const double Bound = 0.02;
+
+typedef ScaleCalibration::Model Model;
+
+struct Calibration {
+  const char* name;
+  Model model;
+};
+
+// Quadratics as the scale has always had them, then what ScaleCalibration
+// fits to points off a sensor that flattens out at the full end.
+std::vector<Calibration> calibrations() {
+  std::vector<Calibration> all = {
+      {"default", Model::quadratic(-0.08, 13.83, 3019.81)},
+      {"older", Model::quadratic(-0.08, 16.83, 2819.81)},
+      {"steep", Model::quadratic(-0.3, 30.0, 2500.0)},
+      {"convex", Model::quadratic(0.05, 8.0, 3200.0)},
+      {"linear", Model::quadratic(0.0, 14.0, 3000.0)},
+  };
+  const float ounces[] = {0, 6, 12, 18, 24, 27, 30};
+  for (int points : {3, 5, 7}) {
+    ScaleCalibration cal;
+    for (int i = 0; i < points; i++) {
+      float oz = ounces[i * 6 / (points - 1)];
+      cal.addPoint(oz, 3020 + 700 * (1 - expf(-oz / 20)));
+    }
+    const Model& m = cal.getModel();
+    all.push_back({m.type == Model::Piecewise ? "piecewise" : "polynomial", m});
+  }
+  return all;
+}
+
+template <typename F>
+double timePerReading(const std::vector<float>& readings, int rounds, F f) {
+  volatile float sink = 0;
+  auto timeStart = std::chrono::steady_clock::now();
+  for (int k = 0; k < rounds; k++) {
+    for (float r : readings) sink = f(r);
+  }
+  std::chrono::duration<double, std::nano> t =
+      std::chrono::steady_clock::now() - timeStart;
+  (void)sink;
+  return t.count() / ((double)rounds * readings.size());
+}
+
+}  // namespace
+
+int curveCheck(int argc, char** argv) {
+  int rounds = argc > 1 ? atoi(argv[1]) : 200;
+
+  bool ok = true;
+  FillCurve curve;
+  for (const Calibration& cal : calibrations()) {
+    curve.setModel(cal.model);
+    double worstFloat = 0;
+    double worstTable = 0;
+    double worstAt = 0;
+    unsigned long rounding = 0;
+    unsigned long checked = 0;
+    // Right at the top of the curve the fill jumps from the vertex to
+    // MaxFill, and float and double can round to either side.
+    const double* k = cal.model.coeffs;
+    double top = cal.model.type != Model::Quadratic || k[0] == 0
+                     ? -1
+                     : k[2] - k[1] * k[1] / (4 * k[0]);
+    for (int i = 0; i < 4096 * 16; i++) {
+      double reading = i / 16.0;
+      if (fabs(reading - top) < 0.01) continue;
+      double exact = cal.model.ounces(reading);
+      double f = curve.solve(reading);
+      double t = curve.ounces(reading);
+      if (fabs(f - exact) > worstFloat) worstFloat = fabs(f - exact);
+      if (fabs(t - exact) > worstTable) {
+        worstTable = fabs(t - exact);
+        worstAt = reading;
+      }
+      // What getFill() reports.
+      if (round(t) != round(exact)) rounding++;
+      checked++;
+    }
+    bool good = worstFloat <= Bound && worstTable <= Bound;
+    printf("%-10s max error oz: float %.4f, table %.4f (at %.1f); rounded fill "
+           "differs for %lu of %lu readings %s\n",
+           cal.name, worstFloat, worstTable, worstAt, rounding, checked,
+           good ? "" : "FAILED");
+    ok = ok && good;
+  }
+
+  // Readings around where a kettle sits, in random order.
+  Model model = Model::quadratic(-0.08, 13.83, 3019.81);
+  curve.setModel(model);
+  std::mt19937 rng(16);
+  std::vector<float> readings(4096);
+  for (float& r : readings) r = 2900 + (rng() % (800 * 16)) / 16.0f;
+  double nsDouble = timePerReading(readings, rounds, [&model](float r) {
+    return (float)model.ounces(r);
+  });
+  double nsFloat = timePerReading(
+      readings, rounds, [&curve](float r) { return curve.solve(r); });
+  double nsTable = timePerReading(
+      readings, rounds, [&curve](float r) { return curve.ounces(r); });
+  printf("ns per reading: double %.1f, float %.1f, table %.1f; table is %zu "
+         "bytes\n",
+         nsDouble, nsFloat, nsTable,
+         sizeof(uint16_t) * (FillCurve::Cells + 1));
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+// Checks EkgDecoder against the original byte-at-a-time recognizer on the
+// shared traffic corpus plus random garbage, under every notification split,
+// and compares raw decode throughput of the two.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <random>
+
+#include "Corpus.hh"
+#include "EkgDecoder.hh"
+#include "LegacyDecoder.hh"
+#include "Tools.hh"
+
+// Everything parseEvent can look at: the reported length, and the frame bytes
+// including the two it reads past a truncated frame.
+struct Frame {
+  size_t length;
+  uint8_t bytes[Ekg::MaxFrame];
+
+  bool operator==(const Frame& other) const {
+    size_t n = length < 3 ? 3 : length;
+    return length == other.length && memcmp(bytes, other.bytes, n) == 0;
+  }
+};
+
+template <typename Decoder>
+static std::vector<Frame> decode(const std::vector<uint8_t>& bytes,
+                                 const std::vector<Corpus::Chunk>& chunks) {
+  Decoder decoder;
+  std::vector<Frame> frames;
+  for (const Corpus::Chunk& c : chunks) {
+    decoder.feed(bytes.data() + c.offset, c.length,
+                 [&](const uint8_t* data, size_t length) {
+                   Frame f;
+                   f.length = length;
+                   memcpy(f.bytes, data, length < 3 ? 3 : length);
+                   frames.push_back(f);
+                 });
+  }
+  return frames;
+}
+
+static bool check(const char* name, const std::vector<uint8_t>& bytes,
+                  uint32_t seed) {
+  bool ok = true;
+  for (int s = 0; s < Corpus::SplitCount; s++) {
+    std::vector<Corpus::Chunk> chunks =
+        Corpus::split(bytes, (Corpus::Split)s, seed);
+    std::vector<Frame> expected = decode<LegacyDecoder>(bytes, chunks);
+    std::vector<Frame> actual = decode<EkgDecoder>(bytes, chunks);
+    if (actual == expected) continue;
+
+    size_t i = 0;
+    while (i < expected.size() && i < actual.size() &&
+           expected[i] == actual[i])
+      i++;
+    printf("MISMATCH %s/%s seed %u: frame %zu of %zu (got %zu frames)\n",
+           name, Corpus::SplitNames[s], seed, i, expected.size(),
+           actual.size());
+    ok = false;
+  }
+  return ok;
+}
+
+// Mostly separator bytes and small frame types, so that every resync path
+// gets hit often.
+static std::vector<uint8_t> garbage(size_t size, uint32_t seed) {
+  static const uint8_t alphabet[] = {0xef, 0xdd, 0x00, 0x01, 0x02, 0x03,
+                                     0x05, 0x08, 0x09, 0x0a, 0xff, 0x7f};
+  std::mt19937 rng(seed);
+  std::vector<uint8_t> bytes(size);
+  for (uint8_t& b : bytes)
+    b = rng() % 4 == 0 ? rng() % 256 : alphabet[rng() % sizeof(alphabet)];
+  return bytes;
+}
+
+template <typename Decoder>
+static double nsPerFrame(const Corpus::Traffic& traffic,
+                         const std::vector<Corpus::Chunk>& chunks,
+                         size_t repeat) {
+  Decoder decoder;
+  size_t sum = 0;
+  auto timeStart = std::chrono::steady_clock::now();
+  for (size_t r = 0; r < repeat; r++) {
+    for (const Corpus::Chunk& c : chunks)
+      decoder.feed(traffic.bytes.data() + c.offset, c.length,
+                   [&](const uint8_t* data, size_t length) {
+                     sum += data[length - 1];
+                   });
+  }
+  auto timeEnd = std::chrono::steady_clock::now();
+  if (sum == 1) printf(" ");
+  return std::chrono::duration<double, std::nano>(timeEnd - timeStart)
+             .count() /
+         ((double)traffic.frames * repeat);
+}
+
+int decoderCheck(int argc, char** argv) {
+  int seeds = argc > 1 ? atoi(argv[1]) : 200;
+  bool ok = check("session", Corpus::session().bytes, 1);
+  for (int seed = 0; seed < seeds; seed++) {
+    ok &= check("synthetic", Corpus::synthetic(2000, seed).bytes, seed);
+    ok &= check("noisy", Corpus::noisy(2000, seed).bytes, seed);
+    ok &= check("garbage", garbage(4000, seed), seed);
+  }
+  printf("%s: %d seeds x %d splits\n", ok ? "OK" : "FAILED", seeds,
+         Corpus::SplitCount);
+
+  printf("%-10s %-10s %12s %12s\n", "corpus", "split", "legacy ns/f",
+         "decoder ns/f");
+  Corpus::Traffic traffic = Corpus::noisy(1000000, 42);
+  for (int s = 0; s < Corpus::SplitCount; s++) {
+    std::vector<Corpus::Chunk> chunks =
+        Corpus::split(traffic.bytes, (Corpus::Split)s, 7);
+    printf("%-10s %-10s %12.1f %12.1f\n", "noisy", Corpus::SplitNames[s],
+           nsPerFrame<LegacyDecoder>(traffic, chunks, 2),
+           nsPerFrame<EkgDecoder>(traffic, chunks, 2));
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,239 @@
+// StaggKettle end to end against KettleSim on the shim's simulated radio.
+// Connects and waits for the handshake's state dump, then sends commands one
+// at a time, power and temperature, on a clean link and on one losing some
+// writes and notifications, and reports how long each took to be confirmed
+// by the kettle's state frames and whether the kettle really took it. Then a
+// boil at simulated speed, checking what the bridge reports against the
+// water, and a burst of state frames as fast as the link carries them.
+
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <functional>
+#include <random>
+#include <thread>
+
+#include "KettleSim.hh"
+#include "LatencyHistogram.hh"
+#include "StaggKettle.hh"
+#include "Tools.hh"
+
+namespace {
+
+const BLEUUID ServiceUUID("00001820-0000-1000-8000-00805f9b34fb");
+const char* Address = "c4:4f:33:0a:17:d2";
+
+// A kettle task: loop() every 10ms until stopped.
+class Bridge {
+ public:
+  Bridge() : reader(kettle.getStatus()) {
+    thread = std::thread([this]() {
+      while (!stop) {
+        kettle.loop();
+        delay(10);
+      }
+    });
+  }
+  ~Bridge() {
+    stop = true;
+    thread.join();
+    BLEDevice::radio().dropAll();
+  }
+
+  // Polls until cond holds; false on timeout.
+  bool waitFor(std::function<bool(const StaggKettle::Status&)> cond,
+               unsigned long timeout) {
+    unsigned long timeStart = millis();
+    while (millis() - timeStart < timeout) {
+      reader.poll(status);
+      if (cond(status)) return true;
+      delay(2);
+    }
+    return false;
+  }
+
+  StaggKettle kettle;
+  StaggKettle::StatusSnapshot::Reader reader;
+  StaggKettle::Status status;
+
+ private:
+  std::atomic<bool> stop{false};
+  std::thread thread;
+};
+
+unsigned long settled(const CommandTracker::Stats& acks) {
+  return acks.confirmed + acks.failed + acks.superseded;
+}
+
+// Sends count commands, each once the last one settled, and checks the
+// kettle ended up as asked. Returns the commands the kettle didn't take.
+int commands(Bridge& bridge, KettleSim& sim, const char* what, int count) {
+  std::mt19937 rng(21);
+  LatencyHistogram latency;
+  CommandTracker::Stats before = bridge.status.acks;
+  unsigned long confirmed = before.confirmed;
+  int wrong = 0;
+  for (int i = 0; i < count; i++) {
+    bool power = false;
+    uint8_t target = 0;
+    if (i % 3 == 0) {
+      power = !sim.isOn();
+      if (power)
+        bridge.kettle.on();
+      else
+        bridge.kettle.off();
+    } else {
+      target = KettleSim::MinTarget +
+               rng() % (KettleSim::MaxTarget - KettleSim::MinTarget + 1);
+      bridge.kettle.setTemp(target);
+    }
+    unsigned long done = settled(bridge.status.acks);
+    if (!bridge.waitFor(
+            [&](const StaggKettle::Status& s) {
+              return settled(s.acks) > done;
+            },
+            10000)) {
+      wrong++;
+      continue;
+    }
+    const CommandTracker::Stats& acks = bridge.status.acks;
+    if (acks.confirmed > confirmed) latency.record(acks.lastTotalTime * 1000);
+    confirmed = acks.confirmed;
+    if (i % 3 == 0 ? sim.isOn() != power : sim.getTarget() != target) wrong++;
+    // Past the debounce, so only the link and the kettle are measured.
+    delay(250);
+  }
+  const CommandTracker::Stats& acks = bridge.status.acks;
+  printf("%-10s %3lu confirmed, %lu retries, %lu failed, %d not taken; "
+         "latency p50 %.0f ms, p95 %.0f ms, max %.0f ms\n",
+         what, acks.confirmed - before.confirmed, acks.retries - before.retries,
+         acks.failed - before.failed, wrong, latency.percentile(0.5) / 1000.0,
+         latency.percentile(0.95) / 1000.0, latency.getMax() / 1000.0);
+  return wrong;
+}
+
+}  // namespace
+
+int ekgCheck(int argc, char** argv) {
+  int count = argc > 1 ? atoi(argv[1]) : 30;
+  float loss = argc > 2 ? atof(argv[2]) / 100 : 0.1;
+
+  BLEHostRadio& radio = BLEDevice::radio();
+  radio.simulate();
+  radio.scanDelay = 200;
+  radio.connectDelay = 100;
+  radio.connectTimeout = 2000;
+  KettleSim::Config config;
+  config.latency = 15;
+  config.jitter = 20;
+  KettleSim sim(BLEAddress(Address), config);
+  radio.addPeer(
+      BLEAdvertisedDevice("EKG-2d-25-b0", BLEAddress(Address), ServiceUUID),
+      &sim);
+
+  int errors = 0;
+  {
+    Bridge bridge;
+    unsigned long timeStart = millis();
+    // The dump after the handshake carries the target.
+    if (!bridge.waitFor(
+            [](const StaggKettle::Status& s) {
+              return s.state == StaggKettle::Connected && s.targetTemp != 0;
+            },
+            10000))
+      errors++;
+    printf("connected, first state after %lu ms\n", millis() - timeStart);
+
+    errors += commands(bridge, sim, "clean", count);
+    if (bridge.status.acks.retries != 0) errors++;
+
+    config.loss = loss;
+    sim.configure(config);
+    char lossy[16];
+    snprintf(lossy, sizeof(lossy), "%.0f%% loss", loss * 100);
+    int lost = commands(bridge, sim, lossy, count);
+    // Four tries each, so hardly any should fail outright.
+    if (lost * 10 > count) errors++;
+    config.loss = 0;
+
+    // A boil, 60 times faster than real.
+    config.speed = 60;
+    sim.configure(config);
+    bridge.kettle.setTemp(200);
+    bridge.kettle.on();
+    timeStart = millis();
+    float start = sim.getTemperature();
+    // On, up to temperature, and off by itself.
+    bool heating = false;
+    int peak = 0;
+    bool boiled = bridge.waitFor(
+        [&](const StaggKettle::Status& s) {
+          heating = heating || s.power;
+          if (s.currentTemp > peak) peak = s.currentTemp;
+          return heating && !s.power;
+        },
+        60000);
+    unsigned long boil = millis() - timeStart;
+    delay(100);
+    bridge.reader.poll(bridge.status);
+    float water = sim.getTemperature();
+    printf("boil %.0fF to 200F: %.1f simulated minutes, bridge saw %dF; now "
+           "reads %dF, water %.1fF\n",
+           start, boil * config.speed / 60000.0, peak,
+           bridge.status.currentTemp, water);
+    if (!boiled || peak < 199 || fabs(bridge.status.currentTemp - water) > 1)
+      errors++;
+
+    // Lifted while on: the countdown runs out and it's off.
+    sim.setHold(true);
+    bridge.kettle.on();
+    bridge.waitFor([](const StaggKettle::Status& s) { return s.power; }, 5000);
+    sim.lift(true);
+    bool counted = bridge.waitFor(
+        [](const StaggKettle::Status& s) { return s.lifted && s.countdown > 0; },
+        5000);
+    bool off = bridge.waitFor(
+        [](const StaggKettle::Status& s) { return s.lifted && !s.power; },
+        10000);
+    sim.lift(false);
+    sim.setHold(false);
+    printf("lifted while on: countdown %s, switched off %s\n",
+           counted ? "seen" : "missed", off ? "seen" : "missed");
+    if (!counted || !off) errors++;
+
+    // Temperature reports every 5ms, on a link with room for them.
+    config.speed = 1;
+    config.interval = 10;
+    config.perEvent = 6;
+    config.statePeriod = 5;
+    config.split = 0.5;
+    sim.configure(config);
+    KettleSim::Stats before = sim.getStats();
+    timeStart = millis();
+    delay(3000);
+    KettleSim::Stats after = sim.getStats();
+    float seconds = (millis() - timeStart) / 1000.0;
+    bridge.reader.poll(bridge.status);
+    printf("burst: %.0f frames/s in %.0f notifications/s, %.0f bytes/s; rx "
+           "high water %zu bytes, %lu overflows, %lu frames overrun\n",
+           (after.frames - before.frames) / seconds,
+           (after.notifications - before.notifications) / seconds,
+           (after.bytes - before.bytes) / seconds, bridge.status.rxHighWater,
+           bridge.status.rxOverflows, after.overruns - before.overruns);
+    if (bridge.status.rxOverflows != 0) errors++;
+  }
+
+  KettleSim::Stats s = sim.getStats();
+  printf("kettle: %lu writes, %lu inits, %lu commands, %lu bad, %lu ignored, "
+         "%lu writes and %lu notifications lost\n",
+         s.writes, s.inits, s.commands, s.badCommands, s.ignored,
+         s.lostWrites, s.lostNotifications);
+  if (s.inits != 1 || s.badCommands != 0) errors++;
+  radio.setPresent(BLEAddress(Address), false);
+
+  printf("errors: %d\n", errors);
+  printf("%s\n", errors == 0 ? "OK" : "FAILED");
+  return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,240 @@
+// Fill filtering over FSR traces: the old 32-sample boxcar, re-summed every
+// time, against FillFilter with and without the kettle's lifted hint.
+// Reports how long each takes to settle after the level changes, how noisy
+// the settled reading is, and the cost per sample.
+//
+// Without arguments it builds a trace at 100Hz: set-downs with different
+// amounts of water, lifts, a spike now and then, and one set-down the lifted
+// hint never reports (BLE was away). A recorded trace is a text file of
+// "reading,lifted[,level]" lines at the same rate; without the level column
+// the level of each stretch on the base is taken as the mean of its second
+// half.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "FillFilter.hh"
+#include "Tools.hh"
+
+namespace {
+
+const int SampleRate = 100;  // Hz
+const int Boxcar = 32;
+// Raw ADC counts; about 1oz with the usual calibration.
+const double Tolerance = 14;
+
+struct Sample {
+  uint16_t reading;
+  bool lifted;
+  double level;
+};
+typedef std::vector<Sample> Trace;
+
+// Reading for this many oz, with the coefficients FSRScale starts with.
+double reading(double ounces) {
+  return -0.08 * ounces * ounces + 13.83 * ounces + 3019.81;
+}
+
+Trace simulate() {
+  struct Phase {
+    double seconds;
+    bool lifted;   // What the kettle reports.
+    double ounces;  // < 0 is off the base.
+  };
+  static const Phase phases[] = {
+      {5, false, 0},   {4, true, -1},   {20, false, 24}, {3, true, -1},
+      {10, false, 12}, {6, true, -1},   {15, false, 30}, {2, true, -1},
+      {8, false, 4},   {3, false, -1},  {12, false, 18}, {2, true, -1},
+      {10, false, 0},
+  };
+  std::mt19937 rng(15);
+  std::normal_distribution<double> noise(0, 12);
+  Trace trace;
+  double last = reading(0);
+  for (const Phase& p : phases) {
+    double level = p.ounces < 0 ? 400 : reading(p.ounces);
+    int n = p.seconds * SampleRate;
+    for (int i = 0; i < n; i++) {
+      // The reading takes about 50ms to get there as the kettle settles.
+      double x = i < 5 ? last + (level - last) * (i + 1) / 5 : level;
+      x += noise(rng);
+      if (rng() % 100 == 0) x += (int)(rng() % 301) - 150;
+      trace.push_back(
+          {(uint16_t)std::max(0.0, std::min(4095.0, x)), p.lifted, level});
+    }
+    last = level;
+  }
+  return trace;
+}
+
+bool load(const char* path, Trace& trace) {
+  FILE* f = fopen(path, "r");
+  if (!f) return false;
+  unsigned reading;
+  int lifted;
+  double level;
+  char line[128];
+  bool levels = true;
+  while (fgets(line, sizeof(line), f)) {
+    int n = sscanf(line, "%u,%d,%lf", &reading, &lifted, &level);
+    if (n < 2) continue;
+    if (n < 3) levels = false;
+    trace.push_back({(uint16_t)reading, lifted != 0, n < 3 ? -1 : level});
+  }
+  fclose(f);
+  if (levels) return !trace.empty();
+
+  // Stretches end where the lifted hint changes.
+  size_t begin = 0;
+  for (size_t i = 1; i <= trace.size(); i++) {
+    if (i < trace.size() && trace[i].lifted == trace[begin].lifted) continue;
+    double sum = 0;
+    size_t from = (begin + i) / 2;
+    for (size_t j = from; j < i; j++) sum += trace[j].reading;
+    for (size_t j = begin; j < i; j++) trace[j].level = sum / (i - from);
+    begin = i;
+  }
+  return !trace.empty();
+}
+
+// The averaging FSRScale did before FillFilter.
+struct BoxcarFilter {
+  uint16_t buffer[Boxcar] = {};
+  int pos = 0;
+  double out = 0;
+  void add(uint16_t sample) {
+    buffer[pos] = sample;
+    pos = (pos + 1) % Boxcar;
+    double sum = 0.0;
+    for (int i = 0; i < Boxcar; i++) sum += buffer[i];
+    out = sum / (double)Boxcar;
+  }
+  void hint(bool) {}
+  double average() const { return out; }
+};
+
+struct AdaptiveFilter {
+  FillFilter filter;
+  bool useHint;
+  bool lifted = false;
+  explicit AdaptiveFilter(bool useHint) : useHint(useHint) {}
+  void add(uint16_t sample) { filter.add(sample); }
+  void hint(bool lifted) {
+    if (!useHint || lifted == this->lifted) return;
+    this->lifted = lifted;
+    filter.reset();
+  }
+  double average() const { return filter.average(); }
+};
+
+struct Result {
+  std::vector<int> settle;  // Samples per level change on the base.
+  double sumSquares = 0;    // Settled error.
+  unsigned long settled = 0;
+  double nsPerSample = 0;
+};
+
+// Feeds the trace through the filter. A change of level settles at the first
+// sample from which the output stays within Tolerance until the next change.
+template <typename Filter>
+Result run(const Trace& trace, Filter filter) {
+  Result r;
+  std::vector<double> out(trace.size());
+  for (size_t i = 0; i < trace.size(); i++) {
+    filter.hint(trace[i].lifted);
+    filter.add(trace[i].reading);
+    out[i] = filter.average();
+  }
+
+  size_t begin = 0;
+  for (size_t i = 1; i <= trace.size(); i++) {
+    if (i < trace.size() && trace[i].level == trace[begin].level) continue;
+    // Off the base the FSR reads far below an empty kettle.
+    bool onBase = trace[begin].level > 1000;
+    if (onBase && begin > 0) {
+      size_t settle = i;
+      while (settle > begin &&
+             fabs(out[settle - 1] - trace[begin].level) <= Tolerance)
+        settle--;
+      r.settle.push_back(settle - begin);
+      for (size_t j = settle; j < i; j++) {
+        double e = out[j] - trace[begin].level;
+        r.sumSquares += e * e;
+        r.settled++;
+      }
+    }
+    begin = i;
+  }
+
+  const int rounds = 200;
+  volatile double sink = 0;
+  auto timeStart = std::chrono::steady_clock::now();
+  for (int k = 0; k < rounds; k++) {
+    for (const Sample& s : trace) {
+      filter.hint(s.lifted);
+      filter.add(s.reading);
+      sink = filter.average();
+    }
+  }
+  std::chrono::duration<double, std::nano> t =
+      std::chrono::steady_clock::now() - timeStart;
+  r.nsPerSample = t.count() / ((double)rounds * trace.size());
+  (void)sink;
+  return r;
+}
+
+int percentile(std::vector<int> v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[std::min(v.size() - 1, (size_t)(p * v.size()))];
+}
+
+int worst(const Result& r) {
+  return r.settle.empty() ? 0
+                          : *std::max_element(r.settle.begin(), r.settle.end());
+}
+
+void report(const char* name, const Result& r) {
+  printf("%-20s settle samples p50 %3d, max %3d (%4d ms); settled rms %.1f; "
+         "%.1f ns/sample\n",
+         name, percentile(r.settle, 0.5), worst(r), worst(r) * 1000 / SampleRate,
+         r.settled ? sqrt(r.sumSquares / r.settled) : 0.0, r.nsPerSample);
+}
+
+}  // namespace
+
+int filterCheck(int argc, char** argv) {
+  Trace trace;
+  if (argc > 1) {
+    if (!load(argv[1], trace)) {
+      fprintf(stderr, "Could not read a trace from %s\n", argv[1]);
+      return 1;
+    }
+  } else {
+    trace = simulate();
+  }
+  printf("%zu samples at %dHz, tolerance %.0f counts\n", trace.size(),
+         SampleRate, Tolerance);
+
+  Result boxcar = run(trace, BoxcarFilter());
+  Result steps = run(trace, AdaptiveFilter(false));
+  Result hinted = run(trace, AdaptiveFilter(true));
+  report("32-sample boxcar", boxcar);
+  report("FillFilter", steps);
+  report("FillFilter + lifted", hinted);
+
+  // Faster to settle, no noisier once it has, and cheaper.
+  bool ok = worst(hinted) < worst(boxcar) && worst(steps) < worst(boxcar) &&
+            hinted.sumSquares / std::max(1UL, hinted.settled) <=
+                1.5 * boxcar.sumSquares / std::max(1UL, boxcar.settled) &&
+            hinted.nsPerSample < boxcar.nsPerSample;
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,310 @@
+#include "KettleSim.hh"
+
+#include <string.h>
+
+#include "EkgDecoder.hh"
+
+// The magic the app opens with, see the README.
+static const uint8_t Init[20] = {0xef, 0xdd, 0x0b, 0x30, 0x31, 0x32, 0x33,
+                                 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x30,
+                                 0x31, 0x32, 0x33, 0x34, 0x9a, 0x6d};
+
+// About a liter on 1200W: 0.6F a second, easing in over the last 10F.
+static const double FullRate = 0.6;
+static const double EaseBand = 10;
+// Seconds for the gap to the room to shrink by e when off.
+static const double CoolingTime = 1500;
+
+KettleSim::KettleSim(const BLEAddress& address, const Config& config)
+    : address(address), config(config), rng(config.seed) {
+  thread = HostThread([this]() { run(); });
+}
+
+KettleSim::~KettleSim() {
+  stop = true;
+  thread.join();
+}
+
+void KettleSim::configure(const Config& config) {
+  std::lock_guard<std::mutex> lock(mtx);
+  this->config = config;
+}
+
+void KettleSim::lift(bool lifted) {
+  std::lock_guard<std::mutex> lock(mtx);
+  if (lifted == this->lifted) return;
+  this->lifted = lifted;
+  countdown = lifted && power ? Countdown : 0;
+  sendLifted();
+}
+
+void KettleSim::setHold(bool hold) {
+  std::lock_guard<std::mutex> lock(mtx);
+  this->hold = hold;
+  sendHold();
+}
+
+float KettleSim::getTemperature() const {
+  std::lock_guard<std::mutex> lock(mtx);
+  return temperature;
+}
+
+bool KettleSim::isOn() const {
+  std::lock_guard<std::mutex> lock(mtx);
+  return power;
+}
+
+uint8_t KettleSim::getTarget() const {
+  std::lock_guard<std::mutex> lock(mtx);
+  return target;
+}
+
+bool KettleSim::isReady() const {
+  std::lock_guard<std::mutex> lock(mtx);
+  return ready;
+}
+
+KettleSim::Stats KettleSim::getStats() const {
+  std::lock_guard<std::mutex> lock(mtx);
+  return stats;
+}
+
+// A new link starts from scratch: nothing is sent until the handshake.
+void KettleSim::onConnect() {
+  std::lock_guard<std::mutex> lock(mtx);
+  connected = true;
+  ready = false;
+  writes.clear();
+  outgoing.clear();
+  notifications.clear();
+}
+
+void KettleSim::onDisconnect() {
+  std::lock_guard<std::mutex> lock(mtx);
+  connected = ready = false;
+  writes.clear();
+  outgoing.clear();
+  notifications.clear();
+}
+
+// On the client's task: just queue the write for the kettle.
+void KettleSim::onWrite(const uint8_t* data, size_t length) {
+  std::lock_guard<std::mutex> lock(mtx);
+  stats.writes++;
+  if (!connected) return;
+  if (lose()) {
+    stats.lostWrites++;
+    return;
+  }
+  Packet write = {delayed(millis()), std::vector<uint8_t>(data, data + length)};
+  // The link keeps them in order, whatever the delay.
+  if (!writes.empty() && (long)(writes.back().due - write.due) > 0)
+    write.due = writes.back().due;
+  writes.push_back(write);
+}
+
+void KettleSim::run() {
+  BLEHostRadio& radio = BLEDevice::radio();
+  unsigned long timeLast = millis();
+  std::vector<Packet> due;
+  unsigned long wait = 1;
+  while (!stop) {
+    delay(wait);
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      unsigned long timeNow = millis();
+      heat((timeNow - timeLast) * config.speed / 1000.0);
+      timeLast = timeNow;
+      while (!writes.empty() && (long)(timeNow - writes.front().due) >= 0) {
+        handle(writes.front().bytes);
+        writes.pop_front();
+      }
+      if (ready && timeNow - timeReport >= config.statePeriod) {
+        timeReport = timeNow;
+        sendCurrent();
+        sendStatus();
+      }
+      if (connected && timeNow - timeEvent >= config.interval) {
+        timeEvent = timeNow;
+        connectionEvent(timeNow);
+      }
+      while (!notifications.empty() &&
+             (long)(timeNow - notifications.front().due) >= 0) {
+        due.push_back(notifications.front());
+        notifications.pop_front();
+      }
+      wait = untilNext(timeNow);
+    }
+    // Not under our lock: the radio calls us with its own held.
+    for (Packet& p : due) radio.notify(address, p.bytes.data(), p.bytes.size());
+    due.clear();
+  }
+}
+
+// Until whatever is due next, and no longer than a connection interval,
+// where writes are picked up; waking every ms would keep a virtual clock busy
+// for nothing.
+unsigned long KettleSim::untilNext(unsigned long timeNow) const {
+  long wait = config.interval;
+  auto sooner = [&](unsigned long due) {
+    long left = (long)(due - timeNow);
+    if (left < wait) wait = left;
+  };
+  if (!writes.empty()) sooner(writes.front().due);
+  if (!notifications.empty()) sooner(notifications.front().due);
+  if (ready) sooner(timeReport + config.statePeriod);
+  if (connected) sooner(timeEvent + config.interval);
+  return wait < 1 ? 1 : wait;
+}
+
+void KettleSim::heat(double seconds) {
+  if (power && lifted) {
+    countdown -= seconds;
+    if (countdown <= 0) {
+      countdown = 0;
+      power = false;
+      sendPower();
+    }
+  }
+  if (power && !lifted) {
+    double gap = target - temperature;
+    double rate =
+        gap > EaseBand ? FullRate : FullRate * (0.2 + 0.8 * gap / EaseBand);
+    temperature += rate * seconds;
+    if (temperature >= target) {
+      temperature = target;
+      // Without hold it's done once there.
+      if (!hold) {
+        power = false;
+        sendPower();
+        sendStatus();
+      }
+    }
+  } else {
+    temperature -= (temperature - Ambient) * seconds / CoolingTime;
+  }
+
+  if ((uint8_t)temperature != reported) sendCurrent();
+  uint8_t shown = (uint8_t)(countdown + 0.999);
+  if (shown != reportedCountdown) {
+    reportedCountdown = shown;
+    frame({0x04, shown, 0x00, 0x00});
+  }
+}
+
+void KettleSim::handle(const std::vector<uint8_t>& write) {
+  const uint8_t* w = write.data();
+  size_t length = write.size();
+  if (length < 3 || w[0] != Ekg::Magic0 || w[1] != Ekg::Magic1) {
+    stats.ignored++;
+    return;
+  }
+  if (w[2] == 0x0b) {
+    if (length != sizeof(Init) || memcmp(w, Init, length) != 0) {
+      stats.ignored++;
+      return;
+    }
+    stats.inits++;
+    ready = true;
+    dump();
+    return;
+  }
+  if (!ready || w[2] != 0x0a || length != 8) {
+    stats.ignored++;
+    return;
+  }
+
+  // Sequence, type, value, sequence + value, type.
+  uint8_t type = w[4], value = w[5];
+  if ((uint8_t)(w[3] + value) != w[6] || w[7] != type || type > 1) {
+    stats.badCommands++;
+    return;
+  }
+  stats.commands++;
+  // Every command is answered with the state it's about, changed or not.
+  if (type == 0) {
+    power = value != 0 && !lifted;
+    countdown = 0;
+    sendPower();
+    sendStatus();
+  } else {
+    target = value < MinTarget ? MinTarget : value > MaxTarget ? MaxTarget
+                                                               : value;
+    sendTarget();
+  }
+}
+
+void KettleSim::frame(std::initializer_list<uint8_t> payload) {
+  if (!ready) return;
+  if (outgoing.size() + 2 + payload.size() > MaxOutgoing) {
+    stats.overruns++;
+    return;
+  }
+  outgoing.push_back(Ekg::Magic0);
+  outgoing.push_back(Ekg::Magic1);
+  outgoing.insert(outgoing.end(), payload);
+  stats.frames++;
+}
+
+// Everything, as right after the handshake.
+void KettleSim::dump() {
+  sendPower();
+  sendHold();
+  sendTarget();
+  sendCurrent();
+  sendLifted();
+  sendStatus();
+}
+
+void KettleSim::sendPower() { frame({0x00, power, 0x00}); }
+
+void KettleSim::sendHold() { frame({0x01, hold, 0x00}); }
+
+void KettleSim::sendTarget() { frame({0x02, target, 0x01, 0x00}); }
+
+void KettleSim::sendCurrent() {
+  reported = (uint8_t)temperature;
+  frame({0x03, reported, 0x01, 0x00});
+}
+
+void KettleSim::sendLifted() { frame({0x08, !lifted, 0x00}); }
+
+void KettleSim::sendStatus() {
+  bool holding = power && hold && temperature >= target;
+  frame({0x05, 0xff, 0xff, 0xff});
+  frame({0x06, holding, 0x00});
+  frame({0x07, 0x00, 0x00});
+}
+
+// What goes out at one connection event: up to perEvent notifications of
+// whatever is queued, some of them cut short mid-frame.
+void KettleSim::connectionEvent(unsigned long timeNow) {
+  for (int i = 0; i < config.perEvent && !outgoing.empty(); i++) {
+    size_t n =
+        outgoing.size() < config.maxChunk ? outgoing.size() : config.maxChunk;
+    if (n > 1 && std::uniform_real_distribution<float>(0, 1)(rng) < config.split)
+      n = 1 + rng() % (n - 1);
+    Packet p = {delayed(timeNow), std::vector<uint8_t>(outgoing.begin(),
+                                                       outgoing.begin() + n)};
+    outgoing.erase(outgoing.begin(), outgoing.begin() + n);
+    stats.notifications++;
+    stats.bytes += n;
+    if (lose()) {
+      stats.lostNotifications++;
+      continue;
+    }
+    if (!notifications.empty() && (long)(notifications.back().due - p.due) > 0)
+      p.due = notifications.back().due;
+    notifications.push_back(p);
+  }
+}
+
+bool KettleSim::lose() {
+  return config.loss > 0 &&
+         std::uniform_real_distribution<float>(0, 1)(rng) < config.loss;
+}
+
+unsigned long KettleSim::delayed(unsigned long timeNow) {
+  return timeNow + config.latency +
+         (config.jitter > 0 ? rng() % (config.jitter + 1) : 0);
+}
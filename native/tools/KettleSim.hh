@@ -0,0 +1,136 @@
+#ifndef __KETTLESIM_H__
+#define __KETTLESIM_H__
+
+// A simulated Stagg EKG+ on the far end of the BLE shim's radio: add it as
+// the peripheral of a simulated peer and StaggKettle talks to it as to the
+// real thing. It speaks the protocol from the README: nothing is sent until
+// the ekgInit handshake, which is answered with a full state dump; 8-byte
+// 0x0a commands with a good checksum are applied and answered with the
+// state they change; and temperature and status frames 0x00-0x08 keep
+// coming. Outgoing bytes are cut into notifications at connection events,
+// whole or split mid-frame like the kettle's serial bridge does, and every
+// write and notification can be delayed or lost.
+//
+// The water heats at full power until close to the target, then eases in;
+// without hold the kettle switches off once there, and it cools towards the
+// room when off. Lifted, the heater stops and a countdown switches the
+// kettle off unless it's put back. All of it runs speed times faster than
+// real time, on the simulator's own thread (a HostThread, so a simulation
+// on the virtual clock runs it too).
+
+#include <Arduino.h>
+#include <BLEDevice.h>
+#include <HostClock.h>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <vector>
+
+class KettleSim : public BLEHostPeripheral {
+ public:
+  struct Config {
+    float speed = 1;                 // Simulated seconds per real second.
+    unsigned long interval = 30;     // ms between connection events.
+    int perEvent = 4;                // Notifications per connection event.
+    size_t maxChunk = 20;            // Notification payload: MTU 23 less 3.
+    float split = 0.3;               // Chance a notification is cut short.
+    unsigned long statePeriod = 1000;  // ms between temperature reports.
+    unsigned long latency = 0;       // ms each way, plus up to jitter.
+    unsigned long jitter = 0;
+    float loss = 0;  // Chance each write or notification is lost.
+    uint32_t seed = 1;
+  };
+
+  struct Stats {
+    unsigned long writes = 0;
+    unsigned long inits = 0;
+    unsigned long commands = 0;     // Applied.
+    unsigned long badCommands = 0;  // Bad checksum or unknown type.
+    unsigned long ignored = 0;      // Before the handshake, or not a frame.
+    unsigned long lostWrites = 0;
+    unsigned long frames = 0;
+    unsigned long overruns = 0;  // Frames dropped with the buffer full.
+    unsigned long notifications = 0;
+    unsigned long lostNotifications = 0;
+    unsigned long bytes = 0;
+  };
+
+  static const int Ambient = 70;   // F
+  static const int MinTarget = 160, MaxTarget = 212;
+  static const int Countdown = 30;  // Seconds off the base before it's off.
+  // Bytes the serial bridge holds for the link before it drops frames.
+  static const size_t MaxOutgoing = 512;
+
+  KettleSim(const BLEAddress& address, const Config& config);
+  ~KettleSim();
+
+  void configure(const Config& config);
+  // At the kettle.
+  void lift(bool lifted);
+  void setHold(bool hold);
+
+  float getTemperature() const;
+  bool isOn() const;
+  uint8_t getTarget() const;
+  // Whether a client finished the handshake.
+  bool isReady() const;
+  Stats getStats() const;
+
+  // BLEHostPeripheral
+  void onConnect();
+  void onDisconnect();
+  void onWrite(const uint8_t* data, size_t length);
+
+ private:
+  struct Packet {
+    unsigned long due;
+    std::vector<uint8_t> bytes;
+  };
+
+  const BLEAddress address;
+  Config config;
+  mutable std::mutex mtx;
+  std::mt19937 rng;
+  std::atomic<bool> stop{false};
+  HostThread thread;
+
+  // The kettle.
+  bool power = false;
+  bool hold = false;
+  bool lifted = false;
+  uint8_t target = 205;
+  double temperature = Ambient;
+  double countdown = 0;  // Seconds, while lifted and on.
+  uint8_t reported = 0;  // Last temperature and countdown sent.
+  uint8_t reportedCountdown = 0;
+
+  // The link.
+  bool connected = false;
+  bool ready = false;
+  std::deque<Packet> writes;         // Received, not yet handled.
+  std::deque<uint8_t> outgoing;      // Not yet cut into notifications.
+  std::deque<Packet> notifications;  // On their way.
+  unsigned long timeEvent = 0;
+  unsigned long timeReport = 0;
+  Stats stats;
+
+  void run();
+  unsigned long untilNext(unsigned long timeNow) const;
+  void heat(double seconds);
+  void handle(const std::vector<uint8_t>& write);
+  void frame(std::initializer_list<uint8_t> payload);
+  void dump();
+  void sendPower();
+  void sendHold();
+  void sendTarget();
+  void sendCurrent();
+  void sendLifted();
+  void sendStatus();
+  void connectionEvent(unsigned long timeNow);
+  bool lose();
+  unsigned long delayed(unsigned long timeNow);
+};
+
+#endif
@@ -0,0 +1,336 @@
+// Several kettles at once through KettleManager, on the shim's simulated
+// radio. First connecting: how long one shared scan takes to get every slot
+// connected, a dropped kettle coming back while the others stay up, and a
+// spare kettle taking the slot of one that's gone for good. Then the cost
+// of finding a notification's kettle, through the slot table against the
+// hashed map it replaced, checking each kettle's frames land on it. Last,
+// status uploads for three kettles over hours of brews in virtual time: one
+// request per kettle as before, against one multi-location update for all.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "KettleManager.hh"
+#include "StatePublisher.hh"
+#include "Tools.hh"
+
+namespace {
+
+const int Slots = KettleManager::MaxKettles;
+const BLEUUID ServiceUUID("00001820-0000-1000-8000-00805f9b34fb");
+const char* Addresses[] = {"c4:4f:33:0a:17:d0", "c4:4f:33:0a:17:d1",
+                           "c4:4f:33:0a:17:d2", "c4:4f:33:0a:17:d3"};
+
+// The kettle task: manager.loop() every 10ms until stopped.
+class Runner {
+ public:
+  Runner(KettleManager& manager) : manager(manager) {
+    for (int i = 0; i < Slots; i++)
+      readers.emplace_back(manager.get(i).getStatus());
+    status.resize(Slots);
+    start();
+  }
+  ~Runner() { halt(); }
+
+  void start() {
+    stop = false;
+    thread = std::thread([this]() {
+      while (!stop) {
+        manager.loop();
+        delay(10);
+      }
+    });
+  }
+  void halt() {
+    stop = true;
+    if (thread.joinable()) thread.join();
+  }
+
+  void poll() {
+    for (int i = 0; i < Slots; i++) readers[i].poll(status[i]);
+  }
+  int connected() {
+    poll();
+    int n = 0;
+    for (const StaggKettle::Status& s : status)
+      n += s.state == StaggKettle::Connected;
+    return n;
+  }
+  int slotOf(const char* address) {
+    poll();
+    for (int i = 0; i < Slots; i++)
+      if (strcmp(status[i].link.address, address) == 0) return i;
+    return -1;
+  }
+  // Waits for cond, polling; returns ms waited, or -1 on timeout.
+  long waitFor(std::function<bool()> cond, unsigned long timeout = 30000) {
+    unsigned long timeStart = millis();
+    while (millis() - timeStart < timeout) {
+      if (cond()) return millis() - timeStart;
+      delay(5);
+    }
+    return -1;
+  }
+
+  std::vector<StaggKettle::Status> status;
+
+ private:
+  KettleManager& manager;
+  std::vector<StaggKettle::StatusSnapshot::Reader> readers;
+  std::atomic<bool> stop{false};
+  std::thread thread;
+};
+
+int checkConnecting(KettleManager& manager, Runner& runner) {
+  int errors = 0;
+  BLEHostRadio& radio = BLEDevice::radio();
+
+  long all = runner.waitFor([&]() { return runner.connected() == Slots; });
+  printf("%d kettles connected after %ld ms, %lu scans\n", Slots, all,
+         manager.getStats().scans);
+  if (all < 0) errors++;
+  for (int i = 0; i < Slots; i++)
+    if (runner.slotOf(Addresses[i]) < 0) errors++;
+
+  // One drops; the others must not notice.
+  int slot = runner.slotOf(Addresses[1]);
+  unsigned long before[Slots];
+  for (int i = 0; i < Slots; i++) before[i] = runner.status[i].connect.connects;
+  radio.setPresent(BLEAddress(Addresses[1]), false);
+  radio.setPresent(BLEAddress(Addresses[1]), true);
+  long back = runner.waitFor([&]() {
+    runner.poll();
+    return runner.status[slot].connect.connects > before[slot] &&
+           runner.connected() == Slots;
+  });
+  printf("dropped kettle back after %ld ms (%lu ms to connected)\n", back,
+         runner.status[slot].connect.lastTime);
+  if (back < 0) errors++;
+  for (int i = 0; i < Slots; i++)
+    if (i != slot && runner.status[i].connect.connects != before[i]) errors++;
+
+  // A spare kettle comes into range and another goes for good: the spare
+  // gets its slot.
+  radio.addPeer(
+      BLEAdvertisedDevice("EKG-spare", BLEAddress(Addresses[3]), ServiceUUID));
+  delay(500);
+  if (runner.slotOf(Addresses[3]) >= 0) errors++;  // No slot was free.
+  slot = runner.slotOf(Addresses[2]);
+  radio.setPresent(BLEAddress(Addresses[2]), false);
+  long spare = runner.waitFor([&]() {
+    return runner.slotOf(Addresses[3]) == slot && runner.connected() == Slots;
+  });
+  printf("spare kettle took slot %d after %ld ms\n", slot, spare);
+  if (spare < 0) errors++;
+  const KettleManager::Stats& s = manager.getStats();
+  printf("manager: %lu scans, %lu found, %lu assigned\n", s.scans, s.found,
+         s.assigned);
+  return errors;
+}
+
+// Notifications for every kettle, round robin, each carrying that kettle's
+// own current temperature.
+int checkDispatch(KettleManager& manager, unsigned long count) {
+  int errors = 0;
+  BLEHostRadio& radio = BLEDevice::radio();
+  BLERemoteCharacteristic* characteristics[Slots];
+  uint8_t frames[Slots][6];
+  for (int i = 0; i < Slots; i++) {
+    StaggKettle& kettle = manager.get(i);
+    characteristics[i] =
+        radio.characteristic(BLEAddress(kettle.getLink().address));
+    if (characteristics[i] == nullptr) return 1;
+    const uint8_t frame[] = {0xef, 0xdd, 0x03, (uint8_t)(100 + i), 0x01, 0x00};
+    memcpy(frames[i], frame, sizeof(frame));
+  }
+
+  // What bleNotify did before: look the characteristic up, twice.
+  std::unordered_map<BLERemoteCharacteristic*, StaggKettle*> notifiers;
+  for (int i = 0; i < Slots; i++) notifiers[characteristics[i]] = &manager.get(i);
+  std::function<void(BLERemoteCharacteristic*, uint8_t*, size_t, bool)> hashed =
+      [&](BLERemoteCharacteristic* c, uint8_t* data, size_t length,
+          bool isNotify) {
+        if (notifiers.count(c) == 0) return;
+        notifiers[c]->onNotify(c, data, length, isNotify);
+      };
+
+  double ns[2];
+  for (int run = 0; run < 2; run++) {
+    std::chrono::duration<double, std::nano> t(0);
+    for (unsigned long n = 0; n < count;) {
+      auto timeStart = std::chrono::steady_clock::now();
+      // Batches small enough for every kettle's notification queue.
+      for (int k = 0; k < 96; k++, n++) {
+        int i = n % Slots;
+        if (run == 0)
+          hashed(characteristics[i], frames[i], sizeof(frames[i]), true);
+        else
+          characteristics[i]->deliver(frames[i], sizeof(frames[i]));
+      }
+      t += std::chrono::steady_clock::now() - timeStart;
+      for (int i = 0; i < Slots; i++) manager.get(i).processNotifications();
+    }
+    ns[run] = t.count() / count;
+    for (int i = 0; i < Slots; i++) {
+      if (manager.get(i).getCurrentTemp() != 100 + i) errors++;
+      if (manager.get(i).getRxOverflows() != 0) errors++;
+    }
+  }
+  printf("notify dispatch: hashed map %.1f ns, slot table %.1f ns per "
+         "notification, %d misrouted\n",
+         ns[0], ns[1], errors);
+  return errors;
+}
+
+void addFields(StatePublisher& publisher, bool fill) {
+  publisher.addBool("isOn", 0);
+  publisher.addBool("isLifted", 0);
+  publisher.addBool("isHold", 0);
+  publisher.addInt("currentTemp", 5000);
+  publisher.addInt("targetTemp", 0);
+  publisher.addInt("units", 0);
+  publisher.addInt("commandsConfirmed", 0);
+  publisher.addInt("lastCommandLatency", 0);
+  if (fill) publisher.addInt("fill", 5000);
+}
+
+// A kettle that boils every so often, holds, is poured from and cools.
+struct Brewer {
+  enum { IsOn, IsLifted, IsHold, CurrentTemp, Fields };
+  long state[Fields] = {0, 0, 0, 70};
+  unsigned long next;
+  unsigned long phase = 0;
+
+  void tick(unsigned long timeNow, std::mt19937& rng) {
+    if (!state[IsOn] && timeNow >= next) {
+      state[IsOn] = 1;
+      phase = timeNow;
+    }
+    if (state[IsOn]) {
+      unsigned long t = timeNow - phase;
+      if (state[CurrentTemp] < 205 && !state[IsHold]) {
+        if (t % 2000 == 0) state[CurrentTemp]++;
+      } else if (!state[IsHold]) {
+        state[IsHold] = 1;
+        phase = timeNow;
+      } else if (t > 300000) {
+        state[IsOn] = state[IsHold] = 0;
+        state[IsLifted] = 1;
+        next = timeNow + 45 * 60000 + rng() % (45 * 60000);
+        phase = timeNow;
+      }
+    } else if (state[CurrentTemp] > 70 && (timeNow - phase) % 20000 == 0) {
+      state[CurrentTemp]--;
+      if (timeNow - phase > 60000) state[IsLifted] = 0;
+    }
+  }
+};
+
+int checkBatching(int hours) {
+  const unsigned long step = 10;
+  StatePublisher separate[Slots] = {StatePublisher(1000), StatePublisher(1000),
+                                    StatePublisher(1000)};
+  StatePublisher batched[Slots] = {StatePublisher(1000), StatePublisher(1000),
+                                   StatePublisher(1000)};
+  std::string paths[Slots];
+  for (int i = 0; i < Slots; i++) {
+    addFields(separate[i], i == 0);
+    addFields(batched[i], i == 0);
+    paths[i] = "EKG-" + std::to_string(i + 1) + "/status/";
+  }
+  std::mt19937 rng(20);
+  Brewer brewers[Slots];
+  for (int i = 0; i < Slots; i++) brewers[i].next = i * 7 * 60000;
+
+  unsigned long separateRequests = 0, batchedRequests = 0;
+  unsigned long separateBytes = 0, batchedBytes = 0;
+  std::string sample;
+  int errors = 0;
+  for (unsigned long timeNow = step; timeNow < hours * 3600000ul;
+       timeNow += step) {
+    for (int i = 0; i < Slots; i++) {
+      brewers[i].tick(timeNow, rng);
+      for (int f = 0; f < Brewer::Fields; f++) {
+        separate[i].set(f, brewers[i].state[f], timeNow);
+        batched[i].set(f, brewers[i].state[f], timeNow);
+      }
+    }
+    // Before: each kettle's delta PATCHed to its own path.
+    for (int i = 0; i < Slots; i++) {
+      if (!separate[i].due(timeNow)) continue;
+      separateBytes += separate[i].delta(timeNow).size();
+      separateRequests++;
+      separate[i].acknowledge(true, timeNow);
+    }
+    // Now: as main.cc, everything pending once any is due.
+    bool due = false;
+    for (int i = 0; i < Slots; i++) due = due || batched[i].due(timeNow);
+    if (!due) continue;
+    std::string body = "{";
+    bool included[Slots];
+    for (int i = 0; i < Slots; i++) {
+      included[i] = batched[i].pending();
+      if (!included[i]) continue;
+      batched[i].prepare();
+      batched[i].append(body, paths[i].c_str(), timeNow);
+    }
+    body += "}";
+    if (body.find("\"EKG-") != 1 || body.find(",}") != std::string::npos)
+      errors++;
+    if (sample.empty() && included[0] && included[1]) sample = body;
+    batchedBytes += body.size();
+    batchedRequests++;
+    for (int i = 0; i < Slots; i++)
+      if (included[i]) batched[i].acknowledge(true, timeNow);
+  }
+  printf("status over %d hours: per kettle %lu requests, %lu bytes; batched "
+         "%lu requests, %lu bytes\n",
+         hours, separateRequests, separateBytes, batchedRequests, batchedBytes);
+  printf("batched upload: %s\n", sample.c_str());
+  if (batchedRequests >= separateRequests) errors++;
+  return errors;
+}
+
+}  // namespace
+
+int kettlesCheck(int argc, char** argv) {
+  int hours = argc > 1 ? atoi(argv[1]) : 6;
+  unsigned long notifications = argc > 2 ? atol(argv[2]) : 3000000;
+
+  BLEHostRadio& radio = BLEDevice::radio();
+  radio.simulate();
+  radio.scanDelay = 1500;
+  radio.connectDelay = 300;
+  radio.connectTimeout = 2000;
+  for (int i = 0; i < Slots; i++) {
+    std::string name = "EKG-" + std::to_string(i + 1);
+    radio.addPeer(
+        BLEAdvertisedDevice(name, BLEAddress(Addresses[i]), ServiceUUID));
+  }
+
+  int errors = 0;
+  {
+    KettleManager manager;
+    Runner runner(manager);
+    errors += checkConnecting(manager, runner);
+    runner.halt();
+    errors += checkDispatch(manager, notifications);
+    // Its clients would call back into deleted kettles.
+    radio.dropAll();
+  }
+  errors += checkBatching(hours);
+
+  printf("errors: %d\n", errors);
+  printf("%s\n", errors == 0 ? "OK" : "FAILED");
+  return errors == 0 ? 0 : 1;
+}
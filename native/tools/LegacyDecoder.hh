@@ -0,0 +1,51 @@
+#ifndef __LEGACYDECODER_H__
+#define __LEGACYDECODER_H__
+
+// The byte-at-a-time frame recognizer StaggKettle::onNotify used before
+// EkgDecoder, kept verbatim as the reference for decoder checks.
+
+#include "EkgDecoder.hh"
+
+class LegacyDecoder {
+ public:
+  template <typename Sink>
+  void feed(const uint8_t* pData, size_t length, Sink&& onFrame) {
+    for (size_t i = 0; i < length; i++) {
+      if (bufferState == 0 && pData[i] == 0xef) {
+        bufferState = 1;
+        bufferPos = 0;
+        continue;
+      } else if (bufferState == 1 && pData[i] == 0xdd) {
+        bufferState = 2;
+        bufferPos = 0;
+        continue;
+      } else if (bufferState == 2) {
+        buffer[bufferPos] = pData[i];
+        if (bufferPos > 0 && buffer[0] < Ekg::States &&
+            bufferPos + 1 >= Ekg::StateBytes[buffer[0]]) {
+          onFrame((const uint8_t*)buffer, bufferPos + 1);
+          bufferPos = 0;
+          bufferState = 1;
+        } else if (bufferPos >= 63) {
+          bufferState = 0;
+          bufferPos = 0;
+          continue;
+        } else if (i + 1 < length && pData[i] == 0xef &&
+                   pData[i + 1] == 0xdd) {
+          if (bufferPos > 1) onFrame((const uint8_t*)buffer, bufferPos - 1);
+          bufferPos = 0;
+          bufferState = 1;
+        } else {
+          bufferPos++;
+        }
+      }
+    }
+  }
+
+ private:
+  uint8_t buffer[64];
+  int bufferPos = 0;
+  int bufferState = 0;
+};
+
+#endif
@@ -0,0 +1,373 @@
+// The binary log (Log.hh): a decoder for what the bridge prints, checks that
+// decoded records read exactly as printf would have printed them, that the
+// ring loses nothing but what it counts with several tasks logging at once,
+// and what a log call costs next to the String building it replaced.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Log.hh"
+#include "MpscRing.hh"
+#include "Tools.hh"
+
+// Splits console output into text lines and log frames, and prints each
+// record with the format its site sent earlier.
+class LogDecoder {
+ public:
+  typedef std::function<void(const std::string&)> Output;
+
+  struct Stats {
+    unsigned long lines = 0;
+    unsigned long records = 0;
+    unsigned long formats = 0;
+    unsigned long dropped = 0;  // As the bridge reported.
+    unsigned long badFrames = 0;
+    unsigned long unknown = 0;  // Records whose format wasn't seen.
+  };
+
+  explicit LogDecoder(Output output) : output(output) {}
+
+  void feed(const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; i++) feed(data[i]);
+  }
+
+  // What's left of a line without its newline.
+  void finish() {
+    if (!text.empty()) line(text);
+    text.clear();
+  }
+
+  const Stats& getStats() const { return stats; }
+
+ private:
+  Output output;
+  std::string formats[256];
+  uint8_t levels[256] = {};
+  bool known[256] = {};
+  std::string text;
+  std::vector<uint8_t> frame;  // From its 0x00, while one is coming in.
+  Stats stats;
+
+  void feed(uint8_t c) {
+    if (!frame.empty()) {
+      frame.push_back(c);
+      if (frame.size() >= 3 && frame.size() == 4 + (size_t)frame[2])
+        endFrame();
+      return;
+    }
+    if (c == 0) {
+      frame.push_back(c);
+    } else if (c == '\n') {
+      line(text);
+      text.clear();
+    } else if (c != '\r') {
+      text += (char)c;
+    }
+  }
+
+  void line(const std::string& s) {
+    stats.lines++;
+    output(s);
+  }
+
+  void endFrame() {
+    std::vector<uint8_t> f;
+    f.swap(frame);
+    uint8_t sum = 0;
+    for (size_t i = 1; i + 1 < f.size(); i++) sum += f[i];
+    const uint8_t* payload = f.data() + 3;
+    size_t length = f[2];
+    if (sum != f.back() || !handle(f[1], payload, length)) {
+      // Not a frame after all: the rest is input again.
+      stats.badFrames++;
+      feed(f.data() + 1, f.size() - 1);
+    }
+  }
+
+  bool handle(uint8_t type, const uint8_t* payload, size_t length) {
+    char buf[256];
+    if (type == 'F' && length >= 2) {
+      formats[payload[0]].assign((const char*)payload + 2, length - 2);
+      levels[payload[0]] = payload[1];
+      known[payload[0]] = true;
+      stats.formats++;
+      return true;
+    }
+    if (type == 'R' && length >= 5) {
+      uint8_t id = payload[0];
+      uint32_t time;
+      memcpy(&time, payload + 1, 4);
+      stats.records++;
+      if (known[id]) {
+        Log::formatLine(buf, sizeof(buf), levels[id], time,
+                        formats[id].c_str(), payload + 5, length - 5);
+      } else {
+        stats.unknown++;
+        int n = snprintf(buf, sizeof(buf),
+                         "[%6lu.%03lu] ? Format %u not seen yet (send l):",
+                         (unsigned long)(time / 1000),
+                         (unsigned long)(time % 1000), id);
+        for (size_t i = 5; i < length && n + 4 < (int)sizeof(buf); i++)
+          n += snprintf(buf + n, sizeof(buf) - n, " %02x", payload[i]);
+      }
+      line(buf);
+      return true;
+    }
+    if (type == 'D' && length == 4) {
+      uint32_t n;
+      memcpy(&n, payload, 4);
+      stats.dropped += n;
+      snprintf(buf, sizeof(buf), "Log: %lu records dropped", (unsigned long)n);
+      line(buf);
+      return true;
+    }
+    return false;
+  }
+};
+
+static int decode(const char* path) {
+  FILE* in = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+  if (in == nullptr) {
+    fprintf(stderr, "Can't open %s\n", path);
+    return 1;
+  }
+  LogDecoder decoder([](const std::string& s) { printf("%s\n", s.c_str()); });
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+    decoder.feed(buf, n);
+    fflush(stdout);
+  }
+  decoder.finish();
+  if (in != stdin) fclose(in);
+  const LogDecoder::Stats& s = decoder.getStats();
+  fprintf(stderr,
+          "%lu lines, %lu records, %lu formats, %lu dropped, %lu bad frames, "
+          "%lu without a format\n",
+          s.lines, s.records, s.formats, s.dropped, s.badFrames, s.unknown);
+  return 0;
+}
+
+// Runs Log::drain() with the console going to a file, and returns what it
+// printed.
+static std::string drainToString(std::function<void()> before) {
+  fflush(stdout);
+  FILE* tmp = tmpfile();
+  int saved = dup(1);
+  dup2(fileno(tmp), 1);
+  Serial.begin(115200);
+  before();
+  Log::drain();
+  Serial.end();
+  fflush(stdout);
+  dup2(saved, 1);
+  close(saved);
+  std::string out;
+  rewind(tmp);
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), tmp)) > 0) out.append(buf, n);
+  fclose(tmp);
+  return out;
+}
+
+// The same calls through the log and through snprintf.
+static bool roundTrip() {
+  static const uint8_t frame[] = {0x05, 0xff, 0x00, 0x7f};
+  std::vector<std::string> expected;
+  char buf[192];
+  auto both = [&](int n) { expected.push_back(std::string(buf, n)); };
+  std::string printed = drainToString([&] {
+    LOG_INFO("<Check> Plain");
+    both(snprintf(buf, sizeof(buf), "<Check> Plain"));
+    LOG_WARN("<Check> %d %u %x %5d|%-4u|%c%%", -42, 4000000000u, 0xbeef, 7,
+             9u, 'F');
+    both(snprintf(buf, sizeof(buf), "<Check> %d %u %x %5d|%-4u|%c%%", -42,
+                  4000000000u, 0xbeef, 7, 9u, 'F'));
+    Serial.println("A line printed directly");
+    LOG_ERROR("<Check> %s at %s, %lums", "EKG-2d-25-b0", "c4:4f:33:0a:17:d2",
+              123456ul);
+    both(snprintf(buf, sizeof(buf), "<Check> %s at %s, %lums", "EKG-2d-25-b0",
+                  "c4:4f:33:0a:17:d2", 123456ul));
+    LOG_INFO("<Check> %.2foz = %.1f, %g", 11.75, 2047.25f, 0.5);
+    both(snprintf(buf, sizeof(buf), "<Check> %.2foz = %.1f, %g", 11.75,
+                  2047.25f, 0.5));
+    LOG_INFO("<Check> Frame: %.*s END", (int)sizeof(frame), frame);
+    both(snprintf(buf, sizeof(buf), "<Check> Frame: 05 ff 00 7f END"));
+    LOG_INFO("<Check> %.*s|%8s|", 3, "kettle", "ekg");
+    both(snprintf(buf, sizeof(buf), "<Check> %.*s|%8s|", 3, "kettle", "ekg"));
+    Serial.print("Half a line, ");
+    LOG_INFO("<Check> between the halves");
+    both(snprintf(buf, sizeof(buf), "<Check> between the halves"));
+    Serial.println("then the rest");
+  });
+
+  std::vector<std::string> lines;
+  LogDecoder decoder([&](const std::string& s) { lines.push_back(s); });
+  // A stray zero and a damaged frame first, as on a console opened midway.
+  static const uint8_t noise[] = {'x', 0, 'R', 3, 1, 2, 3, 9, '\n'};
+  decoder.feed(noise, sizeof(noise));
+  decoder.feed((const uint8_t*)printed.data(), printed.size());
+  decoder.finish();
+
+  size_t next = 0;
+  bool direct = false, halves = false;
+  for (const std::string& s : lines) {
+    if (s == "A line printed directly") direct = true;
+    if (s == "Half a line, then the rest") halves = true;
+    // Records are "[    time] L message".
+    if (s.size() < 15 || s[0] != '[') continue;
+    std::string message = s.substr(15);
+    if (next < expected.size() && message == expected[next]) {
+      next++;
+    } else {
+      printf("  got:      %s\n  expected: %s\n", message.c_str(),
+             next < expected.size() ? expected[next].c_str() : "nothing");
+    }
+  }
+  const LogDecoder::Stats& s = decoder.getStats();
+  bool ok = next == expected.size() && direct && halves && s.badFrames == 1;
+  printf("Round trip: %zu of %zu records as printf, direct lines %s, %lu "
+         "bytes as binary: %s\n",
+         next, expected.size(), direct && halves ? "kept" : "LOST",
+         (unsigned long)printed.size(), ok ? "OK" : "FAILED");
+  return ok;
+}
+
+// Producers push (thread, sequence, filler) records while one consumer takes
+// them: each thread's records must arrive whole and in order, and everything
+// pushed must arrive.
+static bool ringStress(uint32_t records, int threads) {
+  MpscRing<1024> ring;
+  std::atomic<int> running{threads};
+  std::vector<uint32_t> next(threads, 0);
+  uint32_t received = 0, errors = 0;
+
+  std::vector<std::thread> producers;
+  for (int t = 0; t < threads; t++) {
+    producers.emplace_back([&, t] {
+      uint8_t record[64];
+      for (uint32_t n = 0; n < records; n++) {
+        size_t length = 8 + (n * 7 + t) % 48;
+        memcpy(record, &t, 4);
+        memcpy(record + 4, &n, 4);
+        for (size_t i = 8; i < length; i++) record[i] = (uint8_t)(n + i);
+        if (!ring.push(record, length)) std::this_thread::yield();
+      }
+      running--;
+    });
+  }
+  for (;;) {
+    size_t length;
+    const uint8_t* data = ring.front(length);
+    if (data == nullptr) {
+      if (running.load() == 0 && ring.front(length) == nullptr) break;
+      std::this_thread::yield();
+      continue;
+    }
+    int t;
+    uint32_t n;
+    memcpy(&t, data, 4);
+    memcpy(&n, data + 4, 4);
+    bool whole = t >= 0 && t < threads && length == 8 + (n * 7 + t) % 48;
+    for (size_t i = 8; whole && i < length; i++)
+      whole = data[i] == (uint8_t)(n + i);
+    if (!whole || n < next[t]) errors++;
+    if (whole) next[t] = n + 1;
+    received++;
+    ring.pop();
+  }
+  for (std::thread& p : producers) p.join();
+  bool ok = errors == 0 && received == ring.getPushed() &&
+            ring.getPushed() + ring.getOverflows() == records * threads;
+  printf("Ring, %d threads x %u: %u received, %u dropped, %u torn or "
+         "reordered, high water %zu/1024: %s\n",
+         threads, records, received, ring.getOverflows(), errors,
+         ring.getHighWater(), ok ? "OK" : "FAILED");
+  return ok;
+}
+
+static volatile size_t sink;
+static double drainTime = 0;
+
+// ns per call against the same loop without it, the caller's side only:
+// the log is drained between batches, outside the clock, as the drain task
+// would.
+template <typename F>
+static double timePerCall(uint32_t calls, F call) {
+  static const uint32_t Batch = 32;
+  auto run = [&](bool withCall) {
+    double ns = 0;
+    for (uint32_t i = 0; i < calls; i += Batch) {
+      auto timeStart = std::chrono::steady_clock::now();
+      for (uint32_t j = i; j < i + Batch; j++) {
+        sink = sink + j;
+        if (withCall) call(j);
+      }
+      auto timeEnd = std::chrono::steady_clock::now();
+      ns += std::chrono::duration<double, std::nano>(timeEnd - timeStart)
+                .count();
+      Log::drain();
+      drainTime += std::chrono::duration<double, std::nano>(
+                       std::chrono::steady_clock::now() - timeEnd)
+                       .count();
+    }
+    return ns;
+  };
+  double base = run(false);
+  double with = run(true);
+  return with > base ? (with - base) / calls : 0;
+}
+
+int logCheck(int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "decode") == 0)
+    return decode(argc > 2 ? argv[2] : "-");
+  uint32_t records = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+  int threads = argc > 2 ? atoi(argv[2]) : 4;
+  bool ok = roundTrip();
+  ok = ringStress(records, threads) && ok;
+
+  uint32_t calls = records * 5;
+  const char* name = "EKG-2d-25-b0";
+  Log::Stats before = Log::getStats();
+  printf("ns per call over %u calls:\n", calls);
+  printf("  LOG_INFO, no arguments      %6.1f\n",
+         timePerCall(calls, [](uint32_t i) { LOG_INFO("<Bench> Plain"); }));
+  printf("  LOG_INFO, 2 ints            %6.1f\n",
+         timePerCall(calls, [](uint32_t i) {
+           LOG_INFO("<Bench> Command %d seq %u", (int)(i % 3), i);
+         }));
+  printf("  LOG_INFO, int and string    %6.1f\n",
+         timePerCall(calls, [&](uint32_t i) {
+           LOG_INFO("<Bench> Device %s seq %u", name, i);
+         }));
+  printf("  LOG_DEBUG (compiled out)    %6.1f\n",
+         timePerCall(calls, [](uint32_t i) {
+           LOG_DEBUG("<Bench> Current %u", i);
+         }));
+  printf("  String building, as before  %6.1f\n",
+         timePerCall(calls, [&](uint32_t i) {
+           String s = "<Bench> Command " + String((int)(i % 3)) + " seq " +
+                      String(i) + " confirmed in " + String(i % 500) + "ms";
+           sink = sink + s.length();
+         }));
+  Log::Stats logged = Log::getStats();
+  uint32_t drained = logged.written - before.written;
+  printf("  drain task, per record      %6.1f (framing, console off)\n",
+         drained ? drainTime / drained : 0);
+  printf("Log: %u records, %u dropped, %d formats, high water %zu/%zu\n",
+         logged.written, logged.dropped, logged.sites, logged.highWater,
+         Log::RingBytes);
+  ok = ok && logged.dropped == 0;
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
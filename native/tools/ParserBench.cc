@@ -0,0 +1,59 @@
+// Microbenchmark for the kettle notify path: feeds recorded-style and synthetic
+// 0xefdd traffic through StaggKettle::onNotify and the notification queue,
+// cut into notifications in several ways, and reports throughput per split.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+
+#include "Corpus.hh"
+#include "StaggKettle.hh"
+#include "Tools.hh"
+
+// Keeps the decoded state observable so the parser can't be optimized away.
+static unsigned long sink = 0;
+
+static void run(const char* name, const Corpus::Traffic& traffic,
+                size_t frames) {
+  std::vector<uint8_t> bytes(traffic.bytes);
+  size_t repeat = (frames + traffic.frames - 1) / traffic.frames;
+
+  for (int s = 0; s < Corpus::SplitCount; s++) {
+    std::vector<Corpus::Chunk> chunks =
+        Corpus::split(bytes, (Corpus::Split)s, 1234 + s);
+    StaggKettle kettle;
+    kettle.onConnect(nullptr);
+
+    auto timeStart = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < repeat; r++) {
+      for (const Corpus::Chunk& c : chunks) {
+        kettle.onNotify(nullptr, bytes.data() + c.offset, c.length, true);
+        kettle.processNotifications();
+      }
+    }
+    auto timeEnd = std::chrono::steady_clock::now();
+    sink += kettle.getCurrentTemp() + kettle.getTargetTemp() + kettle.isOn();
+
+    double ns = std::chrono::duration<double, std::nano>(timeEnd - timeStart)
+                    .count();
+    double totalFrames = (double)traffic.frames * repeat;
+    double totalBytes = (double)bytes.size() * repeat;
+    printf("%-10s %-10s %10.0f %12.0f %10.1f %10.2f %10.1f\n", name,
+           Corpus::SplitNames[s], totalFrames, (double)chunks.size() * repeat,
+           ns / totalFrames, totalBytes / ns * 1e3,
+           ns / ((double)chunks.size() * repeat));
+  }
+}
+
+int parserBench(int argc, char** argv) {
+  size_t frames = argc > 1 ? strtoul(argv[1], nullptr, 10) : 2000000;
+  if (frames == 0) frames = 1;
+
+  printf("%-10s %-10s %10s %12s %10s %10s %10s\n", "corpus", "split",
+         "frames", "notifies", "ns/frame", "MB/s", "ns/notify");
+  run("session", Corpus::session(), frames);
+  run("synthetic", Corpus::synthetic(frames, 42), frames);
+  run("noisy", Corpus::noisy(frames, 42), frames);
+  return sink == 0xffffffff;
+}
@@ -0,0 +1,116 @@
+// Replays a simulated brew (heat-up, hold, lift, pour) through StatePublisher
+// in virtual time, and compares what it uploads against the previous scheme:
+// a full setJSON snapshot whenever anything changed, at most every 5 s.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <random>
+
+#include "StatePublisher.hh"
+#include "Tools.hh"
+
+enum { IsOn, IsLifted, IsHold, CurrentTemp, TargetTemp, Units, Fill,
+       CommandsConfirmed, LastCommandLatency, Fields };
+
+static void addFields(StatePublisher& publisher, unsigned long maxLatency) {
+  publisher.addBool("isOn", 0);
+  publisher.addBool("isLifted", 0);
+  publisher.addBool("isHold", 0);
+  publisher.addInt("currentTemp", maxLatency);
+  publisher.addInt("targetTemp", 0);
+  publisher.addInt("units", 0);
+  publisher.addInt("fill", maxLatency);
+  publisher.addInt("commandsConfirmed", 0);
+  publisher.addInt("lastCommandLatency", 0);
+}
+
+int publishBench(int argc, char** argv) {
+  int brews = argc > 1 ? atoi(argv[1]) : 20;
+  const unsigned long step = 10;  // ms per loop() iteration
+
+  // Same settings as main.cc.
+  StatePublisher publisher(1000);
+  addFields(publisher, 5000);
+  // The old scheme sent everything, at most every 5 s; its fullBytes is what
+  // those snapshots cost.
+  StatePublisher snapshots(5000 + step);
+  addFields(snapshots, 0);
+
+  std::mt19937 rng(1);
+  long state[Fields] = {0, 0, 0, 70, 205, 0, 24, 0, 0};
+  long published[Fields];
+  for (int i = 0; i < Fields; i++) published[i] = -1;
+  unsigned long timeNow = 0, timeChanged = 0, maxWait = 0;
+  bool waiting = false;
+
+  auto tick = [&]() {
+    timeNow += step;
+    for (int i = 0; i < Fields; i++) {
+      publisher.set(i, state[i], timeNow);
+      snapshots.set(i, state[i], timeNow);
+      if (state[i] != published[i] && !waiting) {
+        waiting = true;
+        timeChanged = timeNow;
+      }
+    }
+    if (publisher.due(timeNow)) {
+      publisher.delta(timeNow);
+      publisher.acknowledge(true, timeNow);
+      for (int i = 0; i < Fields; i++) published[i] = state[i];
+      if (waiting && timeNow - timeChanged > maxWait)
+        maxWait = timeNow - timeChanged;
+      waiting = false;
+    }
+    if (snapshots.due(timeNow)) {
+      snapshots.delta(timeNow);
+      snapshots.acknowledge(true, timeNow);
+    }
+  };
+  auto run = [&](unsigned long ms) {
+    for (unsigned long t = 0; t < ms; t += step) tick();
+  };
+
+  for (int b = 0; b < brews; b++) {
+    // Turn on; the kettle confirms shortly after.
+    state[IsOn] = 1;
+    run(100);
+    state[CommandsConfirmed]++;
+    state[LastCommandLatency] = 90 + rng() % 40;
+    // Heat up about a degree every 1.5 s, then hold for a bit.
+    while (state[CurrentTemp] < state[TargetTemp]) {
+      run(1200 + rng() % 600);
+      state[CurrentTemp]++;
+    }
+    state[IsHold] = 1;
+    run(30000);
+    // Lift, pour, put back, switch off.
+    state[IsLifted] = 1;
+    run(8000);
+    state[Fill] = 8 + rng() % 8;
+    state[IsLifted] = 0;
+    state[IsOn] = 0;
+    state[IsHold] = 0;
+    run(2000);
+    // Cool down a degree every 20 s for ten minutes, then refill.
+    for (int i = 0; i < 30; i++) {
+      run(20000);
+      state[CurrentTemp]--;
+    }
+    state[Fill] = 24;
+  }
+
+  const StatePublisher::Stats& s = publisher.getStats();
+  const StatePublisher::Stats& old = snapshots.getStats();
+  printf("%d brews, %.1f min of kettle time, %lu field changes\n", brews,
+         timeNow / 60000.0, s.changes);
+  printf("full snapshots: %6lu requests, %8lu bytes\n", old.uploads,
+         old.fullBytes);
+  printf("deltas:         %6lu requests, %8lu bytes, %lu fields\n", s.uploads,
+         s.bytesSent, s.fieldsSent);
+  printf("bytes saved %.0f%%, requests saved %.0f%%, max wait %lu ms\n",
+         old.fullBytes ? 100.0 * (1.0 - (double)s.bytesSent / old.fullBytes) : 0.0,
+         old.uploads ? 100.0 * (1.0 - (double)s.uploads / old.uploads) : 0.0,
+         maxWait);
+  return 0;
+}
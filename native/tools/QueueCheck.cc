@@ -0,0 +1,268 @@
+// The kettle's CommandQueue: its rules pushed through directly (Set
+// coalescing, Off jumping the line and cancelling On, repeats collapsing)
+// with the order things come out and the Stats they leave, that requests
+// from several threads are all accounted for, and bursts dispatched one per
+// debounce slot on the virtual clock, against the FIFO it replaced.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Arduino.h>
+#include <HostClock.h>
+
+#include "CommandQueue.hh"
+#include "Tools.hh"
+
+namespace {
+
+typedef CommandQueue::Command Command;
+typedef CommandQueue::Entry Entry;
+
+// As StaggKettle's debounceDelay.
+const unsigned long Debounce = 200;
+const unsigned long LoopPeriod = 10;
+
+struct Expect {
+  Command cmd;
+  byte value;
+};
+
+std::string describe(const Entry* entries, int n) {
+  static const char* names[] = {"On", "Off", "Set"};
+  std::string s;
+  for (int i = 0; i < n; i++) {
+    if (i) s += ' ';
+    s += names[entries[i].cmd];
+    if (entries[i].cmd == CommandQueue::Set)
+      s += "(" + std::to_string(entries[i].value) + ")";
+  }
+  return s.empty() ? "nothing" : s;
+}
+
+// Pushes requests, pops everything, and checks what came out and the
+// counters left behind.
+int rule(const char* name, const std::vector<Expect>& pushes,
+         const std::vector<Expect>& expected, unsigned long coalesced,
+         unsigned long cancelled, int maxDepth) {
+  CommandQueue queue;
+  for (const Expect& p : pushes) queue.push(p.cmd, p.value);
+  Entry out[CommandQueue::Capacity + 1];
+  int n = 0;
+  while (n <= CommandQueue::Capacity && queue.pop(out[n])) n++;
+
+  bool order = n == (int)expected.size();
+  for (int i = 0; order && i < n; i++) {
+    order = out[i].cmd == expected[i].cmd &&
+            (out[i].cmd != CommandQueue::Set ||
+             out[i].value == expected[i].value);
+  }
+  CommandQueue::Stats s = queue.getStats();
+  bool counted = s.queued == pushes.size() && s.coalesced == coalesced &&
+                 s.cancelled == cancelled && s.dispatched == (unsigned long)n &&
+                 s.depth == 0 && s.maxDepth == maxDepth && queue.empty();
+  printf("  %-20s -> %-18s queued %lu, coalesced %lu, cancelled %lu, max "
+         "depth %d: %s\n",
+         name, describe(out, n).c_str(), s.queued, s.coalesced, s.cancelled,
+         s.maxDepth, order && counted ? "ok" : order ? "BAD STATS" : "BAD ORDER");
+  return order && counted ? 0 : 1;
+}
+
+int rules() {
+  const Command On = CommandQueue::On, Off = CommandQueue::Off,
+                Set = CommandQueue::Set;
+  std::vector<Expect> sets;
+  for (int i = 0; i < 10; i++) sets.push_back({Set, (byte)(180 + i)});
+  int errors = 0;
+  printf("Rules:\n");
+  errors += rule("Set x10", sets, {{Set, 189}}, 9, 0, 1);
+  errors += rule("On Off", {{On, 0}, {Off, 0}}, {{Off, 0}}, 0, 1, 1);
+  errors += rule("Off On Off", {{Off, 0}, {On, 0}, {Off, 0}}, {{Off, 0}}, 1,
+                 1, 2);
+  errors += rule("On x3", {{On, 0}, {On, 0}, {On, 0}}, {{On, 0}}, 2, 0, 1);
+  errors += rule("Set On Off", {{Set, 190}, {On, 0}, {Off, 0}},
+                 {{Off, 0}, {Set, 190}}, 0, 1, 2);
+  errors += rule("Set On Set", {{Set, 180}, {On, 0}, {Set, 200}},
+                 {{Set, 200}, {On, 0}}, 1, 0, 2);
+  errors += rule("Off Set On", {{Off, 0}, {Set, 170}, {On, 0}},
+                 {{Off, 0}, {Set, 170}, {On, 0}}, 0, 0, 3);
+  errors += rule("Set On Set Off Set",
+                 {{Set, 180}, {On, 0}, {Set, 185}, {Off, 0}, {Set, 190}},
+                 {{Off, 0}, {Set, 190}}, 2, 1, 2);
+  return errors;
+}
+
+// Dispatch times are from the first request a command covers, on the
+// virtual clock; clear() empties the queue but keeps the counters.
+int timing() {
+  int errors = 0;
+  HostClock::simulate(millis());
+  CommandQueue queue;
+  Entry e;
+  queue.push(CommandQueue::Set, 180);
+  delay(300);
+  queue.push(CommandQueue::Set, 190);
+  delay(200);
+  bool popped = queue.pop(e);
+  CommandQueue::Stats s = queue.getStats();
+  if (!popped || e.value != 190 || s.lastDispatchTime != 500) errors++;
+  queue.push(CommandQueue::On);
+  delay(100);
+  queue.pop(e);
+  s = queue.getStats();
+  if (s.lastDispatchTime != 100 || s.maxDispatchTime != 500 ||
+      s.totalDispatchTime != 600)
+    errors++;
+  queue.push(CommandQueue::Set, 170);
+  queue.push(CommandQueue::Off);
+  queue.clear();
+  s = queue.getStats();
+  if (!queue.empty() || queue.pop(e) || s.depth != 0 || s.queued != 5 ||
+      s.dispatched != 2)
+    errors++;
+  HostClock::realtime();
+  printf("Dispatch times and clear(): %s\n", errors ? "WRONG" : "ok");
+  return errors;
+}
+
+// Every request pushed from several threads, with one popping, ends up
+// merged, cancelled, dispatched or still queued.
+int threads(int count, unsigned long pushes) {
+  CommandQueue queue;
+  std::vector<std::thread> workers;
+  for (int t = 0; t < count; t++) {
+    workers.emplace_back([&queue, t, pushes] {
+      for (unsigned long i = 0; i < pushes; i++) {
+        switch ((i + t) % 8) {
+          case 0: queue.push(CommandQueue::On); break;
+          case 1: queue.push(CommandQueue::Off); break;
+          default: queue.push(CommandQueue::Set, (byte)(160 + i % 52));
+        }
+        if (i % 16 == 0) std::this_thread::yield();
+      }
+    });
+  }
+  std::atomic<bool> done{false};
+  unsigned long popped = 0;
+  bool overfull = false;
+  std::thread consumer([&] {
+    Entry e;
+    while (!done.load()) {
+      if (queue.pop(e)) popped++;
+      if (queue.getStats().depth > CommandQueue::Capacity) overfull = true;
+      std::this_thread::yield();
+    }
+  });
+  for (std::thread& w : workers) w.join();
+  done = true;
+  consumer.join();
+  Entry e;
+  while (queue.pop(e)) popped++;
+  CommandQueue::Stats s = queue.getStats();
+  bool exact = s.queued == pushes * count &&
+               s.queued == s.coalesced + s.cancelled + s.dispatched &&
+               s.dispatched == popped && s.maxDepth <= CommandQueue::Capacity &&
+               !overfull;
+  printf("%d threads x %lu requests: %lu queued = %lu coalesced + %lu "
+         "cancelled + %lu dispatched, max depth %d: %s\n",
+         count, pushes, s.queued, s.coalesced, s.cancelled, s.dispatched,
+         s.maxDepth, exact ? "exact" : "LOST");
+  return exact ? 0 : 1;
+}
+
+struct Drain {
+  int writes = 0;
+  unsigned long last = 0;  // Burst to last write, ms.
+  unsigned long off = 0;   // Burst to the Off's write, ms.
+};
+
+// A burst arriving just after a write, then loop() passes every LoopPeriod
+// writing one command per debounce slot, as StaggKettle does; with
+// coalescing or in arrival order as the std::queue did.
+Drain drain(const std::vector<Expect>& burst, bool coalescing) {
+  HostClock::simulate(millis());
+  CommandQueue queue;
+  std::queue<Entry> fifo;
+  unsigned long timeStart = millis();
+  unsigned long timeLastCommand = timeStart;
+  for (const Expect& b : burst) {
+    if (coalescing) queue.push(b.cmd, b.value);
+    else fifo.push({b.cmd, b.value, timeStart});
+  }
+  Drain d;
+  for (;;) {
+    unsigned long timeNow = millis();
+    if (timeNow - timeLastCommand >= Debounce) {
+      Entry e;
+      bool got = coalescing ? queue.pop(e) : !fifo.empty();
+      if (!got) break;
+      if (!coalescing) {
+        e = fifo.front();
+        fifo.pop();
+      }
+      d.writes++;
+      d.last = timeNow - timeStart;
+      if (e.cmd == CommandQueue::Off) d.off = d.last;
+      timeLastCommand = timeNow;
+    }
+    delay(LoopPeriod);
+  }
+  HostClock::realtime();
+  return d;
+}
+
+int bursts() {
+  std::vector<Expect> sets;
+  for (int i = 0; i < 10; i++)
+    sets.push_back({CommandQueue::Set, (byte)(180 + i)});
+  std::vector<Expect> setsOff = sets;
+  setsOff.push_back({CommandQueue::Off, 0});
+  std::vector<Expect> onSetsOff = setsOff;
+  onSetsOff.insert(onSetsOff.begin(), {CommandQueue::On, 0});
+  struct Burst {
+    const char* name;
+    const std::vector<Expect>& commands;
+    bool hasOff;
+  } list[] = {{"Set x10", sets, false},
+              {"Set x10, Off", setsOff, true},
+              {"On, Set x10, Off", onSetsOff, true}};
+
+  int errors = 0;
+  printf("Bursts right after a write, %lums debounce: writes, ms to the last "
+         "write, ms to the Off\n",
+         Debounce);
+  printf("  %-18s %-18s %s\n", "", "FIFO", "CommandQueue");
+  for (const Burst& b : list) {
+    Drain fifo = drain(b.commands, false);
+    Drain queue = drain(b.commands, true);
+    char off[2][24] = {"", ""};
+    if (b.hasOff) {
+      snprintf(off[0], sizeof(off[0]), "Off %lu", fifo.off);
+      snprintf(off[1], sizeof(off[1]), "Off %lu", queue.off);
+    }
+    printf("  %-18s %-4d %5lu %-8s %-4d %5lu %s\n", b.name, fifo.writes,
+           fifo.last, off[0], queue.writes, queue.last, off[1]);
+    // Off goes out in the first slot, and whatever follows it in the next.
+    if (queue.last > 2 * Debounce || (b.hasOff && queue.off != Debounce))
+      errors++;
+  }
+  return errors;
+}
+
+}  // namespace
+
+int queueCheck(int argc, char** argv) {
+  unsigned long pushes = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+  int count = argc > 2 ? atoi(argv[2]) : 4;
+  int errors = rules();
+  errors += timing();
+  errors += threads(count, pushes);
+  errors += bursts();
+  printf("%s\n", errors == 0 ? "OK" : "FAILED");
+  return errors == 0 ? 0 : 1;
+}
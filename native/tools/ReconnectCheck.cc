@@ -0,0 +1,150 @@
+// Time to connected for StaggKettle against the shim's simulated radio: at
+// boot with and without a saved link, after dropped links, after the kettle
+// was off for a while, and with a saved link to a kettle that's gone. Each
+// is set against what the old fixed 5s RetryDelay before every scan would
+// have taken on the same radio. Runs in real time, about 20s by default.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <thread>
+
+#include "StaggKettle.hh"
+#include "Tools.hh"
+
+namespace {
+
+const BLEUUID ServiceUUID("00001820-0000-1000-8000-00805f9b34fb");
+const char* Address = "c4:4f:33:0a:17:d2";
+const unsigned long OldRetryDelay = 5000;
+
+// A kettle task: loop() every 10ms until stopped.
+class Bridge {
+ public:
+  Bridge(const StaggKettle::Link* link = nullptr) : reader(kettle.getStatus()) {
+    if (link != nullptr) kettle.setLink(*link);
+    thread = std::thread([this]() {
+      while (!stop) {
+        kettle.loop();
+        delay(10);
+      }
+    });
+  }
+  ~Bridge() {
+    stop = true;
+    thread.join();
+    // Its client would call back into a deleted kettle.
+    BLEDevice::radio().dropAll();
+  }
+
+  // Waits until connects goes past count; returns false on timeout.
+  bool waitConnects(unsigned long count, unsigned long timeout = 60000) {
+    unsigned long timeStart = millis();
+    while (millis() - timeStart < timeout) {
+      reader.poll(status);
+      if (status.connect.connects > count && status.link.valid()) return true;
+      delay(5);
+    }
+    return false;
+  }
+
+  StaggKettle kettle;
+  StaggKettle::StatusSnapshot::Reader reader;
+  StaggKettle::Status status;
+
+ private:
+  std::atomic<bool> stop{false};
+  std::thread thread;
+};
+
+void report(const char* what, unsigned long ms, unsigned long old) {
+  printf("%-26s %6lu ms to connected (fixed retry: %lu ms)\n", what, ms, old);
+}
+
+}  // namespace
+
+int reconnectCheck(int argc, char** argv) {
+  unsigned long offTime = argc > 1 ? atol(argv[1]) * 1000 : 8000;
+
+  BLEHostRadio& radio = BLEDevice::radio();
+  radio.simulate();
+  radio.scanDelay = 1500;     // Heard that far into an active scan.
+  radio.connectDelay = 300;
+  radio.connectTimeout = 2000;
+  radio.addPeer(BLEAdvertisedDevice("EKG-2d-25-b0", BLEAddress(Address),
+                                    ServiceUUID));
+  // What the old code paid for every reconnect: the retry delay, then a scan.
+  unsigned long oldReconnect =
+      OldRetryDelay + radio.scanDelay + radio.connectDelay;
+  int errors = 0;
+  bool faster = true;
+  StaggKettle::Link saved;
+
+  {
+    Bridge bridge;
+    if (!bridge.waitConnects(0)) errors++;
+    const StaggKettle::ConnectStats& c = bridge.status.connect;
+    // At boot the old code scanned at once.
+    report("boot, nothing saved", c.bootTime,
+           radio.scanDelay + radio.connectDelay);
+    saved = bridge.status.link;
+    if (c.direct != 0 || c.scans != 1) errors++;
+  }
+  printf("saved link: %s \"%s\" type %d handle 0x%04x\n", saved.address,
+         saved.name, saved.addressType, saved.handle);
+
+  {
+    Bridge bridge(&saved);
+    if (!bridge.waitConnects(0)) errors++;
+    const StaggKettle::ConnectStats& c = bridge.status.connect;
+    report("boot, saved link", c.bootTime,
+           radio.scanDelay + radio.connectDelay);
+    if (c.direct != 1 || c.scans != 0) errors++;
+    faster = faster && c.bootTime * 2 < radio.scanDelay + radio.connectDelay;
+
+    for (int drop = 1; drop <= 3; drop++) {
+      radio.dropAll();
+      if (!bridge.waitConnects(drop)) errors++;
+      report("link dropped", c.lastTime, oldReconnect);
+      faster = faster && c.lastTime * 4 < oldReconnect;
+    }
+    if (c.direct != 4 || c.scans != 0) errors++;
+
+    // Off long enough for a failed direct attempt and a few scans.
+    unsigned long failures = c.failures;
+    radio.setPresent(BLEAddress(Address), false);
+    delay(offTime);
+    unsigned long timeBack = millis();
+    radio.setPresent(BLEAddress(Address), true);
+    if (!bridge.waitConnects(4)) errors++;
+    unsigned long back = millis() - timeBack;
+    // The old code scanned for 5s out of every 10s, so up to this.
+    report("kettle back after off", back,
+           2 * OldRetryDelay + radio.scanDelay + radio.connectDelay);
+    printf("%-26s %lu failed attempts, %lu scans while it was off\n", "",
+           c.failures - failures, c.scans);
+    if (c.failures == failures) errors++;
+  }
+
+  {
+    // A saved link to a kettle that's gone: one direct attempt, then a scan
+    // finds the new one.
+    StaggKettle::Link stale = saved;
+    snprintf(stale.address, sizeof(stale.address), "c4:4f:33:00:00:01");
+    Bridge bridge(&stale);
+    if (!bridge.waitConnects(0)) errors++;
+    const StaggKettle::ConnectStats& c = bridge.status.connect;
+    report("boot, saved link is stale", c.bootTime,
+           radio.scanDelay + radio.connectDelay);
+    if (strcmp(bridge.status.link.address, Address) != 0 || c.scans != 1 ||
+        c.failures != 1)
+      errors++;
+  }
+
+  printf("errors: %d\n", errors);
+  bool ok = errors == 0 && faster;
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
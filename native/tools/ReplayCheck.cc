@@ -0,0 +1,457 @@
+// Replays BleCapture dumps through the frame decoder. A capture is a raw dump
+// file or a serial log holding the board's 'c' printout; without one, the
+// traffic corpus is captured first. Prints the kettle state timeline the
+// frames add up to, the unknown and malformed frames seen, decode throughput
+// with EkgDecoder and the original parser, and where the two disagree. The
+// frame digests can also be compared between builds. "realtime" replays at
+// the captured pace instead, printing the timeline as it happens.
+//
+//   replay [capture] [fast|realtime] [rounds]
+//   replay record <capture> [seconds]
+//
+// The second form records StaggKettle's notifications from KettleSim,
+// through a boil, a lift and a switch off, into a dump file.
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BleCapture.hh"
+#include "Corpus.hh"
+#include "EkgDecoder.hh"
+#include "KettleSim.hh"
+#include "LegacyDecoder.hh"
+#include "StaggKettle.hh"
+#include "Tools.hh"
+
+namespace {
+
+typedef std::vector<BleCapture::Record> Records;
+
+bool readFile(const char* path, std::vector<uint8_t>& bytes) {
+  FILE* f = fopen(path, "rb");
+  if (f == nullptr) return false;
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    bytes.insert(bytes.end(), buf, buf + n);
+  fclose(f);
+  return true;
+}
+
+// The hex lines between the markers BleCapture::startPrint() and printSome()
+// print, if it isn't a dump already. Lines other tasks printed in between
+// are skipped; false if that leaves fewer bytes than the first marker says.
+bool unwrap(std::vector<uint8_t>& bytes) {
+  if (bytes.size() >= 4 && memcmp(bytes.data(), BleCapture::Magic, 4) == 0)
+    return true;
+  static const char start[] = "<BleCapture::print> Capture of";
+  std::string text(bytes.begin(), bytes.end());
+  size_t begin = text.find(start);
+  if (begin == std::string::npos) return false;
+  size_t end = text.find("<BleCapture::print> End of capture", begin);
+  if (end == std::string::npos) return false;
+  size_t expected = strtoul(text.c_str() + begin + strlen(start), nullptr, 10);
+  std::vector<uint8_t> dump;
+  size_t pos = text.find('\n', begin);
+  while (pos != std::string::npos && pos < end) {
+    size_t next = text.find('\n', pos + 1);
+    std::string line = text.substr(pos + 1, next - pos - 1);
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    pos = next;
+    if (line.empty() || line.size() > 64 || line.size() % 2 != 0 ||
+        line.find_first_not_of("0123456789abcdef") != std::string::npos)
+      continue;
+    for (size_t i = 0; i < line.size(); i += 2)
+      dump.push_back(strtoul(line.substr(i, 2).c_str(), nullptr, 16));
+  }
+  bytes.swap(dump);
+  return bytes.size() == expected;
+}
+
+std::vector<uint8_t> dumpOf(BleCapture& capture) {
+  std::vector<uint8_t> dump;
+  capture.dump([&](const uint8_t* data, size_t length) {
+    dump.insert(dump.end(), data, data + length);
+  });
+  return dump;
+}
+
+// The traffic corpus as notifications 30ms apart: a boil, then noise.
+std::vector<uint8_t> corpusCapture() {
+  BleCapture capture;
+  capture.begin(4 << 20);
+  unsigned long time = 1000;
+  for (const Corpus::Traffic& t : {Corpus::session(), Corpus::noisy(5000, 22)})
+    for (const Corpus::Chunk& c : Corpus::split(t.bytes, Corpus::Random, 22)) {
+      capture.record(0, t.bytes.data() + c.offset, c.length, time);
+      time += 30;
+    }
+  return dumpOf(capture);
+}
+
+// The console printout of a full capture, a line at a time with
+// notifications recorded in between faster than it prints: it must still be
+// the dump taken when it started, and recording must go on, dropping only
+// what would overwrite records not printed yet.
+int printCheck() {
+  BleCapture capture;
+  capture.begin(16 << 10);
+  Corpus::Traffic t = Corpus::session();
+  std::vector<Corpus::Chunk> chunks = Corpus::split(t.bytes, Corpus::Random, 22);
+  unsigned long time = 1000;
+  size_t next = 0;
+  auto notify = [&] {
+    const Corpus::Chunk& c = chunks[next++ % chunks.size()];
+    capture.record(0, t.bytes.data() + c.offset, c.length, time);
+    time += 30;
+  };
+  while (capture.getStats().overwritten == 0) notify();
+  std::vector<uint8_t> expected = dumpOf(capture);
+  BleCapture::Stats before = capture.getStats();
+
+  // Serial's output, into a file.
+  fflush(stdout);
+  FILE* tmp = tmpfile();
+  int saved = dup(1);
+  dup2(fileno(tmp), 1);
+  Serial.begin(115200);
+  int slices = 0;
+  capture.startPrint(Serial);
+  size_t sent = next;
+  while (capture.printSome(Serial, 1)) {
+    slices++;
+    for (int i = 0; i < 3; i++) notify();
+    // What another task might print meanwhile.
+    if (slices % 50 == 0) Serial.println("Free heap: 123456");
+  }
+  Serial.end();
+  fflush(stdout);
+  dup2(saved, 1);
+  close(saved);
+  std::vector<uint8_t> printed;
+  rewind(tmp);
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), tmp)) > 0)
+    printed.insert(printed.end(), buf, buf + n);
+  fclose(tmp);
+
+  BleCapture::Stats after = capture.getStats();
+  sent = next - sent;
+  uint32_t recorded = after.recorded - before.recorded;
+  uint32_t dropped = after.dropped - before.dropped;
+  bool same = unwrap(printed) && printed == expected;
+  printf("printout: %zu bytes in %d slices, %lu notifications recorded "
+         "meanwhile, %lu dropped: %s\n",
+         expected.size(), slices, (unsigned long)recorded,
+         (unsigned long)dropped, same ? "same as the dump" : "DIFFERENT");
+  return same && recorded > 0 && recorded + dropped == sent ? 0 : 1;
+}
+
+int record(const char* path, int seconds) {
+  const char* address = "c4:4f:33:0a:17:d2";
+  BLEHostRadio& radio = BLEDevice::radio();
+  radio.simulate();
+  KettleSim::Config config;
+  config.speed = 30;
+  config.statePeriod = 250;
+  KettleSim sim(BLEAddress(address), config);
+  radio.addPeer(BLEAdvertisedDevice("EKG-2d-25-b0", BLEAddress(address),
+                                    BLEUUID("00001820-0000-1000-8000-00805f9b34fb")),
+                &sim);
+  BleCapture capture;
+  capture.begin(1 << 20);
+  {
+    StaggKettle kettle;
+    kettle.setCapture(&capture);
+    std::atomic<bool> stop{false};
+    std::thread task([&]() {
+      while (!stop) {
+        kettle.loop();
+        delay(10);
+      }
+    });
+    delay(1000);
+    kettle.setTemp(195);
+    kettle.on();
+    delay(seconds * 500);
+    sim.lift(true);
+    delay(1000);
+    sim.lift(false);
+    kettle.off();
+    delay(seconds * 500);
+    stop = true;
+    task.join();
+    kettle.setCapture(nullptr);
+    radio.dropAll();
+  }
+  radio.setPresent(BLEAddress(address), false);
+
+  std::vector<uint8_t> dump = dumpOf(capture);
+  FILE* f = fopen(path, "wb");
+  if (f == nullptr || fwrite(dump.data(), 1, dump.size(), f) != dump.size()) {
+    printf("can't write %s\n", path);
+    if (f != nullptr) fclose(f);
+    return 1;
+  }
+  fclose(f);
+  BleCapture::Stats s = capture.getStats();
+  printf("%s: %lu notifications, %zu bytes\n", path, (unsigned long)s.recorded,
+         dump.size());
+  return 0;
+}
+
+// What the frames say about one kettle, as parseEvent reads them.
+struct Timeline {
+  struct Kettle {
+    int state[Ekg::States];
+    Kettle() {
+      for (int& s : state) s = -1;
+    }
+  };
+  Kettle kettles[BleCapture::Channels];
+  std::map<std::string, unsigned long> unknown;  // Hex, times seen.
+  unsigned long malformed = 0;
+
+  // Returns the change as text, or "" if nothing changed.
+  std::string apply(uint8_t channel, const uint8_t* frame, size_t length) {
+    char text[64];
+    text[0] = 0;
+    if (frame[0] >= Ekg::States || Ekg::StateBytes[frame[0]] != length) {
+      malformed++;
+      return "";
+    }
+    uint8_t type = frame[0];
+    if (type == 5 || type == 6 || type == 7) {
+      std::string hex;
+      for (size_t i = 0; i < length; i++) {
+        snprintf(text, sizeof(text), "%02x", frame[i]);
+        hex += text;
+      }
+      if (unknown[hex]++ > 0) return "";
+      snprintf(text, sizeof(text), "new unknown frame %s", hex.c_str());
+      return text;
+    }
+    int& last = kettles[channel].state[type];
+    if (last == frame[1]) return "";
+    last = frame[1];
+    switch (type) {
+      case 0: snprintf(text, sizeof(text), "power %s", last ? "on" : "off"); break;
+      case 1: snprintf(text, sizeof(text), "hold %s", last ? "on" : "off"); break;
+      case 2: snprintf(text, sizeof(text), "target %dF", last); break;
+      case 3: snprintf(text, sizeof(text), "current %dF", last); break;
+      case 4: snprintf(text, sizeof(text), "countdown %d", last); break;
+      case 8: snprintf(text, sizeof(text), "%s", last ? "on base" : "lifted"); break;
+    }
+    return text;
+  }
+};
+
+template <typename Decoder>
+struct Decoded {
+  std::vector<std::vector<uint8_t>> frames;  // Channel, then the frame.
+  std::vector<size_t> firstFrame;            // Per record.
+  uint64_t digest = 14695981039346656037ull;  // FNV-1a over every frame.
+
+  Decoded(const Records& records) {
+    Decoder decoders[BleCapture::Channels];
+    for (const BleCapture::Record& r : records) {
+      firstFrame.push_back(frames.size());
+      decoders[r.channel].feed(r.data, r.length,
+                               [&](const uint8_t* data, size_t length) {
+                                 std::vector<uint8_t> f(1, r.channel);
+                                 f.insert(f.end(), data, data + length);
+                                 for (uint8_t b : f)
+                                   digest = (digest ^ b) * 1099511628211ull;
+                                 digest = (digest ^ 0xff) * 1099511628211ull;
+                                 frames.push_back(f);
+                               });
+    }
+  }
+};
+
+template <typename Decoder>
+double framesPerSecond(const Records& records, int rounds, size_t& frames) {
+  Decoder decoders[BleCapture::Channels];
+  size_t sum = 0;
+  frames = 0;
+  auto timeStart = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; i++)
+    for (const BleCapture::Record& r : records)
+      decoders[r.channel].feed(r.data, r.length,
+                               [&](const uint8_t* data, size_t length) {
+                                 sum += data[length - 1];
+                                 frames++;
+                               });
+  std::chrono::duration<double> t = std::chrono::steady_clock::now() - timeStart;
+  if (sum == 1) printf(" ");
+  return frames / t.count();
+}
+
+// Prints the timeline, a run of temperature changes as one line.
+class Printer {
+ public:
+  Printer(unsigned long start, unsigned long limit)
+      : start(start), limit(limit) {}
+  ~Printer() { flush(); }
+
+  void temperature(unsigned long time, uint8_t channel, int temp) {
+    if (run.count > 0 && run.channel != channel) flush();
+    if (run.count++ == 0) {
+      run.time = time;
+      run.channel = channel;
+      run.from = temp;
+    }
+    run.to = temp;
+  }
+  void event(unsigned long time, uint8_t channel, const std::string& what) {
+    flush();
+    line(time, channel, what.c_str());
+  }
+  void flush() {
+    if (run.count == 0) return;
+    char text[64];
+    if (run.count == 1)
+      snprintf(text, sizeof(text), "current %dF", run.to);
+    else
+      snprintf(text, sizeof(text), "current %dF to %dF, %d changes", run.from,
+               run.to, run.count);
+    line(run.time, run.channel, text);
+    run.count = 0;
+  }
+  unsigned long skipped() const { return lines > limit ? lines - limit : 0; }
+
+ private:
+  struct Run {
+    int count = 0;
+    unsigned long time;
+    uint8_t channel;
+    int from, to;
+  } run;
+  unsigned long start;
+  unsigned long limit;
+  unsigned long lines = 0;
+
+  void line(unsigned long time, uint8_t channel, const char* what) {
+    if (++lines > limit) return;
+    printf("%9.3fs  %d  %s\n", (time - start) / 1000.0, channel, what);
+  }
+};
+
+}  // namespace
+
+int replayCheck(int argc, char** argv) {
+  if (argc > 2 && strcmp(argv[1], "record") == 0)
+    return record(argv[2], argc > 3 ? atoi(argv[3]) : 20);
+
+  std::vector<uint8_t> dump;
+  const char* source = "corpus";
+  if (argc > 1 && strcmp(argv[1], "fast") != 0 &&
+      strcmp(argv[1], "realtime") != 0) {
+    source = argv[1];
+    if (!readFile(source, dump) || !unwrap(dump)) {
+      printf("%s: no capture found\n", source);
+      return 1;
+    }
+    argc--;
+    argv++;
+  } else {
+    dump = corpusCapture();
+  }
+  int errors = source == std::string("corpus") ? printCheck() : 0;
+  bool realtime = argc > 1 && strcmp(argv[1], "realtime") == 0;
+  int rounds = argc > 2 ? atoi(argv[2]) : 500;
+
+  Records records;
+  size_t bytes = 0;
+  if (!BleCapture::parse(dump.data(), dump.size(),
+                         [&](const BleCapture::Record& r) {
+                           records.push_back(r);
+                           bytes += r.length;
+                         })) {
+    printf("%s: not a capture, or cut short\n", source);
+    return 1;
+  }
+  if (records.empty()) {
+    printf("%s: empty\n", source);
+    return 1;
+  }
+  unsigned long span = records.back().time - records.front().time;
+  printf("%s: %zu notifications, %zu bytes over %.1fs\n", source,
+         records.size(), bytes, span / 1000.0);
+
+  // The timeline, at the captured pace or all at once.
+  Timeline timeline;
+  EkgDecoder decoders[BleCapture::Channels];
+  {
+    Printer printer(records.front().time, realtime ? ULONG_MAX : 60);
+    auto timeStart = std::chrono::steady_clock::now();
+    for (const BleCapture::Record& r : records) {
+      if (realtime) {
+        printer.flush();
+        fflush(stdout);
+        std::this_thread::sleep_until(
+            timeStart +
+            std::chrono::milliseconds(r.time - records.front().time));
+      }
+      decoders[r.channel].feed(
+          r.data, r.length, [&](const uint8_t* frame, size_t length) {
+            std::string what = timeline.apply(r.channel, frame, length);
+            if (what.empty()) return;
+            if (frame[0] == 3)
+              printer.temperature(r.time, r.channel, frame[1]);
+            else
+              printer.event(r.time, r.channel, what);
+          });
+    }
+    printer.flush();
+    if (printer.skipped() > 0)
+      printf("%12s ... %lu more lines\n", "", printer.skipped());
+  }
+  printf("unknown frames:");
+  for (const auto& u : timeline.unknown) printf(" %s x%lu", u.first.c_str(), u.second);
+  printf("\nmalformed frames: %lu\n", timeline.malformed);
+
+  // Both parsers, frame for frame.
+  Decoded<EkgDecoder> ekg(records);
+  Decoded<LegacyDecoder> legacy(records);
+  if (ekg.frames != legacy.frames) {
+    size_t i = 0;
+    while (i < ekg.frames.size() && i < legacy.frames.size() &&
+           ekg.frames[i] == legacy.frames[i])
+      i++;
+    size_t record = 0;
+    while (record + 1 < records.size() && ekg.firstFrame[record + 1] <= i)
+      record++;
+    printf("DIVERGED at frame %zu (notification %zu, %.3fs): %zu vs %zu "
+           "frames\n",
+           i, record, (records[record].time - records.front().time) / 1000.0,
+           ekg.frames.size(), legacy.frames.size());
+    errors++;
+  }
+  printf("frames: %zu, digest %016llx; original parser %zu, digest %016llx\n",
+         ekg.frames.size(), (unsigned long long)ekg.digest,
+         legacy.frames.size(), (unsigned long long)legacy.digest);
+
+  size_t frames;
+  double ekgRate = framesPerSecond<EkgDecoder>(records, rounds, frames);
+  double legacyRate = framesPerSecond<LegacyDecoder>(records, rounds, frames);
+  printf("throughput: %.1fM frames/s (%.0f MB/s), original parser %.1fM "
+         "frames/s; the capture replays %.0fx faster than captured\n",
+         ekgRate / 1e6, ekgRate * bytes / ekg.frames.size() / 1e6,
+         legacyRate / 1e6,
+         span > 0 ? ekgRate / ekg.frames.size() * span / 1000.0 : 0.0);
+
+  printf("%s\n", errors == 0 ? "OK" : "FAILED");
+  return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,27 @@
+#include "Rest.hh"
+
+#include <PosixClient.h>
+
+bool rest(const char* host, uint16_t port, const char* method,
+          const std::string& path, const std::string& body,
+          std::string* response) {
+  PosixClient client;
+  if (!client.connect(host, port)) return false;
+  std::string request = std::string(method) + " " + path +
+                        ".json HTTP/1.1\r\nHost: " + host +
+                        "\r\nConnection: close\r\nContent-Length: " +
+                        String((unsigned int)body.size()).c_str() + "\r\n\r\n" +
+                        body;
+  client.write((const uint8_t*)request.data(), request.size());
+  uint8_t buf[256];
+  std::string reply;
+  unsigned long timeStart = millis();
+  while (client.connected() && millis() - timeStart < 2000) {
+    int n = client.read(buf, sizeof(buf));
+    if (n > 0) reply.append((const char*)buf, n);
+  }
+  size_t bodyStart = reply.find("\r\n\r\n");
+  if (response && bodyStart != std::string::npos)
+    *response = reply.substr(bodyStart + 4);
+  return reply.compare(0, 12, "HTTP/1.1 200") == 0;
+}
@@ -0,0 +1,17 @@
+#ifndef __REST_H__
+#define __REST_H__
+
+// Blocking one-shot REST request against the RTDB stand-in, enough to play
+// the part of a cloud client in host tools.
+
+#include <stdint.h>
+
+#include <string>
+
+// Sends method on <path>.json and waits for the server to close, so writes
+// are ordered. Returns true on 200; the body goes to response if given.
+bool rest(const char* host, uint16_t port, const char* method,
+          const std::string& path, const std::string& body,
+          std::string* response = nullptr);
+
+#endif
@@ -0,0 +1,90 @@
+// Stress test for SpscRing: a producer thread pushes notification-sized
+// records while a consumer thread drains and verifies them, with the consumer
+// stalling now and then like a main loop stuck in a Firebase call.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+
+#include "SpscRing.hh"
+#include "Tools.hh"
+
+static const size_t RingBytes = 2048;
+
+// Record n: a 4-byte sequence number followed by bytes derived from it.
+static size_t fillRecord(uint8_t* out, uint32_t n) {
+  size_t length = 4 + n % 60;
+  memcpy(out, &n, 4);
+  for (size_t i = 4; i < length; i++) out[i] = (uint8_t)(n * 31 + i);
+  return length;
+}
+
+int ringStress(int argc, char** argv) {
+  uint32_t records = argc > 1 ? strtoul(argv[1], nullptr, 10) : 5000000;
+  SpscRing<RingBytes> ring;
+  std::atomic<bool> done{false};
+  uint32_t received = 0, errors = 0, gaps = 0;
+
+  auto timeStart = std::chrono::steady_clock::now();
+
+  std::thread consumer([&] {
+    std::mt19937 rng(1);
+    uint8_t expected[64];
+    uint32_t next = 0;
+    for (;;) {
+      size_t length;
+      const uint8_t* data = ring.front(length);
+      if (data == nullptr) {
+        if (done.load(std::memory_order_acquire) &&
+            ring.front(length) == nullptr)
+          break;
+        std::this_thread::yield();
+        continue;
+      }
+      uint32_t n;
+      memcpy(&n, data, 4);
+      // Records may be dropped on overflow, but never reordered or torn.
+      if (n < next) errors++;
+      if (n > next) gaps++;
+      if (fillRecord(expected, n) != length ||
+          memcmp(expected, data, length) != 0)
+        errors++;
+      next = n + 1;
+      received++;
+      ring.pop();
+      if (rng() % 100000 == 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+  });
+
+  std::thread producer([&] {
+    uint8_t record[64];
+    for (uint32_t n = 0; n < records; n++) {
+      size_t length = fillRecord(record, n);
+      // Notifications come in bursts; give the consumer a chance in between
+      // (and when full, drop the record and move on like onNotify does).
+      if (!ring.push(record, length) || n % 16 == 15)
+        std::this_thread::yield();
+    }
+    done.store(true, std::memory_order_release);
+  });
+
+  producer.join();
+  consumer.join();
+  double s = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                           timeStart)
+                 .count();
+
+  printf("pushed %u, received %u, overflows %u, gaps %u, errors %u\n",
+         ring.getPushed(), received, ring.getOverflows(), gaps, errors);
+  printf("high water %zu/%zu bytes, %.1f M records/s\n", ring.getHighWater(),
+         RingBytes, received / s / 1e6);
+  bool ok = errors == 0 && received == ring.getPushed() &&
+            ring.getPushed() + ring.getOverflows() == records;
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
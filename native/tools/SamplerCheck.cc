@@ -0,0 +1,97 @@
+// FSR sampling with a synthetic source: one read per consumer pass, as
+// FSRScale used to, against AdcSampler's timer, while the consumer runs every
+// 20ms with the occasional long stall (a blocking network call, in the old
+// single loop). Reports how evenly each way samples, what the timer drops,
+// and what a batch costs.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <random>
+
+#include "AdcSampler.hh"
+#include "LatencyHistogram.hh"
+#include "Tools.hh"
+
+// An FSR reading around 3000 with noise, stepping up as water is poured in.
+static uint16_t fsr() {
+  static std::mt19937 rng(5);
+  return 3000 + (millis() / 1000 % 4) * 150 + rng() % 64;
+}
+
+// Consumer pass n is late by this much, in ms.
+static unsigned long stall(unsigned long pass) {
+  if (pass % 250 == 100) return 3000;
+  if (pass % 50 == 25) return 500;
+  return 0;
+}
+
+int samplerCheck(int argc, char** argv) {
+  unsigned long duration = argc > 1 ? atoi(argv[1]) * 1000UL : 10000;
+  uint32_t rate = argc > 2 ? atoi(argv[2]) : 100;
+  const unsigned long consumerPeriod = 20;
+
+  // The old way: one read per pass.
+  LatencyHistogram oldIntervals;
+  unsigned long oldSamples = 0;
+  unsigned long timeBegin = millis();
+  unsigned long lastRead = 0;
+  for (unsigned long pass = 0; millis() - timeBegin < duration; pass++) {
+    unsigned long timeNow = micros();
+    fsr();
+    if (oldSamples++) oldIntervals.record(timeNow - lastRead);
+    lastRead = timeNow;
+    delay(consumerPeriod + stall(pass));
+  }
+
+  // Through the sampler.
+  AdcSampler sampler(fsr, rate);
+  uint16_t batch[32];
+  unsigned long sink = 0;
+  std::chrono::duration<double, std::nano> batchTime(0);
+  sampler.begin();
+  timeBegin = millis();
+  for (unsigned long pass = 0; millis() - timeBegin < duration; pass++) {
+    delay(consumerPeriod + stall(pass));
+    size_t n;
+    auto timeStart = std::chrono::steady_clock::now();
+    while ((n = sampler.takeBatch(batch, 32)) > 0)
+      for (size_t i = 0; i < n; i++) sink += batch[i];
+    batchTime += std::chrono::steady_clock::now() - timeStart;
+  }
+  sampler.end();
+  unsigned long elapsed = millis() - timeBegin;
+  while (sampler.takeBatch(batch, 32) > 0) {
+  }
+
+  AdcSampler::Stats s = sampler.getStats();
+  const LatencyHistogram& j = sampler.getJitter();
+  unsigned long expected = elapsed * rate / 1000;
+  unsigned long ticks = s.samples + s.dropped + s.missed;
+  printf("one read per pass (every %lums, stalls of 0.5s and 3s):\n",
+         consumerPeriod);
+  printf("  %lu samples; interval ms p50 %.1f, p99 %.1f, max %.1f\n",
+         oldSamples, oldIntervals.percentile(0.5) / 1000.0,
+         oldIntervals.percentile(0.99) / 1000.0,
+         oldIntervals.getMax() / 1000.0);
+  printf("AdcSampler at %uHz, same consumer:\n", rate);
+  printf("  %lu samples of %lu expected, %lu dropped, %lu missed; %lu batches, "
+         "max %zu\n",
+         s.samples, expected, s.dropped, s.missed, s.batches, s.maxBatch);
+  printf("  interval error us: p50 %u, p99 %u, max %u (period %u)\n",
+         j.percentile(0.5), j.percentile(0.99), j.getMax(),
+         sampler.getPeriod());
+  printf("  consumer: %.0f ns per sample taken\n",
+         s.samples ? batchTime.count() / s.samples : 0.0);
+
+  // Every tick is accounted for, and the timer keeps time. A host thread
+  // is at the mercy of the scheduler, so only the typical error is held to
+  // a tight bound here.
+  bool ok = sink > 0 && ticks + rate / 10 >= expected &&
+            ticks <= expected + rate / 10 && s.missed <= expected / 50 &&
+            j.percentile(0.5) < sampler.getPeriod() / 10;
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,230 @@
+// Display updates over a simulated brew: the way the UI used to draw (clear
+// the frame, plot every glyph pixel by pixel, send the whole 1KB) against
+// StatusScreen's glyph blits and changed-column windows. Both go to an
+// emulated SSD1306 that applies the window commands, so the panel is checked
+// against the frame after every update. Reports I2C bytes, transactions and
+// bus time at 400kHz, and render time per update.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "StatusScreen.hh"
+#include "Tools.hh"
+
+namespace {
+
+const int Width = StatusScreen::Width;
+const int Pages = StatusScreen::Pages;
+const double BusHz = 400000;
+
+// Panel in horizontal addressing mode, as Adafruit_SSD1306::begin() leaves
+// it: data fills the column and page window left to right, page by page.
+class Panel : public StatusScreen::Bus {
+ public:
+  uint8_t ram[Pages][Width] = {};
+  unsigned long bytes = 0;
+  unsigned long transactions = 0;
+
+  bool write(uint8_t control, const uint8_t* data, size_t n) override {
+    bytes += n + 2;
+    transactions++;
+    if (control == 0x40) {
+      for (size_t i = 0; i < n; i++) put(data[i]);
+      return true;
+    }
+    for (size_t i = 0; i < n; i++) command(data[i]);
+    return true;
+  }
+
+  double busMs() const {
+    // 9 clocks a byte, and about 2 for start and stop.
+    return (bytes * 9.0 + transactions * 2.0) / BusHz * 1000.0;
+  }
+
+ private:
+  int colStart = 0, colEnd = Width - 1, pageStart = 0, pageEnd = Pages - 1;
+  int col = 0, page = 0;
+  // The last command and the arguments it still expects.
+  uint8_t lastCommand = 0;
+  uint8_t pending = 0;
+  int args[2];
+  int argCount = 0;
+
+  void command(uint8_t c) {
+    if (argCount < pending) {
+      args[argCount++] = c;
+      if (argCount < pending) return;
+      if (pending == 2 && lastCommand == 0x21) {
+        colStart = col = args[0] & 0x7f;
+        colEnd = args[1] & 0x7f;
+      } else if (pending == 2 && lastCommand == 0x22) {
+        pageStart = page = args[0] & 7;
+        pageEnd = args[1] & 7;
+      }
+      pending = 0;
+      return;
+    }
+    lastCommand = c;
+    argCount = 0;
+    pending = c == 0x21 || c == 0x22 ? 2 : 0;
+  }
+
+  void put(uint8_t b) {
+    ram[page][col] = b;
+    if (++col > colEnd) {
+      col = colStart;
+      if (++page > pageEnd) page = pageStart;
+    }
+  }
+};
+
+// What Adafruit_SSD1306::display() sends: the full window, then the frame in
+// 31-byte writes.
+void fullRefresh(Panel& panel, const uint8_t* frame) {
+  const uint8_t window[] = {0x22, 0, 0xff, 0x21, 0};
+  const uint8_t end[] = {Width - 1};
+  panel.write(0x00, window, sizeof(window));
+  panel.write(0x00, end, sizeof(end));
+  for (int i = 0; i < Width * Pages; i += StatusScreen::Chunk) {
+    size_t n = Width * Pages - i;
+    if (n > StatusScreen::Chunk) n = StatusScreen::Chunk;
+    panel.write(0x40, frame + i, n);
+  }
+}
+
+// Adafruit GFX's way to text: every pixel of every glyph through
+// drawPixel(). Takes the glyph columns from a StatusScreen so both draw the
+// same font.
+struct PixelFrame {
+  uint8_t buffer[Pages * Width];
+  void clear() { memset(buffer, 0, sizeof(buffer)); }
+  void drawPixel(int x, int y) {
+    if (x < 0 || x >= Width || y < 0 || y >= Pages * 8) return;
+    buffer[x + (y / 8) * Width] |= 1 << (y & 7);
+  }
+  void copyFrom(const uint8_t* frame) {
+    // Plots the set pixels one at a time, as drawChar() would.
+    for (int page = 0; page < Pages; page++)
+      for (int x = 0; x < Width; x++) {
+        uint8_t column = frame[page * Width + x];
+        for (int bit = 0; bit < 8; bit++)
+          if (column & (1 << bit)) drawPixel(x, page * 8 + bit);
+      }
+  }
+};
+
+struct Update {
+  StaggKettle::Status kettle;
+  int fill;
+  float calOunces;
+};
+
+// A kettle connecting, heating and holding, lifted and poured from, with a
+// status every second, and a calibration at the end.
+std::vector<Update> session() {
+  std::vector<Update> updates;
+  Update u;
+  u.fill = 0;
+  u.calOunces = -1;
+  u.kettle.units = StaggKettle::Fahrenheit;
+  u.kettle.state = StaggKettle::Scanning;
+  for (int t = 0; t < 5; t++) updates.push_back(u);
+  u.kettle.state = StaggKettle::Connecting;
+  updates.push_back(u);
+  u.kettle.state = StaggKettle::Connected;
+  u.kettle.currentTemp = 68;
+  u.kettle.targetTemp = 205;
+  u.fill = 24;
+  updates.push_back(u);
+  u.kettle.power = true;
+  for (int t = 0; t < 300; t++) {
+    if (t % 2 == 0 && u.kettle.currentTemp < 205) u.kettle.currentTemp++;
+    if (u.kettle.currentTemp == 205) u.kettle.hold = true;
+    updates.push_back(u);
+  }
+  u.kettle.lifted = true;
+  for (int t = 0; t < 20; t++) {
+    if (t % 4 == 0) u.kettle.currentTemp--;
+    updates.push_back(u);
+  }
+  u.kettle.lifted = false;
+  u.fill = 10;
+  for (int t = 0; t < 60; t++) {
+    if (t % 6 == 0) u.kettle.currentTemp--;
+    updates.push_back(u);
+  }
+  for (float oz : {0.0f, 12.0f, 24.0f, 30.0f}) {
+    u.calOunces = oz;
+    updates.push_back(u);
+  }
+  u.calOunces = -1;
+  updates.push_back(u);
+  return updates;
+}
+
+}  // namespace
+
+int screenCheck(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  std::vector<Update> updates = session();
+  int errors = 0;
+
+  Panel oldPanel;
+  Panel newPanel;
+  StatusScreen layout(oldPanel);  // Only used to lay out the old frames.
+  StatusScreen screen(newPanel);
+  PixelFrame pixels;
+  std::chrono::duration<double, std::micro> oldTime(0), newTime(0);
+  unsigned long oldSends = 0;
+  for (const Update& u : updates) {
+    layout.showKettle(u.kettle);
+    layout.showScale(u.fill, u.calOunces);
+
+    // The old way redrew and sent everything whenever anything changed.
+    static uint8_t previous[Pages * Width];
+    if (oldSends == 0 ||
+        memcmp(previous, layout.getFrame(), sizeof(previous)) != 0) {
+      auto timeStart = std::chrono::steady_clock::now();
+      pixels.clear();
+      pixels.copyFrom(layout.getFrame());
+      oldTime += std::chrono::steady_clock::now() - timeStart;
+      fullRefresh(oldPanel, pixels.buffer);
+      memcpy(previous, layout.getFrame(), sizeof(previous));
+      oldSends++;
+    }
+
+    auto timeStart = std::chrono::steady_clock::now();
+    screen.showKettle(u.kettle);
+    screen.showScale(u.fill, u.calOunces);
+    screen.flush();
+    newTime += std::chrono::steady_clock::now() - timeStart;
+    if (memcmp(newPanel.ram, screen.getFrame(), sizeof(newPanel.ram)) != 0 ||
+        memcmp(oldPanel.ram, screen.getFrame(), sizeof(oldPanel.ram)) != 0)
+      errors++;
+  }
+
+  const StatusScreen::Stats& s = screen.getStats();
+  printf("%zu status updates, %lu that change the screen\n", updates.size(),
+         oldSends);
+  printf("full refresh: %lu bytes in %lu writes, %.1f ms of bus, %.0f bytes "
+         "and %.2f ms per update; render %.2f us\n",
+         oldPanel.bytes, oldPanel.transactions, oldPanel.busMs(),
+         (double)oldPanel.bytes / oldSends, oldPanel.busMs() / oldSends,
+         oldTime.count() / oldSends);
+  printf("StatusScreen: %lu bytes in %lu writes, %.1f ms of bus, %.0f bytes "
+         "and %.2f ms per update; %lu pages; render %.2f us\n",
+         newPanel.bytes, newPanel.transactions, newPanel.busMs(),
+         (double)newPanel.bytes / s.flushes, newPanel.busMs() / s.flushes,
+         s.pages, newTime.count() / s.flushes);
+  printf("panel mismatches: %d\n", errors);
+
+  bool ok = errors == 0 && s.flushes == oldSends &&
+            s.bytes == newPanel.bytes && newPanel.bytes * 4 < oldPanel.bytes;
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+// Hammers a Snapshot from one writer and several reader threads. Every field
+// of the published struct is derived from a sequence number, so a torn read
+// shows up as fields that disagree; and every field a reader sees change
+// must be in the mask poll() returned.
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "Snapshot.hh"
+#include "Tools.hh"
+
+static const int Fields = 8;
+
+struct TestState {
+  uint32_t seq = 0;
+  // Field i changes every (i + 1)th publish.
+  uint32_t values[Fields] = {};
+  char name[24] = {};
+};
+typedef Snapshot<TestState, Fields> TestSnapshot;
+
+static TestState make(uint32_t seq) {
+  TestState s;
+  s.seq = seq;
+  for (int i = 0; i < Fields; i++) s.values[i] = seq / (i + 1);
+  snprintf(s.name, sizeof(s.name), "kettle-%u", seq);
+  return s;
+}
+
+static bool consistent(const TestState& s) {
+  TestState expected = make(s.seq);
+  return memcmp(&s, &expected, sizeof(s)) == 0;
+}
+
+struct ReaderRun {
+  unsigned long polls = 0;
+  unsigned long reads = 0;
+  unsigned long torn = 0;
+  unsigned long missed = 0;  // Changed fields without their bit set.
+};
+
+int snapshotCheck(int argc, char** argv) {
+  unsigned long duration = argc > 1 ? atoi(argv[1]) * 1000UL : 3000;
+  int readers = argc > 2 ? atoi(argv[2]) : 3;
+
+  TestSnapshot snapshot;
+  std::atomic<bool> done{false};
+  std::vector<ReaderRun> runs(readers);
+  std::vector<std::thread> threads;
+  for (int r = 0; r < readers; r++) {
+    threads.emplace_back([&, r]() {
+      ReaderRun& run = runs[r];
+      TestSnapshot::Reader reader(snapshot);
+      TestState last, state;
+      bool first = true;
+      while (!done) {
+        run.polls++;
+        TestSnapshot::Mask changed = reader.poll(state);
+        if (!changed) continue;
+        run.reads++;
+        if (!consistent(state)) run.torn++;
+        for (int i = 0; i < Fields && !first; i++)
+          if (state.values[i] != last.values[i] && !(changed & (1u << i)))
+            run.missed++;
+        last = state;
+        first = false;
+      }
+    });
+  }
+
+  // Publish as fast as possible, then idle for a while so the readers'
+  // nothing-changed path gets measured too.
+  uint32_t seq = 0;
+  TestState previous = make(0);
+  auto timeStart = std::chrono::steady_clock::now();
+  unsigned long timeBegin = millis();
+  while (millis() - timeBegin < duration) {
+    TestState next = make(++seq);
+    TestSnapshot::Mask changed = 0;
+    for (int i = 0; i < Fields; i++)
+      if (next.values[i] != previous.values[i]) changed |= 1u << i;
+    snapshot.publish(next, changed);
+    previous = next;
+  }
+  double publishNs = std::chrono::duration<double, std::nano>(
+                         std::chrono::steady_clock::now() - timeStart)
+                         .count() /
+                     seq;
+  delay(200);
+  done = true;
+  for (std::thread& t : threads) t.join();
+
+  // Cost of polling a snapshot that didn't move, on this thread alone.
+  TestSnapshot::Reader idle(snapshot);
+  TestState state;
+  idle.poll(state);
+  const int idlePolls = 10000000;
+  unsigned long sink = 0;
+  timeStart = std::chrono::steady_clock::now();
+  for (int i = 0; i < idlePolls; i++) sink += idle.poll(state);
+  double idleNs = std::chrono::duration<double, std::nano>(
+                      std::chrono::steady_clock::now() - timeStart)
+                      .count() /
+                  idlePolls;
+
+  bool ok = sink == 0 && consistent(state) && state.seq == seq;
+  printf("%u publishes, %.0f ns each; %lu read retries\n", seq, publishNs,
+         snapshot.getRetries());
+  for (int r = 0; r < readers; r++) {
+    const ReaderRun& run = runs[r];
+    printf("reader %d: %lu polls, %lu reads, %lu torn, %lu missed changes\n", r,
+           run.polls, run.reads, run.torn, run.missed);
+    ok = ok && run.reads > 0 && run.torn == 0 && run.missed == 0;
+  }
+  printf("poll with nothing new: %.1f ns\n", idleNs);
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,109 @@
+// End-to-end check of the streaming command channel against the local RTDB
+// stand-in (native/tools/rtdb_standin.py): writes commands over REST, waits
+// for them to come back through RtdbStream and CommandMirror, and reports the
+// write-to-delivery latency.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <PosixClient.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "CloudCommand.hh"
+#include "Rest.hh"
+#include "RtdbClient.hh"
+#include "RtdbStream.hh"
+#include "Tools.hh"
+
+static double percentile(std::vector<double> v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[(size_t)(p * (v.size() - 1))];
+}
+
+int streamCheck(int argc, char** argv) {
+  const char* host = argc > 1 ? argv[1] : "127.0.0.1";
+  uint16_t port = argc > 2 ? atoi(argv[2]) : 9000;
+  int count = argc > 3 ? atoi(argv[3]) : 200;
+  const std::string path = "/kettle/command";
+
+  static const struct {
+    const char* json;
+    CloudCommand::Type type;
+    int value;
+  } commands[] = {
+      {"{\"on\":true}", CloudCommand::On, 0},
+      {"{\"temp\":true,\"value\":205}", CloudCommand::Temp, 205},
+      {"{\"off\":true}", CloudCommand::Off, 0},
+      {"{\"calibrate\":true}", CloudCommand::Calibrate, 0},
+  };
+
+  rest(host, port, "DELETE", path, "");
+  PosixClient client;
+  RtdbStream stream(client, host, port, "secret");
+  if (!stream.begin(path)) {
+    printf("Could not open stream on %s:%u%s\n", host, port, path.c_str());
+    return 1;
+  }
+
+  CommandMirror mirror;
+  PosixClient restClient;
+  RtdbClient rtdb(restClient, host, port, "secret");
+  auto onEvent = [&](const RtdbStream::Event& e) {
+    if (e.type == RtdbStream::Event::Put) mirror.put(e.path, e.data);
+    if (e.type == RtdbStream::Event::Patch) mirror.patch(e.path, e.data);
+  };
+
+  std::vector<double> latencies;
+  int wrong = 0, lost = 0;
+  for (int i = 0; i < count; i++) {
+    const auto& c = commands[i % 4];
+    // Every other temperature command arrives in two writes.
+    bool split = c.type == CloudCommand::Temp && i % 8 == 5;
+    auto timeStart = std::chrono::steady_clock::now();
+    if (split) {
+      rest(host, port, "PUT", path + "/temp", "true");
+      rest(host, port, "PATCH", path, "{\"value\":205}");
+    } else {
+      rest(host, port, "PUT", path, c.json);
+    }
+
+    // Like the bridge: the stream says a command is there, the claim takes
+    // it off the database.
+    CloudCommand cmd;
+    std::string value;
+    bool got = false;
+    while (!got && stream.connected() &&
+           std::chrono::steady_clock::now() - timeStart <
+               std::chrono::seconds(2)) {
+      stream.poll(onEvent);
+      if (mirror.take(cmd)) {
+        got = rtdb.claim(path, value) == RtdbClient::Claimed;
+        if (got) cmd = CloudCommand::parse(value);
+      }
+    }
+    auto timeEnd = std::chrono::steady_clock::now();
+    if (!got) {
+      lost++;
+      continue;
+    }
+    if (cmd.type != c.type || cmd.value != c.value) wrong++;
+    latencies.push_back(
+        std::chrono::duration<double, std::milli>(timeEnd - timeStart)
+            .count());
+  }
+
+  printf("commands %d, delivered %zu, wrong %d, lost %d\n", count,
+         latencies.size(), wrong, lost);
+  printf("write-to-delivery ms: p50 %.2f, p99 %.2f, max %.2f\n",
+         percentile(latencies, 0.5), percentile(latencies, 0.99),
+         percentile(latencies, 1.0));
+  printf("stream: %lu events, %lu bytes, %lu connects\n", stream.getEvents(),
+         stream.getBytes(), stream.getConnects());
+  bool ok = wrong == 0 && lost == 0;
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
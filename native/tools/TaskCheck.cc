@@ -0,0 +1,169 @@
+// Runs the bridge's task layout (TaskLayout.hh) with stand-in workloads, once
+// with everything called one after the other from a single loop, as the
+// bridge used to, and once as PinnedTasks passing messages through bounded
+// queues like main.cc does. The kettle's work is short but must run every
+// period; a full display redraw takes ~25ms of blocking I2C, and the cloud
+// link blocks on the network for up to seconds.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <random>
+#include <thread>
+
+#include "BoundedQueue.hh"
+#include "LatencyHistogram.hh"
+#include "PinnedTask.hh"
+#include "TaskLayout.hh"
+#include "Tools.hh"
+
+static void work(unsigned long micro) {
+  unsigned long timeStart = micros();
+  while (micros() - timeStart < micro) {
+  }
+}
+
+struct Layout {
+  // Command timestamps from the coordinator to the kettle, and reports from
+  // the kettle and scale back, which the coordinator forwards to the UI.
+  BoundedQueue<unsigned long, 4> commands;
+  BoundedQueue<int, 4> reports;
+  BoundedQueue<int, 2> uiUpdates;
+
+  LatencyHistogram kettleIntervals;  // us between kettle step starts.
+  LatencyHistogram commandLatency;   // us from command sent to applied.
+  unsigned long lastKettleStep = 0;
+  unsigned long commandsApplied = 0;
+  int sample = 0;
+  unsigned long redraws = 0;
+  std::mt19937 rng{3};
+  unsigned long lastCloudStall = 0;
+
+  void kettleStep() {
+    unsigned long timeNow = micros();
+    if (lastKettleStep) kettleIntervals.record(timeNow - lastKettleStep);
+    lastKettleStep = timeNow;
+    unsigned long sent;
+    while (commands.pop(sent)) {
+      commandLatency.record(micros() - sent);
+      commandsApplied++;
+    }
+    work(300);
+    reports.push(0);
+  }
+
+  void scaleStep() {
+    work(150);
+    // The fill changes every tenth sample or so.
+    if (++sample % 10 == 0) reports.push(sample);
+  }
+
+  void uiStep() {
+    int update;
+    bool updated = false;
+    while (uiUpdates.pop(update)) updated = true;
+    if (!updated) return;
+    work(25000);
+    redraws++;
+  }
+
+  void cloudStep() {
+    work(500);
+    // A slow request every second, and a 2s stall every 5s.
+    unsigned long timeNow = millis();
+    if (timeNow - lastCloudStall >= 1000) {
+      lastCloudStall = timeNow;
+      delay(timeNow / 1000 % 5 == 4 ? 2000 : 100 + rng() % 200);
+    }
+  }
+
+  // What loop() does: pass reports on to the UI, and send a command every
+  // 100ms.
+  unsigned long lastCommand = 0;
+  void coordinatorStep() {
+    int report;
+    bool fill = false;
+    while (reports.pop(report))
+      if (report) fill = true;
+    if (fill) uiUpdates.push(1);
+    unsigned long timeNow = millis();
+    if (timeNow - lastCommand >= 100) {
+      lastCommand = timeNow;
+      commands.push(micros());
+    }
+  }
+};
+
+static void printStats(const char* name, const PinnedTask::Stats& s) {
+  printf("  %-8s %6lu runs, %3lu%% busy, max %7lu us, %5lu overruns\n", name,
+         s.runs, s.busyPercent(), s.maxRunTime, s.overruns);
+}
+
+static void printLatencies(const Layout& layout) {
+  const LatencyHistogram& k = layout.kettleIntervals;
+  const LatencyHistogram& c = layout.commandLatency;
+  printf("  kettle step interval us: p50 %u, p99 %u, max %u (period %lu ms)\n",
+         k.percentile(0.5), k.percentile(0.99), k.getMax(),
+         TaskLayout::Kettle.period);
+  printf("  command latency us: p50 %u, p99 %u, max %u; %lu applied, %lu "
+         "redraws\n",
+         c.percentile(0.5), c.percentile(0.99), c.getMax(),
+         layout.commandsApplied, layout.redraws);
+}
+
+int taskCheck(int argc, char** argv) {
+  unsigned long duration = argc > 1 ? atoi(argv[1]) * 1000UL : 10000;
+  printf("%u core(s); host priorities map to niceness, so lower priority "
+         "tasks still get some of a busy core\n",
+         std::thread::hardware_concurrency());
+
+  // Everything from one loop, at the kettle's period.
+  Layout single;
+  {
+    PinnedTask loop({"loop", 1, 1, 8192, TaskLayout::Kettle.period});
+    loop.begin([&]() {
+      single.kettleStep();
+      single.scaleStep();
+      single.uiStep();
+      single.cloudStep();
+      single.coordinatorStep();
+    });
+    delay(duration);
+    loop.end();
+    printf("single loop:\n");
+    printStats("loop", loop.takeStats());
+    printLatencies(single);
+  }
+
+  Layout tasks;
+  {
+    PinnedTask kettle(TaskLayout::Kettle);
+    PinnedTask scale(TaskLayout::Scale);
+    PinnedTask ui(TaskLayout::Ui);
+    PinnedTask cloud(TaskLayout::Cloud);
+    PinnedTask loop({"loop", 1, 1, 8192, 10});
+    kettle.begin([&]() { tasks.kettleStep(); });
+    scale.begin([&]() { tasks.scaleStep(); });
+    ui.begin([&]() { tasks.uiStep(); });
+    cloud.begin([&]() { tasks.cloudStep(); });
+    loop.begin([&]() { tasks.coordinatorStep(); });
+    delay(duration);
+    for (PinnedTask* task : {&loop, &kettle, &scale, &ui, &cloud}) task->end();
+    printf("tasks:\n");
+    for (PinnedTask* task : {&kettle, &scale, &ui, &cloud, &loop})
+      printStats(task->getConfig().name, task->takeStats());
+    printLatencies(tasks);
+    printf("  dropped: %lu commands, %lu reports, %lu ui updates\n",
+           tasks.commands.getDropped(), tasks.reports.getDropped(),
+           tasks.uiUpdates.getDropped());
+  }
+
+  // The kettle must keep its pace and get commands within a few periods,
+  // whatever the display and the network are doing.
+  unsigned long budget = 3 * TaskLayout::Kettle.period * 1000;
+  bool ok = tasks.kettleIntervals.percentile(0.99) < budget &&
+            tasks.commandLatency.percentile(0.99) < budget &&
+            tasks.commandsApplied > 0 && tasks.redraws > 0;
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,323 @@
+// Compares the JSON and CBOR status encodings: checks that the CBOR messages
+// carry exactly what the JSON ones do, then measures encode time, heap
+// allocations and payload size. With "relay", also pushes status and reads
+// commands through native/tools/cbor_relay.py into rtdb_standin.py.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <PosixClient.h>
+
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <string>
+
+#include "Cbor.hh"
+#include "CloudCommand.hh"
+#include "Rest.hh"
+#include "StatePublisher.hh"
+#include "TelemetryRelay.hh"
+#include "Tools.hh"
+
+// Count every heap allocation in the program; only read around the timed
+// sections below. Other tools allocate from several threads.
+static std::atomic<unsigned long> allocations{0};
+
+void* operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  void* p = malloc(size ? size : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+struct Status {
+  bool isOn, isLifted, isHold;
+  int currentTemp, targetTemp, units, fill, confirmed, latency;
+};
+
+static void addFields(StatePublisher& publisher) {
+  publisher.addBool("isOn", 0);
+  publisher.addBool("isLifted", 0);
+  publisher.addBool("isHold", 0);
+  publisher.addInt("currentTemp", 0);
+  publisher.addInt("targetTemp", 0);
+  publisher.addInt("units", 0);
+  publisher.addInt("fill", 0);
+  publisher.addInt("commandsConfirmed", 0);
+  publisher.addInt("lastCommandLatency", 0);
+}
+
+static void setFields(StatePublisher& publisher, const Status& s,
+                      unsigned long timeNow) {
+  long values[] = {s.isOn,  s.isLifted, s.isHold,    s.currentTemp, s.targetTemp,
+                   s.units, s.fill,     s.confirmed, s.latency};
+  for (int i = 0; i < 9; i++) publisher.set(i, values[i], timeNow);
+}
+
+// The snapshot updateFirebaseState() used to build: every field, with
+// lastUpdated formatted through String. FirebaseJson itself allocates more
+// than this, so the old path only looks better here than it was.
+static String legacySnapshot(const Status& s, unsigned long timeNow) {
+  String json = "{\"isOn\":";
+  json += s.isOn ? "true" : "false";
+  json += ",\"isLifted\":";
+  json += s.isLifted ? "true" : "false";
+  json += ",\"isHold\":";
+  json += s.isHold ? "true" : "false";
+  json += ",\"currentTemp\":" + String(s.currentTemp);
+  json += ",\"targetTemp\":" + String(s.targetTemp);
+  json += ",\"units\":" + String(s.units);
+  json += ",\"fill\":" + String(s.fill);
+  json += ",\"commandsConfirmed\":" + String(s.confirmed);
+  json += ",\"lastCommandLatency\":" + String(s.latency);
+  json += ",\"lastUpdated\":\"" + String(timeNow) + "\"}";
+  return json;
+}
+
+// Renders a CBOR message as compact JSON, for comparing against delta().
+static bool toJson(CborReader& in, std::string& out, int depth = 0) {
+  CborReader::Item item;
+  if (depth > 4 || !in.next(item)) return false;
+  char buf[24];
+  switch (item.type) {
+    case CborReader::Item::Int:
+      snprintf(buf, sizeof(buf), "%ld", item.value);
+      out += buf;
+      return true;
+    case CborReader::Item::Bool:
+      out += item.value ? "true" : "false";
+      return true;
+    case CborReader::Item::Null:
+      out += "null";
+      return true;
+    case CborReader::Item::Text:
+      out += '"';
+      out.append(item.text, item.length);
+      out += '"';
+      return true;
+    case CborReader::Item::Map:
+      out += '{';
+      for (long i = 0; i < item.value; i++) {
+        if (i) out += ',';
+        if (!toJson(in, out, depth + 1)) return false;
+        out += ':';
+        if (!toJson(in, out, depth + 1)) return false;
+      }
+      out += '}';
+      return true;
+    default:
+      return false;
+  }
+}
+
+static int check() {
+  int errors = 0;
+  StatePublisher json(0), cbor(0);
+  addFields(json);
+  addFields(cbor);
+  Status states[] = {{true, false, false, 70, 205, 0, 24, 1, 112},
+                     {true, false, false, 71, 205, 0, 24, 1, 112},
+                     {true, false, true, 205, 205, 0, 24, 1, 112},
+                     {false, true, false, 204, 205, 0, 9, 2, 98},
+                     {false, false, false, -40, 100, 1, 0, 70000, 0}};
+  unsigned long timeNow = 1000;
+  for (const Status& s : states) {
+    timeNow += 4294960000UL / 5;
+    setFields(json, s, timeNow);
+    setFields(cbor, s, timeNow);
+    uint8_t buf[160];
+    std::string expected = json.delta(timeNow), actual;
+    size_t size = cbor.delta(buf, sizeof(buf), timeNow);
+    CborReader in(buf, size);
+    if (!size || !toJson(in, actual) || !in.atEnd() || actual != expected) {
+      printf("status mismatch:\n  json %s\n  cbor %s\n", expected.c_str(),
+             actual.c_str());
+      errors++;
+    }
+    json.acknowledge(true, timeNow);
+    cbor.acknowledge(true, timeNow);
+  }
+
+  // A buffer too small fails cleanly and leaves the fields to be resent.
+  uint8_t tiny[8];
+  cbor.resync();
+  if (cbor.delta(tiny, sizeof(tiny), timeNow) != 0) errors++;
+  cbor.acknowledge(false, timeNow);
+  if (!cbor.due(timeNow)) errors++;
+
+  CloudCommand commands[] = {{CloudCommand::On, 0},
+                             {CloudCommand::Off, 0},
+                             {CloudCommand::Calibrate, 0},
+                             {CloudCommand::Temp, 205},
+                             {CloudCommand::Temp, 40},
+                             {CloudCommand::CalibratePoint, 16},
+                             {CloudCommand::None, 0}};
+  for (const CloudCommand& c : commands) {
+    uint8_t buf[32];
+    size_t size = c.encode(buf, sizeof(buf));
+    CborReader in(buf, size);
+    std::string text;
+    CloudCommand back = CloudCommand::parse(buf, size);
+    CloudCommand fromJson =
+        toJson(in, text) ? CloudCommand::parse(text) : CloudCommand();
+    if (!size || back.type != c.type || back.value != c.value ||
+        fromJson.type != c.type || fromJson.value != c.value) {
+      printf("command %d/%d mismatch (%s)\n", c.type, c.value, text.c_str());
+      errors++;
+    }
+  }
+  // Several keys at once resolve in the same order as the JSON parser, and
+  // nested or unknown values are skipped.
+  const uint8_t mixed[] = {0xa4, 0x64, 't', 'e', 'm', 'p', 0xf5,
+                           0x63, 'x', 'y', 'z', 0xa1, 0x61, 'a', 0x82, 0x01, 0x02,
+                           0x65, 'v', 'a', 'l', 'u', 'e', 0x18, 0xc8,
+                           0x62, 'o', 'n', 0xf6};
+  CloudCommand m = CloudCommand::parse(mixed, sizeof(mixed));
+  if (m.type != CloudCommand::On) errors++;
+  // Truncated input never reads past the end.
+  for (size_t n = 0; n < sizeof(mixed); n++)
+    if (CloudCommand::parse(mixed, n).type == CloudCommand::Temp) errors++;
+
+  printf("codec check: %d errors\n", errors);
+  return errors;
+}
+
+template <typename F>
+static void measure(const char* name, int iterations, F&& encode) {
+  size_t bytes = 0;
+  unsigned long before = allocations;
+  auto timeStart = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++) bytes += encode(i);
+  auto timeEnd = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(timeEnd - timeStart)
+                  .count() / iterations;
+  printf("  %-16s %7.0f ns %6.1f allocs %6.1f bytes\n", name, ns,
+         (double)(allocations - before) / iterations,
+         (double)bytes / iterations);
+}
+
+static void bench(int iterations) {
+  Status s = {true, false, false, 70, 205, 0, 24, 1, 112};
+  StatePublisher publisher(0);
+  addFields(publisher);
+  uint8_t buf[160];
+  volatile size_t sink = 0;
+
+  printf("full status, per message:\n");
+  measure("String snapshot", iterations, [&](int i) {
+    String json = legacySnapshot(s, 1000000 + i);
+    return json.length();
+  });
+  measure("JSON", iterations, [&](int i) {
+    publisher.resync();
+    std::string json = publisher.delta(1000000 + i);
+    publisher.acknowledge(true, 1000000 + i);
+    return json.size();
+  });
+  measure("CBOR", iterations, [&](int i) {
+    publisher.resync();
+    size_t size = publisher.delta(buf, sizeof(buf), 1000000 + i);
+    publisher.acknowledge(true, 1000000 + i);
+    return size;
+  });
+
+  printf("currentTemp changed, per message:\n");
+  measure("JSON", iterations, [&](int i) {
+    s.currentTemp = 70 + i % 2;
+    setFields(publisher, s, 1000000 + i);
+    std::string json = publisher.delta(1000000 + i);
+    publisher.acknowledge(true, 1000000 + i);
+    return json.size();
+  });
+  measure("CBOR", iterations, [&](int i) {
+    s.currentTemp = 70 + i % 2;
+    setFields(publisher, s, 1000000 + i);
+    size_t size = publisher.delta(buf, sizeof(buf), 1000000 + i);
+    publisher.acknowledge(true, 1000000 + i);
+    return size;
+  });
+
+  printf("command, per message:\n");
+  CloudCommand temp = {CloudCommand::Temp, 205};
+  std::string json = "{\"temp\":true,\"value\":205}";
+  size_t size = temp.encode(buf, sizeof(buf));
+  measure("JSON parse", iterations, [&](int) {
+    sink = sink + CloudCommand::parse(json).value;
+    return json.size();
+  });
+  measure("CBOR parse", iterations, [&](int) {
+    sink = sink + CloudCommand::parse(buf, size).value;
+    return size;
+  });
+}
+
+// Status and a command through the relay, checked against the stand-in.
+static int relay(const char* host, uint16_t relayPort, uint16_t port) {
+  int errors = 0;
+  PosixClient client;
+  TelemetryRelay telemetry(client, host, relayPort);
+  StatePublisher publisher(0);
+  addFields(publisher);
+  rest(host, port, "DELETE", "/relaytest", "");
+
+  Status s = {true, false, false, 70, 205, 0, 24, 1, 112};
+  uint8_t buf[160];
+  std::string expected;
+  for (int i = 0; i < 20; i++) {
+    s.currentTemp = 70 + i;
+    s.isHold = i == 19;
+    setFields(publisher, s, 1000 + i);
+    size_t size = publisher.delta(buf, sizeof(buf), 1000 + i);
+    int code = telemetry.send("PATCH", "/relaytest/status", buf, size);
+    publisher.acknowledge(code == 204, 1000 + i);
+    if (code != 204) {
+      printf("relay PATCH returned %d\n", code);
+      errors++;
+    }
+  }
+  std::string stored;
+  rest(host, port, "GET", "/relaytest/status", "", &stored);
+  const char* want[] = {"\"currentTemp\":89", "\"isHold\":true",
+                        "\"lastUpdated\":\"1019\"", "\"fill\":24"};
+  for (const char* w : want) {
+    if (stored.find(w) == std::string::npos) {
+      printf("stand-in is missing %s: %s\n", w, stored.c_str());
+      errors++;
+    }
+  }
+
+  rest(host, port, "PUT", "/relaytest/command", "{\"temp\":true,\"value\":180}");
+  size_t length;
+  int code = telemetry.get("/relaytest/command", buf, sizeof(buf), length);
+  CloudCommand cmd = CloudCommand::parse(buf, length);
+  if (code != 200 || cmd.type != CloudCommand::Temp || cmd.value != 180) {
+    printf("relay GET returned %d, command %d/%d\n", code, cmd.type, cmd.value);
+    errors++;
+  }
+  rest(host, port, "DELETE", "/relaytest", "");
+
+  printf("relay: %lu requests over %lu connections, %lu bytes sent\n",
+         telemetry.getRequests(), telemetry.getConnects(), telemetry.getBytes());
+  printf("relay check: %d errors\n", errors);
+  return errors;
+}
+
+int telemetryBench(int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "relay") == 0) {
+    const char* host = argc > 2 ? argv[2] : "127.0.0.1";
+    uint16_t relayPort = argc > 3 ? atoi(argv[3]) : 9001;
+    uint16_t port = argc > 4 ? atoi(argv[4]) : 9000;
+    int errors = check() + relay(host, relayPort, port);
+    printf("%s\n", errors ? "FAILED" : "OK");
+    return errors ? 1 : 0;
+  }
+  int iterations = argc > 1 ? atoi(argv[1]) : 200000;
+  int errors = check();
+  bench(iterations);
+  printf("%s\n", errors ? "FAILED" : "OK");
+  return errors ? 1 : 0;
+}
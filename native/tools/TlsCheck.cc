@@ -0,0 +1,126 @@
+// Request latency over TLS against the stand-in started with --tls: a fresh
+// connection with a full handshake for every request, a fresh connection that
+// resumes the saved session, and one kept-alive connection. First, that
+// connect() gives up in time on servers that never answer.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "RtdbClient.hh"
+#include "TlsClient.hh"
+#include "Tools.hh"
+
+static double percentile(std::vector<double> v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[(size_t)(p * (v.size() - 1))];
+}
+
+// A local listener that never accepts, with room for one connection in its
+// queue: the first connect() gets TCP and then silence to its ClientHello,
+// the next one's SYNs go unanswered. Both must fail once the timeout is up.
+static bool bounded(unsigned long timeout) {
+  int server = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(addr);
+  if (server < 0 || bind(server, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+      listen(server, 0) != 0 ||
+      getsockname(server, (struct sockaddr*)&addr, &length) != 0) {
+    printf("Could not listen for the timeout checks\n");
+    if (server >= 0) close(server);
+    return false;
+  }
+  uint16_t port = ntohs(addr.sin_port);
+  TlsClient tls;
+  tls.setInsecure();
+  tls.setConnectTimeout(timeout);
+  const char* names[] = {"silent handshake", "unanswered connect"};
+  bool ok = true;
+  for (const char* name : names) {
+    unsigned long failed = tls.getStats().failed;
+    auto timeStart = std::chrono::steady_clock::now();
+    int connected = tls.connect("127.0.0.1", port);
+    double ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - timeStart)
+                    .count();
+    bool inTime = !connected && tls.getStats().failed == failed + 1 &&
+                  ms >= timeout && ms < timeout + 250;
+    printf("%s: %s after %.0f ms, timeout %lu: %s\n", name,
+           connected ? "connected" : "failed", ms, timeout,
+           inTime ? "ok" : "WRONG");
+    ok = ok && inTime;
+    tls.stop();
+  }
+  close(server);
+  return ok;
+}
+
+int tlsCheck(int argc, char** argv) {
+  const char* host = argc > 1 ? argv[1] : "127.0.0.1";
+  uint16_t port = argc > 2 ? atoi(argv[2]) : 9443;
+  int requests = argc > 3 ? atoi(argv[3]) : 200;
+  const std::string path = "/tlstest/status";
+
+  bool ok = bounded(500);
+
+  TlsClient tls;
+  tls.setInsecure();
+  RtdbClient rtdb(tls, host, port, "secret");
+  if (rtdb.request("PUT", path, "{\"isOn\":false}").code != 200) {
+    printf("Could not reach https://%s:%u\n", host, port);
+    return 1;
+  }
+
+  enum Mode { Full, Resumed, KeepAlive };
+  const char* names[] = {"new connection, full handshake",
+                         "new connection, resumed session",
+                         "kept-alive connection"};
+  for (int mode = Full; mode <= KeepAlive; mode++) {
+    TlsClient::Stats before = tls.getStats();
+    std::vector<double> latencies;
+    int errors = 0;
+    for (int i = 0; i < requests; i++) {
+      if (mode != KeepAlive) tls.stop();
+      if (mode == Full) tls.forgetSession();
+      auto timeStart = std::chrono::steady_clock::now();
+      RtdbClient::Response r = rtdb.request("GET", path);
+      auto timeEnd = std::chrono::steady_clock::now();
+      if (r.code != 200 || r.body != "{\"isOn\":false}") errors++;
+      latencies.push_back(
+          std::chrono::duration<double, std::milli>(timeEnd - timeStart)
+              .count());
+    }
+    const TlsClient::Stats& after = tls.getStats();
+    unsigned long full = after.full - before.full;
+    unsigned long resumed = after.resumed - before.resumed;
+    printf("%s:\n", names[mode]);
+    printf("  %d requests, %d errors; %lu full and %lu resumed handshakes\n",
+           requests, errors, full, resumed);
+    printf("  request ms: p50 %.2f, p99 %.2f, max %.2f\n",
+           percentile(latencies, 0.5), percentile(latencies, 0.99),
+           percentile(latencies, 1.0));
+    ok = ok && errors == 0;
+    if (mode == Resumed) ok = ok && resumed >= (unsigned long)requests - 1;
+    if (mode == KeepAlive) ok = ok && full + resumed <= 1;
+  }
+
+  const TlsClient::Stats& s = tls.getStats();
+  printf("handshake ms: full avg %.2f, resumed avg %.2f, max %lu\n",
+         s.full ? (double)s.totalFullTime / s.full : 0.0,
+         s.resumed ? (double)s.totalResumedTime / s.resumed : 0.0,
+         s.maxHandshakeTime);
+  rtdb.request("DELETE", "/tlstest");
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,30 @@
+#ifndef __TOOLS_H__
+#define __TOOLS_H__
+
+// Entry points of the host-side tools, dispatched by name from main.cc.
+
+int parserBench(int argc, char** argv);
+int decoderCheck(int argc, char** argv);
+int ringStress(int argc, char** argv);
+int queueCheck(int argc, char** argv);
+int streamCheck(int argc, char** argv);
+int publishBench(int argc, char** argv);
+int telemetryBench(int argc, char** argv);
+int claimCheck(int argc, char** argv);
+int tlsCheck(int argc, char** argv);
+int workerCheck(int argc, char** argv);
+int taskCheck(int argc, char** argv);
+int snapshotCheck(int argc, char** argv);
+int samplerCheck(int argc, char** argv);
+int filterCheck(int argc, char** argv);
+int curveCheck(int argc, char** argv);
+int calibrationCheck(int argc, char** argv);
+int screenCheck(int argc, char** argv);
+int reconnectCheck(int argc, char** argv);
+int kettlesCheck(int argc, char** argv);
+int ekgCheck(int argc, char** argv);
+int replayCheck(int argc, char** argv);
+int traceBench(int argc, char** argv);
+int logCheck(int argc, char** argv);
+
+#endif
@@ -0,0 +1,126 @@
+// Costs and checks of the Trace probes (Trace.hh): what each kind of probe
+// adds to the code it measures, that counts from several threads at once all
+// land, and that a probe's histogram reads back as a LatencyHistogram fed
+// the same durations would.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "LatencyHistogram.hh"
+#include "Tools.hh"
+#include "Trace.hh"
+
+static volatile uint32_t sink;
+
+// ns per call of probe, less a loop doing the same work without it.
+template <typename F>
+static double timePerCall(uint32_t calls, F probe) {
+  auto run = [&](bool withProbe) {
+    auto timeStart = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < calls; i++) {
+      sink = sink + i;
+      if (withProbe) probe(i);
+    }
+    return std::chrono::duration<double, std::nano>(
+               std::chrono::steady_clock::now() - timeStart)
+               .count();
+  };
+  double base = run(false);
+  double with = run(true);
+  return with > base ? (with - base) / calls : 0;
+}
+
+static bool same(const LatencyHistogram& a, const LatencyHistogram& b) {
+  static const double ps[] = {0, 0.1, 0.5, 0.9, 0.99, 0.999, 1};
+  if (a.getCount() != b.getCount() || a.getMax() != b.getMax()) return false;
+  for (double p : ps)
+    if (a.percentile(p) != b.percentile(p)) return false;
+  return true;
+}
+
+int traceBench(int argc, char** argv) {
+  uint32_t calls = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10000000;
+  int threads = argc > 2 ? atoi(argv[2]) : 4;
+  bool ok = true;
+
+  printf("ns per probe over %u calls:\n", calls);
+  printf("  count      %6.1f\n", timePerCall(calls, [](uint32_t i) {
+           Trace::count(Trace::Frames);
+         }));
+  printf("  record     %6.1f\n", timePerCall(calls, [](uint32_t i) {
+           Trace::record(Trace::Decode, i & 1023);
+         }));
+  printf("  Span       %6.1f\n", timePerCall(calls, [](uint32_t i) {
+           Trace::Span span(Trace::Decode);
+         }));
+  printf("  LongSpan   %6.1f\n", timePerCall(calls, [](uint32_t i) {
+           Trace::LongSpan span(Trace::CloudRequest);
+         }));
+  Trace::Mark mark;
+  printf("  Mark+take  %6.1f\n", timePerCall(calls, [&](uint32_t i) {
+           mark.set();
+           mark.take(Trace::NotifyWait);
+         }));
+  printf("  micros()   %6.1f\n", timePerCall(calls, [](uint32_t i) {
+           sink = sink + micros();
+         }));
+
+  // Every thread counts and records the same durations; nothing may be lost.
+  Trace::reset();
+  uint32_t perThread = calls / threads;
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++) {
+    workers.emplace_back([perThread] {
+      for (uint32_t i = 0; i < perThread; i++) {
+        Trace::count(Trace::Notifications);
+        Trace::count(Trace::NotifyBytes, 20);
+        Trace::record(Trace::Write, i % 5000);
+      }
+    });
+  }
+  for (std::thread& w : workers) w.join();
+  uint32_t expected = perThread * threads;
+  LatencyHistogram h;
+  Trace::histograms[Trace::Write].read(h);
+  uint32_t notifications = Trace::counters[Trace::Notifications].load();
+  uint32_t bytes = Trace::counters[Trace::NotifyBytes].load();
+  bool exact = notifications == expected && bytes == expected * 20 &&
+               h.getCount() == expected;
+  printf("%d threads x %u: counted %u, %u bytes, recorded %u of %u: %s\n",
+         threads, perThread, notifications, bytes, h.getCount(), expected,
+         exact ? "exact" : "LOST");
+  ok = ok && exact;
+
+  // The same durations through a probe and a LatencyHistogram, from 0 to
+  // beyond an hour.
+  Trace::reset();
+  LatencyHistogram direct;
+  std::mt19937 rng(1);
+  for (uint32_t i = 0; i < 1000000; i++) {
+    uint32_t micros = rng() >> (rng() % 32);
+    Trace::record(Trace::LoopPass, micros);
+    direct.record(micros);
+  }
+  LatencyHistogram traced;
+  Trace::histograms[Trace::LoopPass].read(traced);
+  bool match = same(traced, direct);
+  printf("Histogram vs LatencyHistogram, p50 %u/%u, p99 %u/%u, max %u/%u: %s\n",
+         traced.percentile(0.5), direct.percentile(0.5),
+         traced.percentile(0.99), direct.percentile(0.99), traced.getMax(),
+         direct.getMax(), match ? "same" : "DIFFERENT");
+  ok = ok && match;
+
+  Serial.begin(115200);
+  Trace::print(Serial);
+  std::string json = "{";
+  Trace::appendJson(json, "trace");
+  json += "}";
+  printf("%s\n", json.c_str());
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,177 @@
+// Main loop latency with cloud I/O done inline, as loop() used to, and through
+// CloudWorker: once against the stand-in and once during an outage, played by
+// a listener that accepts connections and never answers. Each simulated loop
+// pass does about 200us of kettle and scale work and changes the status.
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <PosixClient.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "CloudWorker.hh"
+#include "LatencyHistogram.hh"
+#include "Rest.hh"
+#include "StatePublisher.hh"
+#include "TaskLayout.hh"
+#include "Tools.hh"
+
+// Accepts connections and holds them open without reading or replying.
+class Blackhole {
+ public:
+  uint16_t port = 0;
+
+  bool begin() {
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (bind(listener, (sockaddr*)&addr, len) != 0 || listen(listener, 8) != 0 ||
+        getsockname(listener, (sockaddr*)&addr, &len) != 0)
+      return false;
+    port = ntohs(addr.sin_port);
+    thread = std::thread([this]() {
+      while (running) {
+        pollfd p = {listener, POLLIN, 0};
+        if (::poll(&p, 1, 50) > 0) held.push_back(accept(listener, nullptr, 0));
+      }
+    });
+    return true;
+  }
+
+  ~Blackhole() {
+    running = false;
+    if (thread.joinable()) thread.join();
+    for (int fd : held) close(fd);
+    if (listener >= 0) close(listener);
+  }
+
+ private:
+  int listener = -1;
+  std::atomic<bool> running{true};
+  std::thread thread;
+  std::vector<int> held;
+};
+
+struct LoopRun {
+  LatencyHistogram times;
+  unsigned long uploads = 0;
+  unsigned long failures = 0;
+  unsigned long commands = 0;
+};
+
+static const char* StatusPath = "/workertest/status";
+
+static void work(unsigned long micro) {
+  unsigned long timeStart = micros();
+  while (micros() - timeStart < micro) {
+  }
+}
+
+static LoopRun runLoop(const char* host, uint16_t port, bool useWorker,
+                       unsigned long duration) {
+  PosixClient restSocket, streamSocket;
+  RtdbClient rest(restSocket, host, port, "secret");
+  RtdbStream stream(streamSocket, host, port, "secret");
+  CloudWorker worker(TaskLayout::Cloud, rest, stream);
+  StatePublisher publisher(1000);
+  publisher.addInt("currentTemp", 5000);
+  publisher.addBool("isOn", 0);
+  LoopRun run;
+  bool inFlight = false;
+  unsigned long lastPoll = 0;
+  if (useWorker) {
+    worker.setKettle("workertest");
+    worker.begin();
+  }
+
+  unsigned long timeBegin = millis();
+  for (unsigned long timeNow = timeBegin; timeNow - timeBegin < duration;
+       timeNow = millis()) {
+    unsigned long loopStart = micros();
+    work(200);
+    publisher.set(0, 150 + (timeNow / 400) % 60, timeNow);
+    publisher.set(1, (timeNow / 2500) % 2, timeNow);
+    if (useWorker) {
+      bool ok;
+      while (worker.takeResult(ok)) {
+        publisher.acknowledge(ok, timeNow);
+        inFlight = false;
+        ok ? run.uploads++ : run.failures++;
+      }
+      if (!inFlight && publisher.due(timeNow)) {
+        inFlight = worker.sendStatus(StatusPath, publisher.delta(timeNow));
+        if (!inFlight) publisher.acknowledge(false, timeNow);
+      }
+      CloudCommand cmd;
+      while (worker.takeCommand(cmd)) run.commands++;
+    } else {
+      if (publisher.due(timeNow)) {
+        bool ok = rest.request("PATCH", StatusPath, publisher.delta(timeNow))
+                      .code == 200;
+        publisher.acknowledge(ok, timeNow);
+        ok ? run.uploads++ : run.failures++;
+      }
+      if (timeNow - lastPoll >= CloudWorker::PollInterval) {
+        lastPoll = timeNow;
+        std::string value;
+        if (rest.claim("/workertest/command", value) == RtdbClient::Claimed)
+          run.commands++;
+      }
+    }
+    run.times.record(micros() - loopStart);
+  }
+  // Joins the worker, which may still be waiting on a request.
+  worker.end();
+  return run;
+}
+
+int workerCheck(int argc, char** argv) {
+  const char* host = argc > 1 ? argv[1] : "127.0.0.1";
+  uint16_t port = argc > 2 ? atoi(argv[2]) : 9000;
+  unsigned long duration = argc > 3 ? atoi(argv[3]) * 1000UL : 8000;
+
+  if (!rest(host, port, "DELETE", "/workertest", "")) {
+    printf("Could not reach http://%s:%u\n", host, port);
+    return 1;
+  }
+  Blackhole outage;
+  if (!outage.begin()) {
+    printf("Could not open the outage listener\n");
+    return 1;
+  }
+
+  bool ok = true;
+  for (int outagePhase = 0; outagePhase < 2; outagePhase++) {
+    for (int useWorker = 0; useWorker < 2; useWorker++) {
+      // One command per run, waiting on the server; both loops should get it.
+      if (!outagePhase)
+        rest(host, port, "PUT", "/workertest/command", "{\"off\":true}");
+      LoopRun run = outagePhase
+                        ? runLoop("127.0.0.1", outage.port, useWorker, duration)
+                        : runLoop(host, port, useWorker, duration);
+      const LatencyHistogram& t = run.times;
+      unsigned long slow = t.countAbove(50000);
+      printf("%s, %s:\n", outagePhase ? "outage" : "cloud up",
+             useWorker ? "CloudWorker" : "inline");
+      printf("  %lu passes, %lu over 50ms; us p50 %u, p99 %u, p99.9 %u, max %u\n",
+             (unsigned long)t.getCount(), slow, t.percentile(0.5),
+             t.percentile(0.99), t.percentile(0.999), t.getMax());
+      printf("  %lu uploads, %lu failed, %lu commands\n", run.uploads,
+             run.failures, run.commands);
+      if (useWorker) ok = ok && slow == 0;
+      if (!outagePhase) ok = ok && run.uploads > 0 && run.commands == 1;
+    }
+  }
+  rest(host, port, "DELETE", "/workertest", "");
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
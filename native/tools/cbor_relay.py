@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+"""Translates the bridge's CBOR telemetry to Realtime Database REST calls.
+
+The bridge can send its status as CBOR instead of JSON (see
+TELEMETRY_RELAY_HOST and TELEMETRY_RELAY_PORT in PIIDefinesExample.hh).
+Firebase only speaks JSON, so this relay sits on the local network and
+forwards:
+
+    PUT/PATCH /<path>.cbor  (application/cbor)  ->  PUT/PATCH /<path>.json
+    GET /<path>.cbor                            ->  GET /<path>.json, as CBOR
+
+Point --upstream at Firebase (https://<project>.firebaseio.com, with --auth)
+or at rtdb_standin.py for tests:
+
+    python3 native/tools/cbor_relay.py --port 9001 --upstream http://127.0.0.1:9000
+"""
+
+import argparse
+import json
+import struct
+import urllib.error
+import urllib.request
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import urlsplit
+
+
+def cbor_decode(data, pos=0):
+    """Returns (value, next position). Definite lengths only, like the bridge."""
+    initial = data[pos]
+    major, info = initial >> 5, initial & 0x1F
+    pos += 1
+    if major == 7:
+        if info == 20:
+            return False, pos
+        if info == 21:
+            return True, pos
+        if info in (22, 23):
+            return None, pos
+        if info == 25:
+            return _half(data[pos:pos + 2]), pos + 2
+        if info == 26:
+            return struct.unpack(">f", data[pos:pos + 4])[0], pos + 4
+        if info == 27:
+            return struct.unpack(">d", data[pos:pos + 8])[0], pos + 8
+        raise ValueError("unsupported simple value %d" % info)
+    if info < 24:
+        arg = info
+    elif info <= 27:
+        n = 1 << (info - 24)
+        arg = int.from_bytes(data[pos:pos + n], "big")
+        pos += n
+    else:
+        raise ValueError("indefinite lengths are not supported")
+    if major == 0:
+        return arg, pos
+    if major == 1:
+        return -1 - arg, pos
+    if major in (2, 3):
+        raw = data[pos:pos + arg]
+        return raw.decode() if major == 3 else raw.hex(), pos + arg
+    if major == 4:
+        items = []
+        for _ in range(arg):
+            item, pos = cbor_decode(data, pos)
+            items.append(item)
+        return items, pos
+    if major == 5:
+        items = {}
+        for _ in range(arg):
+            key, pos = cbor_decode(data, pos)
+            items[str(key)], pos = cbor_decode(data, pos)
+        return items, pos
+    return cbor_decode(data, pos)  # Tag: use the tagged item.
+
+
+def _half(raw):
+    bits = int.from_bytes(raw, "big")
+    exp, frac = (bits >> 10) & 0x1F, bits & 0x3FF
+    value = frac * 2.0 ** -24 if exp == 0 else (
+        float("inf") if exp == 31 else (1024 + frac) * 2.0 ** (exp - 25))
+    return -value if bits & 0x8000 else value
+
+
+def _head(major, arg):
+    if arg < 24:
+        return bytes([major << 5 | arg])
+    for info, n in ((24, 1), (25, 2), (26, 4), (27, 8)):
+        if arg < 1 << (8 * n):
+            return bytes([major << 5 | info]) + arg.to_bytes(n, "big")
+    raise ValueError("integer too large")
+
+
+def cbor_encode(value):
+    if value is None:
+        return b"\xf6"
+    if value is True:
+        return b"\xf5"
+    if value is False:
+        return b"\xf4"
+    if isinstance(value, int):
+        return _head(0, value) if value >= 0 else _head(1, -1 - value)
+    if isinstance(value, float):
+        return b"\xfb" + struct.pack(">d", value)
+    if isinstance(value, str):
+        raw = value.encode()
+        return _head(3, len(raw)) + raw
+    if isinstance(value, list):
+        return _head(4, len(value)) + b"".join(map(cbor_encode, value))
+    if isinstance(value, dict):
+        return _head(5, len(value)) + b"".join(
+            cbor_encode(str(k)) + cbor_encode(v) for k, v in value.items())
+    raise TypeError("can't encode %r" % type(value))
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    # Keep-alive clients send the next request only after the whole reply;
+    # don't let Nagle hold back its last segment.
+    disable_nagle_algorithm = True
+    options = None
+
+    def log_message(self, fmt, *args):
+        if self.options.verbose:
+            super().log_message(fmt, *args)
+
+    def reply(self, code, body=b"", content_type="application/cbor"):
+        self.send_response(code)
+        self.send_header("Content-Type", content_type)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def upstream(self, method, body=None):
+        path = urlsplit(self.path).path
+        if not path.endswith(".cbor"):
+            return None
+        url = self.options.upstream.rstrip("/") + path[: -len(".cbor")] + ".json"
+        if self.options.auth:
+            url += "?auth=" + self.options.auth
+        data = None if body is None else json.dumps(
+            body, separators=(",", ":")).encode()
+        request = urllib.request.Request(url, data=data, method=method)
+        try:
+            with urllib.request.urlopen(request, timeout=10) as response:
+                return response.status, json.loads(response.read() or b"null")
+        except urllib.error.HTTPError as e:
+            return e.code, None
+
+    def write(self, method):
+        length = int(self.headers.get("Content-Length", 0))
+        try:
+            value, end = cbor_decode(self.rfile.read(length))
+            if end != length:
+                raise ValueError("trailing bytes")
+        except (IndexError, ValueError, UnicodeDecodeError) as e:
+            return self.reply(400, str(e).encode(), "text/plain")
+        result = self.upstream(method, value)
+        if result is None:
+            return self.reply(404)
+        self.reply(204 if result[0] == 200 else result[0])
+
+    def do_PUT(self):
+        self.write("PUT")
+
+    def do_PATCH(self):
+        self.write("PATCH")
+
+    def do_GET(self):
+        result = self.upstream("GET")
+        if result is None:
+            return self.reply(404)
+        code, value = result
+        self.reply(code, cbor_encode(value) if code == 200 else b"")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--host", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=9001)
+    parser.add_argument("--upstream", default="http://127.0.0.1:9000",
+                        help="Realtime Database base URL")
+    parser.add_argument("--auth", help="database secret for the upstream")
+    parser.add_argument("--verbose", action="store_true")
+    options = parser.parse_args()
+
+    Handler.options = options
+    server = ThreadingHTTPServer((options.host, options.port), Handler)
+    server.daemon_threads = True
+    print("CBOR relay on http://%s:%d -> %s" % (
+        options.host, options.port, options.upstream), flush=True)
+    server.serve_forever()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Tools.hh"
+
+struct Tool {
+  const char* name;
+  int (*run)(int argc, char** argv);
+  const char* usage;
+};
+
+static const Tool tools[] = {
+    {"parser", parserBench,
+     "[frames]  Push kettle traffic through StaggKettle::onNotify"},
+    {"decoder", decoderCheck,
+     "[seeds]   Check EkgDecoder against the original frame parser"},
+    {"ring", ringStress,
+     "[records] Stress the notification SpscRing from two threads"},
+    {"queue", queueCheck,
+     "[requests] [threads]  CommandQueue rules, and bursts vs the old FIFO"},
+    {"stream", streamCheck,
+     "[host] [port] [count]  Command stream against rtdb_standin.py"},
+    {"publish", publishBench,
+     "[brews]   Delta status uploads vs full snapshots, in virtual time"},
+    {"telemetry", telemetryBench,
+     "[iterations] | relay [host] [relay port] [port]  JSON vs CBOR status"},
+    {"claim", claimCheck,
+     "[host] [port] [bursts]  Racing command claims against rtdb_standin.py"},
+    {"tls", tlsCheck,
+     "[host] [port] [requests]  TLS session reuse against rtdb_standin.py --tls"},
+    {"worker", workerCheck,
+     "[host] [port] [seconds]  Loop latency with inline vs CloudWorker I/O"},
+    {"tasks", taskCheck,
+     "[seconds] Kettle timing with one loop vs the PinnedTask layout"},
+    {"snapshot", snapshotCheck,
+     "[seconds] [readers]  Torn reads and dirty masks of Snapshot"},
+    {"sampler", samplerCheck,
+     "[seconds] [rate]  Timer-driven FSR sampling vs one read per loop"},
+    {"filter", filterCheck,
+     "[trace]   Fill settle time and cost, boxcar vs FillFilter"},
+    {"curve", curveCheck,
+     "[rounds]  Fill curve error and cost: double, float and table"},
+    {"calibration", calibrationCheck,
+     "[rounds]  Calibration models against the old fit, and the saved blob"},
+    {"screen", screenCheck,
+     "          Display I2C traffic, full refresh vs StatusScreen"},
+    {"reconnect", reconnectCheck,
+     "[off seconds]  Kettle time to connected, saved link and backoff"},
+    {"kettles", kettlesCheck,
+     "[hours] [notifications]  Several kettles: connecting, dispatch, batching"},
+    {"ekg", ekgCheck,
+     "[commands] [loss %]  StaggKettle against the simulated kettle"},
+    {"replay", replayCheck,
+     "[capture] [fast|realtime] [rounds] | record <capture> [seconds]  BLE "
+     "captures through the decoders"},
+    {"trace", traceBench,
+     "[calls] [threads]  Cost of the Trace probes, lost counts, buckets"},
+    {"log", logCheck,
+     "[records] [threads] | decode [file]  Binary log round trip, ring and "
+     "cost; decode a console capture"},
+};
+
+int main(int argc, char** argv) {
+  const char* name = argc > 1 ? argv[1] : "parser";
+  for (const Tool& tool : tools) {
+    if (strcmp(tool.name, name) == 0)
+      return tool.run(argc > 1 ? argc - 1 : argc, argc > 1 ? argv + 1 : argv);
+  }
+  fprintf(stderr, "Usage: %s <tool> [args]\n", argv[0]);
+  for (const Tool& tool : tools)
+    fprintf(stderr, "  %-10s %s\n", tool.name, tool.usage);
+  return 1;
+}
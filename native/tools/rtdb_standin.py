@@ -0,0 +1,260 @@
+#!/usr/bin/env python3
+"""Local stand-in for the Firebase Realtime Database REST API.
+
+Keeps a JSON tree in memory and serves GET/PUT/PATCH/POST/DELETE on
+/<path>.json, plus streaming (server-sent events) for GET requests with
+"Accept: text/event-stream", so the bridge's cloud code can be exercised on
+the host without a Firebase project. Plain HTTP, or HTTPS with --tls; the
+auth query parameter is accepted and ignored.
+
+ETags work as in Firebase: "X-Firebase-ETag: true" adds an ETag header, and
+"if-match" makes PUT/DELETE conditional (412 with the current value and ETag
+if the node changed). Like Firebase, GET has no If-None-Match.
+
+    python3 native/tools/rtdb_standin.py --port 9000
+
+For HTTPS, make a throwaway certificate first:
+
+    openssl req -x509 -newkey ec -pkeyopt ec_paramgen_curve:prime256v1 \
+        -nodes -keyout key.pem -out cert.pem -days 30 -subj /CN=localhost
+    python3 native/tools/rtdb_standin.py --port 9443 --tls cert.pem key.pem
+"""
+
+import argparse
+import hashlib
+import json
+import ssl
+import threading
+import time
+import uuid
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import urlsplit
+
+
+class Tree:
+    def __init__(self):
+        self.root = None
+        self.lock = threading.Condition()
+        self.streams = []  # (path, queue list)
+
+    @staticmethod
+    def split(path):
+        return [p for p in path.split("/") if p]
+
+    def get(self, parts):
+        node = self.root
+        for p in parts:
+            if not isinstance(node, dict) or p not in node:
+                return None
+            node = node[p]
+        return node
+
+    def _set(self, parts, value):
+        if not parts:
+            self.root = value
+            return
+        if not isinstance(self.root, dict):
+            self.root = {}
+        node = self.root
+        for p in parts[:-1]:
+            if not isinstance(node.get(p), dict):
+                node[p] = {}
+            node = node[p]
+        if value is None:
+            node.pop(parts[-1], None)
+        else:
+            node[parts[-1]] = value
+        self.root = self._prune(self.root)
+
+    def _prune(self, node):
+        if isinstance(node, dict):
+            node = {k: self._prune(v) for k, v in node.items()}
+            node = {k: v for k, v in node.items() if v is not None}
+            return node or None
+        return node
+
+    def write(self, parts, value, patch=False):
+        with self.lock:
+            if patch:
+                for k, v in value.items():
+                    self._set(parts + self.split(k), v)
+            else:
+                self._set(parts, value)
+            for stream_parts, events in self.streams:
+                if parts[: len(stream_parts)] == stream_parts:
+                    rel = "/" + "/".join(parts[len(stream_parts):])
+                    events.append(("patch" if patch else "put", rel, value))
+                elif stream_parts[: len(parts)] == parts:
+                    events.append(("put", "/", self.get(stream_parts)))
+            self.lock.notify_all()
+
+
+def etag(value):
+    return hashlib.sha1(
+        json.dumps(value, separators=(",", ":"), sort_keys=True).encode()
+    ).hexdigest()
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    # Keep-alive clients send the next request only after the whole reply;
+    # don't let Nagle hold back its last segment.
+    disable_nagle_algorithm = True
+    tree = None
+    options = None
+
+    def log_message(self, fmt, *args):
+        if self.options.verbose:
+            super().log_message(fmt, *args)
+
+    def parts(self):
+        path = urlsplit(self.path).path
+        if not path.endswith(".json"):
+            return None
+        return Tree.split(path[: -len(".json")])
+
+    def body(self):
+        length = int(self.headers.get("Content-Length", 0))
+        data = self.rfile.read(length) if length else b""
+        return json.loads(data) if data else None
+
+    def reply(self, code, value, headers=()):
+        data = json.dumps(value, separators=(",", ":")).encode()
+        self.send_response(code)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(data)))
+        for k, v in headers:
+            self.send_header(k, v)
+        self.end_headers()
+        self.wfile.write(data)
+
+    def do_GET(self):
+        parts = self.parts()
+        if parts is None:
+            return self.reply(404, {"error": "not found"})
+        if self.headers.get("Accept") == "text/event-stream":
+            return self.stream(parts)
+        with self.tree.lock:
+            value = self.tree.get(parts)
+        headers = [("ETag", etag(value))] if self.headers.get(
+            "X-Firebase-ETag") else []
+        self.reply(200, value, headers)
+
+    def conditional_write(self, parts, value):
+        """PUT/DELETE honouring if-match; returns False if it replied 412."""
+        expected = self.headers.get("if-match")
+        with self.tree.lock:
+            current = self.tree.get(parts)
+            if expected is not None and expected != etag(current):
+                self.reply(412, current, [("ETag", etag(current))])
+                return False
+            self.tree.write(parts, value)
+        return True
+
+    def do_PUT(self):
+        parts = self.parts()
+        value = self.body()
+        if self.conditional_write(parts, value):
+            headers = [("ETag", etag(value))] if self.headers.get(
+                "X-Firebase-ETag") else []
+            self.reply(200, value, headers)
+
+    def do_PATCH(self):
+        parts = self.parts()
+        value = self.body()
+        if not isinstance(value, dict):
+            return self.reply(400, {"error": "Invalid data; couldn't parse JSON object."})
+        self.tree.write(parts, value, patch=True)
+        self.reply(200, value)
+
+    def do_POST(self):
+        parts = self.parts()
+        name = "-" + uuid.uuid4().hex[:19]
+        self.tree.write(parts + [name], self.body())
+        self.reply(200, {"name": name})
+
+    def do_DELETE(self):
+        if self.conditional_write(self.parts(), None):
+            headers = [("ETag", etag(None))] if self.headers.get(
+                "X-Firebase-ETag") else []
+            self.reply(200, None, headers)
+
+    def send_event(self, name, data):
+        payload = "event: %s\ndata: %s\n\n" % (
+            name, json.dumps(data, separators=(",", ":")))
+        payload = payload.encode()
+        if self.options.chunked:
+            payload = b"%x\r\n%s\r\n" % (len(payload), payload)
+        self.wfile.write(payload)
+        self.wfile.flush()
+
+    def stream(self, parts):
+        self.send_response(200)
+        self.send_header("Content-Type", "text/event-stream")
+        self.send_header("Cache-Control", "no-cache")
+        if self.options.chunked:
+            self.send_header("Transfer-Encoding", "chunked")
+        self.end_headers()
+
+        events = []
+        with self.tree.lock:
+            self.tree.streams.append((parts, events))
+            events.append(("put", "/", self.tree.get(parts)))
+        try:
+            last = time.monotonic()
+            while True:
+                with self.tree.lock:
+                    if not events:
+                        self.tree.lock.wait(0.5)
+                    pending = events[:]
+                    del events[:]
+                for name, path, data in pending:
+                    self.send_event(name, {"path": path, "data": data})
+                    last = time.monotonic()
+                if time.monotonic() - last >= self.options.keep_alive:
+                    self.send_event("keep-alive", None)
+                    last = time.monotonic()
+        except (BrokenPipeError, ConnectionResetError):
+            pass
+        finally:
+            with self.tree.lock:
+                self.tree.streams.remove((parts, events))
+            self.close_connection = True
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=9000)
+    parser.add_argument("--keep-alive", type=float, default=30.0,
+                        help="seconds between keep-alive events")
+    parser.add_argument("--chunked", action="store_true",
+                        help="send streams with chunked transfer encoding")
+    parser.add_argument("--tls", nargs=2, metavar=("CERT", "KEY"),
+                        help="serve HTTPS with this certificate and key")
+    parser.add_argument("--tls-max", choices=["1.2", "1.3"], default="1.3",
+                        help="highest TLS version (the ESP32's mbedTLS has 1.2)")
+    parser.add_argument("--verbose", action="store_true")
+    options = parser.parse_args()
+
+    Handler.tree = Tree()
+    Handler.options = options
+    server = ThreadingHTTPServer((options.host, options.port), Handler)
+    server.daemon_threads = True
+    scheme = "http"
+    if options.tls:
+        # Session tickets and the session cache are on by default, so
+        # clients can resume.
+        context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        context.load_cert_chain(*options.tls)
+        if options.tls_max == "1.2":
+            context.maximum_version = ssl.TLSVersion.TLSv1_2
+        server.socket = context.wrap_socket(server.socket, server_side=True)
+        scheme = "https"
+    print("RTDB stand-in on %s://%s:%d" % (scheme, options.host, options.port),
+          flush=True)
+    server.serve_forever()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,102 @@
+#include "AdcSampler.hh"
+
+#include "Log.hh"
+#include "Trace.hh"
+
+// A queued sample: timestamp in us, then the reading.
+static const size_t SampleBytes = 6;
+
+AdcSampler::AdcSampler(Source read, uint32_t rate)
+    : read(read), rate(rate), period(1000000 / rate) {}
+
+bool AdcSampler::begin() {
+  if (running) return true;
+  running = true;
+#ifdef ESP32
+  esp_timer_create_args_t args = {};
+  args.callback = [](void* arg) { ((AdcSampler*)arg)->sample(); };
+  args.arg = this;
+  args.dispatch_method = ESP_TIMER_TASK;
+  args.name = "adc";
+  if (esp_timer_create(&args, &timer) != ESP_OK ||
+      esp_timer_start_periodic(timer, period) != ESP_OK) {
+    LOG_ERROR("<AdcSampler::begin> Could not start the sample timer");
+    running = false;
+    return false;
+  }
+#else
+  thread = HostThread([this]() {
+    unsigned long next = micros();
+    while (running) {
+      next += period;
+      long wait = (long)(next - micros());
+      if (wait > 0) delayMicroseconds(wait);
+      sample();
+    }
+  });
+#endif
+  return true;
+}
+
+void AdcSampler::end() {
+  if (!running) return;
+  running = false;
+#ifdef ESP32
+  esp_timer_stop(timer);
+  esp_timer_delete(timer);
+  timer = nullptr;
+#else
+  thread.join();
+#endif
+}
+
+void AdcSampler::sample() {
+  TRACE_SPAN(AdcSample);
+  uint8_t record[SampleBytes];
+  uint32_t time = micros();
+  uint16_t value = read();
+  memcpy(record, &time, 4);
+  memcpy(record + 4, &value, 2);
+  // Counted by the queue if it's full.
+  queue.push(record, sizeof(record));
+}
+
+size_t AdcSampler::takeBatch(uint16_t* out, size_t max) {
+  size_t n = 0;
+  size_t length;
+  const uint8_t* record;
+  while (n < max && (record = queue.front(length)) != nullptr) {
+    uint32_t time;
+    memcpy(&time, record, 4);
+    memcpy(&out[n++], record + 4, 2);
+    queue.pop();
+
+    if (started) {
+      // How far the interval is from a whole number of periods. Skipped
+      // periods are dropped samples or ticks the timer never delivered;
+      // getStats() tells them apart.
+      uint32_t interval = time - lastTime;
+      uint32_t ticks = (interval + period / 2) / period;
+      if (ticks > 1) stats.missed += ticks - 1;
+      uint32_t ideal = ticks ? ticks * period : period;
+      uint32_t error = interval > ideal ? interval - ideal : ideal - interval;
+      jitter.record(error);
+      if (error > stats.maxJitter) stats.maxJitter = error;
+    }
+    started = true;
+    lastTime = time;
+  }
+  if (n) {
+    stats.samples += n;
+    stats.batches++;
+    if (n > stats.maxBatch) stats.maxBatch = n;
+  }
+  return n;
+}
+
+AdcSampler::Stats AdcSampler::getStats() const {
+  Stats s = stats;
+  s.dropped = queue.getOverflows();
+  s.missed = s.missed > s.dropped ? s.missed - s.dropped : 0;
+  return s;
+}
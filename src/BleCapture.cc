@@ -0,0 +1,199 @@
+#include "BleCapture.hh"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef ESP32
+#include <esp_heap_caps.h>
+#endif
+
+const uint8_t BleCapture::Magic[4] = {'E', 'K', 'G', 'C'};
+
+BleCapture::~BleCapture() { free(buffer); }
+
+bool BleCapture::begin(size_t bytes) {
+  if (buffer != nullptr) return true;
+#ifdef ESP32
+  buffer = (uint8_t*)heap_caps_malloc(bytes,
+                                      MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#else
+  buffer = (uint8_t*)malloc(bytes);
+#endif
+  if (buffer == nullptr) return false;
+  capacity = bytes;
+  return true;
+}
+
+static size_t putVarint(uint8_t* out, uint32_t value) {
+  size_t n = 0;
+  while (value >= 0x80) {
+    out[n++] = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  out[n++] = value;
+  return n;
+}
+
+void BleCapture::record(uint8_t channel, const uint8_t* data, size_t length,
+                        unsigned long timeNow) {
+  if (buffer == nullptr) return;
+  // Pairs with dump(): either it sees us writing, or we see it's dumping.
+  writing.store(true);
+  if (!enabled.load() || channel >= Channels || length > MaxRecord) {
+    writing.store(false);
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  if (used == 0) base = timeLast = timeNow;
+  uint8_t header[10];
+  size_t n = putVarint(header, timeNow - timeLast);
+  n += putVarint(header + n, length << 2 | channel);
+  while (capacity - used < n + length) {
+    if (printActive.load(std::memory_order_acquire)) {
+      // Not past what's been printed.
+      size_t oldest = oldestSize();
+      if (printFreed + oldest > printed.load(std::memory_order_acquire)) {
+        writing.store(false);
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      printFreed += oldest;
+    }
+    dropOldest();
+  }
+
+  for (size_t i = 0; i < n; i++) buffer[(head + i) % capacity] = header[i];
+  size_t offset = (head + n) % capacity;
+  size_t first = capacity - offset < length ? capacity - offset : length;
+  memcpy(buffer + offset, data, first);
+  memcpy(buffer, data + first, length - first);
+  head = (head + n + length) % capacity;
+  used += n + length;
+  timeLast = timeNow;
+  recorded.fetch_add(1, std::memory_order_relaxed);
+  writing.store(false, std::memory_order_release);
+}
+
+size_t BleCapture::readVarint(size_t offset, uint32_t& value) const {
+  value = 0;
+  size_t n = 0;
+  uint8_t b;
+  do {
+    b = at(offset + n);
+    value |= (uint32_t)(b & 0x7f) << (7 * n);
+    n++;
+  } while (b & 0x80);
+  return n;
+}
+
+bool BleCapture::readVarint(const uint8_t* data, size_t length, size_t& i,
+                            uint32_t& value) {
+  value = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (i >= length) return false;
+    uint8_t b = data[i++];
+    value |= (uint32_t)(b & 0x7f) << shift;
+    if ((b & 0x80) == 0) return true;
+  }
+  return false;
+}
+
+size_t BleCapture::oldestSize() const {
+  uint32_t delta, tag;
+  size_t n = readVarint(tail, delta);
+  n += readVarint(tail + n, tag);
+  return n + (tag >> 2);
+}
+
+void BleCapture::dropOldest() {
+  uint32_t delta, tag;
+  size_t n = readVarint(tail, delta);
+  n += readVarint(tail + n, tag);
+  n += tag >> 2;
+  base += delta;
+  tail = (tail + n) % capacity;
+  used -= n;
+  overwritten.fetch_add(1, std::memory_order_relaxed);
+}
+
+void BleCapture::header(uint8_t* out) const {
+  const uint8_t h[HeaderBytes] = {Magic[0], Magic[1], Magic[2], Magic[3],
+                                  Version,  0,        0,        0,
+                                  (uint8_t)base,
+                                  (uint8_t)(base >> 8),
+                                  (uint8_t)(base >> 16),
+                                  (uint8_t)(base >> 24)};
+  memcpy(out, h, HeaderBytes);
+}
+
+size_t BleCapture::dump(std::function<void(const uint8_t*, size_t)> sink) {
+  if (buffer == nullptr) return 0;
+  enabled.store(false);
+  while (writing.load()) delay(1);
+
+  uint8_t h[HeaderBytes];
+  header(h);
+  sink(h, sizeof(h));
+  size_t held = used;
+  size_t first = capacity - tail < held ? capacity - tail : held;
+  if (first > 0) sink(buffer + tail, first);
+  if (held > first) sink(buffer, held - first);
+  size_t bytes = sizeof(h) + held;
+
+  enabled.store(true);
+  return bytes;
+}
+
+void BleCapture::startPrint(HardwareSerial& out) {
+  if (buffer == nullptr || printing()) return;
+  // Only for as long as it takes to note where the records are.
+  enabled.store(false);
+  while (writing.load()) delay(1);
+  header(printHeader);
+  printStart = tail;
+  printBytes = HeaderBytes + used;
+  printPos = 0;
+  printFreed = 0;
+  printed.store(0);
+  printActive.store(true);
+  enabled.store(true);
+
+  out.print("<BleCapture::print> Capture of ");
+  out.print((unsigned long)printBytes);
+  out.println(" bytes:");
+}
+
+bool BleCapture::printSome(HardwareSerial& out, int maxLines) {
+  if (!printing()) return false;
+  // 32 bytes a line, written whole so other tasks' output can't split it.
+  char line[2 * 32 + 2];
+  for (int lines = 0; lines < maxLines && printPos < printBytes; lines++) {
+    if (out.availableForWrite() < (int)sizeof(line)) return true;
+    size_t n = 0;
+    for (; n < 32 && printPos < printBytes; n++, printPos++) {
+      uint8_t b = printPos < HeaderBytes
+                      ? printHeader[printPos]
+                      : at(printStart + printPos - HeaderBytes);
+      snprintf(line + 2 * n, 3, "%02x", b);
+    }
+    line[2 * n] = '\r';
+    line[2 * n + 1] = '\n';
+    // Read before record() may reuse it.
+    if (printPos > HeaderBytes)
+      printed.store(printPos - HeaderBytes, std::memory_order_release);
+    out.write((const uint8_t*)line, 2 * n + 2);
+  }
+  if (printPos < printBytes) return true;
+  out.println("<BleCapture::print> End of capture");
+  printActive.store(false, std::memory_order_release);
+  return false;
+}
+
+BleCapture::Stats BleCapture::getStats() const {
+  Stats s;
+  s.recorded = recorded.load(std::memory_order_relaxed);
+  s.overwritten = overwritten.load(std::memory_order_relaxed);
+  s.dropped = dropped.load(std::memory_order_relaxed);
+  return s;
+}
@@ -0,0 +1,153 @@
+#include "Cbor.hh"
+
+#include <string.h>
+
+// Major types.
+static const uint8_t Unsigned = 0;
+static const uint8_t Negative = 1;
+static const uint8_t ByteString = 2;
+static const uint8_t TextString = 3;
+static const uint8_t ArrayType = 4;
+static const uint8_t MapType = 5;
+static const uint8_t Simple = 7;
+
+// Simple values.
+static const uint8_t False = 20;
+static const uint8_t True = 21;
+static const uint8_t Null = 22;
+
+// Nested maps in a command are skipped, not decoded; don't recurse forever.
+static const int MaxDepth = 8;
+
+void CborWriter::put(const uint8_t* data, size_t n) {
+  if (overflow || capacity - length < n) {
+    overflow = true;
+    return;
+  }
+  if (buffer) memcpy(buffer + length, data, n);
+  length += n;
+}
+
+void CborWriter::head(uint8_t major, uint64_t value) {
+  uint8_t bytes[9];
+  size_t n;
+  major <<= 5;
+  if (value < 24) {
+    bytes[0] = major | value;
+    n = 1;
+  } else if (value <= 0xff) {
+    bytes[0] = major | 24;
+    n = 2;
+  } else if (value <= 0xffff) {
+    bytes[0] = major | 25;
+    n = 3;
+  } else if (value <= 0xffffffff) {
+    bytes[0] = major | 26;
+    n = 5;
+  } else {
+    bytes[0] = major | 27;
+    n = 9;
+  }
+  // Big-endian argument.
+  for (size_t i = n - 1; i > 0; i--, value >>= 8) bytes[i] = value;
+  put(bytes, n);
+}
+
+void CborWriter::map(size_t pairs) { head(MapType, pairs); }
+
+void CborWriter::text(const char* s) { text(s, strlen(s)); }
+
+void CborWriter::text(const char* s, size_t n) {
+  head(TextString, n);
+  put((const uint8_t*)s, n);
+}
+
+void CborWriter::integer(long value) {
+  if (value >= 0)
+    head(Unsigned, value);
+  else
+    head(Negative, -1 - value);
+}
+
+void CborWriter::boolean(bool value) {
+  uint8_t b = (Simple << 5) | (value ? True : False);
+  put(&b, 1);
+}
+
+void CborWriter::null() {
+  uint8_t b = (Simple << 5) | Null;
+  put(&b, 1);
+}
+
+bool CborReader::argument(uint8_t info, uint64_t& value) {
+  if (info < 24) {
+    value = info;
+    return true;
+  }
+  if (info > 27) return false;  // Indefinite lengths aren't supported.
+  size_t n = (size_t)1 << (info - 24);
+  if (length - pos < n) return false;
+  value = 0;
+  for (size_t i = 0; i < n; i++) value = (value << 8) | data[pos++];
+  return true;
+}
+
+bool CborReader::next(Item& item) {
+  if (pos >= length) return false;
+  uint8_t initial = data[pos++];
+  uint8_t major = initial >> 5, info = initial & 0x1f;
+  uint64_t value;
+  if (major == Simple) {
+    item.type = Item::Other;
+    item.value = 0;
+    if (info == False || info == True) {
+      item.type = Item::Bool;
+      item.value = info == True;
+    } else if (info == Null) {
+      item.type = Item::Null;
+    } else if (info >= 24) {
+      // Floats and extended simple values: step over their payload.
+      if (info > 27 || !argument(info, value)) return false;
+    }
+    return true;
+  }
+  if (!argument(info, value)) return false;
+  switch (major) {
+    case Unsigned:
+      item.type = Item::Int;
+      item.value = value;
+      return true;
+    case Negative:
+      item.type = Item::Int;
+      item.value = -1 - (long)value;
+      return true;
+    case TextString:
+    case ByteString:  // Treated as text.
+      if (length - pos < value) return false;
+      item.type = Item::Text;
+      item.text = (const char*)data + pos;
+      item.length = value;
+      pos += value;
+      return true;
+    case ArrayType:
+    case MapType:
+      item.type = major == MapType ? Item::Map : Item::Array;
+      item.value = value;
+      return true;
+    default:  // Tags: report the tagged item instead.
+      return next(item);
+  }
+}
+
+bool CborReader::skipDepth(const Item& item, int depth) {
+  if (item.type != Item::Map && item.type != Item::Array) return true;
+  if (depth > MaxDepth) return false;
+  long entries = item.type == Item::Map ? item.value * 2 : item.value;
+  for (long i = 0; i < entries; i++) {
+    Item child;
+    if (!next(child) || !skipDepth(child, depth + 1)) return false;
+  }
+  return true;
+}
+
+bool CborReader::skip(const Item& item) { return skipDepth(item, 0); }
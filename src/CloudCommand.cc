@@ -0,0 +1,138 @@
+#include "CloudCommand.hh"
+
+#include <string.h>
+
+#include "Cbor.hh"
+#include "JsonScan.hh"
+
+CloudCommand CloudCommand::parse(const std::string& json) {
+  CloudCommand cmd;
+  std::string raw;
+  if (JsonScan::member(json, "off", raw)) {
+    cmd.type = Off;
+  } else if (JsonScan::member(json, "on", raw)) {
+    cmd.type = On;
+  } else if (JsonScan::member(json, "calibrate", raw)) {
+    long value;
+    if (JsonScan::member(json, "value", raw) && JsonScan::toLong(raw, value)) {
+      cmd.type = CalibratePoint;
+      cmd.value = value;
+    } else {
+      cmd.type = Calibrate;
+    }
+  } else if (JsonScan::member(json, "temp", raw)) {
+    long value;
+    if (JsonScan::member(json, "value", raw) && JsonScan::toLong(raw, value)) {
+      cmd.type = Temp;
+      cmd.value = value;
+    }
+  }
+  return cmd;
+}
+
+CloudCommand CloudCommand::parse(const uint8_t* cbor, size_t length) {
+  CloudCommand cmd;
+  CborReader in(cbor, length);
+  CborReader::Item map, key, value;
+  if (!in.next(map) || map.type != CborReader::Item::Map) return cmd;
+
+  bool off = false, on = false, calibrate = false, temp = false;
+  bool hasValue = false;
+  long tempValue = 0;  // Or the calibration point's.
+  for (long i = 0; i < map.value; i++) {
+    if (!in.next(key) || !in.next(value) || !in.skip(value)) return cmd;
+    if (key.type != CborReader::Item::Text) continue;
+    auto is = [&](const char* name) {
+      return key.length == strlen(name) &&
+             memcmp(key.text, name, key.length) == 0;
+    };
+    if (is("off")) {
+      off = true;
+    } else if (is("on")) {
+      on = true;
+    } else if (is("calibrate")) {
+      calibrate = true;
+    } else if (is("temp")) {
+      temp = true;
+    } else if (is("value") && value.type == CborReader::Item::Int) {
+      hasValue = true;
+      tempValue = value.value;
+    }
+  }
+  if (off) {
+    cmd.type = Off;
+  } else if (on) {
+    cmd.type = On;
+  } else if (calibrate && hasValue) {
+    cmd.type = CalibratePoint;
+    cmd.value = tempValue;
+  } else if (calibrate) {
+    cmd.type = Calibrate;
+  } else if (temp && hasValue) {
+    cmd.type = Temp;
+    cmd.value = tempValue;
+  }
+  return cmd;
+}
+
+size_t CloudCommand::encode(uint8_t* buffer, size_t capacity) const {
+  static const char* names[] = {nullptr,     "on",   "off",
+                                "calibrate", "temp", "calibrate"};
+  CborWriter out(buffer, capacity);
+  if (type == None) {
+    out.map(0);
+    return out.size();
+  }
+  bool hasValue = type == Temp || type == CalibratePoint;
+  out.map(hasValue ? 2 : 1);
+  out.text(names[type]);
+  out.boolean(true);
+  if (hasValue) {
+    out.text("value");
+    out.integer(value);
+  }
+  return out.size();
+}
+
+void CommandMirror::set(const std::string& key, const std::string& value) {
+  std::string updated = "{";
+  JsonScan::members(node, [&](const std::string& k, const std::string& v) {
+    if (k == key) return;
+    if (updated.size() > 1) updated += ",";
+    updated += "\"" + k + "\":" + v;
+  });
+  if (!JsonScan::isNull(value)) {
+    if (updated.size() > 1) updated += ",";
+    updated += "\"" + key + "\":" + value;
+  }
+  node = updated + "}";
+}
+
+void CommandMirror::put(const std::string& path, const std::string& data) {
+  if (path == "/" || path.empty()) {
+    node = "{}";
+    patch("/", data);
+  } else {
+    // Deeper paths only matter for their first component.
+    std::string key = path.substr(1, path.find('/', 1) - 1);
+    set(key, path.find('/', 1) == std::string::npos ? data : "true");
+  }
+}
+
+void CommandMirror::patch(const std::string& path, const std::string& data) {
+  if (path != "/" && !path.empty()) {
+    // Patching below a member: the member exists, which is all we look at.
+    put(path, "true");
+    return;
+  }
+  JsonScan::members(data, [&](const std::string& k, const std::string& v) {
+    set(k, v);
+  });
+}
+
+bool CommandMirror::take(CloudCommand& cmd) {
+  cmd = CloudCommand::parse(node);
+  if (cmd.type == CloudCommand::None) return false;
+  node = "{}";
+  return true;
+}
@@ -0,0 +1,138 @@
+#include "CloudWorker.hh"
+
+#include "Log.hh"
+#include "Trace.hh"
+
+CloudWorker::CloudWorker(const PinnedTask::Config& config, RtdbClient& rest,
+                         RtdbStream& stream, TelemetryRelay* relay)
+    : rest(rest), stream(stream), relay(relay), task(config) {}
+
+void CloudWorker::begin() { task.begin([this]() { step(); }); }
+
+void CloudWorker::end() {
+  task.end();
+  stream.stop();
+}
+
+void CloudWorker::setKettle(const std::string& name) {
+  std::lock_guard<std::mutex> lock(mtx);
+  kettleName = name;
+}
+
+bool CloudWorker::sendStatus(const std::string& path, const std::string& body,
+                             bool cbor) {
+  Request request;
+  request.path = path;
+  request.body = body;
+  request.cbor = cbor;
+  return requests.push(std::move(request));
+}
+
+CloudWorker::Stats CloudWorker::getStats() {
+  std::lock_guard<std::mutex> lock(mtx);
+  return stats;
+}
+
+void CloudWorker::timed(unsigned long timeStart) {
+  unsigned long time = millis() - timeStart;
+  std::lock_guard<std::mutex> lock(mtx);
+  if (time > stats.maxRequestTime) stats.maxRequestTime = time;
+}
+
+void CloudWorker::step() {
+  Request request;
+  while (requests.pop(request)) upload(request);
+  std::string name;
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    name = kettleName;
+  }
+  serviceCommands(name, millis());
+}
+
+void CloudWorker::upload(const Request& request) {
+  unsigned long timeStart = millis();
+  bool ok;
+  if (request.cbor && relay) {
+    ok = relay->send("PATCH", request.path.c_str(),
+                     (const uint8_t*)request.body.data(),
+                     request.body.size()) == 204;
+  } else {
+    ok = rest.request("PATCH", request.path, request.body).code == 200;
+  }
+  timed(timeStart);
+  if (!ok)
+    LOG_WARN("<CloudWorker::upload> Failed for %s", request.path.c_str());
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (ok)
+      stats.uploads++;
+    else
+      stats.failures++;
+  }
+  // Can't overflow: there's at most one result per queued request.
+  results.push(ok);
+}
+
+// Takes the command off the database and queues it for the main loop.
+// Returns false if that failed and should be retried.
+bool CloudWorker::claim(const std::string& path) {
+  unsigned long timeStart = millis();
+  std::string value;
+  RtdbClient::Claim result = rest.claim(path, value);
+  timed(timeStart);
+  std::lock_guard<std::mutex> lock(mtx);
+  if (result == RtdbClient::Failed) {
+    stats.claimFailures++;
+    return false;
+  }
+  if (result == RtdbClient::Claimed) {
+    CloudCommand cmd = CloudCommand::parse(value);
+    TRACE_STAMP(cmd.timeClaimed);
+    if (cmd.type != CloudCommand::None) {
+      commands.push(cmd);
+      stats.commands++;
+    }
+  }
+  return true;
+}
+
+void CloudWorker::serviceCommands(const std::string& name,
+                                  unsigned long timeNow) {
+  if (name.empty()) {
+    stream.stop();
+    return;
+  }
+  // Leave commands on the server until the main loop has room for them.
+  if (commands.full()) return;
+
+  std::string path = "/" + name + "/command";
+  if (!stream.connected() || path != streamPath) {
+    if (path != streamPath ||
+        timeNow - lastStreamAttempt >= StreamRetryInterval) {
+      lastStreamAttempt = timeNow;
+      streamPath = path;
+      mirror = CommandMirror();
+      LOG_INFO("<CloudWorker::serviceCommands> Opening stream %s", path.c_str());
+      if (!stream.begin(path))
+        LOG_WARN("<CloudWorker::serviceCommands> Stream failed, polling");
+    }
+  }
+
+  if (stream.connected()) {
+    stream.poll([this](const RtdbStream::Event& event) {
+      if (event.type == RtdbStream::Event::Put)
+        mirror.put(event.path, event.data);
+      else if (event.type == RtdbStream::Event::Patch)
+        mirror.patch(event.path, event.data);
+    });
+    // The stream only tells us a command arrived; the claim decides which
+    // one is applied, in case it was replaced in the meantime.
+    CloudCommand cmd;
+    if (mirror.take(cmd)) claimPending = true;
+    if (claimPending) claimPending = !claim(path);
+  } else if (timeNow - lastPoll >= PollInterval) {
+    lastPoll = timeNow;
+    claim(path);
+  }
+}
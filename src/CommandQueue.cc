@@ -0,0 +1,78 @@
+#include "CommandQueue.hh"
+
+int CommandQueue::find(Command cmd) const {
+  for (int i = 0; i < count; i++) {
+    if (entries[i].cmd == cmd) return i;
+  }
+  return -1;
+}
+
+void CommandQueue::remove(int i) {
+  for (; i + 1 < count; i++) entries[i] = entries[i + 1];
+  count--;
+}
+
+void CommandQueue::push(Command cmd, byte value) {
+  std::lock_guard<std::mutex> lock(mtx);
+  stats.queued++;
+
+  if (cmd == Command::Off) {
+    int on = find(Command::On);
+    if (on >= 0) {
+      remove(on);
+      stats.cancelled++;
+      stats.depth = count;
+    }
+  }
+
+  int i = find(cmd);
+  if (i >= 0) {
+    // Already pending: keep its place in line, take the latest value.
+    entries[i].value = value;
+    stats.coalesced++;
+    return;
+  }
+
+  Entry entry = {cmd, value, millis()};
+  if (cmd == Command::Off) {
+    for (i = count; i > 0; i--) entries[i] = entries[i - 1];
+    entries[0] = entry;
+  } else {
+    entries[count] = entry;
+  }
+  count++;
+
+  stats.depth = count;
+  if (count > stats.maxDepth) stats.maxDepth = count;
+}
+
+bool CommandQueue::pop(Entry& entry) {
+  std::lock_guard<std::mutex> lock(mtx);
+  if (count == 0) return false;
+  entry = entries[0];
+  remove(0);
+
+  unsigned long waited = millis() - entry.timeQueued;
+  stats.depth = count;
+  stats.dispatched++;
+  stats.lastDispatchTime = waited;
+  stats.totalDispatchTime += waited;
+  if (waited > stats.maxDispatchTime) stats.maxDispatchTime = waited;
+  return true;
+}
+
+void CommandQueue::clear() {
+  std::lock_guard<std::mutex> lock(mtx);
+  count = 0;
+  stats.depth = 0;
+}
+
+bool CommandQueue::empty() {
+  std::lock_guard<std::mutex> lock(mtx);
+  return count == 0;
+}
+
+CommandQueue::Stats CommandQueue::getStats() {
+  std::lock_guard<std::mutex> lock(mtx);
+  return stats;
+}
@@ -0,0 +1,64 @@
+#include "CommandTracker.hh"
+
+#include "Log.hh"
+
+void CommandTracker::sent(const CommandQueue::Entry& cmd, byte sequence,
+                          unsigned long timeNow, bool retry) {
+  InFlight& f = inFlight[slotFor(cmd.cmd)];
+  if (!retry) {
+    if (f.active) stats.superseded++;
+    f.active = true;
+    f.cmd = cmd;
+    f.retries = 0;
+    f.timeFirstWrite = timeNow;
+  }
+  f.sequence = sequence;
+  f.timeLastWrite = timeNow;
+}
+
+void CommandTracker::confirm(InFlight& f, unsigned long timeNow) {
+  f.active = false;
+  stats.confirmed++;
+  stats.lastQueueTime = f.timeFirstWrite - f.cmd.timeQueued;
+  stats.lastConfirmTime = timeNow - f.timeFirstWrite;
+  stats.lastTotalTime = timeNow - f.cmd.timeQueued;
+  stats.totalTime += stats.lastTotalTime;
+  if (stats.lastTotalTime > stats.maxTotalTime)
+    stats.maxTotalTime = stats.lastTotalTime;
+  LOG_INFO("<CommandTracker::confirm> Command %d seq %u confirmed in %lums",
+           f.cmd.cmd, f.sequence, stats.lastTotalTime);
+}
+
+void CommandTracker::onPower(bool power, unsigned long timeNow) {
+  InFlight& f = inFlight[Power];
+  if (f.active && power == (f.cmd.cmd == CommandQueue::Command::On))
+    confirm(f, timeNow);
+}
+
+void CommandTracker::onTargetTemp(byte temp, unsigned long timeNow) {
+  InFlight& f = inFlight[Temp];
+  if (f.active && temp == f.cmd.value) confirm(f, timeNow);
+}
+
+bool CommandTracker::due(unsigned long timeNow, CommandQueue::Entry& cmd) {
+  for (InFlight& f : inFlight) {
+    if (!f.active || timeNow - f.timeLastWrite < RetryTimeout) continue;
+    if (f.retries >= MaxRetries) {
+      f.active = false;
+      stats.failed++;
+      LOG_WARN("<CommandTracker::due> Command %d seq %u not confirmed, giving "
+               "up",
+               f.cmd.cmd, f.sequence);
+      continue;
+    }
+    f.retries++;
+    stats.retries++;
+    cmd = f.cmd;
+    return true;
+  }
+  return false;
+}
+
+void CommandTracker::clear() {
+  for (InFlight& f : inFlight) f.active = false;
+}
@@ -1,93 +1,157 @@
 #include "FSRScale.hh"
-#include <curveFitting.h>
 
-FSRScale::FSRScale(byte pin) : pin(pin) {
-  // Some reasonable numbers from a good calibration:
-  coeffs[0] = -0.08; // ax^2 -0.08
-  coeffs[1] = 13.83; // bx 16.83?
-  coeffs[2] = 3019.81; // c 2819.81?
+#include "Log.hh"
+
+FSRScale::FSRScale(byte pin, uint32_t sampleRate)
+    : pin(pin),
+      sampler([this]() { return (uint16_t)analogRead(this->pin); },
+              sampleRate),
+      // Some reasonable numbers from a good calibration:
+      calibration(ScaleCalibration::Model::quadratic(-0.08, 13.83, 3019.81)) {
+  curve.setModel(calibration.getModel());
+  for (int i = 0; i < Calibration::Count; i++) calReadings[i] = -1;
 }
 
 FSRScale::~FSRScale() {}
 
+void FSRScale::begin() { sampler.begin(); }
+
 void FSRScale::loadFromPrefs() {
   // NVRAM settings
-  char prefName[] = "ScaleCoeffs0";
-  prefs.begin("fellow-stagg", false);  
-  for (int i = 0; i < Calibration::CurveOrder + 1; i++) {
-    prefName[strlen(prefName)-1] = '0' + i;
-    coeffs[i] = prefs.getDouble(prefName, 0.0);
-    Serial.println("<Scale::Scale> Loaded coefficient " + String(i) + " = " +
-                   String(coeffs[i]));
+  uint8_t blob[ScaleCalibration::MaxBlob];
+  prefs.begin("fellow-stagg", false);
+  size_t length = prefs.getBytesLength(Calibration::PrefsKey);
+  if (length > 0 && length <= sizeof(blob) &&
+      prefs.getBytes(Calibration::PrefsKey, blob, length) == length &&
+      calibration.load(blob, length)) {
+    LOG_INFO("<Scale::Scale> Loaded calibration of %d points",
+             calibration.getCount());
+  } else {
+    // Coefficients from before the calibration was one blob.
+    double coeffs[3];
+    char prefName[] = "ScaleCoeffs0";
+    for (int i = 0; i < 3; i++) {
+      prefName[strlen(prefName)-1] = '0' + i;
+      coeffs[i] = prefs.getDouble(prefName, NAN);
+      LOG_INFO("<Scale::Scale> Loaded coefficient %d = %.2f", i, coeffs[i]);
+    }
+    if (!isnan(coeffs[0]) && !isnan(coeffs[1]) && !isnan(coeffs[2]))
+      calibration = ScaleCalibration(
+          ScaleCalibration::Model::quadratic(coeffs[0], coeffs[1], coeffs[2]));
   }
   prefs.end();
+  curve.setModel(calibration.getModel());
 }
 
 void FSRScale::nextCalibration() {
   prevAvg = -1;
+  if (calMode == 0) {
+    // Starting over, on the side: the old calibration, points and all, stays
+    // in use until this one has a model.
+    guided.clear();
+    for (int i = 0; i < Calibration::Count; i++) calReadings[i] = -1;
+  } else if (calReadings[calMode - 1] >= 0) {
+    guided.addPoint(Calibration::Ounces[calMode - 1],
+                    calReadings[calMode - 1]);
+  }
   if (calMode < Calibration::Count) {
     calMode++;
+    publishStatus();
     return;
   }
   calMode = 0;
+  publishStatus();
+  if (guided.getCount() < 2) {
+    LOG_ERROR("<Scale::Loop> Calibration error! %d points, keeping the old one",
+              guided.getCount());
+    return;
+  }
+  calibration = guided;
+  applyCalibration();
+}
 
-  int ret =
-      fitCurve(Calibration::CurveOrder, Calibration::Count, Calibration::Ounces,
-               calReadings, Calibration::CurveOrder + 1, coeffs);
-  if (ret == 0) {
-    Serial.println("<Scale::Loop> Calibrated scale! Coefficients:");
-    for (int i = 0; i < Calibration::CurveOrder + 1; i++) {
-      Serial.println(coeffs[i]);
-      // Save to memory!
-      char prefName[] = "ScaleCoeffs0";
-      prefName[strlen(prefName)-1] = '0' + i;
-      prefs.begin("fellow-stagg", false);  
-      prefs.putDouble(prefName, coeffs[i]);
-      prefs.end();
-    }
-  } else {
-    Serial.println("<Scale::Loop> Calibration error! " + String(ret));
+void FSRScale::addCalibrationPoint(float ounces) {
+  if (!filter.ready()) {
+    LOG_WARN("<Scale::Loop> No reading to calibrate with");
+    return;
   }
+  calibration.addPoint(ounces, filter.average());
+  applyCalibration();
 }
 
-void FSRScale::loop() {
-  // Read a raw value
-  uint16_t fsrValue = analogRead(pin);
-
-  // We use this buffer to average out the highly variable measurements
-  fsrBuffer[fsrBufferPos] = fsrValue;
-  fsrBufferPos++;
-  if (fsrBufferPos >= Calibration::BufferSize) fsrBufferPos = 0;
-
-  // Simple averaging
-  double fsrAverage = 0.0;
-  for (int i = 0; i < Calibration::BufferSize; i++) {
-    fsrAverage += fsrBuffer[i];
+void FSRScale::applyCalibration() {
+  if (calibration.getCount() < 2) {
+    LOG_ERROR("<Scale::Loop> Calibration error! %d points",
+              calibration.getCount());
+    return;
   }
-  fsrAverage /= (double)Calibration::BufferSize;
-
-  // We curve fit the measurements during calibration to a 2nd order (quadratic)
-  // polynomial ax^2 + bx + c = y [where x is the ounces filled and y is the FSR
-  // measurement]. Now that we have the coefficients, use the quadratic formula
-  // to solve for x based on y. x = (sqrt(4ay - 4ac + b^2) - b) / 2a
-  double det = 4.0*coeffs[0]*(fsrAverage - coeffs[2])+coeffs[1]*coeffs[1];
-  if (det >= 0.0) {
-    double num = sqrt(det)-coeffs[1];
-    double denom = 2 * coeffs[0];
-    fill = denom == 0 ? 0 : (num / denom);
-    if (fill < 0)
-      fill = 0;
-  } else {
-    fill = 30.43; // Max fill is 0.9L
+  static const char* models[] = {"quadratic", "polynomial", "piecewise"};
+  const ScaleCalibration::Model& model = calibration.getModel();
+  curve.setModel(model);
+  LOG_INFO("<Scale::Loop> Calibrated scale! %d points, %s model, residual "
+           "%.2foz",
+           calibration.getCount(), models[model.type],
+           calibration.getResidual());
+
+  // Save to memory, in one write.
+  uint8_t blob[ScaleCalibration::MaxBlob];
+  size_t length = calibration.save(blob, sizeof(blob));
+  prefs.begin("fellow-stagg", false);
+  if (prefs.putBytes(Calibration::PrefsKey, blob, length) != length)
+    LOG_ERROR("<Scale::Loop> Could not save the calibration");
+  prefs.end();
+}
+
+void FSRScale::setLifted(bool lifted) {
+  if (lifted == this->lifted) return;
+  this->lifted = lifted;
+  filter.reset();
+}
+
+void FSRScale::loop() {
+  // Samples come in at a fixed rate from the sampler's timer, however long
+  // it's been since the last call; the fill is worked out once per batch.
+  size_t count = 0;
+  size_t n;
+  while ((n = sampler.takeBatch(batch, Calibration::BufferSize)) > 0) {
+    // We filter the highly variable measurements as they come in
+    for (size_t i = 0; i < n; i++) filter.add(batch[i]);
+    count += n;
   }
-  
-  // Serial.println(String(fsrAverage) + " " + String(fill));
+  if (count == 0 || !filter.ready()) return;
+
+  double fsrAverage = filter.average();
+
+  // Looked up on the calibration curve; see FillCurve.
+  fill = curve.ounces(fsrAverage);
+
+  LOG_VERBOSE("<Scale::Loop> %.2f %.2f", fsrAverage, fill);
 
   if (calMode >= 1 && calMode <= Calibration::Count && prevAvg != fsrAverage) {
-    Serial.println("<Scale::Loop> Calibration value for " +
-                   String(Calibration::Ounces[calMode - 1]) +
-                   "oz = " + String(fsrAverage));
+    LOG_INFO("<Scale::Loop> Calibration value for %.2foz = %.2f",
+             Calibration::Ounces[calMode - 1], fsrAverage);
     calReadings[calMode - 1] = fsrAverage;
     prevAvg = fsrAverage;
   }
+  publishStatus();
+}
+
+void FSRScale::publishStatus() {
+  Status next;
+  next.fill = getFill();
+  next.calMode = calMode;
+  next.sampling = published.sampling;
+  StatusSnapshot::Mask changed = 0;
+  if (status.getVersion() == 0) changed = StatusSnapshot::All;
+  if (next.fill != published.fill) changed |= 1 << Status::FillField;
+  if (next.calMode != published.calMode) changed |= 1 << Status::CalModeField;
+  unsigned long timeNow = millis();
+  if (timeNow - lastSamplingPublish >= 1000) {
+    lastSamplingPublish = timeNow;
+    next.sampling = sampler.getStats();
+    changed |= 1 << Status::SamplingField;
+  }
+  if (!changed) return;
+  status.publish(next, changed);
+  published = next;
 }
\ No newline at end of file
@@ -0,0 +1,52 @@
+#include "FillCurve.hh"
+
+#include <math.h>
+
+void FillCurve::setModel(const Model& model) {
+  this->model = model;
+  for (int i = 0; i <= Cells; i++) {
+    double fill = model.ounces(i * Step) * 256.0 + 0.5;
+    table[i] = fill > 65535.0 ? 65535 : (uint16_t)fill;
+  }
+
+  for (int i = 0; i < Cells / 32; i++) solved[i] = 0;
+  // Where the model breaks, and a cell either side, in case it's on an edge.
+  float breaks[ScaleCalibration::MaxPoints];
+  int n = model.breaks(breaks, ScaleCalibration::MaxPoints);
+  if (model.type == Model::Quadratic && model.coeffs[0] != 0) {
+    // There's no solution past y = c - b^2 / 4a.
+    const double* k = model.coeffs;
+    breaks[n++] = k[2] - k[1] * k[1] / (4.0 * k[0]);
+  }
+  for (int i = 0; i < n; i++) {
+    int cell = (int)floorf(breaks[i] / Step);
+    for (int c = cell - 1; c <= cell + 1; c++) {
+      if (c >= 0 && c < Cells) solved[c / 32] |= 1UL << (c % 32);
+    }
+  }
+  // Where the fill starts or stops clamping, and anywhere else the line
+  // between the ends of a cell strays too far, checked at a few points.
+  for (int cell = 0; cell < Cells; cell++) {
+    if (isSolved(cell)) continue;
+    bool solve = table[cell] != table[cell + 1] &&
+                 (table[cell] == 0 || table[cell + 1] == 0 ||
+                  model.ounces(cell * Step) >= Model::MaxFill ||
+                  model.ounces((cell + 1) * Step) >= Model::MaxFill);
+    for (uint32_t frac = 32; !solve && frac < 256; frac += 32) {
+      double exact = model.ounces(cell * Step + frac / 16.0);
+      solve = fabs(interpolate(cell, frac) - exact) > Tolerance;
+    }
+    if (solve) solved[cell / 32] |= 1UL << (cell % 32);
+  }
+  built = true;
+}
+
+float FillCurve::ounces(float reading) const {
+  if (!built || reading < 0 || reading >= Cells * Step) return solve(reading);
+  // The reading in 1/16 codes: the top bits pick the cell, the rest is how
+  // far into it.
+  uint32_t fixed = (uint32_t)(reading * 16.0f);
+  uint32_t cell = fixed >> 8;
+  if (isSolved(cell)) return solve(reading);
+  return interpolate(cell, fixed & 0xff);
+}
@@ -0,0 +1,52 @@
+#include "FillFilter.hh"
+
+void FillFilter::add(uint16_t sample) {
+  if (count > Recent) {
+    // Which side of the average the sample is on, if it's past the
+    // threshold; compared without dividing.
+    int64_t scaled = (int64_t)sample * count;
+    int64_t margin = (int64_t)stepThreshold * count;
+    int8_t side = scaled > sum + margin ? 1 : scaled + margin < sum ? -1 : 0;
+    if (side == 0 || (side > 0) != (outside > 0))
+      outside = side;
+    else
+      outside += side;
+  }
+
+  if (recentCount == Recent)
+    recentSum -= recent[recentPos];
+  else
+    recentCount++;
+  recent[recentPos] = sample;
+  recentSum += sample;
+  recentPos = (recentPos + 1) % Recent;
+
+  if (count == Window)
+    sum -= window[pos];
+  else
+    count++;
+  window[pos] = sample;
+  sum += sample;
+  pos = (pos + 1) % Window;
+
+  if (outside >= Recent || outside <= -Recent) {
+    // The recent samples are all at the new level; keep only them.
+    for (int i = 0; i < Recent; i++)
+      window[i] = recent[(recentPos + i) % Recent];
+    pos = Recent;
+    count = Recent;
+    sum = recentSum;
+    outside = 0;
+    steps++;
+  }
+}
+
+void FillFilter::reset() {
+  pos = 0;
+  count = 0;
+  sum = 0;
+  recentPos = 0;
+  recentCount = 0;
+  recentSum = 0;
+  outside = 0;
+}
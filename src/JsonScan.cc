@@ -0,0 +1,104 @@
+#include "JsonScan.hh"
+
+#include <stdlib.h>
+
+namespace JsonScan {
+
+size_t skipSpace(const std::string& json, size_t pos) {
+  while (pos < json.size() && (json[pos] == ' ' || json[pos] == '\t' ||
+                               json[pos] == '\n' || json[pos] == '\r'))
+    pos++;
+  return pos;
+}
+
+static size_t stringLength(const std::string& json, size_t pos) {
+  for (size_t i = pos + 1; i < json.size(); i++) {
+    if (json[i] == '\\')
+      i++;
+    else if (json[i] == '"')
+      return i + 1 - pos;
+  }
+  return 0;
+}
+
+size_t valueLength(const std::string& json, size_t pos) {
+  if (pos >= json.size()) return 0;
+  char c = json[pos];
+  if (c == '"') return stringLength(json, pos);
+  if (c == '{' || c == '[') {
+    int depth = 0;
+    for (size_t i = pos; i < json.size(); i++) {
+      if (json[i] == '"') {
+        size_t length = stringLength(json, i);
+        if (length == 0) return 0;
+        i += length - 1;
+      } else if (json[i] == '{' || json[i] == '[') {
+        depth++;
+      } else if (json[i] == '}' || json[i] == ']') {
+        if (--depth == 0) return i + 1 - pos;
+      }
+    }
+    return 0;
+  }
+  // Number or literal: runs up to the next delimiter.
+  size_t i = pos;
+  while (i < json.size() && json[i] != ',' && json[i] != '}' &&
+         json[i] != ']' && json[i] != ' ' && json[i] != '\n' &&
+         json[i] != '\r' && json[i] != '\t')
+    i++;
+  return i - pos;
+}
+
+bool member(const std::string& json, const char* key, std::string& value) {
+  bool found = false;
+  members(json, [&](const std::string& k, const std::string& v) {
+    if (!found && k == key) {
+      value = v;
+      found = true;
+    }
+  });
+  return found;
+}
+
+bool toString(const std::string& raw, std::string& value) {
+  if (raw.size() < 2 || raw[0] != '"' || raw[raw.size() - 1] != '"')
+    return false;
+  value.clear();
+  for (size_t i = 1; i + 1 < raw.size(); i++) {
+    char c = raw[i];
+    if (c == '\\' && i + 2 < raw.size()) {
+      c = raw[++i];
+      switch (c) {
+        case 'n': c = '\n'; break;
+        case 't': c = '\t'; break;
+        case 'r': c = '\r'; break;
+        case 'b': c = '\b'; break;
+        case 'f': c = '\f'; break;
+        case 'u':  // Only ASCII escapes are expected here.
+          if (i + 4 < raw.size()) {
+            c = (char)strtol(raw.substr(i + 1, 4).c_str(), nullptr, 16);
+            i += 4;
+          }
+          break;
+        default: break;  // \" \\ \/
+      }
+    }
+    value += c;
+  }
+  return true;
+}
+
+bool toLong(const std::string& raw, long& value) {
+  if (raw.empty()) return false;
+  char* end;
+  value = strtol(raw.c_str(), &end, 10);
+  // Accept integral values written as floats, e.g. 205.0.
+  if (*end == '.') {
+    value = (long)strtod(raw.c_str(), &end);
+  }
+  return *end == '\0';
+}
+
+bool isNull(const std::string& raw) { return raw.empty() || raw == "null"; }
+
+}  // namespace JsonScan
@@ -0,0 +1,94 @@
+#include "KettleManager.hh"
+
+#include "Log.hh"
+
+KettleManager::KettleManager() {
+  for (StaggKettle& kettle : kettles) kettle.setScanning(false);
+}
+
+KettleManager::~KettleManager() {
+  if (scanning && pBLEScan != nullptr) pBLEScan->stop();
+}
+
+// Runs on the BLE task: just pass kettles on to loop().
+void KettleManager::onResult(BLEAdvertisedDevice advertiser) {
+  if (StaggKettle::isKettle(advertiser))
+    found.push(StaggKettle::linkTo(advertiser));
+}
+
+void KettleManager::loop() {
+  for (StaggKettle& kettle : kettles) kettle.loop();
+
+  StaggKettle::Link link;
+  while (found.pop(link)) {
+    stats.found++;
+    assign(link);
+  }
+
+  unsigned long timeNow = millis();
+  bool needed = false;
+  for (const StaggKettle& kettle : kettles)
+    needed = needed || kettle.needsDevice();
+  if (scanning) {
+    if (!needed || timeNow - timeScan >= StaggKettle::ScanSeconds * 1000)
+      scanDone(timeNow);
+  } else if (needed && timeNow - timeScan >= scanDelay) {
+    scan(timeNow);
+  }
+}
+
+void KettleManager::assign(const StaggKettle::Link& link) {
+  // Already some kettle's own: only of use to it, if it's lost it.
+  for (StaggKettle& kettle : kettles) {
+    if (strcmp(kettle.getLink().address, link.address) != 0) continue;
+    if (kettle.needsDevice()) {
+      kettle.assign(link);
+      stats.assigned++;
+    }
+    return;
+  }
+  // Otherwise an empty slot first, then one whose kettle has gone quiet.
+  StaggKettle* spare = nullptr;
+  for (StaggKettle& kettle : kettles) {
+    if (!kettle.needsDevice()) continue;
+    if (!kettle.getLink().valid()) {
+      spare = &kettle;
+      break;
+    }
+    if (spare == nullptr) spare = &kettle;
+  }
+  if (spare == nullptr) return;
+  spare->assign(link);
+  stats.assigned++;
+}
+
+void KettleManager::scan(unsigned long timeNow) {
+  LOG_DEBUG("<KettleManager::scan> Scanning...");
+  scanning = true;
+  timeScan = timeNow;
+  assignedBefore = stats.assigned;
+  stats.scans++;
+
+  // As StaggKettle::scan(), but in the background.
+  pBLEScan = BLEDevice::getScan();
+  pBLEScan->setAdvertisedDeviceCallbacks(this);
+  pBLEScan->setInterval(1349);
+  pBLEScan->setWindow(449);
+  pBLEScan->setActiveScan(true);
+  pBLEScan->start(StaggKettle::ScanSeconds, nullptr, false);
+}
+
+// Scans that found nobody a kettle back off as connection attempts do.
+void KettleManager::scanDone(unsigned long timeNow) {
+  pBLEScan->stop();
+  pBLEScan->clearResults();
+  scanning = false;
+  timeScan = timeNow;
+  if (stats.assigned != assignedBefore) {
+    scanDelay = 0;
+  } else {
+    scanDelay = scanDelay == 0 ? StaggKettle::MinRetryDelay : scanDelay * 2;
+    if (scanDelay > StaggKettle::MaxRetryDelay)
+      scanDelay = StaggKettle::MaxRetryDelay;
+  }
+}
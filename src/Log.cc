@@ -0,0 +1,267 @@
+#include "Log.hh"
+
+#include <stdio.h>
+
+#include <atomic>
+
+#include "MpscRing.hh"
+#include "TaskLayout.hh"
+
+namespace Log {
+
+static MpscRing<RingBytes> ring;
+static PinnedTask task(TaskLayout::Log);
+
+// Drain task only: the sites sent so far, open addressed by address. A
+// site's id is its slot.
+static const int MaxSites = 256;
+static const Site* sites[MaxSites];
+static int siteCount = 0;
+static uint32_t droppedSent = 0;
+static std::atomic<bool> resendWanted{false};
+
+void push(const Record& r) { ring.push(r.bytes, r.length); }
+
+void begin() { task.begin(drain); }
+
+void resend() { resendWanted.store(true, std::memory_order_relaxed); }
+
+Stats getStats() {
+  Stats s;
+  s.written = ring.getPushed();
+  s.dropped = ring.getOverflows();
+  s.highWater = ring.getHighWater();
+  s.sites = siteCount;
+  return s;
+}
+
+PinnedTask::Stats takeTaskStats() { return task.takeStats(); }
+
+char levelLetter(uint8_t level) {
+  static const char letters[] = "?EWIDV";
+  return level < sizeof(letters) - 1 ? letters[level] : '?';
+}
+
+// Takes n bytes off the arguments, or fails when they ran out.
+static bool take(const uint8_t*& args, const uint8_t* end, void* out,
+                 size_t n) {
+  if ((size_t)(end - args) < n) return false;
+  memcpy(out, args, n);
+  args += n;
+  return true;
+}
+
+size_t format(char* out, size_t size, const char* fmt, const uint8_t* args,
+              size_t length) {
+  const uint8_t* end = args + length;
+  size_t n = 0;
+  auto append = [&](int written) {
+    if (written > 0) n += (size_t)written < size - n ? written : size - n - 1;
+  };
+  out[0] = '\0';
+  for (const char* p = fmt; *p && n + 1 < size; p++) {
+    if (*p != '%') {
+      out[n++] = *p;
+      out[n] = '\0';
+      continue;
+    }
+    if (p[1] == '%') {
+      out[n++] = '%';
+      out[n] = '\0';
+      p++;
+      continue;
+    }
+    // One conversion: rebuilt with its flags, width and precision, without
+    // length modifiers, for the argument as it travelled.
+    char spec[24];
+    size_t s = 0;
+    bool starPrecision = false;
+    spec[s++] = *p++;
+    while (*p && strchr("-+ #0123456789.*", *p)) {
+      if (*p == '*') starPrecision = true;
+      if (s < sizeof(spec) - 4) spec[s++] = *p;
+      p++;
+    }
+    while (*p && strchr("hljztL", *p)) p++;
+    if (!*p) break;
+    char conversion = *p;
+    uint32_t precision = 0;
+    if (starPrecision && !take(args, end, &precision, 4)) {
+      append(snprintf(out + n, size - n, "?"));
+      continue;
+    }
+    int written;
+    if (conversion == 's') {
+      uint8_t header;
+      if (!take(args, end, &header, 1)) {
+        append(snprintf(out + n, size - n, "?"));
+        continue;
+      }
+      size_t textLength = header & ~Hex;
+      if (textLength > (size_t)(end - args)) textLength = end - args;
+      if (header & Hex) {
+        // "aa bb cc", without the precision's say.
+        for (size_t i = 0; i < textLength && n + 1 < size; i++)
+          append(snprintf(out + n, size - n, i ? " %02x" : "%02x", args[i]));
+        args += textLength;
+        continue;
+      }
+      char text[MaxText + 1];
+      memcpy(text, args, textLength);
+      text[textLength] = '\0';
+      args += textLength;
+      spec[s++] = 's';
+      spec[s] = '\0';
+      written = starPrecision ? snprintf(out + n, size - n, spec,
+                                         (int)precision, text)
+                              : snprintf(out + n, size - n, spec, text);
+    } else {
+      uint32_t v;
+      if (!take(args, end, &v, 4)) {
+        append(snprintf(out + n, size - n, "?"));
+        continue;
+      }
+      if (strchr("fFeEgGaA", conversion)) {
+        float f;
+        memcpy(&f, &v, 4);
+        spec[s++] = conversion;
+        spec[s] = '\0';
+        written = starPrecision
+                      ? snprintf(out + n, size - n, spec, (int)precision,
+                                 (double)f)
+                      : snprintf(out + n, size - n, spec, (double)f);
+      } else if (conversion == 'c') {
+        spec[s++] = 'c';
+        spec[s] = '\0';
+        written = snprintf(out + n, size - n, spec, (int)v);
+      } else {
+        // Integers: d and i are signed, the rest not.
+        spec[s++] = 'l';
+        spec[s++] = conversion;
+        spec[s] = '\0';
+        if (conversion == 'd' || conversion == 'i') {
+          long l = (int32_t)v;
+          written = starPrecision
+                        ? snprintf(out + n, size - n, spec, (int)precision, l)
+                        : snprintf(out + n, size - n, spec, l);
+        } else {
+          unsigned long u = v;
+          written = starPrecision
+                        ? snprintf(out + n, size - n, spec, (int)precision, u)
+                        : snprintf(out + n, size - n, spec, u);
+        }
+      }
+    }
+    append(written);
+  }
+  return n;
+}
+
+size_t formatLine(char* out, size_t size, uint8_t level, uint32_t time,
+                  const char* fmt, const uint8_t* args, size_t length) {
+  int n = snprintf(out, size, "[%6lu.%03lu] %c ",
+                   (unsigned long)(time / 1000), (unsigned long)(time % 1000),
+                   levelLetter(level));
+  if (n < 0 || (size_t)n >= size) return size - 1;
+  return n + format(out + n, size - n, fmt, args, length);
+}
+
+#ifndef LOG_TEXT
+static void frame(char type, const uint8_t* payload, size_t length) {
+  uint8_t buf[3 + 255 + 1];
+  if (length > 255) length = 255;
+  buf[0] = 0;
+  buf[1] = type;
+  buf[2] = length;
+  memcpy(buf + 3, payload, length);
+  uint8_t sum = 0;
+  for (size_t i = 1; i < 3 + length; i++) sum += buf[i];
+  buf[3 + length] = sum;
+  // One write, so lines printed by other tasks can't land inside the frame.
+  Serial.write(buf, length + 4);
+}
+
+static void sendFormat(int id) {
+  uint8_t payload[255];
+  payload[0] = id;
+  payload[1] = sites[id]->level;
+  size_t n = strnlen(sites[id]->format, sizeof(payload) - 2);
+  memcpy(payload + 2, sites[id]->format, n);
+  frame('F', payload, n + 2);
+}
+#endif
+
+// The site's slot, new ones added (and their format sent); -1 when full.
+static int siteId(const Site* site) {
+  int slot = (int)(((uintptr_t)site >> 2) * 2654435761u % MaxSites);
+  for (int probes = 0; probes < MaxSites; probes++) {
+    if (sites[slot] == site) return slot;
+    if (sites[slot] == nullptr) {
+      if (siteCount == MaxSites - 1) return -1;
+      sites[slot] = site;
+      siteCount++;
+#ifndef LOG_TEXT
+      sendFormat(slot);
+#endif
+      return slot;
+    }
+    slot = (slot + 1) % MaxSites;
+  }
+  return -1;
+}
+
+static void emit(const uint8_t* data, size_t length) {
+  const Site* site;
+  uint32_t time;
+  if (length < sizeof(site) + sizeof(time)) return;
+  memcpy(&site, data, sizeof(site));
+  memcpy(&time, data + sizeof(site), sizeof(time));
+  const uint8_t* args = data + sizeof(site) + sizeof(time);
+  size_t argsLength = length - sizeof(site) - sizeof(time);
+#ifdef LOG_TEXT
+  siteId(site);
+  char line[192];
+  formatLine(line, sizeof(line), site->level, time, site->format, args,
+             argsLength);
+  Serial.println(line);
+#else
+  int id = siteId(site);
+  if (id < 0) return;
+  uint8_t payload[1 + 4 + MaxRecord];
+  payload[0] = id;
+  memcpy(payload + 1, &time, 4);
+  memcpy(payload + 5, args, argsLength);
+  frame('R', payload, 5 + argsLength);
+#endif
+}
+
+void drain() {
+#ifdef LOG_TEXT
+  resendWanted.store(false, std::memory_order_relaxed);
+#else
+  if (resendWanted.exchange(false, std::memory_order_relaxed)) {
+    for (int i = 0; i < MaxSites; i++)
+      if (sites[i] != nullptr) sendFormat(i);
+  }
+#endif
+  size_t length;
+  const uint8_t* data;
+  while ((data = ring.front(length)) != nullptr) {
+    emit(data, length);
+    ring.pop();
+  }
+  uint32_t dropped = ring.getOverflows();
+  if (dropped != droppedSent) {
+    uint32_t n = dropped - droppedSent;
+    droppedSent = dropped;
+#ifdef LOG_TEXT
+    Serial.print("Log: ");
+    Serial.print((unsigned long)n);
+    Serial.println(" records dropped");
+#else
+    frame('D', (const uint8_t*)&n, 4);
+#endif
+  }
+}
+
+}  // namespace Log
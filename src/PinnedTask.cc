@@ -0,0 +1,99 @@
+#include "PinnedTask.hh"
+
+#ifdef ESP32
+#include <esp_pthread.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+void PinnedTask::begin(std::function<void()> step) {
+  if (running) return;
+  this->step = step;
+  running = true;
+  statsStart = micros();
+#ifdef ESP32
+  // Applies to the next pthread this task creates.
+  esp_pthread_cfg_t cfg = esp_pthread_get_default_config();
+  cfg.stack_size = config.stackSize;
+  cfg.prio = config.priority;
+  cfg.pin_to_core = config.core;
+  cfg.thread_name = config.name;
+  esp_pthread_set_cfg(&cfg);
+#endif
+#ifdef ESP32
+  thread = std::thread(&PinnedTask::run, this);
+#else
+  thread = HostThread([this]() { run(); });
+#endif
+}
+
+void PinnedTask::end() {
+  if (!running) return;
+  running = false;
+  thread.join();
+}
+
+PinnedTask::Stats PinnedTask::takeStats() {
+  std::lock_guard<std::mutex> lock(mtx);
+  unsigned long timeNow = micros();
+  stats.elapsed = timeNow - statsStart;
+#ifdef ESP32
+  if (handle)
+    stats.stackFree = uxTaskGetStackHighWaterMark((TaskHandle_t)handle.load());
+#endif
+  Stats taken = stats;
+  stats = Stats();
+  statsStart = timeNow;
+  return taken;
+}
+
+void PinnedTask::run() {
+#ifdef ESP32
+  handle = xTaskGetCurrentTaskHandle();
+#elif defined(__linux__)
+  // Best effort: a small machine may not have the core, and raising priority
+  // needs privileges, so only lower ones get a higher niceness. Coroutines
+  // share the simulation's thread, so they leave it alone.
+  if (!(HostClock::simulated() && thread.isCurrent())) {
+    unsigned cores = std::thread::hardware_concurrency();
+    if (cores) {
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(config.core % cores, &cpus);
+      pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+    int nice = config.priority < 3 ? 2 * (3 - config.priority) : 0;
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), nice);
+  }
+#endif
+
+  unsigned long next = millis();
+  while (running) {
+    unsigned long timeStart = micros();
+    step();
+    unsigned long time = micros() - timeStart;
+    next += config.period;
+    long wait = (long)(next - millis());
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      stats.runs++;
+      stats.busyTime += time;
+      if (time > stats.maxRunTime) stats.maxRunTime = time;
+      if (wait < 0) stats.overruns++;
+    }
+    if (wait > 0) {
+      delay(wait);
+    } else {
+      // Fell behind: start over from now rather than running back to back,
+      // and still give lower priority tasks a tick.
+      next = millis();
+      delay(1);
+    }
+  }
+}
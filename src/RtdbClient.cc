@@ -0,0 +1,182 @@
+#include "RtdbClient.hh"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "JsonScan.hh"
+#include "Log.hh"
+#include "Trace.hh"
+
+RtdbClient::RtdbClient(Client& client, const char* host, uint16_t port,
+                       const char* auth)
+    : client(client), host(host), port(port), auth(auth ? auth : "") {}
+
+bool RtdbClient::readLine(std::string& out) {
+  out.clear();
+  unsigned long timeStart = millis();
+  while (millis() - timeStart < Timeout) {
+    if (client.available() <= 0) {
+      if (!client.connected()) return false;
+      delay(1);
+      continue;
+    }
+    uint8_t c;
+    if (client.read(&c, 1) != 1) continue;
+    if (c == '\n') {
+      if (!out.empty() && out[out.size() - 1] == '\r') out.resize(out.size() - 1);
+      return true;
+    }
+    if (out.size() < 512) out += (char)c;
+  }
+  return false;
+}
+
+bool RtdbClient::readBody(size_t length, std::string* out) {
+  uint8_t buf[128];
+  unsigned long timeStart = millis();
+  while (length > 0 && millis() - timeStart < Timeout) {
+    if (client.available() <= 0) {
+      if (!client.connected()) return false;
+      delay(1);
+      continue;
+    }
+    int n = client.read(buf, length < sizeof(buf) ? length : sizeof(buf));
+    if (n <= 0) continue;
+    if (out && out->size() + n <= MaxBody) out->append((const char*)buf, n);
+    length -= n;
+  }
+  return length == 0;
+}
+
+bool RtdbClient::readChunked(std::string& out) {
+  std::string line;
+  while (readLine(line)) {
+    size_t length = strtoul(line.c_str(), nullptr, 16);
+    if (length == 0) return readLine(line);  // Trailing CRLF.
+    if (!readBody(length, &out) || !readLine(line)) return false;
+  }
+  return false;
+}
+
+RtdbClient::Response RtdbClient::request(const char* method,
+                                         const std::string& path,
+                                         const std::string& body,
+                                         bool wantEtag, const char* ifMatch) {
+  TRACE_LONG_SPAN(CloudRequest);
+  Response response;
+  std::string uri = path + ".json";
+  if (!auth.empty()) uri += "?auth=" + auth;
+  std::string request = std::string(method) + " " + uri + " HTTP/1.1\r\nHost: " +
+                        host + "\r\nConnection: keep-alive\r\n";
+  if (wantEtag) request += "X-Firebase-ETag: true\r\n";
+  if (ifMatch) request += std::string("if-match: ") + ifMatch + "\r\n";
+  if (!body.empty() || strcmp(method, "GET") != 0)
+    request += "Content-Length: " +
+               std::string(String((unsigned int)body.size()).c_str()) + "\r\n";
+  request += "\r\n" + body;
+
+  // A kept-alive connection may have been closed by the server meanwhile;
+  // then reconnect and send again once.
+  for (int attempt = 0; attempt < 2; attempt++) {
+    bool reused = client.connected();
+    if (!reused) {
+      if (!client.connect(host.c_str(), port)) {
+        LOG_WARN("<RtdbClient::request> Failed to connect to %s", host.c_str());
+        return response;
+      }
+      connects++;
+    }
+    client.write((const uint8_t*)request.data(), request.size());
+
+    std::string status, header;
+    if (!readLine(status) || status.compare(0, 5, "HTTP/") != 0) {
+      client.stop();
+      if (reused) continue;
+      return response;
+    }
+    requests++;
+    response.code = atoi(status.c_str() + status.find(' ') + 1);
+    size_t contentLength = 0;
+    bool hasLength = false, chunked = false, close = false;
+    while (readLine(header) && !header.empty()) {
+      size_t colon = header.find(':');
+      if (colon == std::string::npos) continue;
+      std::string value = header.substr(colon + 1);
+      value.erase(0, value.find_first_not_of(' '));
+      header.resize(colon);
+      if (strcasecmp(header.c_str(), "Content-Length") == 0) {
+        contentLength = strtoul(value.c_str(), nullptr, 10);
+        hasLength = true;
+      } else if (strcasecmp(header.c_str(), "Transfer-Encoding") == 0) {
+        chunked = strcasecmp(value.c_str(), "chunked") == 0;
+      } else if (strcasecmp(header.c_str(), "Connection") == 0) {
+        close = strcasecmp(value.c_str(), "close") == 0;
+      } else if (strcasecmp(header.c_str(), "ETag") == 0) {
+        response.etag = value;
+      }
+    }
+
+    bool ok = true;
+    if (chunked) {
+      ok = readChunked(response.body);
+    } else if (hasLength || response.code == 204) {
+      ok = readBody(contentLength, &response.body);
+    } else {
+      // No length: the body runs until the server closes.
+      readBody((size_t)-1, &response.body);
+      close = true;
+    }
+    if (!ok) close = true;
+    if (close) client.stop();
+    if (response.code == 412) conflicts++;
+    return response;
+  }
+  return response;
+}
+
+RtdbClient::Claim RtdbClient::claim(const std::string& path,
+                                    std::string& value) {
+  if (path != claimPath) {
+    claimPath = path;
+    claimEtag.clear();
+  }
+  Response r;
+  if (claimEtag.empty()) {
+    // The node's value and ETag, the first time.
+    r = request("GET", path, "", true);
+  } else {
+    // Deleting the node only if it's still empty leaves it as it was; if a
+    // command came in, the 412 carries it and its ETag.
+    r = request("DELETE", path, "", true, claimEtag.c_str());
+    if (r.code == 200) {
+      idlePolls++;
+      return Empty;
+    }
+    if (r.code == 412) r.code = 200;
+  }
+  // A few rounds at most: each 412 means a client wrote a newer command.
+  for (int attempt = 0; attempt < 4 && r.code == 200; attempt++) {
+    if (JsonScan::isNull(r.body)) {
+      claimEtag = r.etag;
+      return Empty;
+    }
+    Response d = request("DELETE", path, "", true, r.etag.c_str());
+    if (d.code == 200) {
+      value = r.body;
+      // What's left is the empty node.
+      claimEtag = d.etag;
+      return Claimed;
+    }
+    if (d.code != 412) {
+      r.code = d.code;
+      break;
+    }
+    r.body = d.body;
+    r.etag = d.etag;
+  }
+  if (r.code != 200)
+    LOG_WARN("<RtdbClient::claim> HTTP status %d", r.code);
+  claimEtag.clear();
+  return Failed;
+}
@@ -0,0 +1,233 @@
+#include "RtdbStream.hh"
+
+#include <stdlib.h>
+#include <strings.h>
+
+#include "JsonScan.hh"
+#include "Log.hh"
+
+// Longest SSE line we'll hold on to; commands and keep-alives are tiny.
+static const size_t MaxLine = 4096;
+
+RtdbStream::RtdbStream(Client& client, const char* host, uint16_t port,
+                       const char* auth)
+    : client(client), host(host), port(port), auth(auth ? auth : "") {}
+
+bool RtdbStream::begin(const std::string& path) {
+  stop();
+  std::string h = host;
+  uint16_t p = port;
+  std::string uri = path + ".json";
+  if (!auth.empty()) uri += "?auth=" + auth;
+
+  // Firebase answers streaming requests with a redirect to the server that
+  // actually holds the database.
+  for (int redirects = 0; redirects < 3; redirects++) {
+    std::string location;
+    if (open(h, p, uri, location)) {
+      active = true;
+      connects++;
+      timeLastData = millis();
+      chunkState = ChunkSize;
+      chunkRemaining = 0;
+      chunkLine.clear();
+      line.clear();
+      eventName.clear();
+      eventData.clear();
+      return true;
+    }
+    size_t scheme = location.find("://");
+    if (scheme == std::string::npos) return false;
+    p = location.compare(0, scheme, "http") == 0 ? 80 : 443;
+    size_t hostStart = scheme + 3;
+    size_t slash = location.find('/', hostStart);
+    if (slash == std::string::npos) slash = location.size();
+    h = location.substr(hostStart, slash - hostStart);
+    size_t colon = h.find(':');
+    if (colon != std::string::npos) {
+      p = atoi(h.c_str() + colon + 1);
+      h = h.substr(0, colon);
+    }
+    uri = slash < location.size() ? location.substr(slash) : "/";
+  }
+  return false;
+}
+
+bool RtdbStream::readLine(std::string& out) {
+  out.clear();
+  unsigned long timeStart = millis();
+  while (millis() - timeStart < ConnectTimeout) {
+    if (client.available() <= 0) {
+      if (!client.connected()) return false;
+      delay(1);
+      continue;
+    }
+    uint8_t c;
+    if (client.read(&c, 1) != 1) continue;
+    if (c == '\n') {
+      if (!out.empty() && out[out.size() - 1] == '\r') out.resize(out.size() - 1);
+      return true;
+    }
+    if (out.size() < MaxLine) out += (char)c;
+  }
+  return false;
+}
+
+bool RtdbStream::open(const std::string& h, uint16_t p, const std::string& uri,
+                      std::string& location) {
+  client.stop();
+  if (!client.connect(h.c_str(), p)) {
+    LOG_WARN("<RtdbStream::open> Failed to connect to %s", h.c_str());
+    return false;
+  }
+  std::string request = "GET " + uri + " HTTP/1.1\r\nHost: " + h +
+                        "\r\nAccept: text/event-stream\r\n"
+                        "Connection: keep-alive\r\n\r\n";
+  client.write((const uint8_t*)request.data(), request.size());
+
+  std::string status, header;
+  if (!readLine(status) || status.compare(0, 5, "HTTP/") != 0) {
+    client.stop();
+    return false;
+  }
+  int code = atoi(status.c_str() + status.find(' ') + 1);
+  chunked = false;
+  while (readLine(header) && !header.empty()) {
+    size_t colon = header.find(':');
+    if (colon == std::string::npos) continue;
+    std::string value = header.substr(colon + 1);
+    value.erase(0, value.find_first_not_of(' '));
+    header.resize(colon);
+    if (strcasecmp(header.c_str(), "Location") == 0)
+      location = value;
+    else if (strcasecmp(header.c_str(), "Transfer-Encoding") == 0)
+      chunked = strcasecmp(value.c_str(), "chunked") == 0;
+  }
+  if (code != 200) {
+    if (code < 300 || code >= 400)
+      LOG_WARN("<RtdbStream::open> HTTP status %d", code);
+    client.stop();
+    return false;
+  }
+  return true;
+}
+
+void RtdbStream::stop() {
+  if (active) client.stop();
+  active = false;
+}
+
+bool RtdbStream::connected() { return active && client.connected(); }
+
+void RtdbStream::poll(Callback onEvent) {
+  if (!active) return;
+  uint8_t buf[256];
+  while (active && client.available() > 0) {
+    int n = client.read(buf, sizeof(buf));
+    if (n <= 0) break;
+    bytes += n;
+    timeLastData = millis();
+    consume((const char*)buf, n, onEvent);
+  }
+  if (active &&
+      (!client.connected() || millis() - timeLastData > IdleTimeout)) {
+    LOG_INFO("<RtdbStream::poll> Stream closed");
+    stop();
+  }
+}
+
+void RtdbStream::consume(const char* data, size_t length, Callback& onEvent) {
+  for (size_t i = 0; i < length && active; i++) {
+    if (!chunked) {
+      consumeEventByte(data[i], onEvent);
+      continue;
+    }
+    switch (chunkState) {
+      case ChunkSize:
+        if (data[i] != '\n') {
+          if (chunkLine.size() < 16) chunkLine += data[i];
+          break;
+        }
+        chunkRemaining = strtoul(chunkLine.c_str(), nullptr, 16);
+        chunkLine.clear();
+        if (chunkRemaining == 0) {
+          // Last chunk: the server ended the stream.
+          stop();
+          break;
+        }
+        chunkState = ChunkData;
+        break;
+      case ChunkData: {
+        size_t n = length - i < chunkRemaining ? length - i : chunkRemaining;
+        for (size_t j = 0; j < n && active; j++)
+          consumeEventByte(data[i + j], onEvent);
+        i += n - 1;
+        chunkRemaining -= n;
+        if (chunkRemaining == 0) chunkState = ChunkEnd;
+        break;
+      }
+      case ChunkEnd:
+        if (data[i] == '\n') chunkState = ChunkSize;
+        break;
+    }
+  }
+}
+
+void RtdbStream::consumeEventByte(char c, Callback& onEvent) {
+  if (c != '\n') {
+    if (line.size() < MaxLine) line += c;
+    return;
+  }
+  if (!line.empty() && line[line.size() - 1] == '\r') line.resize(line.size() - 1);
+
+  if (line.empty()) {
+    dispatch(onEvent);
+  } else if (line[0] != ':') {
+    size_t colon = line.find(':');
+    std::string field = line.substr(0, colon);
+    std::string value = colon == std::string::npos ? "" : line.substr(colon + 1);
+    if (!value.empty() && value[0] == ' ') value.erase(0, 1);
+    if (field == "event") {
+      eventName = value;
+    } else if (field == "data") {
+      if (!eventData.empty()) eventData += '\n';
+      eventData += value;
+    }
+  }
+  line.clear();
+}
+
+void RtdbStream::dispatch(Callback& onEvent) {
+  if (eventName.empty() && eventData.empty()) return;
+  Event event;
+  if (eventName == "put")
+    event.type = Event::Put;
+  else if (eventName == "patch")
+    event.type = Event::Patch;
+  else if (eventName == "keep-alive")
+    event.type = Event::KeepAlive;
+  else if (eventName == "cancel")
+    event.type = Event::Cancel;
+  else if (eventName == "auth_revoked")
+    event.type = Event::AuthRevoked;
+  else
+    event.type = Event::Other;
+
+  if (event.type == Event::Put || event.type == Event::Patch) {
+    std::string raw;
+    if (JsonScan::member(eventData, "path", raw))
+      JsonScan::toString(raw, event.path);
+    if (!JsonScan::member(eventData, "data", event.data)) event.data = "null";
+  } else {
+    event.data = eventData;
+  }
+  eventName.clear();
+  eventData.clear();
+  events++;
+  onEvent(event);
+
+  if (event.type == Event::Cancel || event.type == Event::AuthRevoked) {
+    LOG_WARN("<RtdbStream::dispatch> Stream cancelled by server");
+    stop();
+  }
+}
@@ -0,0 +1,285 @@
+#include "ScaleCalibration.hh"
+
+#include <math.h>
+#include <string.h>
+
+#include <cmath>
+
+// "SCAL", then the version, the number of points, the model type and order.
+static const uint32_t Magic = 0x4c414353;
+static const size_t HeaderBytes = 8;
+
+// Readings are scaled to -1..1 for the polynomials, to keep the fits well
+// conditioned.
+static double scaled(double reading) { return (reading - 2048.0) / 2048.0; }
+
+static uint32_t crc32(const uint8_t* data, size_t length) {
+  uint32_t crc = 0xffffffff;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (int k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+template <typename T>
+static T clampFill(T fill) {
+  if (fill < 0) return 0;
+  if (fill > ScaleCalibration::Model::MaxFill)
+    return ScaleCalibration::Model::MaxFill;
+  return fill;
+}
+
+// The model in T, so the float version does all its arithmetic in float.
+template <typename T>
+static T evaluate(const ScaleCalibration::Model& m, T reading) {
+  typedef ScaleCalibration::Model Model;
+  switch (m.type) {
+    case Model::Quadratic: {
+      // x = (sqrt(4ay - 4ac + b^2) - b) / 2a, as the scale always did.
+      T a = m.coeffs[0], b = m.coeffs[1], c = m.coeffs[2];
+      T det = 4 * a * (reading - c) + b * b;
+      if (det < 0) return Model::MaxFill;
+      T denom = 2 * a;
+      T fill = denom == 0 ? 0 : (std::sqrt(det) - b) / denom;
+      return fill < 0 ? 0 : fill;
+    }
+    case Model::Polynomial: {
+      T x = (reading - T(2048)) / T(2048);
+      T fill = 0;
+      for (int i = m.order; i >= 0; i--) fill = fill * x + T(m.coeffs[i]);
+      return clampFill(fill);
+    }
+    case Model::Piecewise: {
+      if (m.count == 0) return 0;
+      if (m.count == 1) return clampFill(T(m.points[0].ounces));
+      int i = 0;
+      while (i < m.count - 2 && reading > m.points[i + 1].reading) i++;
+      const ScaleCalibration::Point& p = m.points[i];
+      const ScaleCalibration::Point& q = m.points[i + 1];
+      T dx = T(q.reading) - T(p.reading);
+      if (dx == 0) return clampFill(T(p.ounces));
+      return clampFill(T(p.ounces) + (reading - T(p.reading)) *
+                                         (T(q.ounces) - T(p.ounces)) / dx);
+    }
+  }
+  return 0;
+}
+
+ScaleCalibration::Model ScaleCalibration::Model::quadratic(double a, double b,
+                                                           double c) {
+  Model m;
+  m.type = Quadratic;
+  m.coeffs[0] = a;
+  m.coeffs[1] = b;
+  m.coeffs[2] = c;
+  return m;
+}
+
+double ScaleCalibration::Model::ounces(double reading) const {
+  return evaluate<double>(*this, reading);
+}
+
+float ScaleCalibration::Model::ouncesFloat(float reading) const {
+  return evaluate<float>(*this, reading);
+}
+
+int ScaleCalibration::Model::breaks(float* out, int max) const {
+  if (type != Piecewise) return 0;
+  int n = 0;
+  for (int i = 0; i < count && n < max; i++) out[n++] = points[i].reading;
+  return n;
+}
+
+bool ScaleCalibration::addPoint(float ounces, float reading) {
+  int i = 0;
+  while (i < count && points[i].ounces != ounces) i++;
+  if (i < count) {
+    // Replacing it.
+    accumulate(points[i], -1, powers, moments);
+    memmove(&points[i], &points[i + 1], (count - i - 1) * sizeof(Point));
+    count--;
+  } else if (count == MaxPoints) {
+    return false;
+  }
+  Point p = {ounces, reading};
+  i = count;
+  while (i > 0 && points[i - 1].reading > reading) {
+    points[i] = points[i - 1];
+    i--;
+  }
+  points[i] = p;
+  count++;
+  accumulate(p, 1, powers, moments);
+  refit();
+  return true;
+}
+
+void ScaleCalibration::clear() {
+  count = 0;
+  memset(powers, 0, sizeof(powers));
+  memset(moments, 0, sizeof(moments));
+  residual = 0;
+}
+
+void ScaleCalibration::accumulate(const Point& p, double sign, double* powers,
+                                  double* moments) {
+  double x = scaled(p.reading);
+  double xk = 1;
+  for (int k = 0; k <= 2 * MaxOrder; k++) {
+    powers[k] += sign * xk;
+    if (k <= MaxOrder) moments[k] += sign * p.ounces * xk;
+    xk *= x;
+  }
+}
+
+// Least squares through the normal equations, by Gaussian elimination.
+bool ScaleCalibration::fitPolynomial(int order, const double* powers,
+                                     const double* moments, double* coeffs) {
+  const int n = order + 1;
+  double m[MaxOrder + 1][MaxOrder + 2];
+  for (int r = 0; r < n; r++) {
+    for (int c = 0; c < n; c++) m[r][c] = powers[r + c];
+    m[r][n] = moments[r];
+  }
+  for (int c = 0; c < n; c++) {
+    int pivot = c;
+    for (int r = c + 1; r < n; r++)
+      if (fabs(m[r][c]) > fabs(m[pivot][c])) pivot = r;
+    if (fabs(m[pivot][c]) < 1e-12) return false;
+    for (int k = 0; k <= n; k++) {
+      double t = m[c][k];
+      m[c][k] = m[pivot][k];
+      m[pivot][k] = t;
+    }
+    for (int r = c + 1; r < n; r++) {
+      double f = m[r][c] / m[c][c];
+      for (int k = c; k <= n; k++) m[r][k] -= f * m[c][k];
+    }
+  }
+  for (int r = n - 1; r >= 0; r--) {
+    double v = m[r][n];
+    for (int k = r + 1; k < n; k++) v -= m[r][k] * coeffs[k];
+    coeffs[r] = v / m[r][r];
+  }
+  for (int k = n; k <= MaxOrder; k++) coeffs[k] = 0;
+  return true;
+}
+
+// Fits the candidate without each point in turn and checks how well it
+// predicts the point left out.
+double ScaleCalibration::leaveOneOut(const Model& candidate) const {
+  double sum = 0;
+  for (int i = 0; i < count; i++) {
+    Model m = candidate;
+    if (m.type == Model::Polynomial) {
+      double p[2 * MaxOrder + 1];
+      double q[MaxOrder + 1];
+      memcpy(p, powers, sizeof(p));
+      memcpy(q, moments, sizeof(q));
+      accumulate(points[i], -1, p, q);
+      if (!fitPolynomial(m.order, p, q, m.coeffs)) return INFINITY;
+    } else {
+      m.count = 0;
+      for (int j = 0; j < count; j++)
+        if (j != i) m.points[m.count++] = points[j];
+    }
+    double e = m.ounces(points[i].reading) - points[i].ounces;
+    sum += e * e;
+  }
+  return sqrt(sum / count);
+}
+
+void ScaleCalibration::refit() {
+  if (count < 2) {
+    residual = 0;
+    return;
+  }
+  Model best;
+  double bestResidual = INFINITY;
+  for (int order = 1; order <= MaxOrder; order++) {
+    // Leaving a point out has to leave enough to fit.
+    bool checkable = count >= order + 2;
+    if (!checkable && !(order == 1 && count == 2)) continue;
+    Model m;
+    m.type = Model::Polynomial;
+    m.order = order;
+    if (!fitPolynomial(order, powers, moments, m.coeffs)) continue;
+    double r = checkable ? leaveOneOut(m) : 0;
+    if (r < bestResidual) {
+      best = m;
+      bestResidual = r;
+    }
+  }
+  if (count >= 3) {
+    Model m;
+    m.type = Model::Piecewise;
+    m.count = count;
+    memcpy(m.points, points, count * sizeof(Point));
+    double r = leaveOneOut(m);
+    if (r < bestResidual) {
+      best = m;
+      bestResidual = r;
+    }
+  }
+  if (bestResidual == INFINITY) return;
+  model = best;
+  residual = bestResidual;
+}
+
+size_t ScaleCalibration::save(uint8_t* out, size_t capacity) const {
+  size_t length = HeaderBytes + count * sizeof(Point) + sizeof(model.coeffs) +
+                  sizeof(residual) + 4;
+  if (length > capacity) return 0;
+  // Both ends are little-endian; fields are copied as they are.
+  uint8_t* p = out;
+  memcpy(p, &Magic, 4);
+  p[4] = Version;
+  p[5] = count;
+  p[6] = model.type;
+  p[7] = model.order;
+  p += HeaderBytes;
+  memcpy(p, points, count * sizeof(Point));
+  p += count * sizeof(Point);
+  memcpy(p, model.coeffs, sizeof(model.coeffs));
+  p += sizeof(model.coeffs);
+  memcpy(p, &residual, sizeof(residual));
+  p += sizeof(residual);
+  uint32_t crc = crc32(out, p - out);
+  memcpy(p, &crc, 4);
+  return length;
+}
+
+bool ScaleCalibration::load(const uint8_t* data, size_t length) {
+  uint32_t magic, crc;
+  if (length < HeaderBytes + 4) return false;
+  memcpy(&magic, data, 4);
+  memcpy(&crc, data + length - 4, 4);
+  int n = data[5];
+  if (magic != Magic || data[4] != Version || n > MaxPoints ||
+      data[6] > Model::Piecewise || data[7] > MaxOrder ||
+      length != HeaderBytes + n * sizeof(Point) + sizeof(model.coeffs) +
+                    sizeof(residual) + 4 ||
+      crc != crc32(data, length - 4))
+    return false;
+
+  clear();
+  const uint8_t* p = data + HeaderBytes;
+  memcpy(points, p, n * sizeof(Point));
+  count = n;
+  for (int i = 0; i < count; i++) accumulate(points[i], 1, powers, moments);
+  p += n * sizeof(Point);
+  // The model as it was saved, even if refitting would now pick another.
+  Model m;
+  m.type = (Model::Type)data[6];
+  m.order = data[7];
+  memcpy(m.coeffs, p, sizeof(m.coeffs));
+  p += sizeof(m.coeffs);
+  if (m.type == Model::Piecewise) {
+    m.count = count;
+    memcpy(m.points, points, count * sizeof(Point));
+  }
+  model = m;
+  memcpy(&residual, p, sizeof(residual));
+  return true;
+}
@@ -1,5 +1,7 @@
 #include "StaggKettle.hh"
 
+#include "Log.hh"
+
 // Friendly names of states.
 const char* StaggKettle::StateStrings[] = {"Inactive", "Scanning...", "Found",
                                        "Connecting...", "Connected"};
@@ -21,78 +23,111 @@ static uint8_t ekgInit[20] = {0xef, 0xdd, 0x0b, 0x30, 0x31, 0x32, 0x33,
                               0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x30,
                               0x31, 0x32, 0x33, 0x34, 0x9a, 0x6d};
 
-static const uint8_t ekgStates = 9;
-static const uint8_t ekgStateBytes[ekgStates] = {
-    3, // 0 = Power
-    3, // 1 = Hold
-    4, // 2 = Target temperature
-    4, // 3 = Current temperature
-    4, // 4 = Countdown when lifted?
-    4, // 5 = Unknown, usually 0x05, 0xFF, 0xFF, 0xFF
-    3, // 6 = Boiled/Holding?, usually 0x06, 0x00, 0x00
-    3, // 7 = Unknown, usually 0x07, 0x00, 0x00
-    3  // 8 = Kettle lifted
-    };
-
 // Don't send commands more often than every X ms.
 const unsigned long debounceDelay = 200;
 
-static std::unordered_map<BLERemoteCharacteristic*, StaggKettle*> notifiers;
+// Kettles by notifier slot. Each kettle takes a slot when it's made and
+// registers that slot's callback, so a notification finds its kettle by
+// index, without a lookup or a lock.
+static std::atomic<StaggKettle*> notifiers[StaggKettle::MaxKettles];
 
 // static wrapper for onNotify member callback.
+template <int Slot>
 static void bleNotify(BLERemoteCharacteristic* c, uint8_t* pData, size_t length,
                       bool isNotify) {
-  if (notifiers.count(c) == 0) {
-    Serial.println("<bleNotify> No notifier for this characteristic!");
-    return;
-  }
-  notifiers[c]->onNotify(c, pData, length, isNotify);
+  StaggKettle* kettle = notifiers[Slot].load(std::memory_order_acquire);
+  if (kettle != nullptr) kettle->onNotify(c, pData, length, isNotify);
 }
 
+typedef void (*NotifyCallback)(BLERemoteCharacteristic*, uint8_t*, size_t,
+                               bool);
+static const NotifyCallback notifyCallbacks[] = {bleNotify<0>, bleNotify<1>,
+                                                 bleNotify<2>, bleNotify<3>};
+static_assert(sizeof(notifyCallbacks) / sizeof(notifyCallbacks[0]) ==
+                  StaggKettle::MaxKettles,
+              "one callback per notifier slot");
+
 StaggKettle::StaggKettle()
-    : state(StaggKettle::State::Inactive), timeLastCommand(millis()) {}
+    : state(StaggKettle::State::Inactive),
+      timeLinkLost(millis()),
+      timeLastCommand(millis()) {
+  for (int i = 0; i < MaxKettles && notifier < 0; i++) {
+    StaggKettle* free = nullptr;
+    if (notifiers[i].compare_exchange_strong(free, this)) notifier = i;
+  }
+}
 
 StaggKettle::~StaggKettle() {
-  std::unordered_map<BLERemoteCharacteristic*, StaggKettle*>::iterator it;
+  if (notifier >= 0) notifiers[notifier].store(nullptr);
+  for (auto& unknown : unknownStates) delete[] unknown.second;
+  delete pDevice;
+}
 
-  for (it = notifiers.begin(); it != notifiers.end(); ++it) {
-    if (it->second == this) {
-      notifiers.erase(it->first);
-      break;
-    }
-  }
+void StaggKettle::setLink(const Link& link) {
+  this->link = link;
+  // It came from flash; don't trust the terminators.
+  this->link.name[sizeof(link.name) - 1] = 0;
+  this->link.address[sizeof(link.address) - 1] = 0;
+  name.assign(this->link.name);
+}
+
+void StaggKettle::assign(const Link& link) {
+  setLink(link);
+  tryDirect = true;
+  retryDelay = 0;
+}
+
+bool StaggKettle::isKettle(BLEAdvertisedDevice& device) {
+  return device.haveServiceUUID() &&
+         device.isAdvertisingService(ekgServiceUUID);
+}
+
+StaggKettle::Link StaggKettle::linkTo(BLEAdvertisedDevice& device) {
+  Link link;
+  strncpy(link.name, device.getName().c_str(), sizeof(link.name) - 1);
+  strncpy(link.address, device.getAddress().toString().c_str(),
+          sizeof(link.address) - 1);
+  link.addressType = device.getAddressType();
+  return link;
 }
 
 void StaggKettle::scan() {
-  Serial.println("<StaggKettle::scan> Scanning...");
+  LOG_DEBUG("<StaggKettle::scan> Scanning...");
 
   state = StaggKettle::State::Scanning;
   timeStateChange = millis();
+  connectStats.scans++;
 
   // Retrieve a Scanner and set the callback we want to use to be informed when
   // we have detected a new device.  Specify that we want active scanning and
-  // start the scan to run for 5 seconds.
+  // start the scan to run for ScanSeconds.
   pBLEScan = BLEDevice::getScan();
   pBLEScan->setAdvertisedDeviceCallbacks(this);
   pBLEScan->setInterval(1349);
   pBLEScan->setWindow(449);
   pBLEScan->setActiveScan(true);
-  pBLEScan->start(5, false);
+  pBLEScan->start(ScanSeconds, false);
 }
 
 void StaggKettle::onConnect(BLEClient* pclient) {
-  Serial.print("<StaggKettle::onConnect> Device ");
-  Serial.println(name.c_str());
+  LOG_INFO("<StaggKettle::onConnect> Device %s", name.c_str());
   state = StaggKettle::State::Connected;
   timeStateChange = millis();
   sequence = 0;
 }
 
 void StaggKettle::onDisconnect(BLEClient* pclient) {
-  Serial.print("<StaggKettle::onDisconnect> Device ");
-  Serial.println(name.c_str());
+  LOG_INFO("<StaggKettle::onDisconnect> Device %s", name.c_str());
   state = StaggKettle::State::Inactive;
   timeStateChange = millis();
+  // A link that worked is worth trying again straight away; failed attempts
+  // back off in retryLater() instead.
+  if (linked) {
+    linked = false;
+    timeLinkLost = timeStateChange;
+    retryDelay = 0;
+    tryDirect = true;
+  }
   if (pRemoteService != nullptr) {
     delete pRemoteService;
     pRemoteService = nullptr;
@@ -101,15 +136,14 @@ void StaggKettle::onDisconnect(BLEClient* pclient) {
 
 // Called by BLE when a device has been found during a scan.
 void StaggKettle::onResult(BLEAdvertisedDevice advertiser) {
-  Serial.print("<StaggKettle::onResult> BLE Advertised Device found: ");
-  Serial.print(advertiser.getName().c_str());
-  Serial.print(" - ");
-  Serial.println(advertiser.getAddress().toString().c_str());
+  LOG_DEBUG("<StaggKettle::onResult> BLE Advertised Device found: %s - %s",
+            advertiser.getName().c_str(),
+            advertiser.getAddress().toString().c_str());
 
   // Does this device provide the service for our kettle?
-  if (advertiser.haveServiceUUID() &&
-      advertiser.isAdvertisingService(ekgServiceUUID)) {
+  if (isKettle(advertiser)) {
     pBLEScan->stop();
+    delete pDevice;
     pDevice = new BLEAdvertisedDevice(advertiser);
     pBLEScan->clearResults();
     state = StaggKettle::State::Found;
@@ -121,147 +155,178 @@ bool StaggKettle::connectToServer() {
   state = StaggKettle::State::Connecting;
   timeStateChange = millis();
 
-  Serial.print("<StaggKettle::connectToServer> Connecting to BLE device ");
-  name.assign(pDevice->getName());
-  Serial.println(name.c_str());
+  // A device the scan just found replaces the cached one.
+  bool direct = pDevice == nullptr;
+  if (direct && !link.valid()) {
+    retryLater(millis());
+    return false;
+  }
+  if (!direct) {
+    Link found = linkTo(*pDevice);
+    if (strcmp(found.address, link.address) == 0) found.handle = link.handle;
+    link = found;
+  }
+  name.assign(link.name);
+  LOG_INFO("<StaggKettle::connectToServer> Connecting to BLE device %s at %s",
+           name.c_str(), direct ? link.address : "advertised address");
 
   if (pClient != nullptr) {
     delete pClient;
   }
   pClient = BLEDevice::createClient();
   pClient->setClientCallbacks(this);
-  Serial.println("<StaggKettle::connectToServer> Created BLE client");
+  LOG_DEBUG("<StaggKettle::connectToServer> Created BLE client");
 
   // Connect to the remove BLE Server.
   // if we pass a BLEAdvertisedDevice instead of address,
   // it will be recognized as a peer device address (public or private)
-  if (!pClient->connect(pDevice)) {
-    Serial.println("<StaggKettle::connectToServer> Failed to connect.");
+  bool connected =
+      direct ? pClient->connect(BLEAddress(link.address),
+                                (esp_ble_addr_type_t)link.addressType)
+             : pClient->connect(pDevice);
+  delete pDevice;
+  pDevice = nullptr;
+  if (!connected) {
+    LOG_WARN("<StaggKettle::connectToServer> Failed to connect.");
+    if (direct) tryDirect = false;
+    retryLater(millis());
     return false;
   }
 
   // Obtain a reference to the service we are after in the remote BLE server.
   pRemoteService = pClient->getService(ekgServiceUUID);
   if (pRemoteService == nullptr) {
-    Serial.print(
-        "<StaggKettle::connectToServer> Failed to find EKG+ service UUID: ");
-    Serial.println(ekgServiceUUID.toString().c_str());
+    LOG_ERROR("<StaggKettle::connectToServer> Failed to find EKG+ service "
+              "UUID: %s",
+              ekgServiceUUID.toString().c_str());
     pClient->disconnect();
     delete pClient;
     pClient = nullptr;
-    state = StaggKettle::State::Inactive;
-    timeStateChange = millis();
-
+    if (direct) tryDirect = false;
+    retryLater(millis());
     return false;
   }
-  Serial.println("<StaggKettle::connectToServer> Found EKG+ service UUID");
+  LOG_DEBUG("<StaggKettle::connectToServer> Found EKG+ service UUID");
 
   // Obtain a reference to the characteristic in the service of the remote BLE
   // server.
   prcKettleSerial = pRemoteService->getCharacteristic(ekgCharUUID);
   if (prcKettleSerial == nullptr) {
-    Serial.print(
-        "<StaggKettle::connectToServer> Failed to find EKG+ SPS characteristic "
-        "UUID: ");
-    Serial.println(ekgCharUUID.toString().c_str());
+    LOG_ERROR("<StaggKettle::connectToServer> Failed to find EKG+ SPS "
+              "characteristic UUID: %s",
+              ekgCharUUID.toString().c_str());
     pClient->disconnect();
     delete pClient;
-    pClient = nullptr;    
-    state = StaggKettle::State::Inactive;
-    timeStateChange = millis();
-
+    pClient = nullptr;
+    if (direct) tryDirect = false;
+    retryLater(millis());
     return false;
   }
 
-  Serial.println(
+  LOG_DEBUG(
       "<StaggKettle::connectToServer> Found EKG+ SPS characteristic UUID");
 
-  bufferState = 0;
-  if (prcKettleSerial->canNotify()) {
-    notifiers[prcKettleSerial] = this;
-    prcKettleSerial->registerForNotify(bleNotify);
+  rxNotifications.clear();
+  decoder.reset();
+  acks.clear();
+  if (notifier < 0) {
+    LOG_ERROR("<StaggKettle::connectToServer> No notifier slot left");
+  } else if (prcKettleSerial->canNotify()) {
+    prcKettleSerial->registerForNotify(notifyCallbacks[notifier]);
   }
+  // The Arduino client still discovers the service each time; the handle is
+  // kept to notice a kettle whose table has changed.
+  uint16_t handle = prcKettleSerial->getHandle();
+  if (link.handle != 0 && link.handle != handle)
+    LOG_INFO("<StaggKettle::connectToServer> Characteristic moved");
+  link.handle = handle;
+  onLinked(millis(), direct);
   return true;
 }
 
-void StaggKettle::parseEvent(const uint8_t* data, size_t length, bool debug) {
-  if (data[0] >= ekgStates || ekgStateBytes[data[0]] != length) {
-    Serial.print("<StaggKettle::parseEvent> Wrong state length or type: ");    
-    for (int i = 0; i < length; i++) {
-      Serial.print(String(data[i], HEX));
-      Serial.print(" ");
-    }
-    Serial.println("END");
+// A failed attempt: back to Inactive, waiting twice as long as last time.
+void StaggKettle::retryLater(unsigned long timeNow) {
+  connectStats.failures++;
+  retryDelay = retryDelay == 0 ? MinRetryDelay : retryDelay * 2;
+  if (retryDelay > MaxRetryDelay) retryDelay = MaxRetryDelay;
+  state = StaggKettle::State::Inactive;
+  timeStateChange = timeNow;
+}
+
+void StaggKettle::onLinked(unsigned long timeNow, bool direct) {
+  unsigned long elapsed = timeNow - timeLinkLost;
+  if (connectStats.connects == 0) {
+    connectStats.bootTime = elapsed;
+  } else if (elapsed > connectStats.maxTime) {
+    connectStats.maxTime = elapsed;
   }
+  connectStats.connects++;
+  if (direct) connectStats.direct++;
+  connectStats.lastTime = elapsed;
+  linked = true;
+  tryDirect = true;
+  retryDelay = 0;
+}
+
+void StaggKettle::parseEvent(const uint8_t* data, size_t length) {
+  if (data[0] >= Ekg::States || Ekg::StateBytes[data[0]] != length)
+    LOG_WARN("<StaggKettle::parseEvent> Wrong state length or type: %.*s END",
+             (int)length, data);
 
   switch (data[0]) {
     case 0:  // Power (length 3)
       if (data[1] == 1) {
         power = true;
-        if (debug)
-          Serial.println("<StaggKettle::parseEvent> On");
+        LOG_DEBUG("<StaggKettle::parseEvent> On");
       } else if (data[1] == 0) {
         power = false;
-        if (debug)
-          Serial.println("<StaggKettle::parseEvent> Off");
+        LOG_DEBUG("<StaggKettle::parseEvent> Off");
       } else {
-        Serial.print("<StaggKettle::parseEvent> Power unknown state ");
-        Serial.println(data[1]);
+        LOG_WARN("<StaggKettle::parseEvent> Power unknown state %u", data[1]);
+        break;
       }
+      acks.onPower(power, millis());
       break;
     case 1:  // Hold (length 3)
       if (data[1] == 1) {
         hold = true;
-        if (debug)
-          Serial.println("<StaggKettle::parseEvent> Hold [on]");
+        LOG_DEBUG("<StaggKettle::parseEvent> Hold [on]");
       }
       else if(data[1] == 0) {
         hold = false;
-        if (debug)
-          Serial.println("<StaggKettle::parseEvent> Hold [off]");
+        LOG_DEBUG("<StaggKettle::parseEvent> Hold [off]");
       }
       else {
-        Serial.print("<StaggKettle::parseEvent> Hold unknown state ");
-        Serial.println(data[1]);
+        LOG_WARN("<StaggKettle::parseEvent> Hold unknown state %u", data[1]);
       }
       break;
     case 2:  // Target temperature (length 4)
       targetTemp = data[1];
       units = data[2] == 1 ? TempUnits::Fahrenheit : TempUnits::Celsius;
-      if (debug) {
-        Serial.print("<StaggKettle::parseEvent> Target ");
-        Serial.print(String(targetTemp));
-        Serial.println(units == TempUnits::Fahrenheit ? "F" : "C");        
-      }
+      acks.onTargetTemp(targetTemp, millis());
+      LOG_VERBOSE("<StaggKettle::parseEvent> Target %d%c", targetTemp,
+                  units == TempUnits::Fahrenheit ? 'F' : 'C');
       break;
     case 3:  // Current temperature (length 4)
       currentTemp = data[1];
       units = data[2] == 1 ? TempUnits::Fahrenheit : TempUnits::Celsius;      
-      if (debug) {
-        Serial.print("<StaggKettle::parseEvent> Current ");
-        Serial.print(String(currentTemp));
-        Serial.println(units == TempUnits::Fahrenheit ? "F" : "C");
-      }
+      LOG_VERBOSE("<StaggKettle::parseEvent> Current %d%c", currentTemp,
+                  units == TempUnits::Fahrenheit ? 'F' : 'C');
       break;
     case 4:  // Countdown when lifted? (length 4)
       countdown = data[1];
-      if(debug) {
-        Serial.print("<StaggKettle::parseEvent> Countdown ");
-        Serial.println(String(countdown));
-      }
+      LOG_VERBOSE("<StaggKettle::parseEvent> Countdown %d", countdown);
       break;
     case 8:  // Kettle lifted (length 3)
       if (data[1] == 0) {
-        if(debug)
-          Serial.println("<StaggKettle::parseEvent> Kettle lifted!");
+        LOG_DEBUG("<StaggKettle::parseEvent> Kettle lifted!");
         lifted = true;
       } else if (data[1] == 1) {
-        if(debug)
-          Serial.println("<StaggKettle::parseEvent> Kettle on base.");
+        LOG_DEBUG("<StaggKettle::parseEvent> Kettle on base.");
         lifted = false;
       } else {
-        Serial.print("<StaggKettle::parseEvent> Lifting unknown state ");
-        Serial.println(data[1]);
+        LOG_WARN("<StaggKettle::parseEvent> Lifting unknown state %u",
+                 data[1]);
       }
       break;
     case 5:  // Unknown (length 4), usually 0x05, 0xFF, 0xFF, 0xFF
@@ -273,80 +338,49 @@ void StaggKettle::parseEvent(const uint8_t* data, size_t length, bool debug) {
           memcmp(data, unknownStates[data[0]], length) == 0)
         break;
       else if (unknownStates.count(data[0]) == 0)
-        unknownStates[data[0]] = new uint8_t[16];
+        unknownStates[data[0]] = new uint8_t[Ekg::MaxFrame];
 
       memcpy(unknownStates[data[0]], data, length);
-      Serial.print("<StaggKettle::parseEvent> Unknown state change: ");
-      for (int i = 0; i < length; i++) {
-        Serial.print(String(data[i], HEX));
-        Serial.print(" ");
-      }
-      Serial.println("END");
+      LOG_INFO("<StaggKettle::parseEvent> Unknown state change: %.*s END",
+               (int)length, data);
       break;
   }
 }
 
+// Runs on the BLE task: just queue the raw notification for loop(), so the
+// BLE stack never waits on the main loop.
 void StaggKettle::onNotify(BLERemoteCharacteristic* c, uint8_t* pData,
                            size_t length, bool isNotify) {
-  mtxState.lock();
-  if (state != StaggKettle::State::Connected) {
-    mtxState.unlock();
-    return;
-  }
+  if (capture != nullptr)
+    capture->record(captureChannel, pData, length, millis());
+  if (state != StaggKettle::State::Connected) return;
+  if (rxNotifications.push(pData, length)) TRACE_MARK(rxWait);
+  TRACE_COUNT(Notifications, 1);
+  TRACE_COUNT(NotifyBytes, length);
+}
 
-  // Pattern recognizer that expects frames of the form:
-  // 0xefdd followed by some bytes. ekgStateBytes holds the number of bytes for
-  // each state we expect. Some complicated logic here to parse frames as soon
-  // as we get them, and also skip frames in case we get fragments or bad data.
-  for (int i = 0; i < length; i++) {
-    // Look for the first frame separator byte.
-    if (bufferState == 0 && pData[i] == 0xef) {
-      bufferState = 1;
-      bufferPos = 0;
-      continue;
-    // Look for the second frame separator byte.  
-    } else if (bufferState == 1 && pData[i] == 0xdd) {
-      bufferState = 2;
-      bufferPos = 0;
-      continue;
-    // The rest are data bytes.  
-    } else if (bufferState == 2) {
-      buffer[bufferPos] = pData[i];
-      // If we have at least one byte, we know the type of state frame that we
-      // got, so check if it's in range of the states we know about, and if so,
-      // if we have that number of bytes, we have a complete frame, so parse it!
-      if (bufferPos > 0 && buffer[0] < ekgStates &&
-          bufferPos + 1 >= ekgStateBytes[buffer[0]]) {
-        this->parseEvent(buffer, bufferPos + 1, false);
-        bufferPos = 0;
-        bufferState = 1;
-      // Some weirdly long frame, probably something wrong, skip it.
-      } else if (bufferPos >= 63) {
-        bufferState = 0;
-        bufferPos = 0;
-        continue;
-      // If we see 0xef, peek forward and see if we have a frame separator. If
-      // we do, then attempt to parse what we got and move on to the next frame.
-      // Shouldn't hit this block unless something is wrong.
-      } else if (i + 1 < length && pData[i] == 0xef && pData[i + 1] == 0xdd) {
-        if (bufferPos > 1) this->parseEvent(buffer, bufferPos - 1, false);
-        bufferPos = 0;
-        bufferState = 1;
-      } else {
-        bufferPos++;
-      }
-    }
+void StaggKettle::processNotifications() {
+  const uint8_t* data;
+  size_t length;
+  TRACE_TAKE(NotifyWait, rxWait);
+  while ((data = rxNotifications.front(length)) != nullptr) {
+    TRACE_SPAN(Decode);
+    // Complete frames are parsed straight out of the ring, see EkgDecoder.
+    decoder.feed(data, length, [this](const uint8_t* frame, size_t size) {
+      TRACE_COUNT(Frames, 1);
+      this->parseEvent(frame, size);
+    });
+    rxNotifications.pop();
   }
-  mtxState.unlock();
 }
 
-void StaggKettle::sendCommand(StaggKettle::Command cmd) {
+bool StaggKettle::sendCommand(StaggKettle::Command cmd, byte value) {
   if (state != StaggKettle::State::Connected) {
-    Serial.println("<StaggKettle::sendCommand> Not connected, returning.");
-    return;
+    LOG_WARN("<StaggKettle::sendCommand> Not connected, returning.");
+    return false;
   }
 
-  Serial.println(String("<StaggKettle::sendCommand> ") + String(cmd));
+  LOG_INFO("<StaggKettle::sendCommand> %d", cmd);
   uint8_t buf[8];
   buf[0] = 0xef; buf[1] = 0xdd; // Magic, frame start
   buf[2] = 0x0a; // Command flag?
@@ -362,31 +396,35 @@ void StaggKettle::sendCommand(StaggKettle::Command cmd) {
       break;
     case StaggKettle::Command::Set:
       buf[4] = 0x01; // Temp
-      buf[5] = userTemp;
+      buf[5] = value;
       break;
     default:
-      return;
+      return false;
   }
   buf[6] = buf[3] + buf[5]; // Checksum
   buf[7] = buf[4]; // Checksum?
-  prcKettleSerial->writeValue(buf, 8);
+  {
+    TRACE_SPAN(Write);
+    prcKettleSerial->writeValue(buf, 8);
+  }
   sequence++;
+  return true;
 }
 
 void StaggKettle::setTemp(byte temp) {
-  userTemp = temp;
   if (units == TempUnits::Fahrenheit) {
-    if (userTemp > 212) userTemp = 212;
-    if (userTemp < 160) userTemp = 160;
+    if (temp > 212) temp = 212;
+    if (temp < 160) temp = 160;
   } else {
-    if (userTemp > 100) userTemp = 100;
-    if (userTemp < 65) userTemp = 65;
+    if (temp > 100) temp = 100;
+    if (temp < 65) temp = 65;
   }
-  qCommands.push(StaggKettle::Command::Set);
+  commands.push(StaggKettle::Command::Set, temp);
 }
 
 void StaggKettle::loop() {
-  mtxState.lock();
+  processNotifications();
+
   unsigned long timeNow = millis();
 
   // Handle 64bit wraparound
@@ -397,38 +435,96 @@ void StaggKettle::loop() {
     timeStateChange = timeNow;
   }
 
-  StaggKettle::Command cmd;
+  CommandQueue::Entry cmd;
+  bool retry = false;
   switch (state) {
-    case StaggKettle::State::Inactive:
-      if (timeNow - timeStateChange < StaggKettle::RetryDelay) break;
-      scan();
-      break;
     case StaggKettle::State::Scanning:
-      if (timeNow - timeStateChange < StaggKettle::RetryDelay) break;
+      if (timeNow - timeStateChange < ScanSeconds * 1000) break;
       if (pBLEScan != nullptr) {
         pBLEScan->stop();
         pBLEScan->clearResults();
       }
-      state = StaggKettle::State::Inactive;
-      timeStateChange = timeNow;
+      retryLater(timeNow);
       break;
+    case StaggKettle::State::Inactive:
+      if (timeNow - timeStateChange < retryDelay) break;
+      // Straight to the kettle we know if it answered last time, otherwise
+      // look for one.
+      if (!link.valid() || !tryDirect) {
+        if (scans) scan();
+        break;
+      }
+      // Fall through.
     case StaggKettle::State::Found:
       if (connectToServer()) {
-        Serial.println(
-            "<StaggKettle::loop> Connected to kettle, initializing...");
+        LOG_INFO("<StaggKettle::loop> Connected to kettle, initializing...");
         timeLastCommand = timeNow;
         prcKettleSerial->writeValue(ekgInit, 20);
       }
       break;
     case StaggKettle::State::Connected:
-      if (timeNow - timeLastCommand < debounceDelay || qCommands.empty()) break;
-      cmd = qCommands.front();
-      qCommands.pop();
-      sendCommand(cmd);
-      timeLastCommand = debounceDelay;
+      if (timeNow - timeLastCommand < debounceDelay) break;
+      // Unconfirmed commands get resent before anything new goes out.
+      if (acks.due(timeNow, cmd)) {
+        retry = true;
+      } else if (!commands.pop(cmd)) {
+        break;
+      }
+      if (!retry) TRACE_RECORD(CommandQueued, (timeNow - cmd.timeQueued) * 1000);
+      if (sendCommand(cmd.cmd, cmd.value))
+        acks.sent(cmd, sequence - 1, timeNow, retry);
+      timeLastCommand = timeNow;
       break;
     default:
       break;
   }
-  mtxState.unlock();
+  publishStatus();
+}
+
+// Publishes a new status snapshot if anything in it changed.
+void StaggKettle::publishStatus() {
+  Status next;
+  next.state = state;
+  strncpy(next.name, name.c_str(), sizeof(next.name) - 1);
+  next.power = power;
+  next.lifted = lifted;
+  next.hold = hold;
+  next.units = units;
+  next.currentTemp = currentTemp;
+  next.targetTemp = targetTemp;
+  next.countdown = countdown;
+  next.acks = acks.getStats();
+  next.commands = commands.getStats();
+  next.rxHighWater = rxNotifications.getHighWater();
+  next.rxOverflows = rxNotifications.getOverflows();
+  // Only a link that got as far as the kettle is worth keeping.
+  next.link = linked ? link : published.link;
+  next.connect = connectStats;
+
+  const Status& last = published;
+  StatusSnapshot::Mask changed = 0;
+  if (status.getVersion() == 0) changed = StatusSnapshot::All;
+  if (next.state != last.state) changed |= 1 << Status::StateField;
+  if (strcmp(next.name, last.name) != 0) changed |= 1 << Status::NameField;
+  if (next.power != last.power) changed |= 1 << Status::PowerField;
+  if (next.lifted != last.lifted) changed |= 1 << Status::LiftedField;
+  if (next.hold != last.hold) changed |= 1 << Status::HoldField;
+  if (next.units != last.units) changed |= 1 << Status::UnitsField;
+  if (next.currentTemp != last.currentTemp)
+    changed |= 1 << Status::CurrentTempField;
+  if (next.targetTemp != last.targetTemp)
+    changed |= 1 << Status::TargetTempField;
+  if (next.countdown != last.countdown) changed |= 1 << Status::CountdownField;
+  if (memcmp(&next.acks, &last.acks, sizeof(next.acks)) != 0)
+    changed |= 1 << Status::AcksField;
+  if (memcmp(&next.commands, &last.commands, sizeof(next.commands)) != 0 ||
+      next.rxHighWater != last.rxHighWater ||
+      next.rxOverflows != last.rxOverflows)
+    changed |= 1 << Status::DiagnosticsField;
+  if (next.link != last.link) changed |= 1 << Status::LinkField;
+  if (memcmp(&next.connect, &last.connect, sizeof(next.connect)) != 0)
+    changed |= 1 << Status::ConnectField;
+  if (!changed) return;
+  status.publish(next, changed);
+  published = next;
 }
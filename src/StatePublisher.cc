@@ -0,0 +1,225 @@
+#include "StatePublisher.hh"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "Cbor.hh"
+
+int StatePublisher::add(const char* name, bool isBool,
+                        unsigned long maxLatency) {
+  if (count >= MaxFields) return -1;
+  Field& f = fields[count];
+  f.name = name;
+  f.isBool = isBool;
+  f.maxLatency = maxLatency;
+  f.value = f.acked = f.sentValue = 0;
+  f.known = false;
+  f.sending = false;
+  f.dirty = true;
+  f.timeDirty = 0;
+  return count++;
+}
+
+int StatePublisher::addBool(const char* name, unsigned long maxLatency) {
+  return add(name, true, maxLatency);
+}
+
+int StatePublisher::addInt(const char* name, unsigned long maxLatency) {
+  return add(name, false, maxLatency);
+}
+
+void StatePublisher::set(int field, long value, unsigned long timeNow) {
+  if (field < 0 || field >= count) return;
+  Field& f = fields[field];
+  if (value != f.value) stats.changes++;
+  f.value = value;
+  if (f.known && value == f.acked) {
+    f.dirty = false;
+  } else if (!f.dirty) {
+    f.dirty = true;
+    f.timeDirty = timeNow;
+  }
+}
+
+bool StatePublisher::due(unsigned long timeNow) const {
+  if (uploaded && timeNow - timeLastUpload < minInterval) return false;
+  for (int i = 0; i < count; i++) {
+    if (fields[i].dirty && timeNow - fields[i].timeDirty >= fields[i].maxLatency)
+      return true;
+  }
+  return false;
+}
+
+void StatePublisher::append(std::string& json, const Field& f, long value,
+                            const char* path) {
+  char buf[16];
+  if (json.size() > 1) json += ',';
+  json += '"';
+  json += path;
+  json += f.name;
+  json += "\":";
+  if (f.isBool) {
+    json += value ? "true" : "false";
+  } else {
+    snprintf(buf, sizeof(buf), "%ld", value);
+    json += buf;
+  }
+}
+
+int StatePublisher::select() {
+  int n = 0;
+  for (int i = 0; i < count; i++) {
+    Field& f = fields[i];
+    f.sending = f.dirty;
+    if (!f.sending) continue;
+    f.sentValue = f.value;
+    n++;
+  }
+  return n;
+}
+
+std::string StatePublisher::delta(unsigned long timeNow) {
+  char lastUpdated[32];
+  snprintf(lastUpdated, sizeof(lastUpdated), ",\"lastUpdated\":\"%lu\"}",
+           timeNow);
+
+  select();
+  std::string json = "{", full = "{";
+  for (int i = 0; i < count; i++) {
+    const Field& f = fields[i];
+    append(full, f, f.value);
+    if (f.sending) append(json, f, f.value);
+  }
+  // lastUpdated always goes along, so the object is never empty.
+  json += json.size() > 1 ? lastUpdated : lastUpdated + 1;
+  full += lastUpdated;
+
+  stats.bytesSent += json.size();
+  stats.fullBytes += full.size();
+  return json;
+}
+
+void StatePublisher::write(CborWriter& out, const Field& f, const char* key) {
+  out.text(key != nullptr ? key : f.name);
+  if (f.isBool)
+    out.boolean(f.value);
+  else
+    out.integer(f.value);
+}
+
+size_t StatePublisher::delta(uint8_t* buffer, size_t capacity,
+                             unsigned long timeNow) {
+  // A string, as in the JSON version, so both land the same in the database.
+  char lastUpdated[16];
+  snprintf(lastUpdated, sizeof(lastUpdated), "%lu", timeNow);
+
+  int n = select();
+  CborWriter out(buffer, capacity), full(nullptr, SIZE_MAX);
+  out.map(n + 1);
+  full.map(count + 1);
+  for (int i = 0; i < count; i++) {
+    const Field& f = fields[i];
+    write(full, f);
+    if (f.sending) write(out, f);
+  }
+  out.text("lastUpdated");
+  out.text(lastUpdated);
+  full.text("lastUpdated");
+  full.text(lastUpdated);
+
+  if (!out.ok()) {
+    for (int i = 0; i < count; i++) fields[i].sending = false;
+    return 0;
+  }
+  stats.bytesSent += out.size();
+  stats.fullBytes += full.size();
+  return out.size();
+}
+
+bool StatePublisher::pending() const {
+  for (int i = 0; i < count; i++)
+    if (fields[i].dirty) return true;
+  return false;
+}
+
+void StatePublisher::append(std::string& json, const char* path,
+                            unsigned long timeNow) {
+  char lastUpdated[16];
+  snprintf(lastUpdated, sizeof(lastUpdated), "%lu\"", timeNow);
+  std::string entry = std::string("\"") + path + "lastUpdated\":\"" +
+                      lastUpdated;
+
+  size_t start = json.size();
+  std::string full = "{";
+  for (int i = 0; i < count; i++) {
+    const Field& f = fields[i];
+    append(full, f, f.value, path);
+    if (f.sending) append(json, f, f.value, path);
+  }
+  // lastUpdated always goes along, as in delta().
+  if (json.size() > 1) json += ',';
+  json += entry;
+  full += ',' + entry;
+
+  stats.bytesSent += json.size() - start;
+  stats.fullBytes += full.size() - 1;
+}
+
+bool StatePublisher::append(CborWriter& out, const char* path,
+                            unsigned long timeNow) {
+  char lastUpdated[16];
+  snprintf(lastUpdated, sizeof(lastUpdated), "%lu", timeNow);
+
+  char key[MaxKey];
+  size_t start = out.size();
+  CborWriter full(nullptr, SIZE_MAX);
+  for (int i = 0; i < count; i++) {
+    const Field& f = fields[i];
+    if ((size_t)snprintf(key, sizeof(key), "%s%s", path, f.name) >=
+        sizeof(key))
+      return false;
+    write(full, f, key);
+    if (f.sending) write(out, f, key);
+  }
+  if ((size_t)snprintf(key, sizeof(key), "%slastUpdated", path) >=
+      sizeof(key))
+    return false;
+  out.text(key);
+  out.text(lastUpdated);
+  full.text(key);
+  full.text(lastUpdated);
+  if (!out.ok()) return false;
+  stats.bytesSent += out.size() - start;
+  stats.fullBytes += full.size();
+  return true;
+}
+
+void StatePublisher::acknowledge(bool ok, unsigned long timeNow) {
+  timeLastUpload = timeNow;
+  uploaded = true;
+  if (ok)
+    stats.uploads++;
+  else
+    stats.failures++;
+
+  for (int i = 0; i < count; i++) {
+    Field& f = fields[i];
+    if (!f.sending) continue;
+    f.sending = false;
+    if (!ok) continue;
+    stats.fieldsSent++;
+    f.acked = f.sentValue;
+    f.known = true;
+    f.dirty = f.value != f.acked;
+    if (f.dirty) f.timeDirty = timeNow;
+  }
+}
+
+void StatePublisher::resync() {
+  for (int i = 0; i < count; i++) {
+    if (!fields[i].known) continue;
+    fields[i].known = false;
+    fields[i].dirty = true;
+    fields[i].timeDirty = 0;
+  }
+}
@@ -0,0 +1,158 @@
+#include "StatusScreen.hh"
+
+#include <stdio.h>
+#include <string.h>
+
+// 5x7 glyphs for ' ' to '~', then a degree sign for 0x7f. Each byte is a
+// column with its top pixel in bit 0, as the SSD1306 takes them.
+static const uint8_t Font[96][5] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x5f, 0x00, 0x00},
+    {0x00, 0x07, 0x00, 0x07, 0x00}, {0x14, 0x7f, 0x14, 0x7f, 0x14},
+    {0x24, 0x2a, 0x7f, 0x2a, 0x12}, {0x23, 0x13, 0x08, 0x64, 0x62},
+    {0x36, 0x49, 0x55, 0x22, 0x50}, {0x00, 0x05, 0x03, 0x00, 0x00},
+    {0x00, 0x1c, 0x22, 0x41, 0x00}, {0x00, 0x41, 0x22, 0x1c, 0x00},
+    {0x08, 0x2a, 0x1c, 0x2a, 0x08}, {0x08, 0x08, 0x3e, 0x08, 0x08},
+    {0x00, 0x50, 0x30, 0x00, 0x00}, {0x08, 0x08, 0x08, 0x08, 0x08},
+    {0x00, 0x60, 0x60, 0x00, 0x00}, {0x20, 0x10, 0x08, 0x04, 0x02},
+    {0x3e, 0x51, 0x49, 0x45, 0x3e}, {0x00, 0x42, 0x7f, 0x40, 0x00},
+    {0x42, 0x61, 0x51, 0x49, 0x46}, {0x21, 0x41, 0x45, 0x4b, 0x31},
+    {0x18, 0x14, 0x12, 0x7f, 0x10}, {0x27, 0x45, 0x45, 0x45, 0x39},
+    {0x3c, 0x4a, 0x49, 0x49, 0x30}, {0x01, 0x71, 0x09, 0x05, 0x03},
+    {0x36, 0x49, 0x49, 0x49, 0x36}, {0x06, 0x49, 0x49, 0x29, 0x1e},
+    {0x00, 0x36, 0x36, 0x00, 0x00}, {0x00, 0x56, 0x36, 0x00, 0x00},
+    {0x00, 0x08, 0x14, 0x22, 0x41}, {0x14, 0x14, 0x14, 0x14, 0x14},
+    {0x41, 0x22, 0x14, 0x08, 0x00}, {0x02, 0x01, 0x51, 0x09, 0x06},
+    {0x32, 0x49, 0x79, 0x41, 0x3e}, {0x7e, 0x11, 0x11, 0x11, 0x7e},
+    {0x7f, 0x49, 0x49, 0x49, 0x36}, {0x3e, 0x41, 0x41, 0x41, 0x22},
+    {0x7f, 0x41, 0x41, 0x22, 0x1c}, {0x7f, 0x49, 0x49, 0x49, 0x41},
+    {0x7f, 0x09, 0x09, 0x01, 0x01}, {0x3e, 0x41, 0x41, 0x51, 0x32},
+    {0x7f, 0x08, 0x08, 0x08, 0x7f}, {0x00, 0x41, 0x7f, 0x41, 0x00},
+    {0x20, 0x40, 0x41, 0x3f, 0x01}, {0x7f, 0x08, 0x14, 0x22, 0x41},
+    {0x7f, 0x40, 0x40, 0x40, 0x40}, {0x7f, 0x02, 0x04, 0x02, 0x7f},
+    {0x7f, 0x04, 0x08, 0x10, 0x7f}, {0x3e, 0x41, 0x41, 0x41, 0x3e},
+    {0x7f, 0x09, 0x09, 0x09, 0x06}, {0x3e, 0x41, 0x51, 0x21, 0x5e},
+    {0x7f, 0x09, 0x19, 0x29, 0x46}, {0x46, 0x49, 0x49, 0x49, 0x31},
+    {0x01, 0x01, 0x7f, 0x01, 0x01}, {0x3f, 0x40, 0x40, 0x40, 0x3f},
+    {0x1f, 0x20, 0x40, 0x20, 0x1f}, {0x7f, 0x20, 0x18, 0x20, 0x7f},
+    {0x63, 0x14, 0x08, 0x14, 0x63}, {0x03, 0x04, 0x78, 0x04, 0x03},
+    {0x61, 0x51, 0x49, 0x45, 0x43}, {0x00, 0x00, 0x7f, 0x41, 0x41},
+    {0x02, 0x04, 0x08, 0x10, 0x20}, {0x41, 0x41, 0x7f, 0x00, 0x00},
+    {0x04, 0x02, 0x01, 0x02, 0x04}, {0x40, 0x40, 0x40, 0x40, 0x40},
+    {0x00, 0x01, 0x02, 0x04, 0x00}, {0x20, 0x54, 0x54, 0x54, 0x78},
+    {0x7f, 0x48, 0x44, 0x44, 0x38}, {0x38, 0x44, 0x44, 0x44, 0x20},
+    {0x38, 0x44, 0x44, 0x48, 0x7f}, {0x38, 0x54, 0x54, 0x54, 0x18},
+    {0x08, 0x7e, 0x09, 0x01, 0x02}, {0x08, 0x14, 0x54, 0x54, 0x3c},
+    {0x7f, 0x08, 0x04, 0x04, 0x78}, {0x00, 0x44, 0x7d, 0x40, 0x00},
+    {0x20, 0x40, 0x44, 0x3d, 0x00}, {0x00, 0x7f, 0x10, 0x28, 0x44},
+    {0x00, 0x41, 0x7f, 0x40, 0x00}, {0x7c, 0x04, 0x18, 0x04, 0x78},
+    {0x7c, 0x08, 0x04, 0x04, 0x78}, {0x38, 0x44, 0x44, 0x44, 0x38},
+    {0x7c, 0x14, 0x14, 0x14, 0x08}, {0x08, 0x14, 0x14, 0x18, 0x7c},
+    {0x7c, 0x08, 0x04, 0x04, 0x08}, {0x48, 0x54, 0x54, 0x54, 0x20},
+    {0x04, 0x3f, 0x44, 0x40, 0x20}, {0x3c, 0x40, 0x40, 0x20, 0x7c},
+    {0x1c, 0x20, 0x40, 0x20, 0x1c}, {0x3c, 0x40, 0x30, 0x40, 0x3c},
+    {0x44, 0x28, 0x10, 0x28, 0x44}, {0x0c, 0x50, 0x50, 0x50, 0x3c},
+    {0x44, 0x64, 0x54, 0x4c, 0x44}, {0x00, 0x08, 0x36, 0x41, 0x00},
+    {0x00, 0x00, 0x7f, 0x00, 0x00}, {0x00, 0x41, 0x36, 0x08, 0x00},
+    {0x08, 0x04, 0x08, 0x10, 0x08}, {0x00, 0x06, 0x09, 0x09, 0x06},
+};
+
+// Lines of the layout.
+enum Line {
+  StateLine = 0,
+  PowerLine = 1,
+  CurrentLine = 3,
+  TargetLine = 4,
+  FillLine = 6,
+  PromptLine = 7
+};
+
+void StatusScreen::text(int page, int column, const char* s) {
+  uint8_t* row = frame[page];
+  int x = column * GlyphWidth;
+  memset(row + x, 0, Width - x);
+  for (; *s && x + GlyphWidth <= Width; s++, x += GlyphWidth) {
+    uint8_t c = *s;
+    if (c < ' ' || c > 0x7f) c = '?';
+    memcpy(row + x, Font[c - ' '], 5);
+  }
+}
+
+void StatusScreen::showKettle(const StaggKettle::Status& kettle) {
+  char line[Columns + 1];
+  bool connected = kettle.state == StaggKettle::Connected;
+  snprintf(line, sizeof(line), "%s%s", StaggKettle::StateStrings[kettle.state],
+           connected && kettle.lifted ? ", lifted" : "");
+  text(StateLine, 0, line);
+  if (!connected) {
+    text(PowerLine, 0, "");
+    text(CurrentLine, 0, "");
+    text(TargetLine, 0, "");
+    return;
+  }
+  char unit = kettle.units == StaggKettle::Fahrenheit ? 'F' : 'C';
+  snprintf(line, sizeof(line), "Power: %s%s", kettle.power ? "on" : "off",
+           kettle.hold ? ", hold" : "");
+  text(PowerLine, 0, line);
+  snprintf(line, sizeof(line), "Now:    %d\x7f%c", kettle.currentTemp, unit);
+  text(CurrentLine, 0, line);
+  snprintf(line, sizeof(line), "Target: %d\x7f%c", kettle.targetTemp, unit);
+  text(TargetLine, 0, line);
+}
+
+void StatusScreen::showScale(int fill, float calOunces) {
+  char line[Columns + 1];
+  if (calOunces < 0) {
+    snprintf(line, sizeof(line), "Fill: %doz", fill);
+    text(FillLine, 0, line);
+    text(PromptLine, 0, "");
+  } else {
+    snprintf(line, sizeof(line), "Fill to exactly %.0foz", calOunces);
+    text(FillLine, 0, line);
+    text(PromptLine, 0, "then click button");
+  }
+}
+
+bool StatusScreen::send(uint8_t control, const uint8_t* bytes, size_t n) {
+  while (n > 0) {
+    size_t chunk = n < Chunk ? n : Chunk;
+    if (!bus.write(control, bytes, chunk)) return false;
+    stats.bytes += chunk + 2;
+    stats.transactions++;
+    bytes += chunk;
+    n -= chunk;
+  }
+  return true;
+}
+
+bool StatusScreen::flush() {
+  bool sent = false;
+  for (int page = 0; page < Pages; page++) {
+    int first = 0;
+    int last = Width - 1;
+    if (valid) {
+      while (first < Width && frame[page][first] == shown[page][first]) first++;
+      if (first == Width) continue;
+      while (frame[page][last] == shown[page][last]) last--;
+    }
+    // A window of the changed columns on this page; the panel's in
+    // horizontal addressing mode, so the data fills it in order.
+    const uint8_t window[] = {0x21, (uint8_t)first, (uint8_t)last,
+                              0x22, (uint8_t)page,  (uint8_t)page};
+    if (!send(0x00, window, sizeof(window)) ||
+        !send(0x40, &frame[page][first], last - first + 1))
+      return false;
+    memcpy(&shown[page][first], &frame[page][first], last - first + 1);
+    stats.pages++;
+    sent = true;
+  }
+  valid = true;
+  if (sent) stats.flushes++;
+  return true;
+}
+
+bool WireDisplayBus::write(uint8_t control, const uint8_t* bytes, size_t n) {
+  wire.beginTransmission(address);
+  wire.write(control);
+  wire.write(bytes, n);
+  return wire.endTransmission() == 0;
+}
@@ -0,0 +1,62 @@
+#include "TcpConnect.hh"
+
+#include <Arduino.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+bool tcpWait(int fd, bool write, unsigned long timeout) {
+  fd_set set;
+  FD_ZERO(&set);
+  FD_SET(fd, &set);
+  struct timeval tv;
+  tv.tv_sec = timeout / 1000;
+  tv.tv_usec = timeout % 1000 * 1000;
+  return select(fd + 1, write ? nullptr : &set, write ? &set : nullptr,
+                nullptr, &tv) > 0;
+}
+
+// Connects fd without blocking past the deadline; the outcome arrives as the
+// socket turning writable, with its error in SO_ERROR.
+static bool connectBefore(int fd, const struct addrinfo* ai,
+                          unsigned long timeStart, unsigned long timeout) {
+  if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) return true;
+  if (errno != EINPROGRESS) return false;
+  unsigned long elapsed = millis() - timeStart;
+  if (elapsed >= timeout || !tcpWait(fd, true, timeout - elapsed))
+    return false;
+  int error = 0;
+  socklen_t length = sizeof(error);
+  return getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 &&
+         error == 0;
+}
+
+int tcpConnect(const char* host, uint16_t port, unsigned long timeout) {
+  struct addrinfo hints = {}, *res;
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  char portText[6];
+  snprintf(portText, sizeof(portText), "%u", port);
+  if (getaddrinfo(host, portText, &hints, &res) != 0) return -1;
+  unsigned long timeStart = millis();
+  int fd = -1;
+  for (struct addrinfo* ai = res; ai != nullptr; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) continue;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    if (connectBefore(fd, ai, timeStart, timeout)) break;
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  if (fd < 0) return -1;
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return fd;
+}
@@ -0,0 +1,125 @@
+#include "TelemetryRelay.hh"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "Log.hh"
+
+int TelemetryRelay::send(const char* method, const char* path,
+                         const uint8_t* body, size_t length) {
+  size_t responseLength;
+  return request(method, path, body, length, nullptr, 0, responseLength);
+}
+
+int TelemetryRelay::get(const char* path, uint8_t* response, size_t capacity,
+                        size_t& length) {
+  return request("GET", path, nullptr, 0, response, capacity, length);
+}
+
+bool TelemetryRelay::readLine(char* line, size_t capacity) {
+  size_t n = 0;
+  unsigned long timeStart = millis();
+  while (millis() - timeStart < Timeout) {
+    if (client.available() <= 0) {
+      if (!client.connected()) return false;
+      delay(1);
+      continue;
+    }
+    uint8_t c;
+    if (client.read(&c, 1) != 1) continue;
+    if (c == '\n') {
+      if (n > 0 && line[n - 1] == '\r') n--;
+      line[n] = 0;
+      return true;
+    }
+    if (n < capacity - 1) line[n++] = c;
+  }
+  return false;
+}
+
+bool TelemetryRelay::readBytes(uint8_t* data, size_t length) {
+  uint8_t discard[32];
+  unsigned long timeStart = millis();
+  while (length > 0 && millis() - timeStart < Timeout) {
+    if (client.available() <= 0) {
+      if (!client.connected()) return false;
+      delay(1);
+      continue;
+    }
+    // Without a buffer, read into scratch space and drop it.
+    int n = data ? client.read(data, length)
+                 : client.read(discard, length < sizeof(discard)
+                                            ? length
+                                            : sizeof(discard));
+    if (n <= 0) continue;
+    if (data) data += n;
+    length -= n;
+  }
+  return length == 0;
+}
+
+int TelemetryRelay::request(const char* method, const char* path,
+                            const uint8_t* body, size_t length,
+                            uint8_t* response, size_t capacity,
+                            size_t& responseLength) {
+  responseLength = 0;
+  // Reuse the connection while the relay keeps it open; reconnect once if a
+  // kept-alive connection turns out to be stale.
+  for (int attempt = 0; attempt < 2; attempt++) {
+    bool reused = client.connected();
+    if (!reused) {
+      if (!client.connect(host, port)) {
+        LOG_WARN("<TelemetryRelay::request> Failed to connect to %s", host);
+        return 0;
+      }
+      connects++;
+    }
+
+    char header[192];
+    int n = snprintf(header, sizeof(header),
+                     "%s %s.cbor HTTP/1.1\r\nHost: %s\r\n"
+                     "Content-Type: application/cbor\r\n"
+                     "Content-Length: %u\r\n\r\n",
+                     method, path, host, (unsigned int)length);
+    if (n <= 0 || (size_t)n >= sizeof(header)) return 0;
+    client.write((const uint8_t*)header, n);
+    if (length > 0) client.write(body, length);
+    bytes += n + length;
+
+    char line[128];
+    if (!readLine(line, sizeof(line)) || strncmp(line, "HTTP/", 5) != 0) {
+      client.stop();
+      if (reused) continue;
+      return 0;
+    }
+    requests++;
+    int code = atoi(strchr(line, ' ') ? strchr(line, ' ') + 1 : line);
+    size_t contentLength = 0;
+    bool close = false;
+    while (readLine(line, sizeof(line)) && line[0]) {
+      char* colon = strchr(line, ':');
+      if (!colon) continue;
+      *colon = 0;
+      const char* value = colon + 1;
+      while (*value == ' ') value++;
+      if (strcasecmp(line, "Content-Length") == 0)
+        contentLength = strtoul(value, nullptr, 10);
+      else if (strcasecmp(line, "Connection") == 0)
+        close = strcasecmp(value, "close") == 0;
+    }
+
+    // Keep what fits, drain the rest so the connection stays usable.
+    size_t keep = response && contentLength <= capacity ? contentLength : 0;
+    if (!readBytes(response, keep) ||
+        !readBytes(nullptr, contentLength - keep)) {
+      client.stop();
+      return 0;
+    }
+    responseLength = keep;
+    if (close) client.stop();
+    return code;
+  }
+  return 0;
+}
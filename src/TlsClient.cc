@@ -0,0 +1,259 @@
+#include "TlsClient.hh"
+
+#include <stdio.h>
+
+#include <esp_heap_caps.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/platform.h>
+#include <mbedtls/ssl.h>
+
+#include <string>
+
+#include "Log.hh"
+#include "TcpConnect.hh"
+
+// Allocations at least this big are TLS record buffers (16KB in and out per
+// connection with the default config); those go to PSRAM.
+static const size_t PsramThreshold = 4096;
+static const unsigned long WriteTimeout = 10000;
+
+struct TlsClient::Impl {
+  mbedtls_net_context net;
+  mbedtls_ssl_context ssl;
+  mbedtls_ssl_config conf;
+  mbedtls_entropy_context entropy;
+  mbedtls_ctr_drbg_context drbg;
+  mbedtls_x509_crt ca;
+  mbedtls_ssl_session session;
+  bool configured = false;
+  bool open = false;
+  bool haveSession = false;
+  std::string sessionHost;
+  int peeked = -1;
+
+  Impl() {
+    mbedtls_net_init(&net);
+    mbedtls_ssl_init(&ssl);
+    mbedtls_ssl_config_init(&conf);
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&drbg);
+    mbedtls_x509_crt_init(&ca);
+    mbedtls_ssl_session_init(&session);
+  }
+  ~Impl() {
+    mbedtls_net_free(&net);
+    mbedtls_ssl_free(&ssl);
+    mbedtls_ssl_config_free(&conf);
+    mbedtls_ctr_drbg_free(&drbg);
+    mbedtls_entropy_free(&entropy);
+    mbedtls_x509_crt_free(&ca);
+    mbedtls_ssl_session_free(&session);
+  }
+};
+
+TlsClient::TlsClient() : impl(new Impl) {}
+
+TlsClient::~TlsClient() {
+  stop();
+  delete impl;
+}
+
+#if defined(MBEDTLS_PLATFORM_MEMORY) && !defined(MBEDTLS_PLATFORM_CALLOC_MACRO)
+static void* tlsCalloc(size_t n, size_t size) {
+  if (n * size >= PsramThreshold) {
+    void* p = heap_caps_calloc(n, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (p) return p;
+  }
+  return heap_caps_calloc(n, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+}
+
+bool TlsClient::usePsram() {
+  if (heap_caps_get_total_size(MALLOC_CAP_SPIRAM) == 0) return false;
+  mbedtls_platform_set_calloc_free(tlsCalloc, heap_caps_free);
+  return true;
+}
+#else
+// The framework's mbedTLS was built with a fixed allocator; only
+// CONFIG_MBEDTLS_EXTERNAL_MEM_ALLOC in its sdkconfig can move it.
+bool TlsClient::usePsram() { return false; }
+#endif
+
+void TlsClient::forgetSession() {
+  mbedtls_ssl_session_free(&impl->session);
+  mbedtls_ssl_session_init(&impl->session);
+  impl->haveSession = false;
+}
+
+void TlsClient::handshakeDone(bool resumed, unsigned long timeStart) {
+  unsigned long time = millis() - timeStart;
+  stats.lastHandshakeTime = time;
+  if (time > stats.maxHandshakeTime) stats.maxHandshakeTime = time;
+  if (resumed) {
+    stats.resumed++;
+    stats.totalResumedTime += time;
+  } else {
+    stats.full++;
+    stats.totalFullTime += time;
+  }
+}
+
+int TlsClient::connect(IPAddress ip, uint16_t port) {
+  return connect(ip.toString().c_str(), port);
+}
+
+int TlsClient::connect(const char* host, uint16_t port) {
+  stop();
+  Impl& s = *impl;
+  if (!s.configured) {
+    if (mbedtls_ctr_drbg_seed(&s.drbg, mbedtls_entropy_func, &s.entropy,
+                              nullptr, 0) != 0 ||
+        mbedtls_ssl_config_defaults(&s.conf, MBEDTLS_SSL_IS_CLIENT,
+                                    MBEDTLS_SSL_TRANSPORT_STREAM,
+                                    MBEDTLS_SSL_PRESET_DEFAULT) != 0)
+      return 0;
+    mbedtls_ssl_conf_rng(&s.conf, mbedtls_ctr_drbg_random, &s.drbg);
+    if (caCert && !insecure &&
+        mbedtls_x509_crt_parse(&s.ca, (const unsigned char*)caCert,
+                               strlen(caCert) + 1) == 0) {
+      mbedtls_ssl_conf_ca_chain(&s.conf, &s.ca, nullptr);
+      mbedtls_ssl_conf_authmode(&s.conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    } else {
+      mbedtls_ssl_conf_authmode(&s.conf, MBEDTLS_SSL_VERIFY_NONE);
+    }
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    mbedtls_ssl_conf_session_tickets(&s.conf,
+                                     MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+    if (mbedtls_ssl_setup(&s.ssl, &s.conf) != 0) return 0;
+    s.configured = true;
+  } else {
+    mbedtls_ssl_session_reset(&s.ssl);
+  }
+
+  // mbedtls_net_connect() would block for as long as the stack lets it; the
+  // socket comes non-blocking instead, so every handshake step returns too.
+  unsigned long timeStart = millis();
+  s.net.fd = tcpConnect(host, port, connectTimeout);
+  if (s.net.fd < 0) {
+    LOG_WARN("<TlsClient::connect> Could not connect to %s:%u", host, port);
+    stats.failed++;
+    return 0;
+  }
+  mbedtls_ssl_set_hostname(&s.ssl, host);
+  mbedtls_ssl_set_bio(&s.ssl, &s.net, mbedtls_net_send, mbedtls_net_recv,
+                      nullptr);
+  if (s.haveSession && s.sessionHost == host)
+    mbedtls_ssl_set_session(&s.ssl, &s.session);
+
+  // Step through the handshake to see which way it went: a resumed one goes
+  // from ServerHello straight to ChangeCipherSpec, without a certificate.
+  bool full = false;
+  while (s.ssl.state != MBEDTLS_SSL_HANDSHAKE_OVER) {
+    int ret = mbedtls_ssl_handshake_step(&s.ssl);
+    if (s.ssl.state == MBEDTLS_SSL_SERVER_CERTIFICATE) full = true;
+    unsigned long elapsed = millis() - timeStart;
+    if (ret == 0 && elapsed < connectTimeout) continue;
+    if ((ret == MBEDTLS_ERR_SSL_WANT_READ ||
+         ret == MBEDTLS_ERR_SSL_WANT_WRITE) &&
+        elapsed < connectTimeout) {
+      tcpWait(s.net.fd, ret == MBEDTLS_ERR_SSL_WANT_WRITE,
+              connectTimeout - elapsed);
+      continue;
+    }
+    LOG_WARN("<TlsClient::connect> Handshake failed: %d", ret);
+    mbedtls_net_free(&s.net);
+    stats.failed++;
+    return 0;
+  }
+  handshakeDone(!full, timeStart);
+
+  forgetSession();
+  if (mbedtls_ssl_get_session(&s.ssl, &s.session) == 0) {
+    s.haveSession = true;
+    s.sessionHost = host;
+  }
+  s.open = true;
+  s.peeked = -1;
+  return 1;
+}
+
+size_t TlsClient::write(const uint8_t* buf, size_t size) {
+  if (!impl->open) return 0;
+  size_t written = 0;
+  unsigned long timeStart = millis();
+  while (written < size && millis() - timeStart < WriteTimeout) {
+    int ret = mbedtls_ssl_write(&impl->ssl, buf + written, size - written);
+    if (ret > 0) {
+      written += ret;
+    } else if (ret != MBEDTLS_ERR_SSL_WANT_READ &&
+               ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+      stop();
+      break;
+    } else {
+      delay(1);
+    }
+  }
+  return written;
+}
+
+int TlsClient::available() {
+  if (!impl->open) return 0;
+  // Process whatever records arrived, then report decrypted bytes.
+  int ret = mbedtls_ssl_read(&impl->ssl, nullptr, 0);
+  if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ &&
+      ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+    int pending = (impl->peeked >= 0) + mbedtls_ssl_get_bytes_avail(&impl->ssl);
+    if (pending == 0) stop();
+    return pending;
+  }
+  return (impl->peeked >= 0) + mbedtls_ssl_get_bytes_avail(&impl->ssl);
+}
+
+int TlsClient::read(uint8_t* buf, size_t size) {
+  if (size == 0) return 0;
+  int n = 0;
+  if (impl->peeked >= 0) {
+    buf[n++] = impl->peeked;
+    impl->peeked = -1;
+    if (--size == 0) return n;
+  }
+  if (!impl->open) return n ? n : -1;
+  int ret = mbedtls_ssl_read(&impl->ssl, buf + n, size);
+  if (ret > 0) return n + ret;
+  if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE)
+    stop();
+  return n ? n : -1;
+}
+
+int TlsClient::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int TlsClient::peek() {
+  if (impl->peeked < 0) impl->peeked = read();
+  return impl->peeked;
+}
+
+void TlsClient::stop() {
+  if (!impl->open) return;
+  // Keep the session, tickets may have been updated along the way.
+  mbedtls_ssl_session fresh;
+  mbedtls_ssl_session_init(&fresh);
+  if (mbedtls_ssl_get_session(&impl->ssl, &fresh) == 0) {
+    mbedtls_ssl_session_free(&impl->session);
+    impl->session = fresh;
+  } else {
+    mbedtls_ssl_session_free(&fresh);
+  }
+  mbedtls_ssl_close_notify(&impl->ssl);
+  mbedtls_net_free(&impl->net);
+  impl->open = false;
+}
+
+uint8_t TlsClient::connected() {
+  if (impl->open) available();
+  return impl->open || impl->peeked >= 0;
+}
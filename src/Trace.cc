@@ -0,0 +1,125 @@
+#include "Trace.hh"
+
+#include <stdio.h>
+
+#include "Cbor.hh"
+
+namespace Trace {
+
+Histogram histograms[Probes];
+std::atomic<uint32_t> counters[Counters];
+
+static const char* const probeNames[Probes] = {
+    "notifyWait", "decode",       "commandHandoff", "commandQueued",
+    "write",      "cloudRequest", "loopPass",       "adcSample"};
+static const char* const counterNames[Counters] = {"notifications",
+                                                    "notifyBytes", "frames"};
+
+const char* name(Probe probe) { return probeNames[probe]; }
+const char* name(Counter counter) { return counterNames[counter]; }
+
+void Histogram::read(LatencyHistogram& out) const {
+  uint32_t largest = max.load(std::memory_order_relaxed);
+  for (int i = 0; i < LatencyHistogram::Buckets; i++)
+    out.add(i, counts[i].load(std::memory_order_relaxed), largest);
+}
+
+void Histogram::reset() {
+  for (std::atomic<uint32_t>& c : counts) c.store(0, std::memory_order_relaxed);
+  max.store(0, std::memory_order_relaxed);
+}
+
+void print(HardwareSerial& out) {
+  for (int i = 0; i < Probes; i++) {
+    LatencyHistogram h;
+    histograms[i].read(h);
+    if (h.getCount() == 0) continue;
+    out.print("Trace ");
+    out.print(probeNames[i]);
+    out.print(" us p50/p99/max: ");
+    out.print(h.percentile(0.5));
+    out.print("/");
+    out.print(h.percentile(0.99));
+    out.print("/");
+    out.print(h.getMax());
+    out.print(" over ");
+    out.println(h.getCount());
+  }
+  out.print("Trace counts:");
+  for (int i = 0; i < Counters; i++) {
+    out.print(" ");
+    out.print(counterNames[i]);
+    out.print(" ");
+    out.print(counters[i].load(std::memory_order_relaxed));
+  }
+  out.println();
+}
+
+void appendJson(std::string& body, const char* key) {
+  char buf[96];
+  if (body.size() > 1) body += ',';
+  body += '"';
+  body += key;
+  body += "\":{";
+  bool first = true;
+  for (int i = 0; i < Probes; i++) {
+    LatencyHistogram h;
+    histograms[i].read(h);
+    if (h.getCount() == 0) continue;
+    snprintf(buf, sizeof(buf),
+             "%s\"%s\":{\"p50\":%u,\"p99\":%u,\"max\":%u,\"n\":%u}",
+             first ? "" : ",", probeNames[i], (unsigned)h.percentile(0.5),
+             (unsigned)h.percentile(0.99), (unsigned)h.getMax(),
+             (unsigned)h.getCount());
+    body += buf;
+    first = false;
+  }
+  for (int i = 0; i < Counters; i++) {
+    snprintf(buf, sizeof(buf), "%s\"%s\":%u", first ? "" : ",",
+             counterNames[i],
+             (unsigned)counters[i].load(std::memory_order_relaxed));
+    body += buf;
+    first = false;
+  }
+  body += '}';
+}
+
+void appendCbor(CborWriter& out, const char* key) {
+  // Two passes rather than a histogram per probe on the caller's stack.
+  int recorded = 0;
+  for (int i = 0; i < Probes; i++) {
+    LatencyHistogram h;
+    histograms[i].read(h);
+    if (h.getCount() > 0) recorded++;
+  }
+  out.text(key);
+  out.map(recorded + Counters);
+  for (int i = 0; i < Probes && recorded > 0; i++) {
+    LatencyHistogram h;
+    histograms[i].read(h);
+    if (h.getCount() == 0) continue;
+    recorded--;
+    out.text(probeNames[i]);
+    out.map(4);
+    out.text("p50");
+    out.integer(h.percentile(0.5));
+    out.text("p99");
+    out.integer(h.percentile(0.99));
+    out.text("max");
+    out.integer(h.getMax());
+    out.text("n");
+    out.integer(h.getCount());
+  }
+  for (int i = 0; i < Counters; i++) {
+    out.text(counterNames[i]);
+    out.integer(counters[i].load(std::memory_order_relaxed));
+  }
+}
+
+void reset() {
+  for (Histogram& h : histograms) h.reset();
+  for (std::atomic<uint32_t>& c : counters)
+    c.store(0, std::memory_order_relaxed);
+}
+
+}  // namespace Trace
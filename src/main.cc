@@ -4,56 +4,161 @@
 
 #include <Arduino.h>
 #include <WiFi.h>
-#include <FirebaseESP32.h>
 #include <Preferences.h>
 #include <BLEDevice.h>
 #include <Adafruit_SSD1306.h>
 
+#include "BleCapture.hh"
+#include "BoundedQueue.hh"
+#include "CloudCommand.hh"
+#include "Cbor.hh"
+#include "CloudWorker.hh"
 #include "FSRScale.hh"
+#include "KettleManager.hh"
+#include "LatencyHistogram.hh"
+#include "Log.hh"
 #include "PIIDefinesExample.hh"
+#include "PinnedTask.hh"
+#include "RtdbClient.hh"
+#include "RtdbStream.hh"
+#include "StatePublisher.hh"
+#include "StatusScreen.hh"
+#include "TaskLayout.hh"
+#include "TelemetryRelay.hh"
+#include "TlsClient.hh"
+#include "Trace.hh"
 
+#include <vector>
 
 
 const int fillThreshold = 3.0;
-const unsigned long firebaseStateInterval = 5000;
-const unsigned long firebasePollInterval = 3000;
+// Status uploads are at least this far apart; changes to temperature and
+// fill are batched for up to firebaseStateMaxLatency, everything else goes
+// out at the next slot.
+const unsigned long firebaseStateMinInterval = 1000;
+const unsigned long firebaseStateMaxLatency = 5000;
+// loop() only passes messages between tasks; sleeping between passes leaves
+// core 1 to them.
+const unsigned long loopPeriod = 10;
+#ifdef BRIDGE_TRACE
+// The probe totals go to /bridge/trace with a status upload this often.
+const unsigned long tracePublishInterval = 60000;
+static unsigned long lastTracePublish = 0;
+#endif
 
 // For an SSD1306 display connected to I2C (SDA, SCL pins)
 const uint8_t ScreenWidth = 128;
 const uint8_t ScreenHeight = 64;
 const int8_t ScreenResetPin = -1; // Reset pin # (or -1 if sharing Arduino reset pin)
+const uint8_t ScreenAddress = 0x3C;
+// Sets the panel up; after that the UI task draws through screen, which only
+// sends what changed.
 Adafruit_SSD1306 display(ScreenWidth, ScreenHeight, &Wire, ScreenResetPin);
+static WireDisplayBus screenBus(Wire, ScreenAddress);
+static StatusScreen screen(screenBus);
 
-static StaggKettle kettle;
-static FirebaseData firebaseData;
+// Every kettle in range, up to KettleManager::MaxKettles. The first is the
+// one on the scale: it's shown on the display and takes the cloud commands.
+static KettleManager kettles;
+static StaggKettle& kettle = kettles.get(0);
 static Preferences prefs;
+// Preferences key prefix of the last kettle each slot connected to, a
+// StaggKettle::Link: "KettleLink", then "KettleLink1" and so on.
+static const char KettleLinkKey[] = "KettleLink";
+// The kettles' last raw notifications, in PSRAM; 'c' on the serial console
+// prints them for the replay tool.
+static BleCapture capture;
+static const size_t CaptureBytes = 256 * 1024;
 static FSRScale scale(32);
-static FirebaseJson json;
+// Two TLS connections to Firebase: the command event stream, and one
+// kept-alive connection for everything else. Both resume their TLS session
+// when they have to reconnect.
+static TlsClient streamClient;
+static TlsClient cloudClient;
+static RtdbClient cloudRest(cloudClient, FIREBASE_PROJECT, 443,
+                            FIREBASE_SECRET);
+static RtdbStream commandStream(streamClient, FIREBASE_PROJECT, 443,
+                                FIREBASE_SECRET);
+#ifdef TELEMETRY_RELAY_HOST
+static WiFiClient relayClient;
+static TelemetryRelay telemetryRelay(relayClient, TELEMETRY_RELAY_HOST,
+                                     TELEMETRY_RELAY_PORT);
+static CloudWorker cloud(TaskLayout::Cloud, cloudRest, commandStream,
+                         &telemetryRelay);
+#else
+static CloudWorker cloud(TaskLayout::Cloud, cloudRest, commandStream);
+#endif
+// Kettles whose status is in the upload awaiting its result, by slot.
+static uint32_t stateInFlight = 0;
+static std::string cloudKettle;
+// Duration of each loop() pass, reported with the heap debug stats.
+static LatencyHistogram loopTimes;
+
+// One task each for the kettle, the scale and the display, plus the cloud
+// worker; see TaskLayout.hh. Commands reach the kettle and scale through
+// these queues, none of which blocks; their state comes back as snapshots,
+// which loop() and the display each follow with their own reader.
+static PinnedTask kettleTask(TaskLayout::Kettle);
+static PinnedTask scaleTask(TaskLayout::Scale);
+static PinnedTask uiTask(TaskLayout::Ui);
+void kettleStep();
+void scaleStep();
+void uiStep();
+static BoundedQueue<CloudCommand, 4> kettleCommands;
+static BoundedQueue<CloudCommand, 4> scaleCommands;
+typedef StaggKettle::Status KettleStatus;
+typedef FSRScale::Status ScaleStatus;
+static FSRScale::StatusSnapshot::Reader scaleReader(scale.getStatus());
+static ScaleStatus scaleState;
+// The scale task only needs to know when the kettle comes off the base.
+static StaggKettle::StatusSnapshot::Reader scaleKettleReader(
+    kettle.getStatus());
+static KettleStatus scaleKettle;
+
+// Fields of /<name>/status, registered with each publisher in this order.
+// Only the first kettle has a fill.
+enum StatusField {
+  IsOn,
+  IsLifted,
+  IsHold,
+  CurrentTemp,
+  TargetTemp,
+  Units,
+  CommandsConfirmed,
+  LastCommandLatency,
+  Fill
+};
+
+// What loop() follows of each kettle: its status, what of it the cloud has,
+// and the link saved for the next boot.
+struct KettleView {
+  StaggKettle::StatusSnapshot::Reader reader;
+  KettleStatus state;
+  StatePublisher publisher;
+  std::string path;  // "<name>/status/" while online, else empty.
+  StaggKettle::Link savedLink;
+  char linkKey[16];
+
+  KettleView(const StaggKettle& kettle)
+      : reader(kettle.getStatus()), publisher(firebaseStateMinInterval) {}
+};
+static std::vector<KettleView> views;
 
 // State tracking for UI
-static StaggKettle::State xState = StaggKettle::State::Connected;
-static bool xLifted;
-static bool xPower;
-static byte xCurrentTemp = -1;
-static byte xTargetTemp = -1;
-//static unsigned int xCountdown = -1;
-static int xFill = -1;
-static byte xCalMode = -1;
-static bool refreshState = false;
-static bool refreshTemps = false;
-static bool refreshFirebaseState = true;
-static unsigned long lastFirebaseStateRefresh = 0;
-static unsigned long lastFirebasePoll = 0;
+static StaggKettle::StatusSnapshot::Reader uiKettleReader(kettle.getStatus());
+static FSRScale::StatusSnapshot::Reader uiScaleReader(scale.getStatus());
+static KettleStatus uiKettle;
+static ScaleStatus uiScale;
 static unsigned long lastHeapDebug = 0;
 
 void onWiFiEvent(WiFiEvent_t event)
 {
   switch (event) {
     case SYSTEM_EVENT_STA_GOT_IP:
-      Serial.println("<onWiFiEvent> Got IP!");
+      LOG_INFO("<onWiFiEvent> Got IP!");
       break;
     case SYSTEM_EVENT_STA_DISCONNECTED:
-      Serial.println("<onWiFiEvent> Disconnected!");
+      LOG_WARN("<onWiFiEvent> Disconnected!");
       break;
     default:
       break;
@@ -61,193 +166,486 @@ void onWiFiEvent(WiFiEvent_t event)
 }
 
 void setupWiFi() {
-  Serial.println("Connecting to WiFi...");
+  LOG_INFO("Connecting to WiFi...");
   WiFi.mode(WIFI_MODE_STA);
   WiFi.onEvent(onWiFiEvent);
   WiFi.config(HOME_WIFI_IP, HOME_WIFI_GATEWAY, HOME_WIFI_SUBNET, HOME_WIFI_DNS);
   WiFi.begin(HOME_WIFI_SSID, HOME_WIFI_PASS);
-  Firebase.begin(FIREBASE_PROJECT, FIREBASE_SECRET);
-  Firebase.reconnectWiFi(true);
-  Firebase.setMaxRetry(firebaseData, 3);
-  Firebase.setMaxErrorQueue(firebaseData, 15);
-  Firebase.setwriteSizeLimit(firebaseData, "tiny");
+  WiFi.setAutoReconnect(true);
+  streamClient.setInsecure();
+  cloudClient.setInsecure();
 }
 
 void setup() {
   Serial.begin(115200);
-  Serial.println("Starting Fellow Stagg EKG+ bridge application...");
+  Log::begin();
+  LOG_INFO("Starting Fellow Stagg EKG+ bridge application...");
+  // Before anything sets up TLS, so record buffers land in PSRAM and the
+  // internal heap is left to BLE.
+  if (!TlsClient::usePsram())
+    LOG_WARN("TLS buffers stay in internal RAM");
   // Init display
   // SSD1306_SWITCHCAPVCC = generate display voltage from 3.3V internally
-  if(!display.begin(SSD1306_SWITCHCAPVCC, 0x3C)) { 
-    Serial.println("SSD1306 allocation failed");
+  if(!display.begin(SSD1306_SWITCHCAPVCC, ScreenAddress)) { 
+    LOG_ERROR("SSD1306 allocation failed");
   }
   // Show initial display buffer contents on the screen --
   // the library initializes this with an Adafruit splash screen.
   display.display();
   // Init scale
-  // scale.loadFromPrefs();
+  scale.loadFromPrefs();
+  scale.begin();
   // Init bluetooth
   BLEDevice::init("");
   esp_bt_controller_mem_release(ESP_BT_MODE_CLASSIC_BT);
   // Init wifi
   setupWiFi();
-  // Let's scan for a kettle!
-  kettle.scan();
+  if (!capture.begin(CaptureBytes))
+    LOG_WARN("No room for the BLE capture");
+  // Try the kettles from last time first; the kettle task scans for the
+  // ones that don't answer.
+  prefs.begin("fellow-stagg", true);
+  views.reserve(KettleManager::MaxKettles);
+  for (int i = 0; i < KettleManager::MaxKettles; i++) {
+    views.emplace_back(kettles.get(i));
+    KettleView& view = views.back();
+    if (capture.active()) kettles.get(i).setCapture(&capture, i);
+    // Register status fields, in StatusField order.
+    StatePublisher& publisher = view.publisher;
+    publisher.addBool("isOn", 0);
+    publisher.addBool("isLifted", 0);
+    publisher.addBool("isHold", 0);
+    publisher.addInt("currentTemp", firebaseStateMaxLatency);
+    publisher.addInt("targetTemp", 0);
+    publisher.addInt("units", 0);
+    publisher.addInt("commandsConfirmed", 0);
+    publisher.addInt("lastCommandLatency", 0);
+    if (i == 0) publisher.addInt("fill", firebaseStateMaxLatency);
+
+    if (i == 0)
+      snprintf(view.linkKey, sizeof(view.linkKey), "%s", KettleLinkKey);
+    else
+      snprintf(view.linkKey, sizeof(view.linkKey), "%s%d", KettleLinkKey, i);
+    StaggKettle::Link& link = view.savedLink;
+    if (prefs.getBytesLength(view.linkKey) == sizeof(link) &&
+        prefs.getBytes(view.linkKey, &link, sizeof(link)) == sizeof(link)) {
+      kettles.get(i).setLink(link);
+      LOG_INFO("Kettle last seen at %s", link.address);
+    }
+  }
+  prefs.end();
+  // From here on the kettle, scale and display belong to their tasks.
+  kettleTask.begin(kettleStep);
+  scaleTask.begin(scaleStep);
+  uiTask.begin(uiStep);
+  cloud.begin();
 }
 
-void updateFirebaseState() {
-  if (!WiFi.isConnected() ||
-      kettle.getState() != StaggKettle::State::Connected ||
-      kettle.getName().size() == 0)
-    return;
-
-  std::string path = std::string("/") + kettle.getName() + "/status";
-  Serial.print("Firebase update for ");
-  Serial.print(path.c_str());
-  Serial.println(" from " + String(WiFi.localIP().toString()));
-  
-  json.clear();
-  json.add("isOn", kettle.isOn());
-  json.add("isLifted", kettle.isLifted());
-  json.add("isHold", kettle.isHold());
-  json.add("currentTemp", (int)kettle.getCurrentTemp());
-  json.add("targetTemp", (int)kettle.getTargetTemp());
-  json.add("units", (int)kettle.getUnits());
-  json.add("fill", scale.getFill());
-  json.add("lastUpdated", String(millis()));
-  if(!Firebase.setJSON(firebaseData, path.c_str(), json)) {
-    Serial.println("Firebase update failed.");
-    Serial.println(firebaseData.errorReason());
+// Hands the status of every online kettle to the cloud worker as one
+// multi-location update of the database root, as soon as any of them is
+// due; the upload's outcome comes back through cloud.takeResult().
+void updateFirebaseState(unsigned long timeNow) {
+  bool due = false;
+  for (KettleView& view : views)
+    due = due || (!view.path.empty() && view.publisher.due(timeNow));
+  if (!due) return;
+
+  // Only the fields that changed since the last successful upload, of
+  // every kettle with any, due or not.
+  uint32_t included = 0;
+  int entries = 0;
+  for (size_t i = 0; i < views.size(); i++) {
+    if (views[i].path.empty() || !views[i].publisher.pending()) continue;
+    included |= 1 << i;
+    entries += views[i].publisher.prepare();
+  }
+#ifdef BRIDGE_TRACE
+  bool trace = timeNow - lastTracePublish >= tracePublishInterval;
+  if (trace) {
+    lastTracePublish = timeNow;
+    entries++;
+  }
+#endif
+#ifdef TELEMETRY_RELAY_HOST
+  static uint8_t body[1024];
+  CborWriter out(body, sizeof(body));
+  out.map(entries);
+  bool written = true;
+  for (size_t i = 0; i < views.size(); i++) {
+    if (included & 1 << i)
+      written = views[i].publisher.append(out, views[i].path.c_str(),
+                                          timeNow) &&
+                written;
+  }
+#ifdef BRIDGE_TRACE
+  if (trace) Trace::appendCbor(out, "bridge/trace");
+#endif
+  bool queued = written && cloud.sendStatus(
+                               "/", std::string((char*)body, out.size()), true);
+#else
+  std::string body = "{";
+  for (size_t i = 0; i < views.size(); i++) {
+    if (included & 1 << i)
+      views[i].publisher.append(body, views[i].path.c_str(), timeNow);
+  }
+#ifdef BRIDGE_TRACE
+  if (trace) Trace::appendJson(body, "bridge/trace");
+#endif
+  body += "}";
+  bool queued = cloud.sendStatus("/", body);
+#endif
+  if (queued) {
+    stateInFlight = included;
+  } else {
+    for (size_t i = 0; i < views.size(); i++)
+      if (included & 1 << i) views[i].publisher.acknowledge(false, timeNow);
+    LOG_WARN("Firebase update not queued.");
   }
 }
 
-void pollFirebase() {
-   if (!WiFi.isConnected() ||
-      kettle.getState() != StaggKettle::State::Connected ||
-      kettle.getName().size() == 0)
-    return;
-
-  std::string path = std::string("/") + kettle.getName() + "/command";
-  Serial.print("Polling Firebase ");
-  Serial.print(path.c_str());
-  Serial.println(" from " + String(WiFi.localIP().toString()));
-  if (!Firebase.pathExist(firebaseData, path.c_str()))
-    return;
-
-  if(!Firebase.getJSON(firebaseData, path.c_str())) {
-    Serial.println("Firebase polling failed.");
-    Serial.println(firebaseData.errorReason());
-    return;
-  }
-  FirebaseJson &result = firebaseData.jsonObject();
-  FirebaseJsonData data;
-  if(result.get(data, "off")) {
-    kettle.off();
-  } else if(result.get(data, "on")) {
-    if (scale.getFill() >= fillThreshold) {
-      kettle.on();
-    } else {
-      Serial.println("FILL LEVEL TOO LOW! " + String(scale.getFill()) +
-                       "oz < " + String(fillThreshold) + "oz");
-    }
-  } else if (result.get(data, "calibrate")) {
-    Serial.println("Calibrate");
-    scale.nextCalibration();
-  } else if(result.get(data, "temp")) {
-    if(result.get(data, "value"))
-      kettle.setTemp((byte)data.intValue);
-  }
-  Firebase.deleteNode(firebaseData, path.c_str());
+// Routes a cloud command to the task that carries it out.
+void applyCommand(const CloudCommand& cmd) {
+  bool queued = true;
+  switch (cmd.type) {
+    case CloudCommand::Off:
+    case CloudCommand::Temp:
+      queued = kettleCommands.push(cmd);
+      break;
+    case CloudCommand::On:
+      if (scaleState.fill >= fillThreshold) {
+        queued = kettleCommands.push(cmd);
+      } else {
+        LOG_WARN("FILL LEVEL TOO LOW! %doz < %doz", scaleState.fill,
+                 fillThreshold);
+      }
+      break;
+    case CloudCommand::Calibrate:
+    case CloudCommand::CalibratePoint:
+      LOG_INFO("Calibrate");
+      queued = scaleCommands.push(cmd);
+      break;
+    default:
+      break;
+  }
+  if (!queued) LOG_WARN("Command dropped, task queue full.");
 }
 
-void drawScale() {
-  int fh = 10;
-  int ypos = 32 - fh / 2;
-  display.setCursor(32, ypos);
-  if (scale.getCalibrationMode() == 0) {
-    display.setTextColor(SSD1306_WHITE);
-    display.println("Fill: " + String(scale.getFill()) + "oz");
-  } else {
-    display.setTextColor(SSD1306_WHITE);
-    display.println(
-        "Fill kettle to exactly " +
-            String(Calibration::Ounces[scale.getCalibrationMode() - 1]) +
-            "oz, then click button");
+// Kettle task: BLE state machine and commands.
+void kettleStep() {
+  CloudCommand cmd;
+  while (kettleCommands.pop(cmd)) {
+    if (cmd.timeClaimed != 0)
+      TRACE_RECORD(CommandHandoff, Trace::since(cmd.timeClaimed));
+    if (cmd.type == CloudCommand::On)
+      kettle.on();
+    else if (cmd.type == CloudCommand::Off)
+      kettle.off();
+    else if (cmd.type == CloudCommand::Temp)
+      kettle.setTemp((byte)cmd.value);
   }
+  kettles.loop();
 }
 
-void loop(void) {
-  kettle.loop();
+// Scale task: FSR sampling and calibration.
+void scaleStep() {
+  CloudCommand cmd;
+  while (scaleCommands.pop(cmd)) {
+    if (cmd.type == CloudCommand::CalibratePoint)
+      scale.addCalibrationPoint(cmd.value);
+    else
+      scale.nextCalibration();
+  }
+  if (scaleKettleReader.poll(scaleKettle) & 1 << KettleStatus::LiftedField)
+    scale.setLifted(scaleKettle.lifted);
   scale.loop();
+}
 
-  // State tracking for UI
+// UI task: lays out what changed since the last step and sends the pages
+// that differ.
+void uiStep() {
+  typedef KettleStatus K;
+  if (uiKettleReader.poll(uiKettle) &
+      (1 << K::StateField | 1 << K::PowerField | 1 << K::LiftedField |
+       1 << K::HoldField | 1 << K::UnitsField | 1 << K::CurrentTempField |
+       1 << K::TargetTempField))
+    screen.showKettle(uiKettle);
 
-  refreshState = false;
-  refreshTemps = false;
-  if (xState != kettle.getState()) {
-    xState = kettle.getState();
-    refreshState = true;
-    refreshTemps = true;
-    refreshFirebaseState = true;
-  }
-  if (xPower != kettle.isOn()) {
-    xPower = kettle.isOn();
-    refreshState = true;
-    refreshTemps = true;
-    refreshFirebaseState = true;
-  }
-  if (xLifted != kettle.isLifted()) {
-    xLifted = kettle.isLifted();
-    refreshState = true;
-    refreshTemps = true;
-    refreshFirebaseState = true;
-  }
-  if (xCurrentTemp != kettle.getCurrentTemp()) {
-    xCurrentTemp = kettle.getCurrentTemp();
-    refreshTemps = true;
-    refreshFirebaseState = true;
+  typedef ScaleStatus S;
+  if (uiScaleReader.poll(uiScale) &
+      (1 << S::FillField | 1 << S::CalModeField))
+    screen.showScale(uiScale.fill,
+                     uiScale.calMode == 0
+                         ? -1
+                         : Calibration::Ounces[uiScale.calMode - 1]);
+  // Once per failure, not every step, e.g. with no display attached.
+  static bool failed = false;
+  bool ok = screen.flush();
+  if (!ok && !failed) LOG_ERROR("<uiStep> Display write failed");
+  failed = !ok;
+}
+
+void printTaskStats(const PinnedTask::Stats& s, const char* name) {
+  Serial.print("Task ");
+  Serial.print(name);
+  Serial.print(": ");
+  Serial.print(s.runs);
+  Serial.print(" runs, ");
+  Serial.print(s.busyPercent());
+  Serial.print("% busy, max us ");
+  Serial.print(s.maxRunTime);
+  Serial.print(", ");
+  Serial.print(s.overruns);
+  Serial.print(" overruns, stack free ");
+  Serial.println(s.stackFree);
+}
+
+// Follows one kettle's snapshot: its fields go to its publisher, its path
+// to the cloud is set while it's online, and a new link is saved for the
+// next boot.
+void pollKettle(KettleView& view, bool wifi, unsigned long timeNow) {
+  KettleStatus& kettleState = view.state;
+  const CommandTracker::Stats& acks = kettleState.acks;
+  StatePublisher& publisher = view.publisher;
+  // Only touch the publisher when a snapshot moved.
+  StaggKettle::StatusSnapshot::Mask kettleChanged =
+      view.reader.poll(kettleState);
+  if (kettleChanged) {
+    publisher.set(IsOn, kettleState.power, timeNow);
+    publisher.set(IsLifted, kettleState.lifted, timeNow);
+    publisher.set(IsHold, kettleState.hold, timeNow);
+    publisher.set(CurrentTemp, kettleState.currentTemp, timeNow);
+    publisher.set(TargetTemp, kettleState.targetTemp, timeNow);
+    publisher.set(Units, kettleState.units, timeNow);
+    publisher.set(CommandsConfirmed, acks.confirmed, timeNow);
+    publisher.set(LastCommandLatency, acks.lastTotalTime, timeNow);
   }
-  if (xTargetTemp != kettle.getTargetTemp()) {
-    xTargetTemp = kettle.getTargetTemp();
-    refreshTemps = true;
-    refreshFirebaseState = true;
+
+  std::string path;
+  if (wifi && kettleState.state == StaggKettle::State::Connected)
+    path = std::string(kettleState.name) + "/status/";
+  if (path != view.path) {
+    view.path = path;
+    if (!path.empty()) publisher.resync();
   }
 
-  if (xFill != scale.getFill() || xCalMode != scale.getCalibrationMode()) {
-    xFill = scale.getFill();
-    xCalMode = scale.getCalibrationMode();
-    refreshFirebaseState = true;
-    display.clearDisplay();
-    drawScale();
-    display.display();
+  // A new kettle, or the same one on a new address: remember it for the
+  // next boot.
+  if (kettleChanged & 1 << KettleStatus::LinkField &&
+      kettleState.link.valid() && kettleState.link != view.savedLink) {
+    view.savedLink = kettleState.link;
+    prefs.begin("fellow-stagg", false);
+    if (prefs.putBytes(view.linkKey, &view.savedLink,
+                       sizeof(view.savedLink)) != sizeof(view.savedLink))
+      LOG_ERROR("Failed to save the kettle link");
+    prefs.end();
   }
+}
+
+void printKettleStats(int slot, const KettleView& view) {
+  const KettleStatus& kettleState = view.state;
+  if (!kettleState.link.valid()) return;
+  const CommandTracker::Stats& acks = kettleState.acks;
+  const StatePublisher::Stats& pub = view.publisher.getStats();
+  Serial.print("Kettle ");
+  Serial.print(slot);
+  Serial.print(": ");
+  Serial.print(kettleState.link.name);
+  Serial.print(" at ");
+  Serial.println(kettleState.link.address);
+  Serial.print("Kettle notify queue high water: ");
+  Serial.print(kettleState.rxHighWater);
+  Serial.print("/");
+  Serial.print(StaggKettle::RxQueueBytes);
+  Serial.print(" bytes, overflows: ");
+  Serial.println(kettleState.rxOverflows);
+  const CommandQueue::Stats& cmdStats = kettleState.commands;
+  Serial.print("Kettle commands: ");
+  Serial.print(cmdStats.dispatched);
+  Serial.print(" sent, ");
+  Serial.print(cmdStats.coalesced + cmdStats.cancelled);
+  Serial.print(" merged, max depth ");
+  Serial.print(cmdStats.maxDepth);
+  Serial.print(", dispatch ms last/max ");
+  Serial.print(cmdStats.lastDispatchTime);
+  Serial.print("/");
+  Serial.println(cmdStats.maxDispatchTime);
+  Serial.print("Kettle acks: ");
+  Serial.print(acks.confirmed);
+  Serial.print(" confirmed, ");
+  Serial.print(acks.retries);
+  Serial.print(" retries, ");
+  Serial.print(acks.failed);
+  Serial.print(" failed, latency ms last/max ");
+  Serial.print(acks.lastTotalTime);
+  Serial.print("/");
+  Serial.println(acks.maxTotalTime);
+  const StaggKettle::ConnectStats& link = kettleState.connect;
+  Serial.print("Kettle connects: ");
+  Serial.print(link.connects);
+  Serial.print(" (");
+  Serial.print(link.direct);
+  Serial.print(" direct), ");
+  Serial.print(link.scans);
+  Serial.print(" scans, ");
+  Serial.print(link.failures);
+  Serial.print(" failed, ms to connect boot/last/max ");
+  Serial.print(link.bootTime);
+  Serial.print("/");
+  Serial.print(link.lastTime);
+  Serial.print("/");
+  Serial.println(link.maxTime);
+  Serial.print("Status uploads: ");
+  Serial.print(pub.uploads);
+  Serial.print(" sent, ");
+  Serial.print(pub.failures);
+  Serial.print(" failed, ");
+  Serial.print(pub.requestsSaved());
+  Serial.print(" saved, bytes ");
+  Serial.print(pub.bytesSent);
+  Serial.print(" of ");
+  Serial.println(pub.fullBytes);
+}
+
+void loop(void) {
+  unsigned long loopStart = micros();
 
   unsigned long timeNow = millis();
   // Handle 64 bit wraparound
-  if (timeNow < lastFirebaseStateRefresh)
-    lastFirebaseStateRefresh = timeNow;
-  if (timeNow < lastFirebasePoll)
-    lastFirebasePoll = timeNow;
   if (timeNow < lastHeapDebug)
     lastHeapDebug = timeNow;  
 
-  if(refreshFirebaseState &&
-     timeNow - lastFirebaseStateRefresh > firebaseStateInterval) {
-    updateFirebaseState();
-    refreshFirebaseState = false;
-    lastFirebaseStateRefresh = timeNow;
-  }
+  bool wifi = WiFi.isConnected();
+  for (KettleView& view : views)
+    pollKettle(view, wifi, timeNow);
+  if (scaleReader.poll(scaleState) & 1 << ScaleStatus::FillField)
+    views[0].publisher.set(Fill, scaleState.fill, timeNow);
 
-  if (timeNow - lastFirebasePoll > firebasePollInterval) {
-    pollFirebase();
-    lastFirebasePoll = timeNow;
+  // Cloud I/O happens on the worker task; here we only trade messages
+  // with it, so a slow or unreachable Firebase can't stall the kettle.
+  // Commands follow the first kettle.
+  std::string online;
+  if (!views[0].path.empty()) online = views[0].state.name;
+  if (online != cloudKettle) {
+    cloudKettle = online;
+    cloud.setKettle(cloudKettle);
+  }
+  bool ok;
+  while (cloud.takeResult(ok)) {
+    for (size_t i = 0; i < views.size(); i++)
+      if (stateInFlight & 1 << i) views[i].publisher.acknowledge(ok, timeNow);
+    stateInFlight = 0;
   }
+  if (!stateInFlight)
+    updateFirebaseState(timeNow);
+  CloudCommand cmd;
+  while (cloud.takeCommand(cmd))
+    applyCommand(cmd);
+  // Console: c dumps the BLE capture, l repeats the log formats for a
+  // decoder that started late. The dump goes out a few lines a pass, as
+  // fast as the UART takes them, so commands and uploads carry on.
+  int key = Serial.available() > 0 ? Serial.read() : -1;
+  if (key == 'c') capture.startPrint(Serial);
+  if (key == 'l') Log::resend();
+  capture.printSome(Serial);
 
-  if (timeNow - lastHeapDebug > 10000) {
+  if (timeNow - lastHeapDebug > 10000 && !capture.printing()) {
     Serial.print("Free heap: ");
     Serial.println(ESP.getFreeHeap());
+    for (size_t i = 0; i < views.size(); i++) printKettleStats(i, views[i]);
+    const KettleManager::Stats& found = kettles.getStats();
+    Serial.print("Kettle scans: ");
+    Serial.print(found.scans);
+    Serial.print(", ");
+    Serial.print(found.found);
+    Serial.print(" found, ");
+    Serial.print(found.assigned);
+    Serial.println(" assigned");
+    if (capture.active()) {
+      BleCapture::Stats captured = capture.getStats();
+      Serial.print("BLE capture: ");
+      Serial.print((unsigned long)captured.recorded);
+      Serial.print(" notifications, ");
+      Serial.print((unsigned long)capture.size());
+      Serial.print(" bytes held, ");
+      Serial.print((unsigned long)captured.overwritten);
+      Serial.print(" overwritten, ");
+      Serial.print((unsigned long)captured.dropped);
+      Serial.println(" dropped");
+    }
+    const TlsClient::Stats& tls = cloudClient.getStats();
+    const TlsClient::Stats& streamTls = streamClient.getStats();
+    Serial.print("TLS handshakes: ");
+    Serial.print(tls.full + streamTls.full);
+    Serial.print(" full, ");
+    Serial.print(tls.resumed + streamTls.resumed);
+    Serial.print(" resumed, ");
+    Serial.print(tls.failed + streamTls.failed);
+    Serial.print(" failed, ms last/max ");
+    Serial.print(tls.lastHandshakeTime);
+    Serial.print("/");
+    Serial.println(max(tls.maxHandshakeTime, streamTls.maxHandshakeTime));
+    CloudWorker::Stats cloudStats = cloud.getStats();
+    Serial.print("Cloud worker: ");
+    Serial.print(cloudStats.commands);
+    Serial.print(" commands, ");
+    Serial.print(cloudStats.claimFailures);
+    Serial.print(" failed claims, queue high water ");
+    Serial.print(cloud.getQueueHighWater());
+    Serial.print(", request ms max ");
+    Serial.println(cloudStats.maxRequestTime);
+    Serial.print("Loop us p50/p99/max: ");
+    Serial.print(loopTimes.percentile(0.5));
+    Serial.print("/");
+    Serial.print(loopTimes.percentile(0.99));
+    Serial.print("/");
+    Serial.print(loopTimes.getMax());
+    Serial.print(", over 50ms: ");
+    Serial.println(loopTimes.countAbove(50000));
+    loopTimes.reset();
+#ifdef BRIDGE_TRACE
+    Trace::print(Serial);
+#endif
+    printTaskStats(kettleTask.takeStats(), "kettle");
+    printTaskStats(scaleTask.takeStats(), "scale");
+    printTaskStats(uiTask.takeStats(), "ui");
+    printTaskStats(cloud.takeTaskStats(), "cloud");
+    Log::Stats logged = Log::getStats();
+    Serial.print("Log: ");
+    Serial.print(logged.written);
+    Serial.print(" records, ");
+    Serial.print(logged.dropped);
+    Serial.print(" dropped, ");
+    Serial.print(logged.sites);
+    Serial.print(" formats, high water ");
+    Serial.print(logged.highWater);
+    Serial.print("/");
+    Serial.println(Log::RingBytes);
+    printTaskStats(Log::takeTaskStats(), "log");
+    Serial.print("Task queues dropped: ");
+    Serial.print(kettleCommands.getDropped() + scaleCommands.getDropped());
+    Serial.println(" commands");
+    const AdcSampler::Stats& sampling = scaleState.sampling;
+    Serial.print("Scale samples: ");
+    Serial.print(sampling.samples);
+    Serial.print(", ");
+    Serial.print(sampling.dropped);
+    Serial.print(" dropped, ");
+    Serial.print(sampling.missed);
+    Serial.print(" missed, max batch ");
+    Serial.print(sampling.maxBatch);
+    Serial.print(", max jitter us ");
+    Serial.println(sampling.maxJitter);
+    Serial.print("Snapshots: kettle v");
+    Serial.print(kettle.getStatus().getVersion());
+    Serial.print(", scale v");
+    Serial.print(scale.getStatus().getVersion());
+    Serial.print(", read retries ");
+    Serial.println(kettle.getStatus().getRetries() +
+                   scale.getStatus().getRetries());
     lastHeapDebug = timeNow;
   }
 
-
+  loopTimes.record(micros() - loopStart);
+  TRACE_RECORD(LoopPass, micros() - loopStart);
+  delay(loopPeriod);
 }